@@ -95,6 +95,10 @@ struct FilmProfile
 	bool m1_low_gravity_projectiles;
 	bool m1_buggy_repair_goal;
 	bool find_action_key_target_has_side_effects;
+
+	// Aleph One lets precalculated visibility sets turn down sightlines
+	// the fixed line_is_obstructed would also find blocked
+	bool visibility_sets_reject_sightlines;
 };
 
 extern FilmProfile film_profile;
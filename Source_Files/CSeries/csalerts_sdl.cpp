@@ -152,9 +152,14 @@ const int MAX_ALERT_WIDTH = 320;
 extern void update_game_window(void);
 extern bool MainScreenVisible(void);
 
+extern bool option_headless;
+
 void alert_user(const char *message, short severity) 
 {
-  if (!MainScreenVisible()) {
+  if (option_headless) {
+    // nobody to click OK
+    fprintf(stderr, "%s: %s\n", severity == infoError ? "Warning" : "Error", message);
+  } else if (!MainScreenVisible()) {
 	SDL_ShowSimpleMessageBox(severity == infoError ? SDL_MESSAGEBOX_WARNING : SDL_MESSAGEBOX_ERROR, severity == infoError ? "Warning" : "Error", message, NULL);
   } else {
     dialog d;
@@ -26,6 +26,8 @@
 #define MACHINE_TICKS_PER_SECOND 1000
 
 extern uint32 machine_tick_count(void);
+// high-resolution counter for profiling; not tied to the game heartbeat
+extern uint64 machine_microsecond_count(void);
 extern bool wait_for_click_or_keypress(
 	uint32 ticks);
 
@@ -36,6 +36,15 @@ uint32 machine_tick_count(void)
 	return SDL_GetTicks();
 }
 
+uint64 machine_microsecond_count(void)
+{
+	static const uint64 frequency = SDL_GetPerformanceFrequency();
+	const uint64 counter = SDL_GetPerformanceCounter();
+
+	// split the division so that fast counters don't overflow
+	return (counter / frequency) * 1000000 + (counter % frequency) * 1000000 / frequency;
+}
+
 
 /*
  *  Wait for mouse click or keypress
@@ -38,6 +38,7 @@ typedef enum {
 	kPathSavedGames,
 	kPathQuickSaves,
 	kPathImageCache,
+	kPathMapCache,
 	kPathRecordings
 } CSPathType;
 
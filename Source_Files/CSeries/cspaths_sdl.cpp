@@ -142,6 +142,9 @@ std::string get_data_path(CSPathType type)
 		case kPathImageCache:
 			path = _get_local_data_path() + "\\Image Cache";
 			break;
+		case kPathMapCache:
+			path = _get_local_data_path() + "\\Map Cache";
+			break;
 		case kPathRecordings:
 			path = _get_local_data_path() + "\\Recordings";
 			break;
@@ -212,6 +215,9 @@ std::string get_data_path(CSPathType type)
 		case kPathImageCache:
 			path = _get_local_data_path() + "/Image Cache";
 			break;
+		case kPathMapCache:
+			path = _get_local_data_path() + "/Map Cache";
+			break;
 		case kPathRecordings:
 			path = _get_local_data_path() + "/Recordings";
 			break;
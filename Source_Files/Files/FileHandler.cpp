@@ -47,6 +47,9 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <unistd.h>
+#if !defined(__WIN32__)
+#include <sys/mman.h>
+#endif
 #endif
 
 #ifdef HAVE_ZZIP
@@ -75,7 +78,7 @@ namespace io = boost::iostreams;
 
 // From shell_sdl.cpp
 extern vector<DirectorySpecifier> data_search_path;
-extern DirectorySpecifier local_data_dir, preferences_dir, saved_games_dir, quick_saves_dir, image_cache_dir, recordings_dir;
+extern DirectorySpecifier local_data_dir, preferences_dir, saved_games_dir, quick_saves_dir, image_cache_dir, map_cache_dir, recordings_dir;
 
 extern bool is_applesingle(SDL_RWops *f, bool rsrc_fork, int32 &offset, int32 &length);
 extern bool is_macbinary(SDL_RWops *f, int32 &data_length, int32 &rsrc_length);
@@ -84,7 +87,8 @@ extern bool is_macbinary(SDL_RWops *f, int32 &data_length, int32 &rsrc_length);
  *  Opened file
  */
 
-OpenedFile::OpenedFile() : f(NULL), err(0), is_forked(false), fork_offset(0), fork_length(0) {}
+OpenedFile::OpenedFile() : f(NULL), err(0), is_forked(false), fork_offset(0), fork_length(0),
+	mapping(NULL), mapping_failed(false) {}
 
 bool OpenedFile::IsOpen()
 {
@@ -101,6 +105,12 @@ bool OpenedFile::Close()
 	is_forked = false;
 	fork_offset = 0;
 	fork_length = 0;
+	path.clear();
+	if (mapping) {
+		mapping->Release();
+		mapping = NULL;
+	}
+	mapping_failed = false;
 	return true;
 }
 
@@ -169,6 +179,18 @@ SDL_RWops *OpenedFile::TakeRWops ()
 	return taken;
 }
 
+FileMapping *OpenedFile::Map()
+{
+	if (!mapping && !mapping_failed && f && !is_forked && !path.empty()) {
+		mapping = FileMapping::Create(path.c_str());
+		mapping_failed = (mapping == NULL);
+	}
+	if (mapping)
+		mapping->Retain();
+	return mapping;
+}
+
+
 opened_file_device::opened_file_device(OpenedFile& f) : f(f) { }
 
 std::streamsize opened_file_device::read(char* s, std::streamsize n)
@@ -389,6 +411,8 @@ bool FileSpecifier::Open(OpenedFile &OFile, bool Writable)
 	if (Writable)
 		return true;
 
+	OFile.path = GetPath();
+
 	// Transparently handle AppleSingle and MacBinary files on reading
 	int32 offset, data_length, rsrc_length;
 	if (is_applesingle(f, false, offset, data_length)) {
@@ -686,6 +710,12 @@ void FileSpecifier::SetToImageCacheDir()
 	name = image_cache_dir.name;
 }
 
+// Set to map cache directory
+void FileSpecifier::SetToMapCacheDir()
+{
+	name = map_cache_dir.name;
+}
+
 // Set to recordings directory
 void FileSpecifier::SetToRecordingsDir()
 {
@@ -1496,3 +1526,93 @@ ScopedSearchPath::~ScopedSearchPath()
 {
 	data_search_path.erase(data_search_path.begin());
 }
+
+/*
+ *  Mapping files into memory
+ */
+
+// Last, so that none of its macros get into the code above
+#if defined(__WIN32__)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+FileMapping::FileMapping() : data(NULL), length(0)
+{
+	SDL_AtomicSet(&references, 1);
+}
+
+FileMapping::~FileMapping()
+{
+	if (!data)
+		return;
+#if defined(__WIN32__)
+	UnmapViewOfFile(data);
+#elif defined(HAVE_UNISTD_H)
+	munmap(data, length);
+#endif
+}
+
+void FileMapping::Retain()
+{
+	SDL_AtomicIncRef(&references);
+}
+
+void FileMapping::Release()
+{
+	if (SDL_AtomicDecRef(&references))
+		delete this;
+}
+
+// NULL if the file can't be mapped; a path into a zip file isn't one the operating
+// system can open, so those files are left to be read through zziplib
+FileMapping *FileMapping::Create(const char *path)
+{
+	FileMapping *mapping = NULL;
+
+#if defined(__WIN32__)
+	wchar_t wide_path[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wide_path, MAX_PATH))
+		return NULL;
+
+	HANDLE file = CreateFileW(wide_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= INT32_MAX) {
+		HANDLE file_mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (file_mapping) {
+			void *view = MapViewOfFile(file_mapping, FILE_MAP_COPY, 0, 0, 0);
+			if (view) {
+				mapping = new FileMapping;
+				mapping->data = static_cast<uint8 *>(view);
+				mapping->length = static_cast<int32>(size.QuadPart);
+			}
+			// The view keeps the mapping alive
+			CloseHandle(file_mapping);
+		}
+	}
+	CloseHandle(file);
+#elif defined(HAVE_UNISTD_H)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= INT32_MAX) {
+		void *view = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			mapping = new FileMapping;
+			mapping->data = static_cast<uint8 *>(view);
+			mapping->length = static_cast<int32>(st.st_size);
+		}
+	}
+	// The mapping keeps the file
+	close(fd);
+#else
+	(void) path;
+#endif
+
+	return mapping;
+}
@@ -65,6 +65,33 @@ using std::vector;
 #include <boost/iostreams/categories.hpp>
 #include <boost/iostreams/positioning.hpp>
 
+/*
+	A read-only view of a whole file mapped into memory.  It is reference counted,
+	so that data pointing into it (read-only wads, for instance) can outlive the
+	OpenedFile it came from; pages are copy-on-write, so writing to them is harmless
+	but never reaches the file.
+*/
+class FileMapping
+{
+	friend class OpenedFile;
+	
+public:
+	uint8 *GetData() {return data;}
+	int32 GetLength() {return length;}
+	
+	void Retain();
+	void Release();		// Unmaps it when the last reference goes
+
+private:
+	static FileMapping *Create(const char *path);
+	FileMapping();
+	~FileMapping();
+
+	uint8 *data;
+	int32 length;
+	SDL_atomic_t references;
+};
+
 /*
 	Abstraction for opened files; it does reading, writing, and closing of such files,
 	without doing anything to the files' specifications
@@ -94,12 +121,22 @@ public:
 	int GetError() {return err;}
 	SDL_RWops *GetRWops() {return f;}
 	SDL_RWops *TakeRWops();		// Hand over SDL_RWops
+	
+	// Maps the whole file into memory, if it can be: only plain files opened for
+	// reading, not the data forks of AppleSingle and MacBinary files or files inside
+	// zip files.  The mapping is retained for the caller, who releases it; NULL means
+	// use Read() instead.  GetMapping() is the file's own mapping, if it has been mapped.
+	FileMapping *Map();
+	FileMapping *GetMapping() {return mapping;}
 
 private:
 	SDL_RWops *f;	// File handle
 	int err;		// Error code
 	bool is_forked;
 	int32 fork_offset, fork_length;
+	string path;	// Empty unless it may be mapped
+	FileMapping *mapping;
+	bool mapping_failed;
 };
 
 class opened_file_device {
@@ -324,6 +361,7 @@ public:
 	void SetToSavedGamesDir();		// Directory for saved games (per-user)
 	void SetToQuickSavesDir();		// Directory for auto-named saved games (per-user)
 	void SetToImageCacheDir();		// Directory for image cache (per-user)
+	void SetToMapCacheDir();		// Directory for precalculated map data (per-user)
 	void SetToRecordingsDir();		// Directory for recordings (per-user)
 
 	void AddPart(const string &part);
@@ -30,25 +30,73 @@ Nov 6, 2000 (Loren Petrich);
 */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "cseries.h"
 #include "FileHandler.h"
 #include "crc.h"
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_CRC_FOLDING
+#include <immintrin.h>
+#include <cpuid.h>
+#define FOLDING_FUNCTION __attribute__((target("sse2,pclmul")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HAVE_CRC_FOLDING
+#include <immintrin.h>
+#include <intrin.h>
+#define FOLDING_FUNCTION
+#endif
+
 /* ---------- constants */
 #define TABLE_SIZE (256)
+#define TABLE_COUNT (8)
 #define CRC32_POLYNOMIAL 0xEDB88320L
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE (64*1024)
+
+/* Below this a file is read and hashed in turn; above it, one buffer is read on a
+	thread while the last one is hashed */
+#define MINIMUM_STREAMED_FILE_LENGTH (1024*1024)
+#define STREAMED_BUFFER_SIZE (256*1024)
+
+/* The folding kernel starts with four 16-byte lanes */
+#define MINIMUM_FOLDED_LENGTH 64
+
+/* ---------- structures */
+typedef uint32 (*crc_kernel)(int32 count, uint32 crc, const byte *p);
+
+struct crc_stream
+{
+	OpenedFile *file;
+	int32 length;
+
+	byte *buffers[2];
+	int32 counts[2]; /* 0 if the read failed */
+	SDL_sem *empty, *full;
+};
 
 /* ---------- local data */
-static uint32 *crc_table= NULL;
+static uint32 crc_tables[TABLE_COUNT][TABLE_SIZE];
+static int16 active_crc_kernel= NONE;
+static crc_kernel active_crc_function= NULL;
+static SDL_SpinLock crc_lock= 0;
 
 /* ---------- local prototypes ------- */
-static uint32 calculate_file_crc(unsigned char *buffer, 
-	short buffer_size, OpenedFile& OFile);
-static uint32 calculate_buffer_crc(int32 count, uint32 crc, void *buffer);
-static bool build_crc_table(void);
-static void free_crc_table(void);
+static uint32 calculate_file_crc(OpenedFile& OFile, int16 file_method, crc_kernel kernel);
+static uint32 read_file_crc(OpenedFile& OFile, int32 length, crc_kernel kernel);
+static uint32 stream_file_crc(OpenedFile& OFile, int32 length, crc_kernel kernel);
+static int crc_reader_loop(void *data);
+static void initialize_crc(void);
+static void build_crc_tables(void);
+static bool crc_kernel_available(int16 kernel);
+static crc_kernel get_crc_kernel(int16 kernel);
+static uint32 calculate_buffer_crc_bytewise(int32 count, uint32 crc, const byte *p);
+static uint32 calculate_buffer_crc_slice_by_8(int32 count, uint32 crc, const byte *p);
+#ifdef HAVE_CRC_FOLDING
+static bool processor_has_pclmul(void);
+static uint32 calculate_buffer_crc_pclmul(int32 count, uint32 crc, const byte *p);
+static uint32 fold_buffer_crc(int32 count, uint32 crc, const byte *p);
+#endif
 
 /* -------------- Entry Point ----------- */
 uint32 calculate_crc_for_file(FileSpecifier& File)
@@ -67,24 +115,18 @@ uint32 calculate_crc_for_file(FileSpecifier& File)
 
 uint32 calculate_crc_for_opened_file(OpenedFile& OFile)
 {
-	uint32 crc = 0;
-	unsigned char *buffer;
+	int32 file_length;
+	int16 file_method= _crc_file_read;
 
-	/* Build the crc table */
-	if(build_crc_table())
+	initialize_crc();
+
+	/* Files opened for writing can't be mapped, so a wad being saved is streamed */
+	if (OFile.GetLength(file_length) && file_length>=MINIMUM_STREAMED_FILE_LENGTH)
 	{
-		buffer = new byte[BUFFER_SIZE];
-		if(buffer) 
-		{
-			crc= calculate_file_crc(buffer, BUFFER_SIZE, OFile);
-			delete []buffer;
-		}
-		
-		/* free the crc table! */
-		free_crc_table();
+		file_method= _crc_file_mapped;
 	}
 
-	return crc;
+	return calculate_file_crc(OFile, file_method, active_crc_function);
 }
 
 /* Calculate the crc for a file using the given buffer.. */
@@ -92,92 +134,375 @@ uint32 calculate_data_crc(
 	unsigned char *buffer,
 	int32 length)
 {
-	uint32 crc = 0;
+	uint32 crc;
 
 	assert(buffer);
 	
-	/* Build the crc table */
-	if(build_crc_table())
-	{
-		/* The odd permutions ensure that we get the same crc as for a file */
-		crc = 0xFFFFFFFFL;
-		crc = calculate_buffer_crc(length, crc, buffer);
-		crc ^= 0xFFFFFFFFL;
+	initialize_crc();
 
-		/* free the crc table! */
-		free_crc_table();
-	}
+	/* The odd permutions ensure that we get the same crc as for a file */
+	crc = 0xFFFFFFFFL;
+	crc = active_crc_function(length, crc, buffer);
+	crc ^= 0xFFFFFFFFL;
 
 	return crc;
 }
 
-/* ---------------- Private Code --------------- */
-static bool build_crc_table(
-	void)
+const char *get_crc_kernel_name(
+	int16 kernel)
 {
-	bool success= false;
+	switch (kernel)
+	{
+		case _crc_bytewise: return "byte-wise";
+		case _crc_slice_by_8: return "slice-by-8";
+		case _crc_pclmul: return "pclmul";
+		default: return "unavailable";
+	}
+}
 
-	assert(!crc_table);
-	crc_table= new uint32[TABLE_SIZE];
-	if(crc_table)
+const char *get_crc_file_method_name(
+	int16 file_method)
+{
+	switch (file_method)
 	{
-		/* Build the table */
-		short index, j;
-		uint32 crc;
+		case _crc_file_read: return "read";
+		case _crc_file_streamed: return "streamed";
+		case _crc_file_mapped: return "mapped";
+		default: return "in memory";
+	}
+}
 
-		for(index= 0; index<TABLE_SIZE; ++index)
+void benchmark_crc(
+	int32 buffer_length,
+	FileSpecifier *File,
+	std::vector<crc_benchmark>& results)
+{
+	byte *buffer= new byte[buffer_length];
+	uint32 seed= 0x12345678;
+	uint32 reference= 0;
+	int16 kernel;
+	int32 offset;
+
+	initialize_crc();
+	results.clear();
+
+	for (offset= 0; offset<buffer_length; ++offset)
+	{
+		seed= seed*1664525+1013904223;
+		buffer[offset]= seed>>24;
+	}
+
+	for (kernel= 0; kernel<NUMBER_OF_CRC_KERNELS; ++kernel)
+	{
+		crc_kernel function= get_crc_kernel(kernel);
+
+		if (function)
+		{
+			struct crc_benchmark result;
+			uint64 start= machine_microsecond_count();
+			uint64 elapsed;
+
+			result.kernel= kernel;
+			result.file_method= NONE;
+			result.crc= function(buffer_length, 0xFFFFFFFFL, buffer)^0xFFFFFFFFL;
+			elapsed= machine_microsecond_count()-start;
+			result.megabytes= elapsed ? buffer_length/(double)elapsed : 0.0;
+			if (kernel==_crc_bytewise) reference= result.crc;
+			result.matches_reference= result.crc==reference;
+			results.push_back(result);
+		}
+	}
+	delete []buffer;
+
+	if (File)
+	{
+		OpenedFile OFile;
+
+		if (File->Open(OFile))
 		{
-			crc= index;
-			for(j=0; j<8; j++)
+			int32 file_length= 0;
+			FileMapping *mapping= OFile.Map();
+			int16 file_method;
+
+			OFile.GetLength(file_length);
+
+			/* Warm up the file cache, so that the old way isn't charged for the disk */
+			calculate_file_crc(OFile, _crc_file_read, calculate_buffer_crc_bytewise);
+
+			/* The old way first, as the reference, then every way with the active kernel */
+			for (file_method= NONE; file_method<NUMBER_OF_CRC_FILE_METHODS; ++file_method)
 			{
-				if(crc & 1) crc=(crc>>1) ^ CRC32_POLYNOMIAL;
-				else crc>>=1;
+				struct crc_benchmark result;
+				uint64 start, elapsed;
+
+				if (file_method==_crc_file_mapped && !mapping) break;
+
+				result.kernel= file_method==NONE ? _crc_bytewise : active_crc_kernel;
+				result.file_method= file_method==NONE ? _crc_file_read : file_method;
+				start= machine_microsecond_count();
+				result.crc= calculate_file_crc(OFile, result.file_method, get_crc_kernel(result.kernel));
+				elapsed= machine_microsecond_count()-start;
+				result.megabytes= elapsed ? file_length/(double)elapsed : 0.0;
+				if (file_method==NONE) reference= result.crc;
+				result.matches_reference= result.crc==reference;
+				results.push_back(result);
 			}
-			crc_table[index] = crc;
+
+			if (mapping) mapping->Release();
+			OFile.Close();
 		}
-		
-		success= true;
 	}
-	
-	return success;
 }
 
-static void free_crc_table(
+/* ---------------- Private Code --------------- */
+static void initialize_crc(
 	void)
 {
-	assert(crc_table);
-	delete []crc_table;
-	crc_table= NULL;
+	/* Checksums are also taken off the main thread (saving, networking) */
+	SDL_AtomicLock(&crc_lock);
+	if (active_crc_kernel==NONE)
+	{
+		int16 kernel;
+
+		build_crc_tables();
+		for (kernel= NUMBER_OF_CRC_KERNELS-1; kernel>_crc_bytewise; --kernel)
+		{
+			if (crc_kernel_available(kernel)) break;
+		}
+		active_crc_kernel= kernel;
+		active_crc_function= get_crc_kernel(kernel);
+	}
+	SDL_AtomicUnlock(&crc_lock);
+}
+
+/* Table n gives the crc of a byte followed by n zero bytes */
+static void build_crc_tables(
+	void)
+{
+	short index, j;
+	uint32 crc;
+
+	for(index= 0; index<TABLE_SIZE; ++index)
+	{
+		crc= index;
+		for(j=0; j<8; j++)
+		{
+			if(crc & 1) crc=(crc>>1) ^ CRC32_POLYNOMIAL;
+			else crc>>=1;
+		}
+		crc_tables[0][index] = crc;
+	}
+
+	for(index= 0; index<TABLE_SIZE; ++index)
+	{
+		crc= crc_tables[0][index];
+		for(j= 1; j<TABLE_COUNT; ++j)
+		{
+			crc= (crc>>8) ^ crc_tables[0][crc&0xff];
+			crc_tables[j][index]= crc;
+		}
+	}
+}
+
+static bool crc_kernel_available(
+	int16 kernel)
+{
+	switch (kernel)
+	{
+		case _crc_bytewise:
+		case _crc_slice_by_8:
+			return true;
+
+#ifdef HAVE_CRC_FOLDING
+		case _crc_pclmul:
+			return SDL_HasSSE2() && processor_has_pclmul();
+#endif
+
+		default:
+			return false;
+	}
+}
+
+static crc_kernel get_crc_kernel(
+	int16 kernel)
+{
+	if (!crc_kernel_available(kernel)) return NULL;
+
+	switch (kernel)
+	{
+		case _crc_bytewise: return calculate_buffer_crc_bytewise;
+		case _crc_slice_by_8: return calculate_buffer_crc_slice_by_8;
+#ifdef HAVE_CRC_FOLDING
+		case _crc_pclmul: return calculate_buffer_crc_pclmul;
+#endif
+		default: return NULL;
+	}
 }
 
 /* Calculate for a block of data incrementally */
-static uint32 calculate_buffer_crc(
-	int32 count, 
-	uint32 crc, 
-	void *buffer)
+static uint32 calculate_buffer_crc_bytewise(
+	int32 count,
+	uint32 crc,
+	const byte *p)
 {
-	unsigned char *p;
 	uint32 a;
 	uint32 b;
 
-	p= (unsigned char *) buffer;
 	while (count--) 
 	{
 		a= (crc >> 8) & 0x00FFFFFFL;
-		b= crc_table[((int) crc ^ *p++) & 0xff];
+		b= crc_tables[0][((int) crc ^ *p++) & 0xff];
 		crc= a^b;
 	}
 	return crc;
 }
 
-/* Calculate the crc for a file using the given buffer.. */
+/* Eight bytes at a time; the words are put together a byte at a time so that this
+	works on either byte order */
+static uint32 calculate_buffer_crc_slice_by_8(
+	int32 count,
+	uint32 crc,
+	const byte *p)
+{
+	while (count>=8)
+	{
+		uint32 low= crc ^ (p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32) p[3]<<24));
+		uint32 high= p[4] | (p[5]<<8) | (p[6]<<16) | ((uint32) p[7]<<24);
+
+		crc= crc_tables[7][low&0xff] ^ crc_tables[6][(low>>8)&0xff] ^
+			crc_tables[5][(low>>16)&0xff] ^ crc_tables[4][low>>24] ^
+			crc_tables[3][high&0xff] ^ crc_tables[2][(high>>8)&0xff] ^
+			crc_tables[1][(high>>16)&0xff] ^ crc_tables[0][high>>24];
+		p+= 8;
+		count-= 8;
+	}
+
+	return calculate_buffer_crc_bytewise(count, crc, p);
+}
+
+#ifdef HAVE_CRC_FOLDING
+static bool processor_has_pclmul(
+	void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 1);
+	return (info[2] & (1<<1)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1<<1));
+#endif
+}
+
+static uint32 calculate_buffer_crc_pclmul(
+	int32 count,
+	uint32 crc,
+	const byte *p)
+{
+	if (count>=MINIMUM_FOLDED_LENGTH)
+	{
+		int32 folded= count & ~15;
+
+		crc= fold_buffer_crc(folded, crc, p);
+		p+= folded;
+		count-= folded;
+	}
+
+	return calculate_buffer_crc_slice_by_8(count, crc, p);
+}
+
+/* Folds four 16-byte lanes 64 bytes at a time with carry-less multiplies, folds those
+	down to one lane and then to 64 bits, and Barrett reduces that to the crc; the
+	constants are powers of x modulo the (bit-reflected) polynomial.  This is Intel's
+	"Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".  count is at least
+	64 and a multiple of 16. */
+FOLDING_FUNCTION static uint32 fold_buffer_crc(
+	int32 count,
+	uint32 crc,
+	const byte *p)
+{
+	const __m128i k1k2= _mm_set_epi32(0x00000001, 0xc6e41596, 0x00000001, 0x54442bd4);
+	const __m128i k3k4= _mm_set_epi32(0x00000000, 0xccaa009e, 0x00000001, 0x751997d0);
+	const __m128i k5k0= _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63cd6124);
+	const __m128i poly= _mm_set_epi32(0x00000001, 0xf7011641, 0x00000001, 0xdb710641);
+	const __m128i low_words= _mm_set_epi32(0, ~0, 0, ~0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1= _mm_xor_si128(_mm_loadu_si128((const __m128i *) (p+0x00)), _mm_cvtsi32_si128(crc));
+	x2= _mm_loadu_si128((const __m128i *) (p+0x10));
+	x3= _mm_loadu_si128((const __m128i *) (p+0x20));
+	x4= _mm_loadu_si128((const __m128i *) (p+0x30));
+	p+= 64;
+	count-= 64;
+
+	while (count>=64)
+	{
+		x5= _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6= _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7= _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8= _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1= _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2= _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3= _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4= _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1= _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) (p+0x00)));
+		x2= _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (p+0x10)));
+		x3= _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (p+0x20)));
+		x4= _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (p+0x30)));
+		p+= 64;
+		count-= 64;
+	}
+
+	/* Four lanes into one */
+	x5= _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1= _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1= _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5= _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1= _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1= _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5= _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1= _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1= _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while (count>=16)
+	{
+		x5= _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1= _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1= _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) p)), x5);
+		p+= 16;
+		count-= 16;
+	}
+
+	/* 128 bits to 64 */
+	x2= _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1= _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2= _mm_srli_si128(x1, 4);
+	x1= _mm_clmulepi64_si128(_mm_and_si128(x1, low_words), k5k0, 0x00);
+	x1= _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 */
+	x2= _mm_clmulepi64_si128(_mm_and_si128(x1, low_words), poly, 0x10);
+	x2= _mm_clmulepi64_si128(_mm_and_si128(x2, low_words), poly, 0x00);
+	x1= _mm_xor_si128(x1, x2);
+
+	return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
+/* Calculate the crc for a file, leaving its position alone.. */
 static uint32 calculate_file_crc(
-	unsigned char *buffer, 
-	short buffer_size,
-	OpenedFile& OFile)
+	OpenedFile& OFile,
+	int16 file_method,
+	crc_kernel kernel)
 {
-	uint32 crc;
-	int32 count;
+	uint32 crc= 0;
 	int32 file_length, initial_position;
 	
 	/* Save and restore the initial file position */
@@ -187,34 +512,155 @@ static uint32 calculate_file_crc(
 	/* Get the file_length */
 	if (!OFile.GetLength(file_length))
 		return 0;
-	
-	/* Set to the start of the file */
-	if (!OFile.SetPosition(0))
-		return 0;
+
+	switch (file_method)
+	{
+		case _crc_file_mapped:
+			{
+				FileMapping *mapping= OFile.Map();
+
+				if (mapping)
+				{
+					crc= kernel(file_length, 0xFFFFFFFFL, mapping->GetData()) ^ 0xFFFFFFFFL;
+					mapping->Release();
+					return crc;
+				}
+			}
+			/* Fall through and read it */
+
+		case _crc_file_streamed:
+		case _crc_file_read:
+			/* Set to the start of the file */
+			if (!OFile.SetPosition(0))
+				return 0;
+
+			if (file_method!=_crc_file_read)
+				crc= stream_file_crc(OFile, file_length, kernel);
+			else
+				crc= read_file_crc(OFile, file_length, kernel);
+			break;
+
+		default:
+			assert(false);
+			break;
+	}
+
+	/* Restore the file position */
+	OFile.SetPosition(initial_position);
+
+	return crc;
+}
+
+static uint32 read_file_crc(
+	OpenedFile& OFile,
+	int32 file_length,
+	crc_kernel kernel)
+{
+	byte *buffer= new byte[BUFFER_SIZE];
+	uint32 crc;
+	int32 count;
 
 	crc = 0xFFFFFFFFL;
 	while(file_length) 
 	{
-		if(file_length>buffer_size)
+		if(file_length>BUFFER_SIZE)
 		{
-			count= buffer_size;
+			count= BUFFER_SIZE;
 		} else {
 			count= file_length;
 		}
 
 		if (!OFile.Read(count, buffer))
+		{
+			delete []buffer;
 			return 0;
+		}
 
-		crc = calculate_buffer_crc(count, crc, buffer);
+		crc = kernel(count, crc, buffer);
 		file_length -= count;
 	}
-	
-	/* Restore the file position */
-	OFile.SetPosition(initial_position);
+	delete []buffer;
 
 	return (crc ^= 0xFFFFFFFFL);
 }
 
+/* Double buffered: the reader thread fills one buffer while this hashes the other */
+static uint32 stream_file_crc(
+	OpenedFile& OFile,
+	int32 file_length,
+	crc_kernel kernel)
+{
+	struct crc_stream stream;
+	SDL_Thread *reader;
+	uint32 crc;
+	int32 remaining;
+	short index;
+
+	stream.file= &OFile;
+	stream.length= file_length;
+	stream.buffers[0]= new byte[2*STREAMED_BUFFER_SIZE];
+	stream.buffers[1]= stream.buffers[0]+STREAMED_BUFFER_SIZE;
+	stream.empty= SDL_CreateSemaphore(2);
+	stream.full= SDL_CreateSemaphore(0);
+
+	reader= (stream.empty && stream.full) ? SDL_CreateThread(crc_reader_loop, "crc_reader", &stream) : NULL;
+	if (!reader)
+	{
+		if (stream.empty) SDL_DestroySemaphore(stream.empty);
+		if (stream.full) SDL_DestroySemaphore(stream.full);
+		delete []stream.buffers[0];
+
+		return read_file_crc(OFile, file_length, kernel);
+	}
+
+	crc= 0xFFFFFFFFL;
+	for (remaining= file_length, index= 0; remaining; index^= 1)
+	{
+		SDL_SemWait(stream.full);
+		if (!stream.counts[index]) break;
+
+		crc= kernel(stream.counts[index], crc, stream.buffers[index]);
+		remaining-= stream.counts[index];
+		SDL_SemPost(stream.empty);
+	}
+
+	SDL_WaitThread(reader, NULL);
+	SDL_DestroySemaphore(stream.empty);
+	SDL_DestroySemaphore(stream.full);
+	delete []stream.buffers[0];
+
+	return remaining ? 0 : (crc ^= 0xFFFFFFFFL);
+}
+
+static int crc_reader_loop(
+	void *data)
+{
+	struct crc_stream *stream= (struct crc_stream *) data;
+	int32 remaining= stream->length;
+	short index= 0;
+
+	while (remaining)
+	{
+		int32 count= MIN(remaining, STREAMED_BUFFER_SIZE);
+
+		SDL_SemWait(stream->empty);
+		if (!stream->file->Read(count, stream->buffers[index]))
+		{
+			/* Tells the hasher to give up */
+			stream->counts[index]= 0;
+			SDL_SemPost(stream->full);
+			return 0;
+		}
+		stream->counts[index]= count;
+		SDL_SemPost(stream->full);
+
+		remaining-= count;
+		index^= 1;
+	}
+
+	return 0;
+}
+
 /*  crcccitt.c - a demonstration of look up table based CRC
  *               computation using the non-reversed CCITT_CRC
  *               polynomial 0x1021 (truncated)
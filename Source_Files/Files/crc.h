@@ -27,17 +27,63 @@
 
 Aug 15, 2000 (Loren Petrich):
 	Using object-oriented file handler
+
+	The CRC is worked out eight bytes at a time from eight tables, or sixteen bytes at a
+	time with carry-less multiplies on processors that have them; either way it comes out
+	the same as the old table-a-byte loop.  Files big enough to be worth it are hashed
+	straight out of a mapping when they're opened for reading, or else read on a thread
+	while the last buffer is hashed.
 */
 
 #include "cstypes.h"
 
+#include <vector>
+
 class FileSpecifier;
 class OpenedFile;
 
+/* ---------- constants */
+
+enum /* crc kernels */
+{
+	_crc_bytewise,
+	_crc_slice_by_8,
+	_crc_pclmul,
+	NUMBER_OF_CRC_KERNELS
+};
+
+enum /* ways of reading a file */
+{
+	_crc_file_read,
+	_crc_file_streamed,
+	_crc_file_mapped,
+	NUMBER_OF_CRC_FILE_METHODS
+};
+
+/* ---------- structures */
+
+struct crc_benchmark
+{
+	int16 kernel;
+	int16 file_method; /* NONE for a buffer in memory */
+	uint32 crc;
+	double megabytes; /* per second */
+	bool matches_reference;
+};
+
+/* ---------- prototypes/CRC.CPP */
+
 uint32 calculate_crc_for_file(FileSpecifier& File);
 uint32 calculate_crc_for_opened_file(OpenedFile& OFile);
 uint32 calculate_data_crc(unsigned char *buffer, int32 length);
 
+const char *get_crc_kernel_name(int16 kernel);
+const char *get_crc_file_method_name(int16 file_method);
+
+/* times every available kernel over a buffer of the given length, then, if there is a
+	file, reads it every way it can be read; each is checked against the byte-wise loop */
+void benchmark_crc(int32 buffer_length, FileSpecifier *File, std::vector<crc_benchmark>& results);
+
 uint16 calculate_data_crc_ccitt(unsigned char *buffer, int32 length);
 
 #endif
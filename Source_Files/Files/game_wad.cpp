@@ -86,6 +86,8 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include <string.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include "map.h"
 #include "monsters.h"
 #include "network.h"
@@ -94,6 +96,7 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include "player.h"
 #include "platforms.h"
 #include "flood_map.h"
+#include "polygon_visibility.h"
 #include "scenery.h"
 #include "lightsource.h"
 #include "media.h"
@@ -124,10 +127,13 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 
 // For packing and unpacking some of the stuff
 #include "Packing.h"
+#include "crc.h"
+#include "Logging.h"
 
 #include "motion_sensor.h"	// ZZZ for reset_motion_sensor()
 
 #include "Music.h"
+#include "QuickSave.h"
 
 // unify the save game code into one structure.
 
@@ -155,7 +161,10 @@ static void complete_restoring_level(struct wad_data *wad);
 static void load_redundant_map_data(short *redundant_data, size_t count);
 static void allocate_map_structure_for_map(struct wad_data *wad);
 static wad_data *build_export_wad(wad_header *header, int32 *length);
-static struct wad_data *build_save_game_wad(struct wad_header *header, int32 *length);
+static void pack_save_game_tags(struct saved_game_snapshot *snapshot);
+static void add_borrowed_tag(std::vector<struct tag_data>& tags, WadDataType tag,
+	const void *data, size_t size);
+static void make_borrowed_wad(struct wad_data *wad, std::vector<struct tag_data>& tags);
 
 static void allocate_map_for_counts(size_t polygon_count, size_t side_count,
 	size_t endpoint_count, size_t line_count);
@@ -1162,6 +1171,9 @@ bool load_game_from_file(FileSpecifier& File, bool run_scripts, bool *was_map_fo
 {
 	bool success= false;
 
+	/* A quick save (this one, if reverting) may still be on its way to disk */
+	flush_quick_saves();
+
 	ResetPassedLua();
 	
 	/* Setup for a revert.. */
@@ -1374,27 +1386,84 @@ void get_current_saved_game_name(FileSpecifier& File)
 /* The current mapfile should be set to the save game file... */
 bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata)
 {
-	struct wad_header header;
+	struct saved_game_snapshot *snapshot;
 	short err = 0;
 	bool success= false;
-	int32 offset, wad_length;
-	struct directory_entry entries[2];
-	struct wad_data *wad, *meta_wad;
+
+	snapshot= take_saved_game_snapshot(File);
+	success= write_saved_game_snapshot(snapshot, metadata, imagedata, &err);
+	free_saved_game_snapshot(snapshot);
+	
+	if(err || error_pending())
+	{
+		if(!err) err= get_game_error(NULL);
+		alert_user(infoError, strERRORS, fileError, err);
+		clear_game_error();
+		success= false;
+	}
+	
+	return success;
+}
+
+struct saved_game_tag
+{
+	WadDataType tag;
+	uint8 *data;
+	size_t size;
+};
+
+struct saved_game_snapshot
+{
+	FileSpecifier File;
+	uint32 parent_checksum;
+	std::vector<saved_game_tag> tags;
+};
+
+struct saved_game_snapshot *take_saved_game_snapshot(FileSpecifier& File, bool revert_to_it)
+{
+	struct saved_game_snapshot *snapshot= new saved_game_snapshot;
 
 	/* Save off the random seed. */
 	dynamic_world->random_seed= get_random_seed();
 
 	/* Setup to revert the game properly */
-	revert_game_data.game_is_from_disk= true;
-	revert_game_data.SavedGame = File;
+	if (revert_to_it)
+	{
+		revert_game_data.game_is_from_disk= true;
+		revert_game_data.SavedGame = File;
+	}
+
+	snapshot->File= File;
+	/* Reading the map's header may leave a game error pending, so it's done here */
+	snapshot->parent_checksum= read_wad_file_checksum(MapFileSpec);
+
+	/* Pack everything now; the game goes on while it's written */
+	pack_save_game_tags(snapshot);
+
+	return snapshot;
+}
+
+bool write_saved_game_snapshot(
+	struct saved_game_snapshot *snapshot,
+	const std::string& metadata,
+	const std::string& imagedata,
+	short *error)
+{
+	struct wad_header header;
+	short err = 0;
+	bool success= false;
+	int32 offset, wad_length;
+	struct directory_entry entries[2];
+	struct wad_data wad, meta_wad;
+	std::vector<struct tag_data> game_tags, meta_tags;
 
 	// LP: add a file here; use temporary file for a safe save.
 	// Write into the temporary file first
 	FileSpecifier TempFile;
-	TempFile.SetTempName(File);
+	TempFile.SetTempName(snapshot->File);
 	
 	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
-	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
+	fill_default_wad_header(snapshot->File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
 		
 	/* Assume that we confirmed on save as... */
 	if (create_wadfile(TempFile,_typecode_savegame))
@@ -1406,46 +1475,49 @@ bool save_game_file(FileSpecifier& File, const std::string& metadata, const std:
 			if (write_wad_header(SaveFile, &header))
 			{
 				offset= SIZEOF_wad_header;
-		
-				wad= build_save_game_wad(&header, &wad_length);
-				if (wad)
+
+				/* Written straight from the snapshot; copying it into a wad could run out of
+					memory, and append_data_to_wad() would alert the user from this thread */
+				for (size_t loop= 0; loop<snapshot->tags.size(); ++loop)
 				{
-					/* Set the entry data.. */
-					set_indexed_directory_offset_and_length(&header, 
-						entries, 0, offset, wad_length, 0);
+					struct saved_game_tag *tag= &snapshot->tags[loop];
+					add_borrowed_tag(game_tags, tag->tag, tag->data, tag->size);
+				}
+				make_borrowed_wad(&wad, game_tags);
+				wad_length= calculate_wad_length(&header, &wad);
+
+				/* Set the entry data.. */
+				set_indexed_directory_offset_and_length(&header, 
+					entries, 0, offset, wad_length, 0);
+				
+				/* Save it.. */
+				if (write_wad(SaveFile, &header, &wad, offset))
+				{
+					/* Update the new header */
+					offset+= wad_length;
+					header.directory_offset= offset;
+					header.parent_checksum= snapshot->parent_checksum;
 					
-					/* Save it.. */
-					if (write_wad(SaveFile, &header, wad, offset))
+					/* Create metadata wad */
+					if (metadata.length()) add_borrowed_tag(meta_tags, SAVE_META_TAG, metadata.c_str(), metadata.length());
+					if (imagedata.length()) add_borrowed_tag(meta_tags, SAVE_IMG_TAG, imagedata.c_str(), imagedata.length());
+					make_borrowed_wad(&meta_wad, meta_tags);
+					wad_length= calculate_wad_length(&header, &meta_wad);
+
+					set_indexed_directory_offset_and_length(&header,
+						entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
+					
+					if (write_wad(SaveFile, &header, &meta_wad, offset))
 					{
-						/* Update the new header */
 						offset+= wad_length;
 						header.directory_offset= offset;
-						header.parent_checksum= read_wad_file_checksum(MapFileSpec);
-						
-						/* Create metadata wad */
-						meta_wad = build_meta_game_wad(metadata, imagedata, &header, &wad_length);
-						if (meta_wad)
+				
+						if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
 						{
-							set_indexed_directory_offset_and_length(&header,
-								entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
-							
-							if (write_wad(SaveFile, &header, meta_wad, offset))
-							{
-								offset+= wad_length;
-								header.directory_offset= offset;
-						
-								if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
-								{
-									/* We win. */
-									success= true;
-								}
-							}
-							
-							free_wad(meta_wad);
+							/* We win. */
+							success= true;
 						}
 					}
-
-					free_wad(wad);
 				}
 			}
 
@@ -1455,22 +1527,26 @@ bool save_game_file(FileSpecifier& File, const std::string& metadata, const std:
 		
 		if (!err)
 		{
-			if (!TempFile.Rename(File))
+			if (!TempFile.Rename(snapshot->File))
 			{
 				err = 1;
 			}
 		}
 	}
+
+	if (err) success= false;
+	if (error) *error= err;
 	
-	if(err || error_pending())
+	return success;
+}
+
+void free_saved_game_snapshot(struct saved_game_snapshot *snapshot)
+{
+	for (size_t index= 0; index<snapshot->tags.size(); ++index)
 	{
-		if(!err) err= get_game_error(NULL);
-		alert_user(infoError, strERRORS, fileError, err);
-		clear_game_error();
-		success= false;
+		delete []snapshot->tags[index].data;
 	}
-	
-	return success;
+	delete snapshot;
 }
 
 /* -------- static functions */
@@ -1849,6 +1925,12 @@ bool process_map_wad(
 			csprintf(temporary,"Number of projectiles %zu > limit %u",count,MAXIMUM_PROJECTILES_PER_MAP));
 		unpack_projectile_data(data,projectiles,count);
 		
+		ObjectSlots.rebuild(objects, MAXIMUM_OBJECTS_PER_MAP);
+		MonsterSlots.rebuild(monsters, MAXIMUM_MONSTERS_PER_MAP);
+		EffectSlots.rebuild(effects, MAXIMUM_EFFECTS_PER_MAP);
+		ProjectileSlots.rebuild(projectiles, MAXIMUM_PROJECTILES_PER_MAP);
+		rebuild_obstacle_lists();
+		
 		data= (uint8 *)extract_type_from_wad(wad, PLATFORM_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_platform_data;
 		assert(count*SIZEOF_platform_data==data_length);
@@ -1899,6 +1981,13 @@ bool process_map_wad(
 
 	}
 	
+	/* Geometry is final now; index it for world_point_to_polygon_index() */
+	precalculate_polygon_location_index();
+	if (environment_preferences->use_visibility_sets)
+	{
+		precalculate_polygon_visibility();
+	}
+	
 	/* ... and bail */
 	return true;
 }
@@ -1939,6 +2028,213 @@ static void allocate_map_structure_for_map(
 	allocate_map_for_counts(polygon_count, side_count, endpoint_count, line_count);
 }
 
+/* ---------- precalculated map data cache */
+
+/* maps that weren't preprocessed (all of Marathon 1's, and most made since) get their
+	redundant data and map indexes worked out at every load, flooding out from each polygon in
+	turn; on big maps that takes seconds.  the results are kept in the map cache directory, one
+	file per level, named for and checked against a checksum of everything that goes into them,
+	with a second checksum over what's stored.  the directory is kept under MAXIMUM_MAP_CACHE_BYTES
+	by deleting the files written longest ago. */
+
+#define PRECALCULATED_MAP_DATA_TAG FOUR_CHARS_TO_INT('p','m','a','p')
+#define PRECALCULATED_MAP_DATA_VERSION 2
+#define SIZEOF_precalculated_map_data_header 40
+
+#define MAXIMUM_MAP_CACHE_BYTES (64<<20)
+
+struct precalculated_map_data_header
+{
+	uint32 tag;
+	uint32 version;
+	uint32 checksum;
+	uint32 precalculation_microseconds;
+	uint32 endpoint_count, line_count, side_count, polygon_count;
+	uint32 map_index_count;
+	uint32 data_checksum; /* of everything after the header */
+};
+
+static uint32 calculate_precalculated_map_data_checksum(void);
+static bool read_precalculated_map_data(uint32 checksum, uint32 *precalculation_microseconds);
+static void write_precalculated_map_data(uint32 checksum, uint32 precalculation_microseconds);
+static void get_precalculated_map_data_file(uint32 checksum, FileSpecifier& File);
+static void prune_map_cache(void);
+
+static uint32 calculate_precalculated_map_data_checksum(
+	void)
+{
+	size_t length= dynamic_world->endpoint_count*SIZEOF_endpoint_data + dynamic_world->line_count*SIZEOF_line_data +
+		dynamic_world->side_count*SIZEOF_side_data + dynamic_world->polygon_count*SIZEOF_polygon_data +
+		dynamic_world->initial_objects_count*SIZEOF_map_object + sizeof(uint16);
+	vector<uint8> buffer(length);
+	uint8 *S= buffer.data();
+
+	/* packed, so padding and struct layout don't matter */
+	S= pack_endpoint_data(S, map_endpoints, dynamic_world->endpoint_count);
+	S= pack_line_data(S, map_lines, dynamic_world->line_count);
+	S= pack_side_data(S, map_sides, dynamic_world->side_count);
+	S= pack_polygon_data(S, map_polygons, dynamic_world->polygon_count);
+	S= pack_map_object(S, saved_objects, dynamic_world->initial_objects_count);
+	/* the only film profile setting the precalculation looks at */
+	ValueToStream(S, static_cast<uint16>(film_profile.adjacent_polygons_always_intersect));
+	assert(S==buffer.data()+length);
+
+	return calculate_data_crc(buffer.data(), static_cast<int32>(length));
+}
+
+static bool read_precalculated_map_data(
+	uint32 checksum,
+	uint32 *precalculation_microseconds)
+{
+	FileSpecifier File;
+	OpenedFile OFile;
+	int32 length;
+
+	get_precalculated_map_data_file(checksum, File);
+	if (!File.Exists() || !File.Open(OFile) || !OFile.GetLength(length) || length<SIZEOF_precalculated_map_data_header) return false;
+
+	/* all of it in one read */
+	vector<uint8> buffer(length);
+	if (!OFile.Read(length, buffer.data())) return false;
+
+	struct precalculated_map_data_header header;
+	uint8 *S= buffer.data();
+	StreamToValue(S, header.tag);
+	StreamToValue(S, header.version);
+	StreamToValue(S, header.checksum);
+	StreamToValue(S, header.precalculation_microseconds);
+	StreamToValue(S, header.endpoint_count);
+	StreamToValue(S, header.line_count);
+	StreamToValue(S, header.side_count);
+	StreamToValue(S, header.polygon_count);
+	StreamToValue(S, header.map_index_count);
+	StreamToValue(S, header.data_checksum);
+
+	if (header.tag!=PRECALCULATED_MAP_DATA_TAG || header.version!=PRECALCULATED_MAP_DATA_VERSION || header.checksum!=checksum ||
+		header.endpoint_count!=static_cast<uint32>(dynamic_world->endpoint_count) ||
+		header.line_count!=static_cast<uint32>(dynamic_world->line_count) ||
+		header.side_count!=static_cast<uint32>(dynamic_world->side_count) ||
+		header.polygon_count!=static_cast<uint32>(dynamic_world->polygon_count) ||
+		header.map_index_count>=UINT16_MAX ||
+		static_cast<size_t>(length)!=SIZEOF_precalculated_map_data_header + header.endpoint_count*SIZEOF_endpoint_data +
+			header.line_count*SIZEOF_line_data + header.side_count*SIZEOF_side_data +
+			header.polygon_count*SIZEOF_polygon_data + header.map_index_count*sizeof(int16) ||
+		header.data_checksum!=calculate_data_crc(S, length-SIZEOF_precalculated_map_data_header))
+	{
+		return false;
+	}
+
+	S= unpack_endpoint_data(S, map_endpoints, header.endpoint_count);
+	S= unpack_line_data(S, map_lines, header.line_count);
+	S= unpack_side_data(S, map_sides, header.side_count);
+	S= unpack_polygon_data(S, map_polygons, header.polygon_count);
+	MapIndexList.resize(header.map_index_count);
+	StreamToList(S, map_indexes, header.map_index_count);
+	dynamic_world->map_index_count= static_cast<int16>(header.map_index_count);
+
+	*precalculation_microseconds= header.precalculation_microseconds;
+	return true;
+}
+
+static void write_precalculated_map_data(
+	uint32 checksum,
+	uint32 precalculation_microseconds)
+{
+	size_t map_index_count= MapIndexList.size();
+	size_t length= SIZEOF_precalculated_map_data_header + dynamic_world->endpoint_count*SIZEOF_endpoint_data +
+		dynamic_world->line_count*SIZEOF_line_data + dynamic_world->side_count*SIZEOF_side_data +
+		dynamic_world->polygon_count*SIZEOF_polygon_data + map_index_count*sizeof(int16);
+	vector<uint8> buffer(length);
+	uint8 *S= buffer.data();
+
+	ValueToStream(S, static_cast<uint32>(PRECALCULATED_MAP_DATA_TAG));
+	ValueToStream(S, static_cast<uint32>(PRECALCULATED_MAP_DATA_VERSION));
+	ValueToStream(S, checksum);
+	ValueToStream(S, precalculation_microseconds);
+	ValueToStream(S, static_cast<uint32>(dynamic_world->endpoint_count));
+	ValueToStream(S, static_cast<uint32>(dynamic_world->line_count));
+	ValueToStream(S, static_cast<uint32>(dynamic_world->side_count));
+	ValueToStream(S, static_cast<uint32>(dynamic_world->polygon_count));
+	ValueToStream(S, static_cast<uint32>(map_index_count));
+	uint8 *data_checksum= S;
+	ValueToStream(S, static_cast<uint32>(0));
+	assert(S==buffer.data()+SIZEOF_precalculated_map_data_header);
+
+	S= pack_endpoint_data(S, map_endpoints, dynamic_world->endpoint_count);
+	S= pack_line_data(S, map_lines, dynamic_world->line_count);
+	S= pack_side_data(S, map_sides, dynamic_world->side_count);
+	S= pack_polygon_data(S, map_polygons, dynamic_world->polygon_count);
+	ListToStream(S, map_indexes, map_index_count);
+	assert(S==buffer.data()+length);
+
+	ValueToStream(data_checksum, calculate_data_crc(buffer.data()+SIZEOF_precalculated_map_data_header,
+		static_cast<int32>(length-SIZEOF_precalculated_map_data_header)));
+
+	/* write under a temporary name, so nobody ever reads half a file */
+	FileSpecifier File, TempFile;
+	OpenedFile OFile;
+
+	get_precalculated_map_data_file(checksum, File);
+	TempFile.SetTempName(File);
+	if (TempFile.Create(_typecode_unknown) && TempFile.Open(OFile, true))
+	{
+		bool written= OFile.Write(static_cast<int32>(length), buffer.data());
+		OFile.Close();
+		if (!written || !TempFile.Rename(File))
+		{
+			logWarning("couldn't write precalculated map data to the map cache");
+			TempFile.Delete();
+		}
+	}
+
+	prune_map_cache();
+}
+
+static bool written_earlier(
+	const dir_entry& a,
+	const dir_entry& b)
+{
+	return a.date<b.date;
+}
+
+/* everything in the directory counts, the visibility sets too */
+static void prune_map_cache(
+	void)
+{
+	DirectorySpecifier Directory;
+	vector<dir_entry> entries;
+	uint64 total_bytes= 0;
+
+	Directory.SetToMapCacheDir();
+	if (!Directory.ReadDirectory(entries)) return;
+
+	for (size_t i= 0; i<entries.size(); ++i)
+	{
+		if (!entries[i].is_directory) total_bytes+= entries[i].size;
+	}
+	if (total_bytes<=MAXIMUM_MAP_CACHE_BYTES) return;
+
+	std::sort(entries.begin(), entries.end(), written_earlier);
+	for (size_t i= 0; i<entries.size() && total_bytes>MAXIMUM_MAP_CACHE_BYTES; ++i)
+	{
+		if (entries[i].is_directory) continue;
+
+		FileSpecifier File= Directory+entries[i].name;
+		if (File.Delete()) total_bytes-= entries[i].size;
+	}
+}
+
+static void get_precalculated_map_data_file(
+	uint32 checksum,
+	FileSpecifier& File)
+{
+	char name[32];
+
+	sprintf(name, "%08x.mapcache", checksum);
+	File.SetToMapCacheDir();
+	File.AddPart(name);
+}
+
 /* Note that we assume the redundant data has already been recalculated... */
 static void load_redundant_map_data(
 	short *redundant_data,
@@ -1956,8 +2252,24 @@ static void load_redundant_map_data(
 	}
 	else
 	{
-		recalculate_redundant_map();
-		precalculate_map_indexes();
+		uint64 start= machine_microsecond_count();
+		uint32 checksum= calculate_precalculated_map_data_checksum();
+		uint32 precalculation_microseconds;
+
+		if (read_precalculated_map_data(checksum, &precalculation_microseconds))
+		{
+			logNote("read precalculated map data from the map cache in %.1f ms (precalculating took %.1f ms)",
+				(machine_microsecond_count() - start)/1000.0, precalculation_microseconds/1000.0);
+		}
+		else
+		{
+			recalculate_redundant_map();
+			precalculate_map_indexes();
+
+			precalculation_microseconds= static_cast<uint32>(machine_microsecond_count() - start);
+			write_precalculated_map_data(checksum, precalculation_microseconds);
+			logNote("precalculated map data in %.1f ms", precalculation_microseconds/1000.0);
+		}
 	}
 }
 
@@ -2537,35 +2849,45 @@ static wad_data *build_export_wad(wad_header *header, int32 *length)
 	return wad;
 }
 
-/* Build the wad, with all the crap */
-static struct wad_data *build_save_game_wad(
-	struct wad_header *header, 
-	int32 *length)
+/* Pack all the crap, for build_save_game_wad() */
+static void pack_save_game_tags(
+	struct saved_game_snapshot *snapshot)
 {
-	struct wad_data *wad= NULL;
-	uint8 *array_to_slam;
-	size_t size;
-
-	wad= create_empty_wad();
-	if(wad)
+	recalculate_map_counts();
+	for(unsigned loop= 0; loop<NUMBER_OF_SAVE_ARRAYS; ++loop)
 	{
-		recalculate_map_counts();
-		for(unsigned loop= 0; loop<NUMBER_OF_SAVE_ARRAYS; ++loop)
-		{
-			/* If there is a conversion function, let it handle it */
-			array_to_slam= tag_to_global_array_and_size(save_data[loop].tag, &size);
-	
-			/* Add it to the wad.. */
-			if(size)
-			{
-				wad= append_data_to_wad(wad, save_data[loop].tag, array_to_slam, size, 0);
-				delete []array_to_slam;
-			}
-		}
-		if(wad) *length= calculate_wad_length(header, wad);
+		struct saved_game_tag tag;
+
+		/* If there is a conversion function, let it handle it */
+		tag.tag= save_data[loop].tag;
+		tag.data= tag_to_global_array_and_size(tag.tag, &tag.size);
+		if(tag.size) snapshot->tags.push_back(tag);
 	}
-	
-	return wad;
+}
+
+static void add_borrowed_tag(
+	std::vector<struct tag_data>& tags,
+	WadDataType tag,
+	const void *data,
+	size_t size)
+{
+	struct tag_data entry;
+
+	entry.tag= tag;
+	entry.data= (byte *) data; /* only ever read */
+	entry.length= size;
+	entry.offset= 0;
+	tags.push_back(entry);
+}
+
+/* The tags still belong to whoever lent them; never free_wad() this */
+static void make_borrowed_wad(
+	struct wad_data *wad,
+	std::vector<struct tag_data>& tags)
+{
+	obj_clear(*wad);
+	wad->tag_count= tags.size();
+	wad->tag_data= tags.empty() ? NULL : &tags[0];
 }
 
 /* Build save game wad holding metadata and preview image */
@@ -39,6 +39,17 @@ Aug 12, 2000 (Loren Petrich):
 class FileSpecifier;
 
 bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata);
+
+// A saved game packed into memory: taking one must be done on the game thread, between
+// ticks, and may leave a game error pending (from reading the map's checksum).  Writing it
+// out only touches the snapshot and the file, so may be done on any thread: it never sets
+// the game error or alerts the user, and on failure, error is the file error, if any.
+// Unless told otherwise, taking one makes File the game to revert to.
+struct saved_game_snapshot;
+struct saved_game_snapshot *take_saved_game_snapshot(FileSpecifier& File, bool revert_to_it= true);
+bool write_saved_game_snapshot(struct saved_game_snapshot *snapshot, const std::string& metadata,
+	const std::string& imagedata, short *error);
+void free_saved_game_snapshot(struct saved_game_snapshot *snapshot);
 struct wad_data *build_meta_game_wad(const std::string& metadata, const std::string& imagedata, struct wad_header *header, int32 *length);
 
 bool export_level(FileSpecifier& File);
@@ -128,13 +128,20 @@ bool choose_saved_game_to_load(FileSpecifier &saved_game)
  *  Save game
  */
 
+static void report_saved_game(const QuickSave& save, bool success)
+{
+	if (success)
+		screen_printf("Game saved");
+	else
+		screen_printf("Save failed");
+}
+
+// The game goes on as soon as it has been packed; the message comes once it's written
 bool save_game(void)
 {
 	pause_game();
-    bool success = create_quick_save();
-    if (success)
-        screen_printf("Game saved");
-    else
+    bool success = create_quick_save(report_saved_game);
+    if (!success)
         screen_printf("Save failed");
 	resume_game();
 
@@ -80,6 +80,9 @@ Jan 25, 2002 (Br'fin (Jeremy Parsons)):
 
 #include <string.h>
 #include <stdlib.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
 
 #include "wad.h"
 #include "tags.h"
@@ -101,6 +104,9 @@ inline short memory_error() {return 0;}
 // "between-levels" loading, such as 3D models.
 bool BetweenLevels = true;
 
+// Cleared only by the loading benchmark, to time the old copying path
+static bool MapReadOnlyWads = true;
+
 /* ---------------- private global data */
 struct wad_internal_data *internal_data[MAXIMUM_OPEN_WADFILES]= {NULL, NULL, NULL};
 
@@ -111,6 +117,8 @@ static short get_entry_header_length(struct wad_header *header);
 static bool read_indexed_directory_data(OpenedFile& OFile, struct wad_header *header,
 	short index, struct directory_entry *entry);
 static int32 calculate_raw_wad_length(struct wad_header *file_header, uint8 *wad);
+static struct wad_data *read_indexed_wad_from_mapping(OpenedFile& OFile, FileMapping *mapping,
+	struct wad_header *header, short index);
 static bool read_indexed_wad_from_file_into_buffer(OpenedFile& OFile, 
 	struct wad_header *header, short index, void *buffer, int32 *length);
 static short count_raw_tags(uint8 *raw_wad);
@@ -181,6 +189,19 @@ struct wad_data *read_indexed_wad_from_file(
      int32 length = 0;
 	int error = 0;
 
+	/* Read-only wads can point straight into the file, if it can be mapped */
+	if(read_only && MapReadOnlyWads)
+	{
+		FileMapping *mapping= OFile.Map();
+		
+		if(mapping)
+		{
+			read_wad= read_indexed_wad_from_mapping(OFile, mapping, header, index);
+			if(read_wad) return read_wad;
+			mapping->Release();
+		}
+	}
+
 	// if(file_id>=0) /* NOT a union wadfile... */
 	{
 		if (size_of_indexed_wad(OFile, header, index, &length))
@@ -657,8 +678,7 @@ bool write_wad(
 	struct wad_data *wad, 
         int32 offset)
 {
-	int error = 0;
-	bool success;
+	bool success= true;
 	short entry_header_length= get_entry_header_length(file_header);
 	short index;
 	struct entry_header header;
@@ -667,7 +687,7 @@ bool write_wad(
 	assert(wad);
 	assert(!wad->read_only_data);
 
-	for(index=0; !error && index<wad->tag_count; ++index)
+	for(index=0; success && index<wad->tag_count; ++index)
 	{
 		header.tag= wad->tag_data[index].tag;
 		header.length= wad->tag_data[index].length;
@@ -702,21 +722,15 @@ bool write_wad(
 			offset+= entry_header_length;
 		
 			/* Write the data.. */
-			write_to_file(OFile, offset, wad->tag_data[index].data, wad->tag_data[index].length);
-			{
-				offset+= wad->tag_data[index].length;
-			}
+			success= write_to_file(OFile, offset, wad->tag_data[index].data, wad->tag_data[index].length);
+			offset+= wad->tag_data[index].length;
+		} else {
+			success= false;
 		}
 	}
 	
-	if(error)
-	{
-		success= false;
-		set_game_error(systemError, error);
-	} else {
-		success= true;
-	}
-	
+	/* No game error; the file's own error says what went wrong, and this is written from
+		the quick save thread */
 	return success;
 }
 
@@ -748,7 +762,13 @@ void free_wad(
 	assert(wad);
 	
 	/* Free all of the tags */
-	if(wad->read_only_data)
+	if(wad->mapping)
+	{
+		/* Read only wad, in a mapped file.. */
+		wad->mapping->Release();
+		free(wad->tag_data);
+	}
+	else if(wad->read_only_data)
 	{
 		/* Read only wad.. */
 		free(wad->read_only_data);
@@ -923,6 +943,121 @@ void dump_wad(
 	dprintf("---End of Dump---");
 }
 
+/* ---------- benchmark */
+
+/* Resident and private (anonymous) memory, in kilobytes; false where we can't tell */
+static bool get_resident_memory(
+	uint32 *resident_kilobytes,
+	uint32 *private_kilobytes)
+{
+#if defined(__linux__)
+	unsigned long size, resident, shared;
+	bool success= false;
+	FILE *statm= fopen("/proc/self/statm", "r");
+
+	if(statm)
+	{
+		if(fscanf(statm, "%lu %lu %lu", &size, &resident, &shared)==3)
+		{
+			uint32 page_kilobytes= sysconf(_SC_PAGESIZE)/1024;
+
+			*resident_kilobytes= resident*page_kilobytes;
+			*private_kilobytes= (resident-shared)*page_kilobytes;
+			success= true;
+		}
+		fclose(statm);
+	}
+
+	return success;
+#else
+	(void) resident_kilobytes;
+	(void) private_kilobytes;
+	return false;
+#endif
+}
+
+static bool time_wad_loading(
+	FileSpecifier& File,
+	bool mapped,
+	struct wad_loading_benchmark *result)
+{
+	OpenedFile OFile;
+	struct wad_header header;
+	bool success= false;
+
+	obj_clear(*result);
+	result->mapped= mapped;
+	result->memory_known= get_resident_memory(&result->peak_resident_kilobytes,
+		&result->peak_private_kilobytes);
+
+	if(open_wad_file_for_reading(File, OFile))
+	{
+		if(read_wad_header(OFile, &header))
+		{
+			bool old_map_read_only_wads= MapReadOnlyWads;
+			short index;
+
+			MapReadOnlyWads= mapped;
+			success= true;
+			for(index= 0; success && index<header.wad_count; ++index)
+			{
+				uint64 start= machine_microsecond_count();
+				struct wad_data *wad= read_indexed_wad_from_file(OFile, &header, index, true);
+
+				if(wad)
+				{
+					short tag_index;
+					uint32 resident, unshared;
+
+					/* Touch every byte, as loading the level would */
+					for(tag_index= 0; tag_index<wad->tag_count; ++tag_index)
+					{
+						struct tag_data *tag= wad->tag_data+tag_index;
+						int32 offset;
+
+						for(offset= 0; offset<tag->length; ++offset)
+						{
+							result->checksum= result->checksum*31 + tag->data[offset];
+						}
+						result->bytes+= tag->length;
+					}
+					result->microseconds+= machine_microsecond_count()-start;
+					result->level_count+= 1;
+
+					if(result->memory_known && get_resident_memory(&resident, &unshared))
+					{
+						result->peak_resident_kilobytes= MAX(result->peak_resident_kilobytes, resident);
+						result->peak_private_kilobytes= MAX(result->peak_private_kilobytes, unshared);
+					}
+
+					start= machine_microsecond_count();
+					free_wad(wad);
+					result->microseconds+= machine_microsecond_count()-start;
+				} else {
+					success= false;
+				}
+			}
+			MapReadOnlyWads= old_map_read_only_wads;
+		}
+		close_wad_file(OFile);
+	}
+
+	return success;
+}
+
+bool benchmark_wad_loading(
+	FileSpecifier& File,
+	struct wad_loading_benchmark *copied,
+	struct wad_loading_benchmark *mapped)
+{
+	struct wad_loading_benchmark warm_up;
+
+	/* One pass first so that both timed passes find the file in the disk cache */
+	return time_wad_loading(File, false, &warm_up) &&
+		time_wad_loading(File, false, copied) &&
+		time_wad_loading(File, true, mapped);
+}
+
 /* ---------- file management routines */
 bool create_wadfile(FileSpecifier& File, Typecode Type)
 {
@@ -1161,6 +1296,34 @@ static bool read_indexed_wad_from_file_into_buffer(
 	return success;
 }
 
+/* Points a read-only wad into the mapped file, which the wad then holds on to; */
+/* NULL if it isn't all there (including the padding for Marathon 1 entry headers), */
+/* so that the caller can read it the usual way and report any errors */
+static struct wad_data *read_indexed_wad_from_mapping(
+	OpenedFile& OFile,
+	FileMapping *mapping,
+	struct wad_header *header,
+	short index)
+{
+	struct directory_entry entry;
+	struct wad_data *wad= NULL;
+
+	if (read_indexed_directory_data(OFile, header, index, &entry) && entry.length>0 &&
+		entry.offset_to_start>=0 &&
+		entry.offset_to_start <= mapping->GetLength() - entry.length - (SIZEOF_entry_header-SIZEOF_old_entry_header))
+	{
+		uint8 *raw_wad= mapping->GetData() + entry.offset_to_start;
+
+		/* Veracity Check */
+		assert(entry.length==calculate_raw_wad_length(header, raw_wad));
+
+		wad= convert_wad_from_raw(header, raw_wad, 0, entry.length);
+		if(wad) wad->mapping= mapping;
+	}
+
+	return wad;
+}
+
 /* This *MUST* be a base wad.. */
 static struct wad_data *convert_wad_from_raw(
 	struct wad_header *header, 
@@ -1351,6 +1514,15 @@ static bool read_from_file(
 	void *data, 
 	int32 length)
 {
+	/* Once the file has been mapped, its headers and directories come from there */
+	FileMapping *mapping= OFile.GetMapping();
+	if (mapping)
+	{
+		if (offset<0 || length<0 || offset>mapping->GetLength()-length) return false;
+		memcpy(data, mapping->GetData()+offset, length);
+		return true;
+	}
+
 	if (!OFile.SetPosition(offset)) return false;
 	return OFile.Read(length, data);
 }
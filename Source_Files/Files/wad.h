@@ -54,6 +54,7 @@ Aug 12, 2000 (Loren Petrich):
 
 class FileSpecifier;
 class OpenedFile;
+class FileMapping;
 
 /* ------------- typedefs */
 typedef uint32 WadDataType;
@@ -124,6 +125,7 @@ struct wad_data {
 	short padding;
 	byte *read_only_data;		/* If this is non NULL, we are read only.... */
 	struct tag_data *tag_data;	/* Tag data array */
+	FileMapping *mapping;		/* If this is non NULL, read_only_data points into it */
 };
 
 /* ----- miscellaneous functions */
@@ -201,6 +203,7 @@ bool write_wad_header(OpenedFile& OFile, struct wad_header *header);
 bool write_directorys(OpenedFile& OFile,  struct wad_header *header,
 	void *entries);
 void calculate_and_store_wadfile_checksum(OpenedFile& OFile);
+/* false if a write failed; leaves no game error, so it may be called from any thread */
 bool write_wad(OpenedFile& OFile, struct wad_header *file_header, 
 	struct wad_data *wad, int32 offset);
 
@@ -220,6 +223,22 @@ void remove_tag_from_wad(struct wad_data *wad, WadDataType type);
 /* ------- debug function */
 void dump_wad(struct wad_data *wad);
 
+/* ------- benchmark */
+struct wad_loading_benchmark {
+	bool mapped;
+	bool memory_known;			/* Only where the platform reports resident memory */
+	short level_count;
+	uint32 bytes;				/* Of tag data, all of which is read */
+	uint32 checksum;			/* Of the same; both paths must agree */
+	uint64 microseconds;
+	uint32 peak_resident_kilobytes;
+	uint32 peak_private_kilobytes;	/* Resident less file-backed pages */
+};
+
+/* Loads every level of the file read-only, copied and then mapped */
+bool benchmark_wad_loading(FileSpecifier& File, struct wad_loading_benchmark *copied,
+	struct wad_loading_benchmark *mapped);
+
 // To tell the wad allocator that we are between levels (the default);
 // if one wishes to load a model file with a WAD-based format, for example,
 // one would shut off "between levels", so as not to interfere with other loaded stuff.
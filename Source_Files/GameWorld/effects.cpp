@@ -111,8 +111,10 @@ short new_effect(
 		}
 		else
 		{
-			for (effect_index= 0,effect= effects; effect_index<MAXIMUM_EFFECTS_PER_MAP; ++effect_index, ++effect)
+			effect_index= EffectSlots.first_free();
+			if (effect_index!=NONE)
 			{
+				effect= effects+effect_index;
 				if (SLOT_IS_FREE(effect))
 				{
 					short object_index= new_map_object3d(origin, polygon_index, BUILD_DESCRIPTOR(definition->collection, definition->shape), facing);
@@ -127,6 +129,7 @@ short new_effect(
 						effect->data= 0;
 						effect->delay= definition->delay ? global_random()%definition->delay : 0;
 						MARK_SLOT_AS_USED(effect);
+						EffectSlots.mark_used(effect_index);
 						
 						SET_OBJECT_OWNER(object, _object_is_effect);
 						object->sound_pitch= definition->sound_pitch;
@@ -137,11 +140,12 @@ short new_effect(
 					{
 						effect_index= NONE;
 					}
-					
-					break;
+				}
+				else
+				{
+					effect_index= NONE;
 				}
 			}
-			if (effect_index==MAXIMUM_EFFECTS_PER_MAP) effect_index= NONE;
 		}
 	}
 	
@@ -155,8 +159,9 @@ void update_effects(
 	struct effect_data *effect;
 	short effect_index;
 	
-	for (effect_index= 0, effect= effects; effect_index<MAXIMUM_EFFECTS_PER_MAP; ++effect_index, ++effect)
+	for (effect_index= EffectSlots.first_used(); effect_index!=NONE; effect_index= EffectSlots.next_used(effect_index))
 	{
+		effect= effects+effect_index;
 		if (SLOT_IS_USED(effect))
 		{
 			struct object_data *object= get_object_data(effect->object_index);
@@ -206,6 +211,7 @@ void remove_effect(
 	remove_map_object(effect->object_index);
 	L_Invalidate_Effect(effect_index);
 	MARK_SLOT_AS_FREE(effect);
+	EffectSlots.mark_free(effect_index);
 }
 
 void remove_all_nonpersistent_effects(
@@ -214,8 +220,9 @@ void remove_all_nonpersistent_effects(
 	struct effect_data *effect;
 	short effect_index;
 	
-	for (effect_index= 0, effect= effects; effect_index<MAXIMUM_EFFECTS_PER_MAP; ++effect_index, ++effect)
+	for (effect_index= EffectSlots.first_used(); effect_index!=NONE; effect_index= EffectSlots.next_used(effect_index))
 	{
+		effect= effects+effect_index;
 		if (SLOT_IS_USED(effect))
 		{
 			struct effect_definition *definition= get_effect_definition(effect->type);
@@ -282,8 +289,9 @@ void teleport_object_in(
 	struct effect_data *effect;
 	short effect_index;
 
-	for (effect_index= 0, effect= effects; effect_index<MAXIMUM_EFFECTS_PER_MAP; ++effect_index, ++effect)
+	for (effect_index= EffectSlots.first_used(); effect_index!=NONE; effect_index= EffectSlots.next_used(effect_index))
 	{
+		effect= effects+effect_index;
 		if (SLOT_IS_USED(effect))
 		{
 			if (effect->type==_effect_teleport_object_in && effect->data==object_index)
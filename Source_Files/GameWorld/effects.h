@@ -42,6 +42,7 @@ Aug 30, 2000 (Loren Petrich):
 
 // LP addition:
 #include "dynamic_limits.h"
+#include "slot_pool.h"
 
 #include "world.h"
 #include <vector>
@@ -154,6 +155,7 @@ const int SIZEOF_effect_definition = 14;
 
 extern std::vector<effect_data> EffectList;
 #define effects (EffectList.data())
+extern slot_pool EffectSlots;
 
 // extern struct effect_data *effects;
 
@@ -77,10 +77,26 @@ static short node_count= 0, last_node_index_expanded= NONE;
 static struct node_data *nodes = NULL;
 static short *visited_polygons = NULL;
 
+/* unexpanded nodes as a binary heap ordered by (cost, node index), so _best_first can take the
+	cheapest node without scanning; the node index breaks ties exactly as the old scan did.  the
+	breadth-first modes take nodes in the order they were added, so they don't keep it */
+static bool open_heap_kept= false;
+static short open_node_count= 0;
+static short *open_nodes = NULL;
+static short *open_node_positions = NULL; /* NONE if the node is not in the heap */
+
+static bool use_linear_open_set= false; /* for benchmark_flood_map() */
+
 /* ---------- private prototypes */
 
 static void add_node(short parent_node_index, short polygon_index, short depth, int32 cost, int32 user_flags);
 
+static short lowest_cost_unexpanded_node(int32 maximum_cost, int32 *lowest_cost);
+static void insert_open_node(short node_index);
+static void remove_open_node(short node_index);
+static void sift_open_node_up(short position);
+static void sift_open_node_down(short position);
+
 /* ---------- code */
 
 void allocate_flood_map_memory(
@@ -91,7 +107,11 @@ void allocate_flood_map_memory(
 	nodes= new node_data[MAXIMUM_FLOOD_NODES];
 	if (visited_polygons) delete []visited_polygons;
 	visited_polygons= new short[MAXIMUM_POLYGONS_PER_MAP];
-	assert(nodes&&visited_polygons);
+	if (open_nodes) delete []open_nodes;
+	open_nodes= new short[MAXIMUM_FLOOD_NODES];
+	if (open_node_positions) delete []open_node_positions;
+	open_node_positions= new short[MAXIMUM_FLOOD_NODES];
+	assert(nodes&&visited_polygons&&open_nodes&&open_node_positions);
 }
 
 /* returns next polygon index or NONE if there are no more polygons left cheaper than maximum_cost */
@@ -114,6 +134,8 @@ short flood_map(
 		objlist_set(visited_polygons, NONE, MAXIMUM_POLYGONS_PER_MAP);
 		
 		node_count= 0;
+		open_node_count= 0;
+		open_heap_kept= flood_mode==_best_first && !use_linear_open_set;
 		last_node_index_expanded= NONE;
 		add_node(NONE, first_polygon_index, 0, 0, (flood_mode==_flagged_breadth_first) ? *((int32*)caller_data) : 0);
 	}
@@ -122,15 +144,22 @@ short flood_map(
 	{
 		case _best_first:
 			/* find the unexpanded node with the lowest cost */
-			lowest_cost= maximum_cost, lowest_cost_node_index= NONE;
-			for (node= nodes, node_index= 0; node_index<node_count; ++node_index, ++node)
+			if (!open_heap_kept)
 			{
-				if (NODE_IS_UNEXPANDED(node)&&node->cost<lowest_cost)
+				lowest_cost= maximum_cost, lowest_cost_node_index= NONE;
+				for (node= nodes, node_index= 0; node_index<node_count; ++node_index, ++node)
 				{
-					lowest_cost_node_index= node_index;
-					lowest_cost= node->cost;
+					if (NODE_IS_UNEXPANDED(node)&&node->cost<lowest_cost)
+					{
+						lowest_cost_node_index= node_index;
+						lowest_cost= node->cost;
+					}
 				}
 			}
+			else
+			{
+				lowest_cost_node_index= lowest_cost_unexpanded_node(maximum_cost, &lowest_cost);
+			}
 			break;
 		
 		case _breadth_first:
@@ -181,6 +210,7 @@ short flood_map(
 
 		/* mark node as expanded */
 		MARK_NODE_AS_EXPANDED(node);
+		if (open_heap_kept) remove_open_node(lowest_cost_node_index);
 
 		for (i= 0; i<polygon->vertex_count; ++i)		
 		{
@@ -321,6 +351,7 @@ static void add_node(
 			if (node_index==node_count)
 			{
 				node_count+= 1;
+				if (open_heap_kept) open_node_positions[node_index]= NONE;
 			}
 			
 			node->flags= 0;
@@ -333,7 +364,172 @@ static void add_node(
 			assert(polygon_index>=0&&polygon_index<dynamic_world->polygon_count);
 			visited_polygons[polygon_index]= node_index;
 			
+			/* a replaced node only ever gets cheaper */
+			if (open_heap_kept)
+			{
+				if (open_node_positions[node_index]==NONE) insert_open_node(node_index);
+				else sift_open_node_up(open_node_positions[node_index]);
+			}
+			
 //			dprintf("added polygon #%d to node #%d (nodes=%p,visited=%p)", polygon_index, node_index, nodes, visited_polygons);
 		}
 	}
 }
+
+/* ---------- open set */
+
+static inline bool open_node_precedes(
+	short node_index0,
+	short node_index1)
+{
+	int32 cost0= nodes[node_index0].cost, cost1= nodes[node_index1].cost;
+	
+	return cost0<cost1 || (cost0==cost1 && node_index0<node_index1);
+}
+
+/* same answer as scanning every node for the first unexpanded one of lowest cost */
+static short lowest_cost_unexpanded_node(
+	int32 maximum_cost,
+	int32 *lowest_cost)
+{
+	short node_index= NONE;
+	
+	*lowest_cost= maximum_cost;
+	if (open_node_count && nodes[open_nodes[0]].cost<maximum_cost)
+	{
+		node_index= open_nodes[0];
+		*lowest_cost= nodes[node_index].cost;
+	}
+	
+	return node_index;
+}
+
+static void insert_open_node(
+	short node_index)
+{
+	assert(open_node_count<MAXIMUM_FLOOD_NODES);
+	open_nodes[open_node_count]= node_index;
+	open_node_positions[node_index]= open_node_count;
+	sift_open_node_up(open_node_count++);
+}
+
+static void remove_open_node(
+	short node_index)
+{
+	short position= open_node_positions[node_index];
+	
+	if (position!=NONE)
+	{
+		short last_node_index= open_nodes[--open_node_count];
+		
+		open_node_positions[node_index]= NONE;
+		if (position<open_node_count)
+		{
+			open_nodes[position]= last_node_index;
+			open_node_positions[last_node_index]= position;
+			sift_open_node_up(position);
+			sift_open_node_down(open_node_positions[last_node_index]);
+		}
+	}
+}
+
+static void sift_open_node_up(
+	short position)
+{
+	short node_index= open_nodes[position];
+	
+	while (position>0)
+	{
+		short parent= (position-1)>>1;
+		
+		if (!open_node_precedes(node_index, open_nodes[parent])) break;
+		open_nodes[position]= open_nodes[parent];
+		open_node_positions[open_nodes[position]]= position;
+		position= parent;
+	}
+	open_nodes[position]= node_index;
+	open_node_positions[node_index]= position;
+}
+
+static void sift_open_node_down(
+	short position)
+{
+	short node_index= open_nodes[position];
+	
+	for (;;)
+	{
+		short child= 2*position+1;
+		
+		if (child>=open_node_count) break;
+		if (child+1<open_node_count && open_node_precedes(open_nodes[child+1], open_nodes[child])) child+= 1;
+		if (!open_node_precedes(open_nodes[child], node_index)) break;
+		open_nodes[position]= open_nodes[child];
+		open_node_positions[open_nodes[position]]= position;
+		position= child;
+	}
+	open_nodes[position]= node_index;
+	open_node_positions[node_index]= position;
+}
+
+/* ---------- benchmark */
+
+static int32 unit_cost_proc(
+	short source_polygon_index,
+	short line_index,
+	short destination_polygon_index,
+	void *caller_data)
+{
+	(void) (source_polygon_index);
+	(void) (line_index);
+	(void) (destination_polygon_index);
+	(void) (caller_data);
+	
+	return 1;
+}
+
+static void flood_map_from(
+	short polygon_index,
+	cost_proc_ptr cost_proc,
+	vector<short>& visit_order)
+{
+	visit_order.clear();
+	for (polygon_index= flood_map(polygon_index, INT32_MAX, cost_proc, _best_first, NULL);
+		polygon_index!=NONE;
+		polygon_index= flood_map(NONE, INT32_MAX, cost_proc, _best_first, NULL))
+	{
+		visit_order.push_back(polygon_index);
+	}
+}
+
+/* best-first floods from every polygon on the map, once by area (the default cost) and once with
+	every step costing the same (lots of ties), with both the heap and the old linear scan; any
+	difference in the order polygons come back in is a mismatch */
+void benchmark_flood_map(
+	struct flood_map_benchmark *results)
+{
+	vector<short> heap_order, linear_order;
+	cost_proc_ptr cost_procs[]= {NULL, unit_cost_proc};
+	
+	obj_clear(*results);
+	for (short polygon_index= 0; polygon_index<dynamic_world->polygon_count; ++polygon_index)
+	{
+		if (POLYGON_IS_DETACHED(get_polygon_data(polygon_index))) continue;
+		
+		for (unsigned i= 0; i<sizeof(cost_procs)/sizeof(cost_procs[0]); ++i)
+		{
+			uint64 start= machine_microsecond_count();
+			flood_map_from(polygon_index, cost_procs[i], heap_order);
+			results->heap_microseconds+= machine_microsecond_count() - start;
+			
+			use_linear_open_set= true;
+			start= machine_microsecond_count();
+			flood_map_from(polygon_index, cost_procs[i], linear_order);
+			results->linear_microseconds+= machine_microsecond_count() - start;
+			use_linear_open_set= false;
+			
+			results->flood_count+= 1;
+			results->polygons_visited+= heap_order.size();
+			if (heap_order!=linear_order) results->mismatch_count+= 1;
+		}
+	}
+}
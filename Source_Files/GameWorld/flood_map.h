@@ -40,17 +40,37 @@ enum /* flood modes */
 
 typedef int32 (*cost_proc_ptr)(short source_polygon_index, short line_index, short destination_polygon_index, void *caller_data);
 
+/* ---------- structures */
+
+struct path_cache_statistics
+{
+	int32 hit_count, miss_count, invalidation_count;
+	uint64 hit_microseconds, miss_microseconds;
+};
+
 /* ---------- prototypes/PATHFINDING.C */
 
 void allocate_pathfinding_memory(void);
 void reset_paths(void);
 
+/* a cache_key other than NONE promises that cost(..., data) depends only on the key and the
+	state of the map, so the route may be reused for the same polygons, cost and key */
 short new_path(world_point2d *source_point, short source_polygon_index,
 	world_point2d *destination_point, short destination_polygon_index,
-	world_distance minimum_separation, cost_proc_ptr cost, void *data);
+	world_distance minimum_separation, cost_proc_ptr cost, void *data, int32 cache_key= NONE);
 bool move_along_path(short path_index, world_point2d *p);
 void delete_path(short path_index);
 
+void invalidate_path_cache(void);
+void invalidate_paths_through_polygon(short polygon_index);
+void get_path_cache_statistics(struct path_cache_statistics *statistics);
+
+/* for world snapshots: the path slots, and a mark to forget every route cached after it */
+void *get_path_array(void);
+int32 calculate_path_array_length(void);
+uint32 checkpoint_path_cache(void);
+void rewind_path_cache(uint32 checkpoint);
+
 /* ---------- prototypes/FLOOD_MAP.C */
 
 void allocate_flood_map_memory(void);
@@ -63,5 +83,13 @@ short flood_depth(void);
 
 void choose_random_flood_node(world_vector2d *bias);
 
+struct flood_map_benchmark
+{
+	int32 flood_count, polygons_visited, mismatch_count;
+	uint64 heap_microseconds, linear_microseconds;
+};
+
+void benchmark_flood_map(struct flood_map_benchmark *results);
+
 #endif
 
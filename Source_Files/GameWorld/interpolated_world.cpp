@@ -0,0 +1,523 @@
+/*
+INTERPOLATED_WORLD.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	the renderers read the world arrays directly, so rather than teach each of them about two
+	ticks we blend in place around render_screen(), and keep what was there to put back.
+	an object only moves within its own polygon (which is convex, so every blend of two points
+	in it is in it too); the camera is walked into whatever polygon its blended position is in.
+*/
+
+#include "cseries.h"
+#include "map.h"
+#include "interpolated_world.h"
+#include "player.h"
+#include "platforms.h"
+#include "lightsource.h"
+#include "media.h"
+#include "preferences.h"
+#include "Movie.h"
+
+#include <vector>
+using std::vector;
+
+/* ---------- constants */
+
+enum
+{
+	TICK_MICROSECONDS= 1000000/TICKS_PER_SECOND
+};
+
+/* ---------- structures */
+
+struct interpolated_object
+{
+	world_point3d location;
+	int16 polygon;
+	angle facing;
+	uint16 flags; /* only the used slot and owner bits matter */
+	int16 permutation;
+};
+
+struct interpolated_surface
+{
+	int16 polygon_index;
+	world_distance floor_height, ceiling_height;
+};
+
+struct interpolated_line
+{
+	int16 line_index;
+	world_distance highest_adjacent_floor, lowest_adjacent_ceiling;
+};
+
+struct interpolated_camera
+{
+	int16 player_index;
+	world_point3d location;
+	int16 polygon_index;
+	angle facing, elevation;
+	world_distance step_height;
+};
+
+struct interpolated_state
+{
+	bool valid;
+	int32 tick_count;
+	uint64 microseconds; /* machine time when the tick ended */
+
+	vector<interpolated_object> object_positions;
+	vector<interpolated_surface> platform_heights;
+	vector<interpolated_line> line_heights; /* only kept for putting things back */
+	vector<_fixed> light_intensities;
+	vector<world_distance> media_heights;
+	interpolated_camera camera;
+
+	interpolated_state() : valid(false), tick_count(0), microseconds(0) {}
+};
+
+/* ---------- globals */
+
+static interpolated_state previous_tick, current_tick;
+
+/* what the world held when we blended into it */
+static interpolated_state saved_world;
+static bool world_is_interpolated= false;
+
+static frame_statistics frame_stats;
+static uint64 last_frame_microseconds= 0;
+static int32 newest_tick= NONE, last_presented_tick= NONE;
+static uint64 newest_tick_microseconds= 0;
+
+/* how long the last frame took to draw, so one between ticks doesn't hold up the next tick */
+static uint64 frame_start_microseconds= 0;
+static uint32 frame_render_microseconds= 0;
+
+/* ---------- private prototypes */
+
+static void capture_state(interpolated_state *state, bool include_lines);
+static void restore_state(const interpolated_state *state);
+static void blend_objects(_fixed fraction);
+static void blend_platforms(_fixed fraction);
+static void blend_lights_and_media(_fixed fraction);
+static void blend_camera(_fixed fraction);
+
+static inline world_distance blend_distance(world_distance from, world_distance to, _fixed fraction);
+static inline angle blend_angle(angle from, angle to, _fixed fraction);
+
+/* ---------- code */
+
+void reset_interpolated_world(
+	void)
+{
+	assert(!world_is_interpolated);
+
+	previous_tick.valid= current_tick.valid= false;
+	newest_tick= last_presented_tick= NONE;
+}
+
+void record_interpolated_world_tick(
+	void)
+{
+	newest_tick= dynamic_world->tick_count;
+	newest_tick_microseconds= machine_microsecond_count();
+
+	if (!interpolated_world_active())
+	{
+		current_tick.valid= false;
+		return;
+	}
+
+	std::swap(previous_tick, current_tick);
+	capture_state(&current_tick, false);
+
+	/* a level change, a saved game or a rewind is not something to blend across */
+	if (previous_tick.valid && previous_tick.tick_count+1!=current_tick.tick_count) previous_tick.valid= false;
+}
+
+bool interpolated_world_active(
+	void)
+{
+	/* prediction already moves the world around between ticks, and movies want one frame a tick */
+	return graphics_preferences->interpolate_frames && !game_is_networked && !Movie::instance()->IsRecording();
+}
+
+bool interpolated_frame_fits(
+	void)
+{
+	if (!interpolated_world_active() || newest_tick==NONE) return false;
+
+	return machine_microsecond_count()-newest_tick_microseconds+frame_render_microseconds<TICK_MICROSECONDS;
+}
+
+void enter_interpolated_world(
+	void)
+{
+	assert(!world_is_interpolated);
+
+	frame_start_microseconds= machine_microsecond_count();
+	if (!interpolated_world_active() || !previous_tick.valid || !current_tick.valid) return;
+	if (current_tick.tick_count!=dynamic_world->tick_count) return;
+
+	uint64 elapsed= machine_microsecond_count()-current_tick.microseconds;
+	if (elapsed>=TICK_MICROSECONDS) return; /* the next tick is late; the world as it is is right */
+
+	/* we draw one tick behind: fraction 0 is the previous tick, FIXED_ONE the current one */
+	_fixed fraction= (_fixed) ((elapsed*FIXED_ONE)/TICK_MICROSECONDS);
+
+	capture_state(&saved_world, true);
+	world_is_interpolated= true;
+
+	blend_objects(fraction);
+	blend_platforms(fraction);
+	blend_lights_and_media(fraction);
+	blend_camera(fraction);
+}
+
+void exit_interpolated_world(
+	void)
+{
+	if (!world_is_interpolated) return;
+
+	restore_state(&saved_world);
+	world_is_interpolated= false;
+}
+
+void record_frame_presented(
+	bool new_tick)
+{
+	uint64 now= machine_microsecond_count();
+
+	if (frame_start_microseconds) frame_render_microseconds= (uint32) MIN(now-frame_start_microseconds, (uint64) UINT32_MAX);
+
+	if (frame_stats.frame_count && last_frame_microseconds)
+	{
+		uint32 frame_microseconds= (uint32) MIN(now-last_frame_microseconds, (uint64) UINT32_MAX);
+
+		frame_stats.total_frame_microseconds+= frame_microseconds;
+		frame_stats.minimum_frame_microseconds= MIN(frame_stats.minimum_frame_microseconds, frame_microseconds);
+		frame_stats.maximum_frame_microseconds= MAX(frame_stats.maximum_frame_microseconds, frame_microseconds);
+	}
+	else
+	{
+		frame_stats.minimum_frame_microseconds= UINT32_MAX;
+		frame_stats.maximum_frame_microseconds= 0;
+	}
+	last_frame_microseconds= now;
+
+	frame_stats.frame_count+= 1;
+	if (new_tick)
+	{
+		frame_stats.tick_count+= 1;
+	}
+	else
+	{
+		frame_stats.interpolated_frame_count+= 1;
+	}
+
+	/* latency of the newest tick, the first time it makes it to the screen */
+	if (newest_tick!=NONE && newest_tick!=last_presented_tick)
+	{
+		uint32 latency= (uint32) MIN(now-newest_tick_microseconds, (uint64) UINT32_MAX);
+
+		frame_stats.latency_count+= 1;
+		frame_stats.total_latency_microseconds+= latency;
+		frame_stats.maximum_latency_microseconds= MAX(frame_stats.maximum_latency_microseconds, latency);
+		last_presented_tick= newest_tick;
+	}
+}
+
+const struct frame_statistics *get_frame_statistics(
+	void)
+{
+	return &frame_stats;
+}
+
+void reset_frame_statistics(
+	void)
+{
+	obj_clear(frame_stats);
+	last_frame_microseconds= 0;
+}
+
+/* ---------- private code */
+
+static void capture_state(
+	interpolated_state *state,
+	bool include_lines)
+{
+	size_t index;
+
+	state->valid= true;
+	state->tick_count= dynamic_world->tick_count;
+	state->microseconds= machine_microsecond_count();
+
+	state->object_positions.resize(MAXIMUM_OBJECTS_PER_MAP);
+	for (index= 0; index<MAXIMUM_OBJECTS_PER_MAP; ++index)
+	{
+		object_data *object= objects+index;
+		interpolated_object *copy= &state->object_positions[index];
+
+		copy->location= object->location;
+		copy->polygon= object->polygon;
+		copy->facing= object->facing;
+		copy->flags= object->flags;
+		copy->permutation= object->permutation;
+	}
+
+	state->platform_heights.resize(dynamic_world->platform_count);
+	state->line_heights.clear();
+	for (index= 0; index<(size_t)dynamic_world->platform_count; ++index)
+	{
+		polygon_data *polygon= get_polygon_data(platforms[index].polygon_index);
+		interpolated_surface *copy= &state->platform_heights[index];
+
+		copy->polygon_index= platforms[index].polygon_index;
+		copy->floor_height= polygon->floor_height;
+		copy->ceiling_height= polygon->ceiling_height;
+
+		if (include_lines)
+		{
+			for (short i= 0; i<polygon->vertex_count; ++i)
+			{
+				line_data *line= get_line_data(polygon->line_indexes[i]);
+				interpolated_line line_copy;
+
+				line_copy.line_index= polygon->line_indexes[i];
+				line_copy.highest_adjacent_floor= line->highest_adjacent_floor;
+				line_copy.lowest_adjacent_ceiling= line->lowest_adjacent_ceiling;
+				state->line_heights.push_back(line_copy);
+			}
+		}
+	}
+
+	state->light_intensities.resize(MAXIMUM_LIGHTS_PER_MAP);
+	for (index= 0; index<MAXIMUM_LIGHTS_PER_MAP; ++index) state->light_intensities[index]= lights[index].intensity;
+
+	state->media_heights.resize(MAXIMUM_MEDIAS_PER_MAP);
+	for (index= 0; index<MAXIMUM_MEDIAS_PER_MAP; ++index) state->media_heights[index]= medias[index].height;
+
+	state->camera.player_index= current_player_index;
+	state->camera.location= current_player->camera_location;
+	state->camera.polygon_index= current_player->camera_polygon_index;
+	state->camera.facing= current_player->facing;
+	state->camera.elevation= current_player->elevation;
+	state->camera.step_height= current_player->step_height;
+}
+
+/* only ever handed saved_world, taken a moment ago on the same level */
+static void restore_state(
+	const interpolated_state *state)
+{
+	size_t index;
+
+	for (index= 0; index<state->object_positions.size(); ++index)
+	{
+		object_data *object= objects+index;
+
+		object->location= state->object_positions[index].location;
+		object->facing= state->object_positions[index].facing;
+	}
+
+	for (index= 0; index<state->platform_heights.size(); ++index)
+	{
+		polygon_data *polygon= get_polygon_data(state->platform_heights[index].polygon_index);
+
+		polygon->floor_height= state->platform_heights[index].floor_height;
+		polygon->ceiling_height= state->platform_heights[index].ceiling_height;
+	}
+
+	for (index= 0; index<state->line_heights.size(); ++index)
+	{
+		line_data *line= get_line_data(state->line_heights[index].line_index);
+
+		line->highest_adjacent_floor= state->line_heights[index].highest_adjacent_floor;
+		line->lowest_adjacent_ceiling= state->line_heights[index].lowest_adjacent_ceiling;
+	}
+
+	for (index= 0; index<state->light_intensities.size(); ++index) lights[index].intensity= state->light_intensities[index];
+	for (index= 0; index<state->media_heights.size(); ++index) medias[index].height= state->media_heights[index];
+
+	current_player->camera_location= state->camera.location;
+	current_player->camera_polygon_index= state->camera.polygon_index;
+	current_player->facing= state->camera.facing;
+	current_player->elevation= state->camera.elevation;
+	current_player->step_height= state->camera.step_height;
+}
+
+static void blend_objects(
+	_fixed fraction)
+{
+	size_t count= saved_world.object_positions.size();
+
+	if (previous_tick.object_positions.size()!=count || current_tick.object_positions.size()!=count) return;
+
+	for (size_t index= 0; index<count; ++index)
+	{
+		const interpolated_object *from= &previous_tick.object_positions[index];
+		const interpolated_object *to= &current_tick.object_positions[index];
+		const interpolated_object *now= &saved_world.object_positions[index];
+		object_data *object= objects+index;
+
+		if (!SLOT_IS_USED(to) || !SLOT_IS_USED(from)) continue;
+
+		/* the same object, in the same polygon, and nobody has moved it since the tick */
+		if (from->polygon!=to->polygon || GET_OBJECT_OWNER(from)!=GET_OBJECT_OWNER(to) ||
+			from->permutation!=to->permutation) continue;
+		if (now->polygon!=to->polygon || now->facing!=to->facing ||
+			now->location.x!=to->location.x || now->location.y!=to->location.y || now->location.z!=to->location.z) continue;
+
+		object->location.x= blend_distance(from->location.x, to->location.x, fraction);
+		object->location.y= blend_distance(from->location.y, to->location.y, fraction);
+		object->location.z= blend_distance(from->location.z, to->location.z, fraction);
+		object->facing= blend_angle(from->facing, to->facing, fraction);
+	}
+}
+
+static void blend_platforms(
+	_fixed fraction)
+{
+	size_t count= saved_world.platform_heights.size();
+	size_t index;
+
+	if (previous_tick.platform_heights.size()!=count || current_tick.platform_heights.size()!=count) return;
+
+	for (index= 0; index<count; ++index)
+	{
+		const interpolated_surface *from= &previous_tick.platform_heights[index];
+		const interpolated_surface *to= &current_tick.platform_heights[index];
+		const interpolated_surface *now= &saved_world.platform_heights[index];
+		polygon_data *polygon= get_polygon_data(now->polygon_index);
+
+		if (now->floor_height!=to->floor_height || now->ceiling_height!=to->ceiling_height) continue;
+
+		polygon->floor_height= blend_distance(from->floor_height, to->floor_height, fraction);
+		polygon->ceiling_height= blend_distance(from->ceiling_height, to->ceiling_height, fraction);
+	}
+
+	/* then the lines around them, once every platform (some are next to each other) has moved;
+		like adjust_platform_endpoint_and_line_heights(), but leaving solidity and transparency
+		as the tick left them */
+	for (index= 0; index<count; ++index)
+	{
+		polygon_data *polygon= get_polygon_data(saved_world.platform_heights[index].polygon_index);
+
+		for (short i= 0; i<polygon->vertex_count; ++i)
+		{
+			line_data *line= get_line_data(polygon->line_indexes[i]);
+
+			if (polygon->adjacent_polygon_indexes[i]!=NONE)
+			{
+				polygon_data *adjacent_polygon= get_polygon_data(polygon->adjacent_polygon_indexes[i]);
+
+				line->highest_adjacent_floor= MAX(polygon->floor_height, adjacent_polygon->floor_height);
+				line->lowest_adjacent_ceiling= MIN(polygon->ceiling_height, adjacent_polygon->ceiling_height);
+			}
+			else
+			{
+				line->highest_adjacent_floor= polygon->floor_height;
+				line->lowest_adjacent_ceiling= polygon->ceiling_height;
+			}
+		}
+	}
+}
+
+static void blend_lights_and_media(
+	_fixed fraction)
+{
+	size_t count, index;
+
+	count= saved_world.light_intensities.size();
+	if (previous_tick.light_intensities.size()==count && current_tick.light_intensities.size()==count)
+	{
+		for (index= 0; index<count; ++index)
+		{
+			_fixed from= previous_tick.light_intensities[index];
+			_fixed to= current_tick.light_intensities[index];
+
+			if (saved_world.light_intensities[index]!=to) continue;
+			lights[index].intensity= from + (_fixed) (((int64) (to-from)*fraction)>>FIXED_FRACTIONAL_BITS);
+		}
+	}
+
+	count= saved_world.media_heights.size();
+	if (previous_tick.media_heights.size()==count && current_tick.media_heights.size()==count)
+	{
+		for (index= 0; index<count; ++index)
+		{
+			if (saved_world.media_heights[index]!=current_tick.media_heights[index]) continue;
+			medias[index].height= blend_distance(previous_tick.media_heights[index], current_tick.media_heights[index], fraction);
+		}
+	}
+}
+
+static void blend_camera(
+	_fixed fraction)
+{
+	const interpolated_camera *from= &previous_tick.camera;
+	const interpolated_camera *to= &current_tick.camera;
+	const interpolated_camera *now= &saved_world.camera;
+	world_point3d location;
+	short polygon_index;
+
+	if (from->player_index!=to->player_index || now->player_index!=to->player_index) return;
+	if (now->polygon_index!=to->polygon_index || now->facing!=to->facing || now->elevation!=to->elevation ||
+		now->location.x!=to->location.x || now->location.y!=to->location.y || now->location.z!=to->location.z) return;
+
+	location.x= blend_distance(from->location.x, to->location.x, fraction);
+	location.y= blend_distance(from->location.y, to->location.y, fraction);
+	location.z= blend_distance(from->location.z, to->location.z, fraction);
+
+	polygon_index= from->polygon_index;
+	if (from->polygon_index!=to->polygon_index)
+	{
+		world_point2d start= { from->location.x, from->location.y };
+		world_point2d end= { location.x, location.y };
+
+		polygon_index= find_new_object_polygon(&start, &end, from->polygon_index);
+		if (polygon_index==NONE) return; /* teleported, or through something we can't walk */
+	}
+
+	current_player->camera_location= location;
+	current_player->camera_polygon_index= polygon_index;
+	current_player->facing= blend_angle(from->facing, to->facing, fraction);
+	current_player->elevation= blend_angle(from->elevation, to->elevation, fraction);
+	current_player->step_height= blend_distance(from->step_height, to->step_height, fraction);
+}
+
+static inline world_distance blend_distance(
+	world_distance from,
+	world_distance to,
+	_fixed fraction)
+{
+	return from + (world_distance) (((int64) (to-from)*fraction)>>FIXED_FRACTIONAL_BITS);
+}
+
+/* the short way around */
+static inline angle blend_angle(
+	angle from,
+	angle to,
+	_fixed fraction)
+{
+	int32 delta= NORMALIZE_ANGLE(to-from);
+
+	if (delta>HALF_CIRCLE) delta-= FULL_CIRCLE;
+
+	return NORMALIZE_ANGLE(from + (angle) ((delta*fraction)>>FIXED_FRACTIONAL_BITS));
+}
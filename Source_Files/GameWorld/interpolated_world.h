@@ -0,0 +1,81 @@
+#ifndef __INTERPOLATED_WORLD_H
+#define __INTERPOLATED_WORLD_H
+
+/*
+INTERPOLATED_WORLD.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Frames between ticks.  After every world tick the parts of the world the renderers look at
+	(object positions and facings, platform heights, light intensities, media heights and the
+	player's camera) are copied aside, keeping the last two ticks.  When the interpolate frames
+	preference is on, the screen is drawn on every pass through the main loop instead of once
+	per tick: enter_interpolated_world() writes a blend of the two ticks into the world, by how
+	far we are into the next one, and exit_interpolated_world() puts the real values back.
+	The simulation never sees the blended values and is never held up by the frames.
+
+	Objects that changed polygons between the ticks, and anything changed by something other
+	than a tick (cheats, the console), are drawn where they really are.
+
+	Also keeps frame pacing statistics, whether or not frames are interpolated: time between
+	frames, and time from the end of a tick to the first frame that shows it.
+*/
+
+#include "cseries.h"
+
+/* ---------- structures */
+
+struct frame_statistics
+{
+	int32 frame_count, tick_count;
+	int32 interpolated_frame_count; /* frames drawn without a new tick */
+
+	uint64 total_frame_microseconds;
+	uint32 minimum_frame_microseconds, maximum_frame_microseconds;
+
+	int32 latency_count;
+	uint64 total_latency_microseconds;
+	uint32 maximum_latency_microseconds;
+};
+
+/* ---------- prototypes/INTERPOLATED_WORLD.CPP */
+
+/* forget the ticks we have; called when entering a level */
+void reset_interpolated_world(void);
+
+/* called at the end of every real world tick */
+void record_interpolated_world_tick(void);
+
+/* true if frames should be drawn between ticks */
+bool interpolated_world_active(void);
+
+/* true if there's time to draw a frame before the next tick is due, going by how long the
+	last one took; a frame drawn later would hold that tick up */
+bool interpolated_frame_fits(void);
+
+/* bracket render_screen() */
+void enter_interpolated_world(void);
+void exit_interpolated_world(void);
+
+/* called once a frame is on the screen */
+void record_frame_presented(bool new_tick);
+
+const struct frame_statistics *get_frame_statistics(void);
+void reset_frame_statistics(void);
+
+#endif
@@ -492,8 +492,9 @@ bool unretrieved_items_on_map(
 	struct object_data *object;
 	short object_index;
 	
-	for (object_index= 0, object= objects; object_index<MAXIMUM_OBJECTS_PER_MAP; ++object_index, ++object)
+	for (object_index= ObjectSlots.first_used(); object_index!=NONE; object_index= ObjectSlots.next_used(object_index))
 	{
+		object= objects+object_index;
 		if (SLOT_IS_USED(object) && GET_OBJECT_OWNER(object)==_object_is_item)
 		{
 			if (get_item_kind(object->permutation)==_item)
@@ -787,8 +788,9 @@ void animate_items(void) {
 
 	short object_index;
 	object_data *object;
-	for (object_index= 0, object= objects; object_index<MAXIMUM_OBJECTS_PER_MAP; ++object_index, ++object)
+	for (object_index= ObjectSlots.first_used(); object_index!=NONE; object_index= ObjectSlots.next_used(object_index))
 	{
+		object= objects+object_index;
 		if (SLOT_IS_USED(object) && GET_OBJECT_OWNER(object)==_object_is_item && !OBJECT_IS_INVISIBLE(object))
 		{
 			short type = object->permutation;
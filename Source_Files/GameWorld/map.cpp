@@ -102,6 +102,8 @@ find_line_crossed leaving polygon could be sped up considerable by reversing the
 
 #include "cseries.h"
 #include "map.h"
+#include "polygon_visibility.h"
+#include "flood_map.h"
 #include "FilmProfile.h"
 #include "interface.h"
 #include "monsters.h"
@@ -184,6 +186,16 @@ vector<effect_data> EffectList(MAXIMUM_EFFECTS_PER_MAP);
 vector<object_data> ObjectList(MAXIMUM_OBJECTS_PER_MAP);
 vector<monster_data> MonsterList(MAXIMUM_MONSTERS_PER_MAP);
 vector<projectile_data> ProjectileList(MAXIMUM_PROJECTILES_PER_MAP);
+
+// Which slots of the above are in use
+slot_pool EffectSlots;
+slot_pool ObjectSlots;
+slot_pool MonsterSlots;
+slot_pool ProjectileSlots;
+
+// Monsters and scenery on each polygon's object list
+vector<int16> PolygonFirstObstacle;
+vector<int16> ObjectNextObstacle;
 // struct object_data *objects = NULL;
 // struct monster_data *monsters = NULL;
 // struct projectile_data *projectiles = NULL;
@@ -255,6 +267,11 @@ inline void add_object_to_polygon_object_list(short object_index)
 
 short _find_line_crossed_leaving_polygon(short polygon_index, world_point2d *p0, world_point2d *p1, bool *last_line);
 
+static bool object_is_obstacle(struct object_data *object);
+static void link_obstacle(short object_index, short polygon_index);
+static void unlink_obstacle(short object_index, short polygon_index);
+static void rebuild_polygon_obstacle_list(short polygon_index);
+
 /* ---------- code */
 
 // Accessors moved here to shrink the code
@@ -412,6 +429,8 @@ void initialize_map_for_new_level(
 
 	obj_clear(*static_world);
 	Console::instance()->clear_saves();
+	invalidate_polygon_location_index();
+	invalidate_polygon_visibility();
 	
 	// Clear all these out -- supposed to be none of the contents of these when starting a level.
 	objlist_clear(automap_lines, AutomapLineList.size());
@@ -420,6 +439,12 @@ void initialize_map_for_new_level(
 	objlist_clear(projectiles,  ProjectileList.size());
 	objlist_clear(monsters,  MonsterList.size());
 	objlist_clear(objects,  ObjectList.size());
+	EffectSlots.reset(EffectList.size());
+	ProjectileSlots.reset(ProjectileList.size());
+	MonsterSlots.reset(MonsterList.size());
+	ObjectSlots.reset(ObjectList.size());
+	PolygonFirstObstacle.clear();
+	ObjectNextObstacle.assign(ObjectList.size(), NONE);
 
 	/* Note that these pointers just point into a larger structure, so this is not a bad thing */
 	// map_polygons= NULL;
@@ -651,6 +676,9 @@ void reconnect_map_object_list(
 			polygon->first_object= i;
 		}
 	}
+	
+	rebuild_obstacle_lists();
+	invalidate_path_cache();
 }
 
 bool valid_point2d(
@@ -736,6 +764,10 @@ short new_map_object3d(
 		/* insert at head of linked list */
 		object->next_object= polygon->first_object;
 		polygon->first_object= object_index;
+		if (object_is_obstacle(object)) link_obstacle(object_index, polygon_index);
+		
+		/* nobody owns it yet, but it may be about to become a monster */
+		invalidate_paths_through_polygon(polygon_index);
 	}
 	
 	return object_index;
@@ -801,6 +833,7 @@ void remove_parasitic_object(
 	struct object_data *host= get_object_data(host_index);
 	struct object_data *parasite= get_object_data(host->parasitic_object);
 
+	ObjectSlots.mark_free(host->parasitic_object);
 	host->parasitic_object= NONE;
 	MARK_SLOT_AS_FREE(parasite);
 }
@@ -821,12 +854,43 @@ void remove_map_object(
 		struct object_data *parasite= get_object_data(object->parasitic_object);
 		
 		MARK_SLOT_AS_FREE(parasite);
+		ObjectSlots.mark_free(object->parasitic_object);
 	}
 
 	SoundManager::instance()->OrphanSound(object_index);
 	L_Invalidate_Object(object_index);
 	*next_object= object->next_object;
+	if (object_is_obstacle(object)) unlink_obstacle(object_index, object->polygon);
+	if (GET_OBJECT_OWNER(object)==_object_is_monster) invalidate_paths_through_polygon(object->polygon);
 	MARK_SLOT_AS_FREE(object);
+	ObjectSlots.mark_free(object_index);
+}
+
+/* owners change after the object is already on its polygon's list (monsters, scenery and so on
+	are made from normal objects, and dead monsters turn into garbage), so this has to keep the
+	obstacle list up to date */
+void set_object_owner(
+	struct object_data *object,
+	short owner)
+{
+	bool was_obstacle= object_is_obstacle(object);
+	
+	assert(owner>=0&&owner<=7);
+	object->flags&= (uint16)~7;
+	object->flags|= owner;
+	
+	if (object->polygon!=NONE && was_obstacle!=object_is_obstacle(object)) rebuild_polygon_obstacle_list(object->polygon);
+}
+
+void rebuild_obstacle_lists(
+	void)
+{
+	PolygonFirstObstacle.assign(dynamic_world->polygon_count, NONE);
+	ObjectNextObstacle.assign(MAXIMUM_OBJECTS_PER_MAP, NONE);
+	for (short polygon_index= 0; polygon_index<dynamic_world->polygon_count; ++polygon_index)
+	{
+		rebuild_polygon_obstacle_list(polygon_index);
+	}
 }
 
 
@@ -850,6 +914,8 @@ remove_object_from_polygon_object_list(short object_index, short polygon_index)
 
 	*next_object= object->next_object;
 
+	if (object_is_obstacle(object)) unlink_obstacle(object_index, polygon_index);
+	if (GET_OBJECT_OWNER(object)==_object_is_monster) invalidate_paths_through_polygon(polygon_index);
 	object->polygon= NONE;
 }
 
@@ -871,6 +937,8 @@ add_object_to_polygon_object_list(short object_index, short polygon_index)
 	object->next_object= polygon->first_object;
 	polygon->first_object= object_index;
 
+	if (object_is_obstacle(object)) link_obstacle(object_index, polygon_index);
+	if (GET_OBJECT_OWNER(object)==_object_is_monster) invalidate_paths_through_polygon(polygon_index);
 	object->polygon= polygon_index;
 }
 
@@ -913,6 +981,11 @@ perform_deferred_polygon_object_list_manipulations()
 					object->next_object = *next_object_index_p;
 					*next_object_index_p = object_to_insert_index;
 					inserted = true;
+
+					if (object_is_obstacle(object))
+						rebuild_polygon_obstacle_list(object->polygon);
+					if (GET_OBJECT_OWNER(object) == _object_is_monster)
+						invalidate_paths_through_polygon(object->polygon);
 				}
 
 				if(*next_object_index_p == NONE)
@@ -1352,6 +1425,19 @@ short world_point_to_polygon_index(
 	world_point2d *location)
 {
 	short polygon_index;
+	
+	if (!polygon_location_index_lookup(location, &polygon_index))
+	{
+		polygon_index= scan_world_point_to_polygon_index(location);
+	}
+	
+	return polygon_index;
+}
+
+short scan_world_point_to_polygon_index(
+	world_point2d *location)
+{
+	short polygon_index;
 	struct polygon_data *polygon;
 	
 	for (polygon_index=0,polygon=map_polygons;polygon_index<dynamic_world->polygon_count;++polygon_index,++polygon)
@@ -2007,38 +2093,15 @@ struct map_annotation *get_next_map_annotation(
 void recalculate_map_counts(
 	void)
 {
-	struct object_data *object;
-	struct monster_data *monster;
-	struct projectile_data *projectile;
-	struct effect_data *effect;
 	struct light_data *light;
 	size_t count;
 	
 	// LP: fixed serious bug in the counting logic
 	
-	for (count=MAXIMUM_OBJECTS_PER_MAP,object=objects+MAXIMUM_OBJECTS_PER_MAP-1;
-			count>0&&(!SLOT_IS_USED(object));
-			--count,--object)
-		;
-	dynamic_world->object_count= static_cast<int16>(count);
-	
-	for (count=MAXIMUM_MONSTERS_PER_MAP,monster=monsters+MAXIMUM_MONSTERS_PER_MAP-1;
-			count>0&&(!SLOT_IS_USED(monster));
-			--count,--monster)
-		;
-	dynamic_world->monster_count= static_cast<int16>(count);
-	
-	for (count=MAXIMUM_PROJECTILES_PER_MAP,projectile=projectiles+MAXIMUM_PROJECTILES_PER_MAP-1;
-			count>0&&(!SLOT_IS_USED(projectile));
-			--count,--projectile)
-		;
-	dynamic_world->projectile_count= static_cast<int16>(count);
-	
-	for (count=MAXIMUM_EFFECTS_PER_MAP,effect=effects+MAXIMUM_EFFECTS_PER_MAP-1;
-			count>0&&(!SLOT_IS_USED(effect));
-			--count,--effect)
-		;
-	dynamic_world->effect_count= static_cast<int16>(count);
+	dynamic_world->object_count= ObjectSlots.last_used()+1;
+	dynamic_world->monster_count= MonsterSlots.last_used()+1;
+	dynamic_world->projectile_count= ProjectileSlots.last_used()+1;
+	dynamic_world->effect_count= EffectSlots.last_used()+1;
 	
 	for (count=MAXIMUM_LIGHTS_PER_MAP,light=lights+MAXIMUM_LIGHTS_PER_MAP-1;
 			count>0&&(!SLOT_IS_USED(light));
@@ -2173,6 +2236,13 @@ bool line_is_obstructed(
 	bool obstructed= false;
 	short line_index;
 	
+	/* the visibility sets follow the fixed walk, endpoint rule and all */
+	if (film_profile.line_is_obstructed_fix && film_profile.visibility_sets_reject_sightlines &&
+		polygon_visibility_rejects_sightline(polygon_index1, p1, polygon_index2, p2))
+	{
+		return true;
+	}
+	
 	do
 	{
 		bool last_line = false;
@@ -2289,6 +2359,7 @@ void turn_object_to_shit( /* garbage that is, garbage */
 		}
 	}
 	
+	if (GET_OBJECT_OWNER(garbage_object)==_object_is_monster) invalidate_paths_through_polygon(garbage_object->polygon);
 	SET_OBJECT_OWNER(garbage_object, _object_is_garbage);
 }
 
@@ -2360,6 +2431,63 @@ short _find_line_crossed_leaving_polygon(
 	return intersected_line_index;
 }
 
+static bool object_is_obstacle(
+	struct object_data *object)
+{
+	switch (GET_OBJECT_OWNER(object))
+	{
+		case _object_is_monster:
+		case _object_is_scenery:
+			return true;
+	}
+	
+	return false;
+}
+
+/* the object was just put at the head of the polygon's object list */
+static void link_obstacle(
+	short object_index,
+	short polygon_index)
+{
+	if (polygon_index>=(short)PolygonFirstObstacle.size()) PolygonFirstObstacle.resize(polygon_index+1, NONE);
+	
+	ObjectNextObstacle[object_index]= PolygonFirstObstacle[polygon_index];
+	PolygonFirstObstacle[polygon_index]= object_index;
+}
+
+static void unlink_obstacle(
+	short object_index,
+	short polygon_index)
+{
+	if (polygon_index<(short)PolygonFirstObstacle.size())
+	{
+		int16 *next_obstacle= &PolygonFirstObstacle[polygon_index];
+		
+		while (*next_obstacle!=NONE && *next_obstacle!=object_index) next_obstacle= &ObjectNextObstacle[*next_obstacle];
+		if (*next_obstacle!=NONE) *next_obstacle= ObjectNextObstacle[object_index];
+	}
+}
+
+static void rebuild_polygon_obstacle_list(
+	short polygon_index)
+{
+	int16 *next_obstacle;
+	short object_index;
+	
+	if (polygon_index>=(short)PolygonFirstObstacle.size()) PolygonFirstObstacle.resize(polygon_index+1, NONE);
+	
+	next_obstacle= &PolygonFirstObstacle[polygon_index];
+	for (object_index= get_polygon_data(polygon_index)->first_object; object_index!=NONE; object_index= objects[object_index].next_object)
+	{
+		if (object_is_obstacle(objects+object_index))
+		{
+			*next_obstacle= object_index;
+			next_obstacle= &ObjectNextObstacle[object_index];
+		}
+	}
+	*next_obstacle= NONE;
+}
+
 static short _new_map_object(
 	shape_descriptor shape,
 	angle facing)
@@ -2367,8 +2495,10 @@ static short _new_map_object(
 	struct object_data *object;
 	short object_index;
 	
-	for (object_index=0,object=objects;object_index<MAXIMUM_OBJECTS_PER_MAP;++object_index,++object)
+	object_index= ObjectSlots.first_free();
+	if (object_index!=NONE)
 	{
+		object= objects+object_index;
 		if (SLOT_IS_FREE(object))
 		{
 			/* initialize the object_data structure.  the defaults result in a normal (i.e., scenery),
@@ -2386,17 +2516,19 @@ static short _new_map_object(
 			object->sound_pitch= FIXED_ONE;
 			
 			MARK_SLOT_AS_USED(object);
+			ObjectSlots.mark_used(object_index);
 				
 			/* Objects with a shape of UNONE are invisible. */
 			if(shape==UNONE)
 			{
 				SET_OBJECT_INVISIBILITY(object, true);
 			}
-	
-			break;
+		}
+		else
+		{
+			object_index= NONE;
 		}
 	}
-	if (object_index==MAXIMUM_OBJECTS_PER_MAP) object_index= NONE;
 	
 	return object_index;
 }
@@ -56,6 +56,7 @@ Nov 19, 2000 (Loren Petrich):
 #include "csmacros.h"
 #include "world.h"
 #include "dynamic_limits.h"
+#include "slot_pool.h"
 
 #include <vector>
 
@@ -367,7 +368,7 @@ enum /* object scale flags */
 #define TOGGLE_OBJECT_STATUS(o) ((o)->flags^=(uint16)8)
 
 #define GET_OBJECT_OWNER(o) ((o)->flags&(uint16)7)
-#define SET_OBJECT_OWNER(o,n) { assert((n)>=0&&(n)<=7); (o)->flags&= (uint16)~7; (o)->flags|= (n); }
+#define SET_OBJECT_OWNER(o,n) set_object_owner((o),(n))
 enum /* object owners (8) */
 {
 	_object_is_normal, /* normal */
@@ -993,6 +994,7 @@ extern struct dynamic_data *dynamic_world;
 
 extern vector<object_data> ObjectList;
 #define objects (ObjectList.data())
+extern slot_pool ObjectSlots;
 
 // extern struct object_data *objects;
 
@@ -1086,6 +1088,36 @@ std::pair<bool, int16> update_world(void);
 void reset_intermediate_action_queues();
 void set_prediction_wanted(bool inPrediction);
 
+/* where the time in update_world() goes, for the headless replay benchmark */
+enum /* world update timers */
+{
+	_update_timer_lua,
+	_update_timer_lights,
+	_update_timer_media,
+	_update_timer_platforms,
+	_update_timer_control_panels,
+	_update_timer_players,
+	_update_timer_projectiles,
+	_update_timer_monsters,
+	_update_timer_effects,
+	_update_timer_objects,
+	_update_timer_scenery,
+	_update_timer_other,
+	_update_timer_world_hash,
+	NUMBER_OF_WORLD_UPDATE_TIMERS
+};
+
+struct world_update_timing
+{
+	int32 tick_count;
+	uint64 microseconds[NUMBER_OF_WORLD_UPDATE_TIMERS];
+};
+
+/* turning timing on clears the totals; turning it off keeps them for reading */
+void set_world_update_timing(bool enabled);
+const struct world_update_timing *get_world_update_timing(void);
+const char *get_world_update_timer_name(short timer);
+
 /* Called to activate lights, platforms, etc. (original polygon may be NONE) */
 void changed_polygon(short original_polygon_index, short new_polygon_index, short player_index);
 
@@ -1116,6 +1148,16 @@ void remove_parasitic_object(short host_index);
 bool translate_map_object(short object_index, world_point3d *new_location, short new_polygon_index);
 short find_new_object_polygon(world_point2d *parent_location, world_point2d *child_location, short parent_polygon_index);
 void remove_map_object(short index);
+void set_object_owner(struct object_data *object, short owner);
+
+/* each polygon also keeps the monsters and scenery from its object list, in the same order, on a
+	list of obstacles; walk it with get_polygon_first_obstacle() and get_next_obstacle() */
+extern vector<int16> PolygonFirstObstacle;
+extern vector<int16> ObjectNextObstacle;
+inline short get_polygon_first_obstacle(short polygon_index)
+{ return polygon_index<(short)PolygonFirstObstacle.size() ? PolygonFirstObstacle[polygon_index] : NONE; }
+inline short get_next_obstacle(short object_index) { return ObjectNextObstacle[object_index]; }
+void rebuild_obstacle_lists(void);
 
 
 // ZZZ additions in support of prediction:
@@ -1168,6 +1210,7 @@ void initialize_map_for_new_player(void);
 void generate_map(short level);
 
 short world_point_to_polygon_index(world_point2d *location);
+short scan_world_point_to_polygon_index(world_point2d *location); /* same answer, without the location index */
 short clockwise_endpoint_in_line(short polygon_index, short line_index, short index);
 
 short find_adjacent_polygon(short polygon_index, short line_index);
@@ -1264,6 +1307,20 @@ short new_side(short polygon_index, short line_index);
 
 void precalculate_map_indexes(void);
 
+struct polygon_location_index_benchmark
+{
+	int32 sample_count, mismatch_count;
+	int32 unbounded_polygon_count;
+	uint64 scan_microseconds, index_microseconds;
+};
+
+void precalculate_polygon_location_index(void);
+void invalidate_polygon_location_index(void);
+bool polygon_location_index_lookup(world_point2d *location, short *polygon_index);
+void benchmark_polygon_location_index(int32 sample_count, struct polygon_location_index_benchmark *results);
+/* convex, consistently wound and small enough for point_in_polygon() to be exact */
+bool polygon_is_bounded(short polygon_index, world_point2d *minimum, world_point2d *maximum);
+
 void touch_polygon(short polygon_index);
 void recalculate_redundant_polygon_data(short polygon_index);
 void recalculate_redundant_endpoint_data(short endpoint_index);
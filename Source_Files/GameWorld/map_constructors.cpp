@@ -1176,6 +1176,298 @@ static void precalculate_polygon_sound_sources(
 	}
 }
 
+/* ---------- polygon location index */
+
+/* world_point_to_polygon_index() used to test every polygon on the map.  at level load we bucket
+	polygons by bounding box into a uniform grid, so a lookup only tests the polygons whose bounds
+	cover the query cell.  to give exactly the answer of the linear scan, candidates are tested
+	in ascending polygon order, and any polygon whose point_in_polygon() test isn't provably
+	confined to its bounding box (not convex, badly wound, broken, or big enough for the cross
+	product to overflow) is kept on a side list that every lookup tests as well.
+	the grid is purely two-dimensional: height changes don't affect it, and detached polygons
+	are skipped at lookup time, just as the linear scan does. */
+
+#define MINIMUM_LOCATION_CELL_SHIFT 7 /* 1/8 WORLD_ONE */
+#define MAXIMUM_LOCATION_CELL_SHIFT 16
+#define MAXIMUM_LOCATION_EDGE_DELTA (16*KILO) /* keeps point_in_polygon() inside int32 for any int16 point */
+
+struct polygon_location_index_data
+{
+	bool valid;
+	
+	world_point2d origin;
+	int16 cell_shift;
+	int32 columns, rows;
+	
+	/* cell i holds cell_polygon_indexes[cell_first_indexes[i]] .. [cell_first_indexes[i+1]-1], ascending */
+	vector<int32> cell_first_indexes;
+	vector<short> cell_polygon_indexes;
+	
+	/* ascending; tested by every lookup */
+	vector<short> unbounded_polygon_indexes;
+};
+
+static struct polygon_location_index_data polygon_location_index;
+
+void invalidate_polygon_location_index(
+	void)
+{
+	polygon_location_index.valid= false;
+	polygon_location_index.cell_first_indexes.clear();
+	polygon_location_index.cell_polygon_indexes.clear();
+	polygon_location_index.unbounded_polygon_indexes.clear();
+}
+
+void precalculate_polygon_location_index(
+	void)
+{
+	struct polygon_location_index_data& index= polygon_location_index;
+	vector<world_point2d> minimums(dynamic_world->polygon_count), maximums(dynamic_world->polygon_count);
+	vector<bool> bounded(dynamic_world->polygon_count);
+	world_point2d lo= {INT16_MAX, INT16_MAX}, hi= {INT16_MIN, INT16_MIN};
+	int32 bounded_count= 0;
+	short polygon_index;
+	
+	invalidate_polygon_location_index();
+	
+	for (polygon_index= 0; polygon_index<dynamic_world->polygon_count; ++polygon_index)
+	{
+		bounded[polygon_index]= polygon_is_bounded(polygon_index, &minimums[polygon_index], &maximums[polygon_index]);
+		if (bounded[polygon_index])
+		{
+			lo.x= MIN(lo.x, minimums[polygon_index].x), lo.y= MIN(lo.y, minimums[polygon_index].y);
+			hi.x= MAX(hi.x, maximums[polygon_index].x), hi.y= MAX(hi.y, maximums[polygon_index].y);
+			bounded_count+= 1;
+		}
+		else
+		{
+			index.unbounded_polygon_indexes.push_back(polygon_index);
+		}
+	}
+	
+	index.origin= lo;
+	index.cell_shift= MINIMUM_LOCATION_CELL_SHIFT;
+	index.columns= index.rows= 0;
+	if (bounded_count)
+	{
+		/* grow the cells until there are about two per polygon */
+		for (;;)
+		{
+			index.columns= ((hi.x-lo.x)>>index.cell_shift) + 1;
+			index.rows= ((hi.y-lo.y)>>index.cell_shift) + 1;
+			if (index.columns*index.rows<=2*bounded_count || index.cell_shift==MAXIMUM_LOCATION_CELL_SHIFT) break;
+			index.cell_shift+= 1;
+		}
+	}
+	
+	/* count, then fill in polygon order so every cell comes out sorted */
+	index.cell_first_indexes.assign(index.columns*index.rows + 1, 0);
+	for (int pass= 0; pass<2; ++pass)
+	{
+		vector<int32> cursors;
+		
+		if (pass) cursors.assign(index.cell_first_indexes.begin(), index.cell_first_indexes.end()-1);
+		for (polygon_index= 0; polygon_index<dynamic_world->polygon_count; ++polygon_index)
+		{
+			if (!bounded[polygon_index]) continue;
+			
+			int32 column0= (minimums[polygon_index].x-lo.x)>>index.cell_shift, column1= (maximums[polygon_index].x-lo.x)>>index.cell_shift;
+			int32 row0= (minimums[polygon_index].y-lo.y)>>index.cell_shift, row1= (maximums[polygon_index].y-lo.y)>>index.cell_shift;
+			
+			for (int32 row= row0; row<=row1; ++row)
+			{
+				for (int32 column= column0; column<=column1; ++column)
+				{
+					int32 cell= row*index.columns + column;
+					
+					if (pass) index.cell_polygon_indexes[cursors[cell]++]= polygon_index;
+					else index.cell_first_indexes[cell+1]+= 1;
+				}
+			}
+		}
+		
+		if (!pass)
+		{
+			for (size_t cell= 1; cell<index.cell_first_indexes.size(); ++cell)
+			{
+				index.cell_first_indexes[cell]+= index.cell_first_indexes[cell-1];
+			}
+			index.cell_polygon_indexes.resize(index.cell_first_indexes.back());
+		}
+	}
+	
+	index.valid= true;
+}
+
+/* returns false if there is no index to look in; *polygon_index is then untouched */
+bool polygon_location_index_lookup(
+	world_point2d *location,
+	short *polygon_index)
+{
+	struct polygon_location_index_data& index= polygon_location_index;
+	const short *candidates= NULL, *unbounded;
+	size_t candidate_count= 0, unbounded_count;
+	
+	if (!index.valid) return false;
+	
+	int32 column= location->x - index.origin.x, row= location->y - index.origin.y;
+	if (column>=0 && row>=0)
+	{
+		column>>= index.cell_shift, row>>= index.cell_shift;
+		if (column<index.columns && row<index.rows)
+		{
+			int32 cell= row*index.columns + column;
+			
+			candidate_count= index.cell_first_indexes[cell+1] - index.cell_first_indexes[cell];
+			if (candidate_count) candidates= &index.cell_polygon_indexes[index.cell_first_indexes[cell]];
+		}
+	}
+	unbounded_count= index.unbounded_polygon_indexes.size();
+	unbounded= unbounded_count ? &index.unbounded_polygon_indexes[0] : NULL;
+	
+	/* merge the two ascending lists, so the lowest containing polygon wins as in the linear scan */
+	while (candidate_count || unbounded_count)
+	{
+		short candidate_index;
+		
+		if (!unbounded_count || (candidate_count && *candidates<*unbounded))
+		{
+			candidate_index= *candidates++, candidate_count-= 1;
+		}
+		else
+		{
+			candidate_index= *unbounded++, unbounded_count-= 1;
+		}
+		
+		if (!POLYGON_IS_DETACHED(get_polygon_data(candidate_index)) && point_in_polygon(candidate_index, location))
+		{
+			*polygon_index= candidate_index;
+			return true;
+		}
+	}
+	
+	*polygon_index= NONE;
+	return true;
+}
+
+/* times world_point_to_polygon_index() with and without the index over sample_count pseudorandom
+	points around the map plus every polygon center, and counts disagreements between the two */
+void benchmark_polygon_location_index(
+	int32 sample_count,
+	struct polygon_location_index_benchmark *results)
+{
+	vector<world_point2d> samples;
+	vector<short> scanned, indexed;
+	world_point2d lo= {INT16_MAX, INT16_MAX}, hi= {INT16_MIN, INT16_MIN};
+	uint32 seed= 0x1234;
+	short index;
+	
+	obj_clear(*results);
+	if (!polygon_location_index.valid || !dynamic_world->endpoint_count) return;
+	
+	for (index= 0; index<dynamic_world->endpoint_count; ++index)
+	{
+		world_point2d *vertex= &get_endpoint_data(index)->vertex;
+		
+		lo.x= MIN(lo.x, vertex->x), lo.y= MIN(lo.y, vertex->y);
+		hi.x= MAX(hi.x, vertex->x), hi.y= MAX(hi.y, vertex->y);
+	}
+	
+	/* our own generator, so the game's random seed isn't disturbed */
+	for (int32 i= 0; i<sample_count; ++i)
+	{
+		world_point2d p;
+		
+		seed= seed*1664525 + 1013904223;
+		p.x= lo.x + (world_distance)((seed>>8)%(hi.x-lo.x+1));
+		seed= seed*1664525 + 1013904223;
+		p.y= lo.y + (world_distance)((seed>>8)%(hi.y-lo.y+1));
+		samples.push_back(p);
+	}
+	for (index= 0; index<dynamic_world->polygon_count; ++index)
+	{
+		samples.push_back(get_polygon_data(index)->center);
+	}
+	
+	scanned.resize(samples.size());
+	indexed.resize(samples.size());
+	
+	uint64 start= machine_microsecond_count();
+	for (size_t i= 0; i<samples.size(); ++i)
+	{
+		scanned[i]= scan_world_point_to_polygon_index(&samples[i]);
+	}
+	results->scan_microseconds= machine_microsecond_count() - start;
+	
+	start= machine_microsecond_count();
+	for (size_t i= 0; i<samples.size(); ++i)
+	{
+		polygon_location_index_lookup(&samples[i], &indexed[i]);
+	}
+	results->index_microseconds= machine_microsecond_count() - start;
+	
+	results->sample_count= samples.size();
+	for (size_t i= 0; i<samples.size(); ++i)
+	{
+		if (scanned[i]!=indexed[i]) results->mismatch_count+= 1;
+	}
+	results->unbounded_polygon_count= polygon_location_index.unbounded_polygon_indexes.size();
+}
+
+/* true if point_in_polygon() can only succeed inside the polygon's bounding box, which it
+	then returns; this holds for a convex polygon whose lines run clockwise around its endpoints */
+bool polygon_is_bounded(
+	short polygon_index,
+	world_point2d *minimum,
+	world_point2d *maximum)
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	int64 doubled_area= 0;
+	short i;
+	
+	if (polygon->vertex_count<3 || polygon->vertex_count>MAXIMUM_VERTICES_PER_POLYGON) return false;
+	
+	for (i= 0; i<polygon->vertex_count; ++i)
+	{
+		short e0= polygon->endpoint_indexes[i];
+		short e1= polygon->endpoint_indexes[(i+1)%polygon->vertex_count];
+		short line_index= polygon->line_indexes[i];
+		
+		if (e0<0 || e0>=dynamic_world->endpoint_count || e1<0 || e1>=dynamic_world->endpoint_count) return false;
+		if (line_index<0 || line_index>=dynamic_world->line_count) return false;
+		
+		/* point_in_polygon() decides each line's direction from its first endpoint alone */
+		struct line_data *line= get_line_data(line_index);
+		if (line->endpoint_indexes[0]==e0 ? line->endpoint_indexes[1]!=e1 :
+			(line->endpoint_indexes[0]!=e1 || line->endpoint_indexes[1]!=e0)) return false;
+		
+		world_point2d *p0= &get_endpoint_data(e0)->vertex;
+		world_point2d *p1= &get_endpoint_data(e1)->vertex;
+		if (ABS(p1->x-p0->x)>MAXIMUM_LOCATION_EDGE_DELTA || ABS(p1->y-p0->y)>MAXIMUM_LOCATION_EDGE_DELTA) return false;
+		
+		doubled_area+= (int64)p0->x*p1->y - (int64)p1->x*p0->y;
+		if (i)
+		{
+			minimum->x= MIN(minimum->x, p0->x), minimum->y= MIN(minimum->y, p0->y);
+			maximum->x= MAX(maximum->x, p0->x), maximum->y= MAX(maximum->y, p0->y);
+		}
+		else
+		{
+			*minimum= *maximum= *p0;
+		}
+	}
+	if (!doubled_area) return false;
+	
+	/* with every endpoint on the inside of every line, the lines can only wind around the
+		convex hull of the endpoints, so nothing outside it can pass the test */
+	for (i= 0; i<polygon->vertex_count; ++i)
+	{
+		if (!point_in_polygon(polygon_index, &get_endpoint_data(polygon->endpoint_indexes[i])->vertex)) return false;
+	}
+	
+	return true;
+}
+
 uint8 *unpack_endpoint_data(uint8 *Stream, endpoint_data *Objects, size_t Count)
 {
 	uint8* S = Stream;
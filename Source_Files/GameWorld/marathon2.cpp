@@ -80,6 +80,9 @@ Feb 8, 2003 (Woody Zenfell):
 #include "interface.h"
 #include "FilmProfile.h"
 #include "flood_map.h"
+#include "world_snapshot.h"
+#include "world_hash.h"
+#include "interpolated_world.h"
 #include "effects.h"
 #include "monsters.h"
 #include "projectiles.h"
@@ -194,39 +197,22 @@ set_prediction_wanted(bool inPrediction)
 	sPredictionWanted= inPrediction;
 }
 
-static player_data sSavedPlayerData[MAXIMUM_NUMBER_OF_PLAYERS];
-static monster_data sSavedPlayerMonsterData[MAXIMUM_NUMBER_OF_PLAYERS];
-static object_data sSavedPlayerObjectData[MAXIMUM_NUMBER_OF_PLAYERS];
-static object_data sSavedPlayerParasiticObjectData[MAXIMUM_NUMBER_OF_PLAYERS];
-static short sSavedPlayerObjectNextObject[MAXIMUM_NUMBER_OF_PLAYERS];
+// The whole world as it was before we started predicting; prediction runs real game code on
+// guessed input, so anything at all may have changed by the time we come back.
+static world_snapshot sPredictionSnapshot;
 
 // For sanity-checking...
 static int32 sSavedTickCount;
 static uint16 sSavedRandomSeed;
 
-
-// ZZZ: If not already in predictive mode, save off partial game-state for later restoration.
+// ZZZ: If not already in predictive mode, save off the game-state for later restoration.
 static void
 enter_predictive_mode()
 {
 	if(sPredictedTicks == 0)
 	{
-		for(short i = 0; i < dynamic_world->player_count; i++)
-		{
-			sSavedPlayerData[i] = *get_player_data(i);
-			if(sSavedPlayerData[i].monster_index != NONE)
-			{
-				sSavedPlayerMonsterData[i] = *get_monster_data(sSavedPlayerData[i].monster_index);
-				if(sSavedPlayerMonsterData[i].object_index != NONE)
-				{
-					sSavedPlayerObjectData[i] = *get_object_data(sSavedPlayerMonsterData[i].object_index);
-					sSavedPlayerObjectNextObject[i] = sSavedPlayerObjectData[i].next_object;
-					if(sSavedPlayerObjectData[i].parasitic_object != NONE)
-						sSavedPlayerParasiticObjectData[i] = *get_object_data(sSavedPlayerObjectData[i].parasitic_object);
-				}
-			}
-		}
-		
+		take_world_snapshot(&sPredictionSnapshot);
+
 		// Sanity checking
 		sSavedTickCount = dynamic_world->tick_count;
 		sSavedRandomSeed = get_random_seed();
@@ -272,61 +258,38 @@ compare_memory(const char* inChunk1, const char* inChunk2, size_t inSize, size_t
 }
 #endif
 
-// ZZZ: if in predictive mode, restore the saved partial game-state (it'd better take us back
+// ZZZ: if in predictive mode, restore the saved game-state (it'd better take us back
 // to _exactly_ the same full game-state we saved earlier, else problems.)
 static void
 exit_predictive_mode()
 {
 	if(sPredictedTicks > 0)
 	{
+		// We *don't* restore this tiny part of the game-state back because
+		// otherwise the player can't use [] to scroll the inventory panel.
+		// [] scrolling happens outside the normal input/update system, so that's
+		// enough to persuade me that not restoring this won't OOS any more often
+		// than []-scrolling did before prediction.  :)
+		int16 saved_interface_flags[MAXIMUM_NUMBER_OF_PLAYERS];
+		int16 saved_interface_decay[MAXIMUM_NUMBER_OF_PLAYERS];
+
 		for(short i = 0; i < dynamic_world->player_count; i++)
 		{
 			player_data* player = get_player_data(i);
-			
-			assert(player->monster_index == sSavedPlayerData[i].monster_index);
+			saved_interface_flags[i] = player->interface_flags;
+			saved_interface_decay[i] = player->interface_decay;
+		}
 
-			{
-				// We *don't* restore this tiny part of the game-state back because
-				// otherwise the player can't use [] to scroll the inventory panel.
-				// [] scrolling happens outside the normal input/update system, so that's
-				// enough to persuade me that not restoring this won't OOS any more often
-				// than []-scrolling did before prediction.  :)
-				int16 saved_interface_flags = player->interface_flags;
-				int16 saved_interface_decay = player->interface_decay;
-				
-				*player = sSavedPlayerData[i];
-
-				player->interface_flags = saved_interface_flags;
-				player->interface_decay = saved_interface_decay;
-			}
+		if(!restore_world_snapshot(&sPredictionSnapshot))
+			logError("couldn't restore the world from before prediction");
 
-			if(sSavedPlayerData[i].monster_index != NONE)
-			{
-				assert(get_monster_data(sSavedPlayerData[i].monster_index)->object_index == sSavedPlayerMonsterData[i].object_index);
-
-				*get_monster_data(sSavedPlayerData[i].monster_index) = sSavedPlayerMonsterData[i];
-				
-				if(sSavedPlayerMonsterData[i].object_index != NONE)
-				{
-					assert(get_object_data(sSavedPlayerMonsterData[i].object_index)->parasitic_object == sSavedPlayerObjectData[i].parasitic_object);
-
-					remove_object_from_polygon_object_list(sSavedPlayerMonsterData[i].object_index);
-					
-					*get_object_data(sSavedPlayerMonsterData[i].object_index) = sSavedPlayerObjectData[i];
-
-					// We have to defer this insertion since the object lists could still have other players
-					// in their predictive locations etc. - we need to reconstruct everything exactly as it
-					// was when we entered predictive mode.
-					deferred_add_object_to_polygon_object_list(sSavedPlayerMonsterData[i].object_index, sSavedPlayerObjectNextObject[i]);
-					
-					if(sSavedPlayerObjectData[i].parasitic_object != NONE)
-						*get_object_data(sSavedPlayerObjectData[i].parasitic_object) = sSavedPlayerParasiticObjectData[i];
-				}
-			}
+		for(short i = 0; i < dynamic_world->player_count; i++)
+		{
+			player_data* player = get_player_data(i);
+			player->interface_flags = saved_interface_flags[i];
+			player->interface_decay = saved_interface_decay[i];
 		}
 
-		perform_deferred_polygon_object_list_manipulations();
-		
 		sPredictedTicks = 0;
 
 		// Sanity checking
@@ -377,6 +340,98 @@ overlay_queue_with_queue_into_queue(ActionQueues* inBaseQueues, ActionQueues* in
 }
 
 
+// Hash the world at the end of every tick, so films and network games can tell exactly when
+// they stopped agreeing with each other.
+static void
+check_world_hash()
+{
+	update_world_hash();
+	const world_hash* hash = get_world_hash();
+
+	if (!record_or_check_film_world_hash(hash->combined))
+	{
+		logError("film replay no longer matches its recording at tick %d of level %d", hash->tick, dynamic_world->current_level_number);
+		screen_printf("Film out of sync at tick %d", hash->tick);
+	}
+
+#if !defined(DISABLE_NETWORKING)
+	if (game_is_networked)
+	{
+		int32 divergent_tick;
+		int16 divergent_subsystem;
+		uint32 divergent_players;
+
+		NetReportWorldHash(hash->tick, hash->subsystems, NUMBER_OF_WORLD_HASH_SUBSYSTEMS);
+		if (NetGetWorldHashDivergence(divergent_tick, divergent_subsystem, divergent_players))
+		{
+			logError("network game out of sync at tick %d: %s differ (players 0x%x)", divergent_tick, get_world_hash_subsystem_name(divergent_subsystem), divergent_players);
+			screen_printf("Out of sync at tick %d: %s differ", divergent_tick, get_world_hash_subsystem_name(divergent_subsystem));
+		}
+	}
+#endif // !defined(DISABLE_NETWORKING)
+}
+
+// Per-subsystem totals for the headless replay benchmark; each mark charges the time since the
+// previous one to the given timer, so the timers add up to the whole update.
+static bool sWorldUpdateTimingEnabled = false;
+static world_update_timing sWorldUpdateTiming;
+static uint64 sWorldUpdateTimingMark = 0;
+
+static const char* sWorldUpdateTimerNames[NUMBER_OF_WORLD_UPDATE_TIMERS] =
+{
+	"lua",
+	"lights",
+	"media",
+	"platforms",
+	"control panels",
+	"players",
+	"projectiles",
+	"monsters",
+	"effects",
+	"objects",
+	"scenery",
+	"other",
+	"world hash"
+};
+
+static inline void
+start_world_update_timer()
+{
+	if (sWorldUpdateTimingEnabled)
+		sWorldUpdateTimingMark = machine_microsecond_count();
+}
+
+static inline void
+mark_world_update_timer(short timer)
+{
+	if (sWorldUpdateTimingEnabled)
+	{
+		uint64 now = machine_microsecond_count();
+		sWorldUpdateTiming.microseconds[timer] += now - sWorldUpdateTimingMark;
+		sWorldUpdateTimingMark = now;
+	}
+}
+
+void
+set_world_update_timing(bool enabled)
+{
+	sWorldUpdateTimingEnabled = enabled;
+	if (enabled)
+		obj_clear(sWorldUpdateTiming);
+}
+
+const world_update_timing*
+get_world_update_timing()
+{
+	return &sWorldUpdateTiming;
+}
+
+const char*
+get_world_update_timer_name(short timer)
+{
+	return (timer >= 0 && timer < NUMBER_OF_WORLD_UPDATE_TIMERS) ? sWorldUpdateTimerNames[timer] : "unknown";
+}
+
 // Return values for update_world_elements_one_tick()
 enum {
         kUpdateNormalCompletion,
@@ -388,6 +443,8 @@ enum {
 static int
 update_world_elements_one_tick(bool& call_postidle)
 {
+	start_world_update_timer();
+
 	if (m1_solo_player_in_terminal()) 
 	{
 		update_m1_solo_player_in_terminal(GameQueue);
@@ -397,17 +454,27 @@ update_world_elements_one_tick(bool& call_postidle)
 	{
 		L_Call_Idle();
 		call_postidle = true;
+		mark_world_update_timer(_update_timer_lua);
 		
 		update_lights();
+		mark_world_update_timer(_update_timer_lights);
 		update_medias();
+		mark_world_update_timer(_update_timer_media);
 		update_platforms();
+		mark_world_update_timer(_update_timer_platforms);
 		
 		update_control_panels(); // don't put after update_players
+		mark_world_update_timer(_update_timer_control_panels);
 		update_players(GameQueue, false);
+		mark_world_update_timer(_update_timer_players);
 		move_projectiles();
+		mark_world_update_timer(_update_timer_projectiles);
 		move_monsters();
+		mark_world_update_timer(_update_timer_monsters);
 		update_effects();
+		mark_world_update_timer(_update_timer_effects);
 		recreate_objects();
+		mark_world_update_timer(_update_timer_objects);
 		
 		handle_random_sound_image();
 		animate_scenery();
@@ -419,6 +486,7 @@ update_world_elements_one_tick(bool& call_postidle)
 		}
 		
 		AnimTxtr_Update();
+		mark_world_update_timer(_update_timer_scenery);
 		ChaseCam_Update();
 		motion_sensor_scan();
 		check_m1_exploration();
@@ -428,6 +496,8 @@ update_world_elements_one_tick(bool& call_postidle)
 #endif // !defined(DISABLE_NETWORKING)
 	}
 
+	mark_world_update_timer(_update_timer_other);
+
         if(check_level_change()) 
         {
                 sync_heartbeat_count();
@@ -443,6 +513,10 @@ update_world_elements_one_tick(bool& call_postidle)
 
         dynamic_world->tick_count+= 1;
         dynamic_world->game_information.game_time_remaining-= 1;
+
+        check_world_hash();
+        mark_world_update_timer(_update_timer_world_hash);
+        sWorldUpdateTiming.tick_count += 1;
         
         return kUpdateNormalCompletion;
 }
@@ -506,7 +580,12 @@ update_world()
                 theElapsedTime++;
 
                 if (call_postidle)
+                {
+                        start_world_update_timer();
                         L_Call_PostIdle();
+                        mark_world_update_timer(_update_timer_lua);
+                }
+		record_interpolated_world_tick();
                 if(theUpdateResult != kUpdateNormalCompletion || Movie::instance()->IsRecording())
                 {
                         canUpdate = false;
@@ -659,6 +738,8 @@ bool entering_map(bool restoring_saved)
 	if (dynamic_world->player_count>1 && !restoring_saved) initialize_net_game();
 #endif // !defined(DISABLE_NETWORKING)
 	randomize_scenery_shapes();
+	reset_interpolated_world();
+	ResetOverheadMapLayers();
 
 //	reset_action_queues(); //
 //	sync_heartbeat_count();
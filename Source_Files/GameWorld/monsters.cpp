@@ -391,8 +391,10 @@ short new_monster(
 			}
 		}
 		
-		for (monster_index=0,monster=monsters;monster_index<MAXIMUM_MONSTERS_PER_MAP;++monster_index,++monster)
+		monster_index= MonsterSlots.first_free();
+		if (monster_index!=NONE)
 		{
+			monster= monsters+monster_index;
 			if (SLOT_IS_FREE(monster))
 			{
 				short object_index= new_map_object(location, BUILD_DESCRIPTOR(definition->collection, definition->stationary_shape));
@@ -421,6 +423,7 @@ short new_monster(
 					monster->sound_polygon_index= object->polygon;
 					monster->sound_location= object->location;
 					MARK_SLOT_AS_USED(monster);
+					MonsterSlots.mark_used(monster_index);
 					
 					/* initialize the monsters object */
 					if (definition->flags&_monster_is_invisible) object->transfer_mode= _xfer_invisibility;
@@ -440,11 +443,12 @@ short new_monster(
 				{
 					monster_index= NONE;
 				}
-				
-				break;
+			}
+			else
+			{
+				monster_index= NONE;
 			}
 		}
-		if (monster_index==MAXIMUM_MONSTERS_PER_MAP) monster_index= NONE;
 	}
 
 	/* keep track of how many civilians we drop on this level */
@@ -467,8 +471,9 @@ void move_monsters(
 	bool monster_built_path= (dynamic_world->tick_count&3) ? true : false;
 	short monster_index;
 
-	for (monster_index= 0, monster= monsters; monster_index<MAXIMUM_MONSTERS_PER_MAP; ++monster_index, ++monster)
+	for (monster_index= MonsterSlots.first_used(); monster_index!=NONE; monster_index= MonsterSlots.next_used(monster_index))
 	{
+		monster= monsters+monster_index;
 		if (SLOT_IS_USED(monster) && !MONSTER_IS_PLAYER(monster))
 		{
 			struct object_data *object= get_object_data(monster->object_index);
@@ -590,6 +595,7 @@ void move_monsters(
 									remove_map_object(monster->object_index);
 									L_Invalidate_Monster(monster_index);
 									MARK_SLOT_AS_FREE(monster);
+									MonsterSlots.mark_free(monster_index);
 								}
 								break;
 							
@@ -706,8 +712,9 @@ void monster_died(
 	}
 
 	/* anyone locked on this monster needs a clue */
-	for (monster_index= 0, monster= monsters; monster_index<MAXIMUM_MONSTERS_PER_MAP; ++monster_index, ++monster)
+	for (monster_index= MonsterSlots.first_used(); monster_index!=NONE; monster_index= MonsterSlots.next_used(monster_index))
 	{
+		monster= monsters+monster_index;
 		if (SLOT_IS_USED(monster) && MONSTER_IS_ACTIVE(monster) && monster->target_index==target_index)
 		{
 			short closest_target_index= find_closest_appropriate_target(monster_index, true);
@@ -750,8 +757,9 @@ void initialize_monsters_for_new_level(
 	/* when a level is loaded after being saved all of an active monsters data is still intact,
 		but its path no longer exists.  this function resets all monsters so that they recalculate
 		their paths, first thing. */
-	for (monster_index=0,monster=monsters;monster_index<MAXIMUM_MONSTERS_PER_MAP;++monster_index,++monster)
+	for (monster_index= MonsterSlots.first_used(); monster_index!=NONE; monster_index= MonsterSlots.next_used(monster_index))
 	{
+		monster= monsters+monster_index;
 		if (SLOT_IS_USED(monster)&&MONSTER_IS_ACTIVE(monster))
 		{
 			SET_MONSTER_NEEDS_PATH_STATUS(monster, true);
@@ -995,8 +1003,9 @@ bool live_aliens_on_map(
 	short threshhold= LIVE_ALIEN_THRESHHOLD;
 	short monster_index;
 	
-	for (monster_index= 0, monster= monsters; monster_index<MAXIMUM_MONSTERS_PER_MAP; ++monster_index, ++monster)
+	for (monster_index= MonsterSlots.first_used(); monster_index!=NONE; monster_index= MonsterSlots.next_used(monster_index))
 	{
+		monster= monsters+monster_index;
 		if (SLOT_IS_USED(monster))
 		{
 			struct monster_definition *definition= get_monster_definition(monster->type);
@@ -1140,7 +1149,8 @@ void deactivate_monster(
 }
 
 /* returns a list of object indexes of all monsters in or adjacent to the given polygon,
-	up to maximum_object_count. */
+	up to maximum_object_count.  only monsters and scenery can be solid here, so we walk each
+	polygon's obstacle list, which holds them in object list order, and skip everything else */
 // LP change: called with growable list
 bool possible_intersecting_monsters(
 	vector<short> *IntersectedObjectsPtr,
@@ -1157,11 +1167,12 @@ bool possible_intersecting_monsters(
 
 	for (short i=0;i<polygon->neighbor_count;++i)
 	{
-		struct polygon_data *neighboring_polygon= get_polygon_data(*neighbor_indexes++);
+		short neighbor_index= *neighbor_indexes++;
+		struct polygon_data *neighboring_polygon= get_polygon_data(neighbor_index);
 		
 		if (!POLYGON_IS_DETACHED(neighboring_polygon))
 		{
-			short object_index= neighboring_polygon->first_object;
+			short object_index= get_polygon_first_obstacle(neighbor_index);
 			
 			while (object_index!=NONE)
 			{
@@ -1208,7 +1219,7 @@ bool possible_intersecting_monsters(
 					}
 				}
 				
-				object_index= object->next_object;
+				object_index= get_next_obstacle(object_index);
 			}
 		}
 	}
@@ -1238,8 +1249,9 @@ void monster_moved(
 			_pass_solid_lines|_activate_deaf_monsters|_activate_invisible_monsters|_use_activation_biases|_cannot_pass_superglue|_activate_glue_monsters);
 	}
 
-	for (monster_index=0,monster=monsters;monster_index<MAXIMUM_MONSTERS_PER_MAP;++monster_index,++monster)
+	for (monster_index= MonsterSlots.first_used(); monster_index!=NONE; monster_index= MonsterSlots.next_used(monster_index))
 	{
+		monster= monsters+monster_index;
 		/* look for active monsters locked (or losing lock) on the given target_index */
 		if (SLOT_IS_USED(monster) && MONSTER_HAS_VALID_TARGET(monster) && monster->target_index==target_index)
 		{
@@ -2142,7 +2154,8 @@ static void generate_new_path_for_monster(
 	data.cross_zone_boundaries= destination_polygon_index==NONE ? false : true;
 
 	monster->path= new_path((world_point2d *)&object->location, object->polygon, destination,
-		destination_polygon_index, 3*definition->radius, monster_pathfinding_cost_function, &data);
+		destination_polygon_index, 3*definition->radius, monster_pathfinding_cost_function, &data,
+		2*monster->type + (data.cross_zone_boundaries ? 1 : 0));
 	if (monster->path==NONE)
 	{
 		if (monster->action!=_monster_is_being_hit || MONSTER_IS_DYING(monster)) set_monster_action(monster_index, _monster_is_stationary);
@@ -2716,6 +2729,7 @@ static void kill_monster(
 
 	L_Invalidate_Monster(monster_index);
 	MARK_SLOT_AS_FREE(monster);
+	MonsterSlots.mark_free(monster_index);
 }
 		
 /* move the monster along his current heading; if he reaches the center of his destination square,
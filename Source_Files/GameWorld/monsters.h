@@ -47,6 +47,7 @@ Oct 24, 2000 (Mark Levin)
 
 // LP additions:
 #include "dynamic_limits.h"
+#include "slot_pool.h"
 #include <vector>
 
 #include "world.h"
@@ -264,6 +265,7 @@ const int SIZEOF_monster_definition = 156;
 
 extern vector<monster_data> MonsterList;
 #define monsters (MonsterList.data())
+extern slot_pool MonsterSlots;
 
 // extern struct monster_data *monsters;
 
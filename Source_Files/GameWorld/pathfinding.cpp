@@ -34,6 +34,12 @@ Wednesday, June 14, 1995 8:35:28 AM  (Jason)
 
 Feb 10, 2000 (Loren Petrich):
 	Added dynamic-limits setting of MAXIMUM_PATHS
+
+	non-random paths for callers that supply a cache key are remembered by (source polygon,
+	destination polygon, cost function, key), and the polygon route is reused as long as the
+	flood that produced it would come out the same: no platform or media has changed and no
+	monster has entered or left any polygon the cost function looked at.  the points along the
+	route are always picked fresh, so global_random() is called exactly as often as before.
 */
 
 #include <string.h>
@@ -44,10 +50,16 @@ Feb 10, 2000 (Loren Petrich):
 #include "map.h"
 #include "flood_map.h"
 #include "dynamic_limits.h"
+#include "platforms.h"
+#include "media.h"
+
+#include <vector>
+using std::vector;
 
 #ifdef DEBUG
 //#define VALIDATE_PATH_SPACE
 //#define VERIFY_PATH_SYNC
+//#define VERIFY_PATH_CACHE
 #endif
 
 /*
@@ -68,6 +80,8 @@ we should cut corners instead of blindly following map geometry (i.e., separate
 
 #define PATH_VALIDATION_AREA_SIZE 64*1024
 
+#define MAXIMUM_CACHED_PATHS 64
+
 /* ---------- structures */
 
 struct path_definition /* 256 bytes */
@@ -79,6 +93,23 @@ struct path_definition /* 256 bytes */
 	world_point2d points[MAXIMUM_POINTS_PER_PATH];
 };
 
+struct cached_path_data
+{
+	/* NONE is an empty slot */
+	short source_polygon_index, destination_polygon_index;
+	cost_proc_ptr cost;
+	int32 cache_key;
+
+	/* what the world looked like when we flooded */
+	uint32 terrain_signature;
+	uint32 population_clock;
+	vector<short> consulted_polygon_indexes; /* every destination handed to the cost function */
+
+	bool reached_destination;
+	short depth;
+	vector<short> polygon_indexes; /* in the order reverse_flood_map() returned them */
+};
+
 /* ---------- globals */
 
 static struct path_definition *paths = NULL;
@@ -89,11 +120,37 @@ static int32 path_validation_area_index;
 static short path_run_count;
 #endif
 
+static vector<cached_path_data> cached_paths;
+static short next_cached_path_index;
+static struct path_cache_statistics path_cache_statistics;
+
+/* polygon_population_stamps[i] is the population_clock when a monster last entered or left
+	polygon i */
+static uint32 population_clock;
+static vector<uint32> polygon_population_stamps;
+
+/* for recording which polygons the cost function looks at */
+static cost_proc_ptr recorded_cost_proc;
+static vector<short> *recorded_polygon_indexes;
+static vector<bool> polygon_recorded;
+
 /* ---------- private prototypes */
 
 static void calculate_midpoint_of_shared_line(short polygon1, short polygon2,
 	world_distance minimum_separation, world_point2d *midpoint);
 
+static short next_path_polygon(vector<short> *polygon_indexes, size_t *position);
+static bool flood_to_destination(short source_polygon_index, short destination_polygon_index,
+	cost_proc_ptr cost, void *data);
+
+static uint32 calculate_terrain_signature(void);
+static struct cached_path_data *find_cached_path(short source_polygon_index, short destination_polygon_index,
+	cost_proc_ptr cost, int32 cache_key);
+static struct cached_path_data *new_cached_path(short source_polygon_index, short destination_polygon_index,
+	cost_proc_ptr cost, int32 cache_key);
+static int32 recording_cost_function(short source_polygon_index, short line_index,
+	short destination_polygon_index, void *data);
+
 /* ---------- code */
 
 void allocate_pathfinding_memory(
@@ -123,6 +180,92 @@ void reset_paths(
 	path_run_count+= 1;
 	path_validation_area_index= 0;
 #endif
+
+	/* new level, new polygons */
+	invalidate_path_cache();
+	polygon_population_stamps.assign(dynamic_world->polygon_count, 0);
+	polygon_recorded.assign(dynamic_world->polygon_count, false);
+	population_clock= 0;
+	obj_clear(path_cache_statistics);
+}
+
+void invalidate_path_cache(
+	void)
+{
+	cached_paths.resize(MAXIMUM_CACHED_PATHS);
+	for (size_t i= 0; i<cached_paths.size(); ++i)
+	{
+		cached_paths[i].source_polygon_index= NONE;
+	}
+	next_cached_path_index= 0;
+}
+
+/* a monster entered or left this polygon, so every route whose cost function looked at it may
+	have changed */
+void invalidate_paths_through_polygon(
+	short polygon_index)
+{
+	if (polygon_index>=0 && polygon_index<(short)polygon_population_stamps.size())
+	{
+		if (!++population_clock)
+		{
+			/* the clock wrapped; old stamps would look new */
+			invalidate_path_cache();
+			polygon_population_stamps.assign(polygon_population_stamps.size(), 0);
+			population_clock= 1;
+		}
+		polygon_population_stamps[polygon_index]= population_clock;
+	}
+}
+
+void get_path_cache_statistics(
+	struct path_cache_statistics *statistics)
+{
+	*statistics= path_cache_statistics;
+}
+
+void *get_path_array(
+	void)
+{
+	return paths;
+}
+
+int32 calculate_path_array_length(
+	void)
+{
+	return MAXIMUM_PATHS*sizeof(struct path_definition);
+}
+
+/* routes cached after this call can be thrown away by rewind_path_cache(); they may have been
+	flooded through a world that is about to be restored out of existence */
+uint32 checkpoint_path_cache(
+	void)
+{
+	if (!++population_clock)
+	{
+		invalidate_path_cache();
+		polygon_population_stamps.assign(polygon_population_stamps.size(), 0);
+		population_clock= 1;
+	}
+	
+	return population_clock;
+}
+
+void rewind_path_cache(
+	uint32 checkpoint)
+{
+	if (population_clock<checkpoint)
+	{
+		/* the clock wrapped since the checkpoint, so we can't tell old routes from new */
+		invalidate_path_cache();
+	}
+	else
+	{
+		for (size_t i= 0; i<cached_paths.size(); ++i)
+		{
+			if (cached_paths[i].population_clock>=checkpoint) cached_paths[i].source_polygon_index= NONE;
+		}
+	}
 }
 
 short new_path(
@@ -132,7 +275,8 @@ short new_path(
 	short destination_polygon_index,
 	world_distance minimum_separation,
 	cost_proc_ptr cost,
-	void *data)
+	void *data,
+	int32 cache_key)
 {
 	short path_index;
 
@@ -171,21 +315,57 @@ short new_path(
 		short polygon_index;
 		short step_count;
 		short depth;
+		struct cached_path_data *cached_path= NULL;
+		size_t cached_path_position= 0;
 
-		if (destination_polygon_index!=NONE)
+		if (destination_polygon_index!=NONE && cache_key!=NONE && cost)
 		{
-			/* NON-RANDOM PATH: we have a valid destination point: flood out from the source_polygon_index
-				until we reach destination_polygon_index or we run out of stack space */
+			/* CACHED PATH: reuse the route of an identical flood if nothing it depended on has
+				changed; otherwise flood and remember what we looked at */
+			uint64 start= machine_microsecond_count();
 			
-			polygon_index= flood_map(source_polygon_index, INT32_MAX, cost, _breadth_first, data);
-			while (polygon_index!=NONE&&polygon_index!=destination_polygon_index)
+			cached_path= find_cached_path(source_polygon_index, destination_polygon_index, cost, cache_key);
+			if (cached_path)
 			{
-				polygon_index= flood_map(NONE, INT32_MAX, cost, _breadth_first, data);
+				path_cache_statistics.hit_count+= 1;
+				path_cache_statistics.hit_microseconds+= machine_microsecond_count() - start;
 			}
-
+			else
+			{
+				cached_path= new_cached_path(source_polygon_index, destination_polygon_index, cost, cache_key);
+				
+				recorded_cost_proc= cost;
+				recorded_polygon_indexes= &cached_path->consulted_polygon_indexes;
+				cached_path->reached_destination= flood_to_destination(source_polygon_index, destination_polygon_index,
+					recording_cost_function, data);
+				for (size_t i= 0; i<recorded_polygon_indexes->size(); ++i) polygon_recorded[(*recorded_polygon_indexes)[i]]= false;
+				
+				cached_path->depth= flood_depth();
+				while ((polygon_index= reverse_flood_map())!=NONE) cached_path->polygon_indexes.push_back(polygon_index);
+				
+				path_cache_statistics.miss_count+= 1;
+				path_cache_statistics.miss_microseconds+= machine_microsecond_count() - start;
+			}
+#ifdef VERIFY_PATH_CACHE
+			{
+				bool reached= flood_to_destination(source_polygon_index, destination_polygon_index, cost, data);
+				
+				assert(reached==cached_path->reached_destination && flood_depth()==cached_path->depth);
+				for (size_t i= 0; i<cached_path->polygon_indexes.size(); ++i) assert(reverse_flood_map()==cached_path->polygon_indexes[i]);
+				assert(reverse_flood_map()==NONE);
+			}
+#endif
+			
+			reached_destination= cached_path->reached_destination;
+		}
+		else if (destination_polygon_index!=NONE)
+		{
+			/* NON-RANDOM PATH: we have a valid destination point: flood out from the source_polygon_index
+				until we reach destination_polygon_index or we run out of stack space */
+			
 			/* if we reached destination_polygon_index, extract the path by calling
 				reverse_flood_map().  remember to add the destination to the end of the path */
-			reached_destination= polygon_index==destination_polygon_index ? true : false;
+			reached_destination= flood_to_destination(source_polygon_index, destination_polygon_index, cost, data);
 		}
 		else
 		{
@@ -204,7 +384,7 @@ short new_path(
 			reached_destination= false; /* we didnt even have one */
 		}
 
-		depth= flood_depth();
+		depth= cached_path ? cached_path->depth : flood_depth();
 		if (reached_destination)
 		{
 			/* a depth of zero yeilds one point (the destination), two and greater 2*depth */
@@ -234,8 +414,8 @@ short new_path(
 			if (reached_destination && --step_count<MAXIMUM_POINTS_PER_PATH) path->points[step_count]= *destination_point;
 			
 			/* add all the points up to but not including the source (if we have room) */
-			last_polygon_index= reverse_flood_map();
-			while ((polygon_index= reverse_flood_map())!=NONE)
+			last_polygon_index= next_path_polygon(cached_path ? &cached_path->polygon_indexes : NULL, &cached_path_position);
+			while ((polygon_index= next_path_polygon(cached_path ? &cached_path->polygon_indexes : NULL, &cached_path_position))!=NONE)
 			{
 				if (--step_count<MAXIMUM_POINTS_PER_PATH) calculate_midpoint_of_shared_line(last_polygon_index, polygon_index, minimum_separation, path->points+step_count);
 //				if (polygon_index!=source_polygon_index&&--step_count<MAXIMUM_POINTS_PER_PATH) find_center_of_polygon(polygon_index, path->points+step_count);
@@ -326,6 +506,138 @@ void delete_path(
 
 /* ---------- private code */
 
+/* returns true if we got there; either way flood_depth() and reverse_flood_map() describe the
+	route to the last polygon expanded */
+static bool flood_to_destination(
+	short source_polygon_index,
+	short destination_polygon_index,
+	cost_proc_ptr cost,
+	void *data)
+{
+	short polygon_index;
+	
+	polygon_index= flood_map(source_polygon_index, INT32_MAX, cost, _breadth_first, data);
+	while (polygon_index!=NONE&&polygon_index!=destination_polygon_index)
+	{
+		polygon_index= flood_map(NONE, INT32_MAX, cost, _breadth_first, data);
+	}
+	
+	return polygon_index==destination_polygon_index ? true : false;
+}
+
+/* the next polygon along the route, from the cache if we have it and the flood otherwise */
+static short next_path_polygon(
+	vector<short> *polygon_indexes,
+	size_t *position)
+{
+	if (!polygon_indexes) return reverse_flood_map();
+	
+	return *position<polygon_indexes->size() ? (*polygon_indexes)[(*position)++] : NONE;
+}
+
+/* everything about platforms and media that monster_pathfinding_cost_function() (or anything like
+	it) could care about; Lua changes to polygons call invalidate_path_cache() themselves */
+static uint32 calculate_terrain_signature(
+	void)
+{
+	uint32 signature= 0;
+	short i;
+	
+#define MIX_SIGNATURE(v) (signature= (signature ^ (uint32)(v)) * 16777619)
+	for (i= 0; i<dynamic_world->platform_count; ++i)
+	{
+		struct platform_data *platform= get_platform_data(i);
+		
+		MIX_SIGNATURE(platform->static_flags);
+		MIX_SIGNATURE(platform->dynamic_flags);
+		MIX_SIGNATURE(platform->delay);
+		MIX_SIGNATURE(platform->polygon_index);
+		MIX_SIGNATURE(platform->floor_height);
+		MIX_SIGNATURE(platform->ceiling_height);
+		MIX_SIGNATURE(platform->minimum_floor_height);
+		MIX_SIGNATURE(platform->maximum_floor_height);
+		MIX_SIGNATURE(platform->minimum_ceiling_height);
+		MIX_SIGNATURE(platform->maximum_ceiling_height);
+	}
+	for (i= 0; i<(short)MAXIMUM_MEDIAS_PER_MAP; ++i)
+	{
+		struct media_data *media= get_media_data(i);
+		
+		MIX_SIGNATURE(media ? media->height : NONE);
+	}
+#undef MIX_SIGNATURE
+	
+	return signature;
+}
+
+static struct cached_path_data *find_cached_path(
+	short source_polygon_index,
+	short destination_polygon_index,
+	cost_proc_ptr cost,
+	int32 cache_key)
+{
+	for (size_t i= 0; i<cached_paths.size(); ++i)
+	{
+		struct cached_path_data *cached_path= &cached_paths[i];
+		
+		if (cached_path->source_polygon_index==source_polygon_index &&
+			cached_path->destination_polygon_index==destination_polygon_index &&
+			cached_path->cost==cost && cached_path->cache_key==cache_key)
+		{
+			bool valid= cached_path->terrain_signature==calculate_terrain_signature();
+			
+			for (size_t j= 0; valid && j<cached_path->consulted_polygon_indexes.size(); ++j)
+			{
+				if (polygon_population_stamps[cached_path->consulted_polygon_indexes[j]]>cached_path->population_clock) valid= false;
+			}
+			if (valid) return cached_path;
+			
+			cached_path->source_polygon_index= NONE;
+			path_cache_statistics.invalidation_count+= 1;
+			break;
+		}
+	}
+	
+	return NULL;
+}
+
+static struct cached_path_data *new_cached_path(
+	short source_polygon_index,
+	short destination_polygon_index,
+	cost_proc_ptr cost,
+	int32 cache_key)
+{
+	struct cached_path_data *cached_path= &cached_paths[next_cached_path_index];
+	
+	next_cached_path_index= (next_cached_path_index+1)%MAXIMUM_CACHED_PATHS;
+	
+	cached_path->source_polygon_index= source_polygon_index;
+	cached_path->destination_polygon_index= destination_polygon_index;
+	cached_path->cost= cost;
+	cached_path->cache_key= cache_key;
+	cached_path->terrain_signature= calculate_terrain_signature();
+	cached_path->population_clock= population_clock;
+	cached_path->consulted_polygon_indexes.clear();
+	cached_path->polygon_indexes.clear();
+	
+	return cached_path;
+}
+
+static int32 recording_cost_function(
+	short source_polygon_index,
+	short line_index,
+	short destination_polygon_index,
+	void *data)
+{
+	if (!polygon_recorded[destination_polygon_index])
+	{
+		polygon_recorded[destination_polygon_index]= true;
+		recorded_polygon_indexes->push_back(destination_polygon_index);
+	}
+	
+	return recorded_cost_proc(source_polygon_index, line_index, destination_polygon_index, data);
+}
+
 static void calculate_midpoint_of_shared_line(
 	short polygon1,
 	short polygon2,
@@ -0,0 +1,639 @@
+/*
+POLYGON_VISIBILITY.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	the sets are built by flooding out of each polygon through every line a sightline could
+	ever cross: lines that aren't solid, lines that are transparent, and lines whose solidity
+	is up to a platform (so doors count as open, whatever state they're in).  past the second
+	portal, each portal is clipped to the region a straight line through all the portals before
+	it could reach, which is what keeps the sets small.  the clipping is only sound for convex
+	polygons that agree with their neighbours about the lines between them; a flood that runs
+	into anything else, or that takes too long, gives up and marks everything as visible.
+
+	a sightline that reaches a polygon also "reaches" every polygon sharing one of its
+	endpoints, to match line_is_obstructed()'s forgiveness at the end of the walk.
+*/
+
+#include "cseries.h"
+#include "map.h"
+#include "polygon_visibility.h"
+#include "FileHandler.h"
+#include "crc.h"
+#include "Packing.h"
+#include "Logging.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+using std::vector;
+
+/* ---------- constants */
+
+#define MAXIMUM_VISIBILITY_POLYGONS 8192 /* 8M of bits */
+#define MAXIMUM_VISIBILITY_FLOOD_STEPS 16384 /* per source polygon */
+#define MAXIMUM_VISIBILITY_FLOOD_DEPTH 1024
+#define VISIBILITY_CLIP_TOLERANCE 0.5 /* world units of slack around every clipped portal */
+
+#define VISIBILITY_CACHE_TAG FOUR_CHARS_TO_INT('p','v','s','1')
+#define VISIBILITY_CACHE_VERSION 2
+#define SIZEOF_visibility_cache_header 24
+
+/* ---------- structures */
+
+struct polygon_visibility_data
+{
+	bool valid;
+
+	int16 polygon_count;
+	int32 row_bytes;
+
+	/* the walks the sets describe are only exact while both ends of the sightline are in here */
+	world_point2d minimum, maximum;
+
+	/* row i (row_bytes long) has bit j set if a sightline from polygon i might end in polygon j */
+	vector<uint8> rows;
+};
+
+struct visibility_portal
+{
+	double x0, y0, x1, y1;
+};
+
+struct visibility_flood_data
+{
+	int32 steps;
+	bool gave_up;
+
+	vector<bool> sound; /* safe to flood through */
+	vector<bool> on_path;
+	vector<bool> reached;
+};
+
+/* ---------- globals */
+
+static struct polygon_visibility_data polygon_visibility;
+static bool polygon_visibility_suspended= false; /* so the benchmark can time the plain walk */
+
+/* ---------- private prototypes */
+
+static bool line_is_visibility_portal(short line_index);
+static bool polygon_is_visibility_sound(short polygon_index);
+static void flood_polygon_visibility(struct visibility_flood_data *flood, short polygon_index, short depth,
+	struct visibility_portal *source, struct visibility_portal *pass);
+static bool clip_visibility_portal(struct visibility_portal *portal, struct visibility_portal *source,
+	struct visibility_portal *pass);
+static void calculate_polygon_visibility(void);
+
+static uint32 calculate_polygon_visibility_checksum(uint16 *secondary_checksum);
+static void get_polygon_visibility_cache_file(uint32 checksum, FileSpecifier& File);
+static bool read_polygon_visibility_cache(uint32 checksum, uint16 secondary_checksum);
+static void write_polygon_visibility_cache(uint32 checksum, uint16 secondary_checksum);
+
+/* ---------- code */
+
+void invalidate_polygon_visibility(
+	void)
+{
+	polygon_visibility.valid= false;
+	polygon_visibility.rows.clear();
+}
+
+void precalculate_polygon_visibility(
+	void)
+{
+	short polygon_count= dynamic_world->polygon_count;
+	int32 minimum_x= INT16_MAX, minimum_y= INT16_MAX, maximum_x= INT16_MIN, maximum_y= INT16_MIN;
+	short index;
+
+	invalidate_polygon_visibility();
+	if (polygon_count<=0 || polygon_count>MAXIMUM_VISIBILITY_POLYGONS || !dynamic_world->endpoint_count) return;
+
+	for (index= 0; index<dynamic_world->endpoint_count; ++index)
+	{
+		world_point2d *vertex= &get_endpoint_data(index)->vertex;
+
+		minimum_x= MIN(minimum_x, vertex->x), minimum_y= MIN(minimum_y, vertex->y);
+		maximum_x= MAX(maximum_x, vertex->x), maximum_y= MAX(maximum_y, vertex->y);
+	}
+
+	/* find_line_crossed_leaving_polygon() works in int32; two products of deltas up to INT16_MAX
+		still fit, anything bigger and the walk isn't the geometry we flood */
+	if (maximum_x-minimum_x>INT16_MAX || maximum_y-minimum_y>INT16_MAX) return;
+
+	polygon_visibility.polygon_count= polygon_count;
+	polygon_visibility.row_bytes= (polygon_count+7)/8;
+	polygon_visibility.minimum.x= minimum_x, polygon_visibility.minimum.y= minimum_y;
+	polygon_visibility.maximum.x= maximum_x, polygon_visibility.maximum.y= maximum_y;
+
+	uint16 secondary_checksum;
+	uint32 checksum= calculate_polygon_visibility_checksum(&secondary_checksum);
+
+	if (!read_polygon_visibility_cache(checksum, secondary_checksum))
+	{
+		uint64 start= machine_microsecond_count();
+
+		calculate_polygon_visibility();
+		logNote("calculated visibility for %d polygons in %d ms", polygon_count,
+			(int) ((machine_microsecond_count() - start)/1000));
+		write_polygon_visibility_cache(checksum, secondary_checksum);
+	}
+
+	polygon_visibility.valid= true;
+}
+
+bool polygon_visibility_rejects_sightline(
+	short polygon_index1,
+	world_point2d *p1,
+	short polygon_index2,
+	world_point2d *p2)
+{
+	if (!polygon_visibility.valid || polygon_visibility_suspended) return false;
+	if (polygon_index1<0 || polygon_index1>=polygon_visibility.polygon_count) return false;
+	if (polygon_index2<0 || polygon_index2>=polygon_visibility.polygon_count) return false;
+
+	if (polygon_visibility.rows[polygon_index1*polygon_visibility.row_bytes + (polygon_index2>>3)]&(1<<(polygon_index2&7))) return false;
+
+	/* the sets say nothing about walks that start outside their first polygon or leave the map */
+	world_point2d *minimum= &polygon_visibility.minimum, *maximum= &polygon_visibility.maximum;
+	if (p1->x<minimum->x || p1->x>maximum->x || p1->y<minimum->y || p1->y>maximum->y) return false;
+	if (p2->x<minimum->x || p2->x>maximum->x || p2->y<minimum->y || p2->y>maximum->y) return false;
+
+	return point_in_polygon(polygon_index1, p1);
+}
+
+void benchmark_polygon_visibility(
+	int32 sample_count,
+	struct polygon_visibility_benchmark *results)
+{
+	vector<short> bounded_polygon_indexes, polygon_indexes;
+	vector<world_point2d> points;
+	vector<bool> walked, checked;
+	uint32 seed= 0x5678;
+	short index;
+	int32 i;
+
+	obj_clear(*results);
+	if (!polygon_visibility.valid) return;
+
+	for (index= 0; index<dynamic_world->polygon_count; ++index)
+	{
+		world_point2d minimum, maximum;
+
+		if (polygon_is_bounded(index, &minimum, &maximum)) bounded_polygon_indexes.push_back(index);
+	}
+	if (bounded_polygon_indexes.empty()) return;
+
+	/* pairs of points, each between the center and a vertex of a convex polygon; our own
+		generator, so the game's random seed isn't disturbed */
+	for (i= 0; i<2*sample_count; ++i)
+	{
+		struct polygon_data *polygon;
+		world_point2d *vertex, p;
+		int32 fraction;
+
+		seed= seed*1664525 + 1013904223;
+		index= bounded_polygon_indexes[(seed>>8)%bounded_polygon_indexes.size()];
+		polygon= get_polygon_data(index);
+		seed= seed*1664525 + 1013904223;
+		vertex= &get_endpoint_data(polygon->endpoint_indexes[(seed>>8)%polygon->vertex_count])->vertex;
+		seed= seed*1664525 + 1013904223;
+		fraction= (seed>>8)%230; /* out of 256 */
+		p.x= polygon->center.x + (world_distance)(((int32)vertex->x-polygon->center.x)*fraction/256);
+		p.y= polygon->center.y + (world_distance)(((int32)vertex->y-polygon->center.y)*fraction/256);
+		polygon_indexes.push_back(index);
+		points.push_back(p);
+	}
+
+	walked.resize(sample_count);
+	checked.resize(sample_count);
+
+	polygon_visibility_suspended= true;
+	uint64 start= machine_microsecond_count();
+	for (i= 0; i<sample_count; ++i)
+	{
+		walked[i]= line_is_obstructed(polygon_indexes[2*i], &points[2*i], polygon_indexes[2*i+1], &points[2*i+1]);
+	}
+	results->walk_microseconds= machine_microsecond_count() - start;
+	polygon_visibility_suspended= false;
+
+	start= machine_microsecond_count();
+	for (i= 0; i<sample_count; ++i)
+	{
+		checked[i]= line_is_obstructed(polygon_indexes[2*i], &points[2*i], polygon_indexes[2*i+1], &points[2*i+1]);
+	}
+	results->visibility_microseconds= machine_microsecond_count() - start;
+
+	results->sample_count= sample_count;
+	for (i= 0; i<sample_count; ++i)
+	{
+		if (walked[i]!=checked[i]) results->mismatch_count+= 1;
+		if (polygon_visibility_rejects_sightline(polygon_indexes[2*i], &points[2*i], polygon_indexes[2*i+1], &points[2*i+1]))
+		{
+			results->rejected_count+= 1;
+		}
+	}
+
+	results->polygon_count= polygon_visibility.polygon_count;
+	for (size_t j= 0; j<polygon_visibility.rows.size(); ++j)
+	{
+		for (uint8 bits= polygon_visibility.rows[j]; bits; bits&= bits-1) results->visible_pair_count+= 1;
+	}
+}
+
+/* ---------- private code */
+
+/* could a sightline ever cross this line, now or after some platform moves? */
+static bool line_is_visibility_portal(
+	short line_index)
+{
+	struct line_data *line= get_line_data(line_index);
+
+	if (line->clockwise_polygon_owner==NONE || line->counterclockwise_polygon_owner==NONE) return false;
+
+	return !LINE_IS_SOLID(line) || LINE_IS_TRANSPARENT(line) || LINE_IS_VARIABLE_ELEVATION(line);
+}
+
+static bool polygon_is_visibility_sound(
+	short polygon_index)
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	world_point2d minimum, maximum;
+
+	if (!polygon_is_bounded(polygon_index, &minimum, &maximum)) return false;
+
+	/* every portal must lead to a polygon that has the same line between the same endpoints,
+		so wherever a sightline leaves us it enters our neighbour */
+	for (short i= 0; i<polygon->vertex_count; ++i)
+	{
+		short line_index= polygon->line_indexes[i];
+		struct line_data *line= get_line_data(line_index);
+
+		if (!line_is_visibility_portal(line_index)) continue;
+		if (line->clockwise_polygon_owner!=polygon_index && line->counterclockwise_polygon_owner!=polygon_index) return false;
+		if (line->clockwise_polygon_owner==line->counterclockwise_polygon_owner) return false;
+
+		short adjacent_polygon_index= find_adjacent_polygon(polygon_index, line_index);
+		if (adjacent_polygon_index<0 || adjacent_polygon_index>=dynamic_world->polygon_count) return false;
+
+		struct polygon_data *adjacent_polygon= get_polygon_data(adjacent_polygon_index);
+		short j;
+
+		if (adjacent_polygon->vertex_count>MAXIMUM_VERTICES_PER_POLYGON) return false;
+		for (j= 0; j<adjacent_polygon->vertex_count; ++j)
+		{
+			if (adjacent_polygon->line_indexes[j]==line_index) break;
+		}
+		if (j==adjacent_polygon->vertex_count) return false;
+	}
+
+	return true;
+}
+
+static void flood_polygon_visibility(
+	struct visibility_flood_data *flood,
+	short polygon_index,
+	short depth,
+	struct visibility_portal *source, /* first portal on this path, or NULL */
+	struct visibility_portal *pass) /* portal we entered through, or NULL */
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+
+	if (!flood->sound[polygon_index] || ++flood->steps>MAXIMUM_VISIBILITY_FLOOD_STEPS || depth>MAXIMUM_VISIBILITY_FLOOD_DEPTH)
+	{
+		flood->gave_up= true;
+		return;
+	}
+
+	flood->reached[polygon_index]= true;
+	flood->on_path[polygon_index]= true;
+	for (short i= 0; i<polygon->vertex_count && !flood->gave_up; ++i)
+	{
+		short line_index= polygon->line_indexes[i];
+
+		if (line_is_visibility_portal(line_index))
+		{
+			short adjacent_polygon_index= find_adjacent_polygon(polygon_index, line_index);
+
+			/* a straight line can't come back into a convex polygon it has left */
+			if (!flood->on_path[adjacent_polygon_index])
+			{
+				world_point2d *e0= &get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
+				world_point2d *e1= &get_endpoint_data(polygon->endpoint_indexes[i==polygon->vertex_count-1?0:i+1])->vertex;
+				struct visibility_portal portal= {(double)e0->x, (double)e0->y, (double)e1->x, (double)e1->y};
+
+				if (!source || source==pass || clip_visibility_portal(&portal, source, pass))
+				{
+					flood_polygon_visibility(flood, adjacent_polygon_index, depth+1, source ? source : &portal, &portal);
+				}
+			}
+		}
+	}
+	flood->on_path[polygon_index]= false;
+}
+
+/* a line through source and then pass can only continue on the pass side of any line that
+	separates them (one through an endpoint of each, with the rest of source on one side and the
+	rest of pass on the other); cut portal down to that region, false if nothing is left */
+static bool clip_visibility_portal(
+	struct visibility_portal *portal,
+	struct visibility_portal *source,
+	struct visibility_portal *pass)
+{
+	double source_x[2]= {source->x0, source->x1}, source_y[2]= {source->y0, source->y1};
+	double pass_x[2]= {pass->x0, pass->x1}, pass_y[2]= {pass->y0, pass->y1};
+
+	for (short i= 0; i<2; ++i)
+	{
+		for (short j= 0; j<2; ++j)
+		{
+			double dx= pass_x[j]-source_x[i], dy= pass_y[j]-source_y[i];
+			double length= sqrt(dx*dx + dy*dy);
+
+			if (length<1.0) continue;
+
+			/* positive on the left of source[i] -> pass[j] */
+			double source_side= dx*(source_y[!i]-source_y[i]) - dy*(source_x[!i]-source_x[i]);
+			double pass_side= dx*(pass_y[!j]-source_y[i]) - dy*(pass_x[!j]-source_x[i]);
+			double sign;
+
+			if (source_side<=0 && pass_side>=0 && (source_side!=0 || pass_side!=0)) sign= 1;
+			else if (source_side>=0 && pass_side<=0 && (source_side!=0 || pass_side!=0)) sign= -1;
+			else continue;
+
+			double slack= VISIBILITY_CLIP_TOLERANCE*length;
+			double side0= sign*(dx*(portal->y0-source_y[i]) - dy*(portal->x0-source_x[i])) + slack;
+			double side1= sign*(dx*(portal->y1-source_y[i]) - dy*(portal->x1-source_x[i])) + slack;
+
+			if (side0<0 && side1<0) return false;
+			if (side0<0)
+			{
+				double t= side0/(side0-side1);
+
+				portal->x0+= t*(portal->x1-portal->x0), portal->y0+= t*(portal->y1-portal->y0);
+			}
+			else if (side1<0)
+			{
+				double t= side1/(side1-side0);
+
+				portal->x1+= t*(portal->x0-portal->x1), portal->y1+= t*(portal->y0-portal->y1);
+			}
+		}
+	}
+
+	return true;
+}
+
+static void calculate_polygon_visibility(
+	void)
+{
+	short polygon_count= polygon_visibility.polygon_count;
+	int32 row_bytes= polygon_visibility.row_bytes;
+	struct visibility_flood_data flood;
+	vector<int32> first_endpoint_polygons(dynamic_world->endpoint_count+1, 0);
+	vector<short> endpoint_polygons;
+	short polygon_index;
+
+	polygon_visibility.rows.assign(polygon_count*row_bytes, 0);
+
+	flood.sound.resize(polygon_count);
+	flood.on_path.assign(polygon_count, false);
+	for (polygon_index= 0; polygon_index<polygon_count; ++polygon_index)
+	{
+		flood.sound[polygon_index]= polygon_is_visibility_sound(polygon_index);
+	}
+
+	/* the polygons using each endpoint, for the end-of-walk rule */
+	for (int pass= 0; pass<2; ++pass)
+	{
+		vector<int32> next_endpoint_polygons(first_endpoint_polygons);
+
+		if (pass) endpoint_polygons.resize(first_endpoint_polygons[dynamic_world->endpoint_count]);
+		for (polygon_index= 0; polygon_index<polygon_count; ++polygon_index)
+		{
+			struct polygon_data *polygon= get_polygon_data(polygon_index);
+
+			for (short i= 0; i<MIN(polygon->vertex_count, MAXIMUM_VERTICES_PER_POLYGON); ++i)
+			{
+				short endpoint_index= polygon->endpoint_indexes[i];
+
+				if (endpoint_index<0 || endpoint_index>=dynamic_world->endpoint_count) continue;
+				if (pass) endpoint_polygons[next_endpoint_polygons[endpoint_index]++]= polygon_index;
+				else first_endpoint_polygons[endpoint_index+1]+= 1;
+			}
+		}
+		if (!pass)
+		{
+			for (short i= 0; i<dynamic_world->endpoint_count; ++i) first_endpoint_polygons[i+1]+= first_endpoint_polygons[i];
+		}
+	}
+
+	for (polygon_index= 0; polygon_index<polygon_count; ++polygon_index)
+	{
+		uint8 *row= &polygon_visibility.rows[polygon_index*row_bytes];
+
+		flood.steps= 0;
+		flood.gave_up= false;
+		flood.reached.assign(polygon_count, false);
+		flood_polygon_visibility(&flood, polygon_index, 0, NULL, NULL);
+
+		if (flood.gave_up)
+		{
+			memset(row, 0xff, row_bytes);
+			std::fill(flood.on_path.begin(), flood.on_path.end(), false);
+			continue;
+		}
+
+		for (short reached_index= 0; reached_index<polygon_count; ++reached_index)
+		{
+			struct polygon_data *polygon;
+
+			if (!flood.reached[reached_index]) continue;
+
+			polygon= get_polygon_data(reached_index);
+			row[reached_index>>3]|= 1<<(reached_index&7);
+			for (short i= 0; i<polygon->vertex_count; ++i)
+			{
+				short endpoint_index= polygon->endpoint_indexes[i];
+
+				for (int32 j= first_endpoint_polygons[endpoint_index]; j<first_endpoint_polygons[endpoint_index+1]; ++j)
+				{
+					short neighbor_index= endpoint_polygons[j];
+
+					row[neighbor_index>>3]|= 1<<(neighbor_index&7);
+				}
+			}
+		}
+	}
+}
+
+/* ---------- the cache */
+
+/* everything the sets depend on: the geometry, and which lines are portals */
+static uint32 calculate_polygon_visibility_checksum(
+	uint16 *secondary_checksum)
+{
+	size_t length= 4*sizeof(int16) + dynamic_world->endpoint_count*2*sizeof(int16) +
+		dynamic_world->line_count*5*sizeof(int16);
+	short index;
+
+	for (index= 0; index<dynamic_world->polygon_count; ++index)
+	{
+		length+= sizeof(int16) + MIN(get_polygon_data(index)->vertex_count, MAXIMUM_VERTICES_PER_POLYGON)*2*sizeof(int16);
+	}
+
+	vector<uint8> buffer(length);
+	uint8 *S= &buffer[0];
+
+	ValueToStream(S, (int16) VISIBILITY_CACHE_VERSION);
+	ValueToStream(S, dynamic_world->endpoint_count);
+	ValueToStream(S, dynamic_world->line_count);
+	ValueToStream(S, dynamic_world->polygon_count);
+	for (index= 0; index<dynamic_world->endpoint_count; ++index)
+	{
+		world_point2d *vertex= &get_endpoint_data(index)->vertex;
+
+		ValueToStream(S, vertex->x);
+		ValueToStream(S, vertex->y);
+	}
+	for (index= 0; index<dynamic_world->line_count; ++index)
+	{
+		struct line_data *line= get_line_data(index);
+
+		ValueToStream(S, line->endpoint_indexes[0]);
+		ValueToStream(S, line->endpoint_indexes[1]);
+		ValueToStream(S, line->clockwise_polygon_owner);
+		ValueToStream(S, line->counterclockwise_polygon_owner);
+		ValueToStream(S, (int16) line_is_visibility_portal(index));
+	}
+	for (index= 0; index<dynamic_world->polygon_count; ++index)
+	{
+		struct polygon_data *polygon= get_polygon_data(index);
+		short vertex_count= MIN(polygon->vertex_count, MAXIMUM_VERTICES_PER_POLYGON);
+
+		ValueToStream(S, polygon->vertex_count);
+		for (short i= 0; i<vertex_count; ++i)
+		{
+			ValueToStream(S, polygon->endpoint_indexes[i]);
+			ValueToStream(S, polygon->line_indexes[i]);
+		}
+	}
+	assert(S==&buffer[0]+length);
+
+	/* a stale set can change what monsters see, so don't trust a single crc */
+	*secondary_checksum= calculate_data_crc_ccitt(&buffer[0], length);
+	return calculate_data_crc(&buffer[0], length);
+}
+
+static void get_polygon_visibility_cache_file(
+	uint32 checksum,
+	FileSpecifier& File)
+{
+	char name[32];
+
+	sprintf(name, "Visibility %08X", (unsigned int) checksum);
+	File.SetToMapCacheDir();
+	File+= name;
+}
+
+static bool read_polygon_visibility_cache(
+	uint32 checksum,
+	uint16 secondary_checksum)
+{
+	FileSpecifier File;
+	OpenedFile OFile;
+	uint8 header[SIZEOF_visibility_cache_header];
+	int32 length;
+
+	get_polygon_visibility_cache_file(checksum, File);
+	if (!File.Exists() || !File.Open(OFile)) return false;
+
+	int32 rows_length= polygon_visibility.polygon_count*polygon_visibility.row_bytes;
+	if (!OFile.GetLength(length) || length!=SIZEOF_visibility_cache_header+rows_length) return false;
+	if (!OFile.Read(SIZEOF_visibility_cache_header, header)) return false;
+
+	uint8 *S= header;
+	uint32 tag, file_checksum, rows_checksum;
+	int16 version, polygon_count, endpoint_count, line_count;
+	uint16 file_secondary_checksum, unused;
+
+	StreamToValue(S, tag);
+	StreamToValue(S, version);
+	StreamToValue(S, file_checksum);
+	StreamToValue(S, file_secondary_checksum);
+	StreamToValue(S, polygon_count);
+	StreamToValue(S, endpoint_count);
+	StreamToValue(S, line_count);
+	StreamToValue(S, unused);
+	StreamToValue(S, rows_checksum);
+	assert(S==header+SIZEOF_visibility_cache_header);
+
+	if (tag!=VISIBILITY_CACHE_TAG || version!=VISIBILITY_CACHE_VERSION ||
+		file_checksum!=checksum || file_secondary_checksum!=secondary_checksum ||
+		polygon_count!=dynamic_world->polygon_count || endpoint_count!=dynamic_world->endpoint_count ||
+		line_count!=dynamic_world->line_count)
+	{
+		return false;
+	}
+
+	polygon_visibility.rows.resize(rows_length);
+	/* the rows decide what monsters see, so a damaged file is recalculated, not believed */
+	if (!OFile.Read(rows_length, &polygon_visibility.rows[0]) ||
+		calculate_data_crc(&polygon_visibility.rows[0], rows_length)!=rows_checksum)
+	{
+		polygon_visibility.rows.clear();
+		return false;
+	}
+
+	return true;
+}
+
+static void write_polygon_visibility_cache(
+	uint32 checksum,
+	uint16 secondary_checksum)
+{
+	FileSpecifier File;
+	OpenedFile OFile;
+	uint8 header[SIZEOF_visibility_cache_header];
+	uint8 *S= header;
+
+	ValueToStream(S, (uint32) VISIBILITY_CACHE_TAG);
+	ValueToStream(S, (int16) VISIBILITY_CACHE_VERSION);
+	ValueToStream(S, checksum);
+	ValueToStream(S, secondary_checksum);
+	ValueToStream(S, dynamic_world->polygon_count);
+	ValueToStream(S, dynamic_world->endpoint_count);
+	ValueToStream(S, dynamic_world->line_count);
+	ValueToStream(S, (uint16) 0);
+	ValueToStream(S, calculate_data_crc(&polygon_visibility.rows[0], (int32) polygon_visibility.rows.size()));
+	assert(S==header+SIZEOF_visibility_cache_header);
+
+	get_polygon_visibility_cache_file(checksum, File);
+	if (!File.Create(_typecode_unknown) || !File.Open(OFile, true)) return;
+
+	if (!OFile.Write(SIZEOF_visibility_cache_header, header) ||
+		!OFile.Write((int32) polygon_visibility.rows.size(), &polygon_visibility.rows[0]))
+	{
+		/* don't leave a truncated file for next time */
+		OFile.Close();
+		File.Delete();
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef __POLYGON_VISIBILITY_H
+#define __POLYGON_VISIBILITY_H
+
+/*
+POLYGON_VISIBILITY.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Potentially visible sets: for every polygon, a bitset of the polygons a two-dimensional
+	sightline starting inside it could possibly end in.  Built (or read back from the map
+	cache) at level load when the environment preferences ask for them; under film profiles
+	that allow it, lets line_is_obstructed() turn down hopeless sightlines without walking them.
+*/
+
+#include "world.h"
+
+/* ---------- structures */
+
+struct polygon_visibility_benchmark
+{
+	int32 sample_count, rejected_count, mismatch_count;
+	int32 polygon_count, visible_pair_count;
+	uint64 walk_microseconds, visibility_microseconds;
+};
+
+/* ---------- prototypes/POLYGON_VISIBILITY.CPP */
+
+void precalculate_polygon_visibility(void);
+void invalidate_polygon_visibility(void);
+
+/* true only when the sightline p1p2, starting in polygon_index1, can't end in (or at an endpoint
+	of) polygon_index2 no matter how the level's doors and platforms are set; false means
+	"don't know", so the caller still has to walk the line */
+bool polygon_visibility_rejects_sightline(short polygon_index1, world_point2d *p1,
+	short polygon_index2, world_point2d *p2);
+
+void benchmark_polygon_visibility(int32 sample_count, struct polygon_visibility_benchmark *results);
+
+#endif
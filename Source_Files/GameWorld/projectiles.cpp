@@ -261,9 +261,10 @@ short new_projectile(
 	type= adjust_projectile_type(origin, polygon_index, type, owner_index, owner_type, intended_target_index, damage_scale);
 	definition= get_projectile_definition(type);
 
-	for (projectile_index= 0, projectile= projectiles; projectile_index<MAXIMUM_PROJECTILES_PER_MAP;
-		++projectile_index, ++projectile)
+	projectile_index= ProjectileSlots.first_free();
+	if (projectile_index!=NONE)
 	{
+		projectile= projectiles+projectile_index;
 		if (SLOT_IS_FREE(projectile))
 		{
 			angle facing, elevation;
@@ -298,6 +299,7 @@ short new_projectile(
 				projectile->distance_travelled= 0;
 				projectile->damage_scale= damage_scale;
 				MARK_SLOT_AS_USED(projectile);
+				ProjectileSlots.mark_used(projectile_index);
 
 				SET_OBJECT_OWNER(object, _object_is_projectile);
 				object->sound_pitch= definition->sound_pitch;
@@ -307,11 +309,12 @@ short new_projectile(
 			{
 				projectile_index= NONE;
 			}
-			
-			break;
+		}
+		else
+		{
+			projectile_index= NONE;
 		}
 	}
-	if (projectile_index==MAXIMUM_PROJECTILES_PER_MAP) projectile_index= NONE;
 	
 	return projectile_index;
 }
@@ -323,8 +326,9 @@ void move_projectiles(
 	struct projectile_data *projectile;
 	short projectile_index;
 	
-	for (projectile_index=0,projectile=projectiles;projectile_index<MAXIMUM_PROJECTILES_PER_MAP;++projectile_index,++projectile)
+	for (projectile_index= ProjectileSlots.first_used(); projectile_index!=NONE; projectile_index= ProjectileSlots.next_used(projectile_index))
 	{
+		projectile= projectiles+projectile_index;
 		if (SLOT_IS_USED(projectile))
 		{
 			struct object_data *object= get_object_data(projectile->object_index);
@@ -583,6 +587,7 @@ void remove_projectile(
 	L_Invalidate_Projectile(projectile_index);
 	remove_map_object(projectile->object_index);
 	MARK_SLOT_AS_FREE(projectile);
+	ProjectileSlots.mark_free(projectile_index);
 }
 
 void remove_all_projectiles(
@@ -591,8 +596,9 @@ void remove_all_projectiles(
 	struct projectile_data *projectile;
 	short projectile_index;
 	
-	for (projectile_index=0,projectile=projectiles;projectile_index<MAXIMUM_PROJECTILES_PER_MAP;++projectile_index,++projectile)
+	for (projectile_index= ProjectileSlots.first_used(); projectile_index!=NONE; projectile_index= ProjectileSlots.next_used(projectile_index))
 	{
+		projectile= projectiles+projectile_index;
 		if (SLOT_IS_USED(projectile)) remove_projectile(projectile_index);
 	}
 }
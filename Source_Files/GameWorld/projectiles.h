@@ -43,6 +43,7 @@ Jan 6, 2001 (Loren Petrich):
 
 // LP addition:
 #include "dynamic_limits.h"
+#include "slot_pool.h"
 #include "world.h" // for angle
 
 #include <vector>
@@ -156,6 +157,7 @@ enum /* translate_projectile() flags */
 
 extern std::vector<projectile_data> ProjectileList;
 #define projectiles (ProjectileList.data())
+extern slot_pool ProjectileSlots;
 
 // extern struct projectile_data *projectiles;
 
@@ -154,8 +154,9 @@ void randomize_scenery_shapes(
 	
 	AnimatedSceneryObjects.clear();
 	
-	for (object_index= 0, object= objects; object_index<MAXIMUM_OBJECTS_PER_MAP; ++object_index, ++object)
+	for (object_index= ObjectSlots.first_used(); object_index!=NONE; object_index= ObjectSlots.next_used(object_index))
 	{
+		object= objects+object_index;
 		if (SLOT_IS_USED(object) && GET_OBJECT_OWNER(object)==_object_is_scenery)
 		{
 			struct scenery_definition *definition= get_scenery_definition(object->permutation);
@@ -169,6 +170,18 @@ void randomize_scenery_shapes(
 	}
 }
 
+const std::vector<short>& get_animated_scenery(
+	void)
+{
+	return AnimatedSceneryObjects;
+}
+
+void set_animated_scenery(
+	const std::vector<short>& object_indexes)
+{
+	AnimatedSceneryObjects= object_indexes;
+}
+
 void get_scenery_dimensions(
 	short scenery_type,
 	world_distance *radius,
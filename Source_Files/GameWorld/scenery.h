@@ -29,6 +29,8 @@ May 18, 2000 (Loren Petrich):
 
 #include "world.h"
 
+#include <vector>
+
 /* ---------- prototypes/SCENERY.C */
 
 void initialize_scenery(void);
@@ -43,6 +45,10 @@ void randomize_scenery_shape(short object_index);
 
 void randomize_scenery_shapes(void);
 
+// for world snapshots
+const std::vector<short>& get_animated_scenery(void);
+void set_animated_scenery(const std::vector<short>& object_indexes);
+
 void get_scenery_dimensions(short scenery_type, world_distance *radius, world_distance *height);
 void damage_scenery(short object_index);
 
@@ -0,0 +1,154 @@
+#ifndef __SLOT_POOL_H
+#define __SLOT_POOL_H
+
+/*
+SLOT_POOL.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Index of which slots of an object, monster, projectile or effect list are in use, so loops
+	and allocators don't have to test SLOT_IS_USED() on every one of MAXIMUM_*_PER_MAP slots.
+	It's one bit per slot, so marking a slot used or free is a single bit operation wherever
+	the slot is, and finding one takes a word (64 slots) at a time.
+
+	The 0x8000 flag is still the truth; whoever sets or clears it must tell the pool, and
+	whoever rewrites a whole list (level setup, restoring a saved game) must rebuild it.
+	Behaviour is the same as the old linear scans, which films and network games depend on:
+	first_free() is the lowest free index, and next_used() is the next used index above the
+	given one as of right now, so slots used or freed during a loop are seen exactly when
+	the old loop would have seen them.
+*/
+
+#include "cseries.h"
+
+#include <vector>
+
+class slot_pool
+{
+public:
+	slot_pool() : slot_count(0), used_total(0) {}
+
+	/* every slot free */
+	void reset(size_t count)
+	{
+		used_bits.assign((count+63)/64, 0);
+		slot_count= count;
+		used_total= 0;
+	}
+
+	/* from the SLOT_IS_USED() bits of slots[0..count-1] */
+	template <class T> void rebuild(const T *slots, size_t count)
+	{
+		reset(count);
+		for (size_t i= 0; i<count; ++i)
+		{
+			if (slots[i].flags&(uint16)0x8000) mark_used(static_cast<int16>(i));
+		}
+	}
+
+	/* NONE if the list is full */
+	int16 first_free() const
+	{
+		for (size_t word= 0; word<used_bits.size(); ++word)
+		{
+			if (~used_bits[word])
+			{
+				size_t index= 64*word + lowest_bit(~used_bits[word]);
+				return index<slot_count ? static_cast<int16>(index) : NONE;
+			}
+		}
+		return NONE;
+	}
+
+	void mark_used(int16 index)
+	{
+		uint64 bit= static_cast<uint64>(1)<<(index&63);
+
+		assert(index>=0 && static_cast<size_t>(index)<slot_count);
+		if (!(used_bits[index>>6]&bit))
+		{
+			used_bits[index>>6]|= bit;
+			used_total+= 1;
+		}
+	}
+
+	void mark_free(int16 index)
+	{
+		uint64 bit= static_cast<uint64>(1)<<(index&63);
+
+		assert(index>=0 && static_cast<size_t>(index)<slot_count);
+		if (used_bits[index>>6]&bit)
+		{
+			used_bits[index>>6]&= ~bit;
+			used_total-= 1;
+		}
+	}
+
+	/* for (i= pool.first_used(); i!=NONE; i= pool.next_used(i)) visits used slots in index order */
+	int16 first_used() const { return used_from(0); }
+	int16 next_used(int16 index) const { return used_from(index+1); }
+	int16 last_used() const
+	{
+		for (size_t word= used_bits.size(); word>0; --word)
+		{
+			if (used_bits[word-1])
+			{
+				int bit= 63;
+				while (!(used_bits[word-1]&(static_cast<uint64>(1)<<bit))) bit-= 1;
+				return static_cast<int16>(64*(word-1) + bit);
+			}
+		}
+		return NONE;
+	}
+
+	size_t used_count() const { return used_total; }
+
+private:
+	std::vector<uint64> used_bits; /* bit i of word i/64 is slot i; bits past slot_count stay clear */
+	size_t slot_count, used_total;
+
+	/* the lowest used slot at or above index */
+	int16 used_from(size_t index) const
+	{
+		if (index>=slot_count) return NONE;
+
+		size_t word= index>>6;
+		uint64 bits= used_bits[word]&(~static_cast<uint64>(0)<<(index&63));
+		for (;;)
+		{
+			if (bits) return static_cast<int16>(64*word + lowest_bit(bits));
+			if (++word==used_bits.size()) return NONE;
+			bits= used_bits[word];
+		}
+	}
+
+	/* bits must not be zero */
+	static int lowest_bit(uint64 bits)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctzll(bits);
+#else
+		int bit= 0;
+		while (!(bits&0xff)) bits>>= 8, bit+= 8;
+		while (!(bits&1)) bits>>= 1, bit+= 1;
+		return bit;
+#endif
+	}
+};
+
+#endif
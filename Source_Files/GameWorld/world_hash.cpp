@@ -0,0 +1,271 @@
+/*
+WORLD_HASH.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	the hash is murmur3's block mixing, four bytes at a time, run over each record as the saved
+	game packs it: field by field into a zeroed buffer, so compiler padding and whatever follows
+	a name's terminator never reach the hash.  entity lists are walked through their slot pools,
+	so only slots in use (and their indexes) are hashed and the cost follows the population, not
+	MAXIMUM_*_PER_MAP.
+*/
+
+#include "cseries.h"
+#include "map.h"
+#include "world_hash.h"
+#include "player.h"
+#include "monsters.h"
+#include "projectiles.h"
+#include "effects.h"
+#include "platforms.h"
+#include "lightsource.h"
+#include "media.h"
+
+#include <string.h>
+
+#include <vector>
+using std::vector;
+
+/* ---------- globals */
+
+static struct world_hash current_world_hash;
+
+/* big enough for any record we pack */
+static uint8 packed_record[SIZEOF_player_data];
+
+static const char *world_hash_subsystem_names[NUMBER_OF_WORLD_HASH_SUBSYSTEMS]=
+{
+	"dynamic world",
+	"random seed",
+	"players",
+	"objects",
+	"monsters",
+	"projectiles",
+	"effects",
+	"platforms",
+	"lights",
+	"media"
+};
+
+/* ---------- private prototypes */
+
+static inline uint32 rotate_left(uint32 value, int count);
+static inline uint32 mix_word(uint32 hash, uint32 word);
+static uint32 mix_bytes(uint32 hash, const void *data, size_t length);
+static uint32 finish_hash(uint32 hash, size_t length);
+
+template <class T> static uint32 mix_record(uint32 hash, T record,
+	uint8 *(*pack)(uint8 *, T *, size_t), size_t packed_length);
+template <class T> static uint32 hash_used_slots(slot_pool& pool, const vector<T>& list,
+	uint8 *(*pack)(uint8 *, T *, size_t), size_t packed_length);
+template <class T> static uint32 hash_list(const vector<T>& list,
+	uint8 *(*pack)(uint8 *, T *, size_t), size_t packed_length);
+
+/* ---------- code */
+
+void update_world_hash(
+	void)
+{
+	calculate_world_hash(&current_world_hash);
+}
+
+const struct world_hash *get_world_hash(
+	void)
+{
+	return &current_world_hash;
+}
+
+void calculate_world_hash(
+	struct world_hash *hash)
+{
+	uint32 *subsystems= hash->subsystems;
+
+	/* who's talking is up to the microphone, and replays hand out their own cheat flags */
+	{
+		struct dynamic_data world= *dynamic_world;
+
+		world.speaking_player_index= NONE;
+		world.game_information.cheat_flags= 0;
+		subsystems[_hash_dynamic_world]= finish_hash(mix_record(0, world, pack_dynamic_data, SIZEOF_dynamic_data), SIZEOF_dynamic_data);
+	}
+	subsystems[_hash_random_seed]= finish_hash(mix_word(0, get_random_seed()), sizeof(uint32));
+
+	/* the inventory scroll state isn't game state; it's changed outside the game loop and
+		prediction deliberately doesn't put it back */
+	{
+		uint32 players_hash= 0;
+		short player_index;
+
+		for (player_index= 0; player_index<dynamic_world->player_count; ++player_index)
+		{
+			struct player_data player= *get_player_data(player_index);
+			size_t name_length= strnlen(player.name, sizeof(player.name));
+
+			player.interface_flags= 0;
+			player.interface_decay= 0;
+			memset(player.name+name_length, 0, sizeof(player.name)-name_length);
+			players_hash= mix_record(players_hash, player, pack_player_data, SIZEOF_player_data);
+		}
+		subsystems[_hash_players]= finish_hash(players_hash, dynamic_world->player_count*SIZEOF_player_data);
+	}
+
+	subsystems[_hash_objects]= hash_used_slots(ObjectSlots, ObjectList, pack_object_data, SIZEOF_object_data);
+	subsystems[_hash_monsters]= hash_used_slots(MonsterSlots, MonsterList, pack_monster_data, SIZEOF_monster_data);
+	subsystems[_hash_projectiles]= hash_used_slots(ProjectileSlots, ProjectileList, pack_projectile_data, SIZEOF_projectile_data);
+	subsystems[_hash_effects]= hash_used_slots(EffectSlots, EffectList, pack_effect_data, SIZEOF_effect_data);
+
+	subsystems[_hash_platforms]= hash_list(PlatformList, pack_platform_data, SIZEOF_platform_data);
+	subsystems[_hash_lights]= hash_list(LightList, pack_light_data, SIZEOF_light_data);
+	subsystems[_hash_media]= hash_list(MediaList, pack_media_data, SIZEOF_media_data);
+
+	hash->tick= dynamic_world->tick_count;
+	{
+		uint32 combined= 0;
+
+		for (short subsystem= 0; subsystem<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; ++subsystem)
+		{
+			combined= mix_word(combined, subsystems[subsystem]);
+		}
+		hash->combined= finish_hash(combined, sizeof(hash->subsystems));
+	}
+}
+
+const char *get_world_hash_subsystem_name(
+	short subsystem)
+{
+	return (subsystem>=0 && subsystem<NUMBER_OF_WORLD_HASH_SUBSYSTEMS) ? world_hash_subsystem_names[subsystem] : "unknown";
+}
+
+uint64 benchmark_world_hash(
+	int32 iteration_count)
+{
+	struct world_hash hash;
+
+	uint64 start= machine_microsecond_count();
+	for (int32 i= 0; i<iteration_count; ++i) calculate_world_hash(&hash);
+
+	return machine_microsecond_count() - start;
+}
+
+/* ---------- private code */
+
+static inline uint32 rotate_left(
+	uint32 value,
+	int count)
+{
+	return (value<<count) | (value>>(32-count));
+}
+
+static inline uint32 mix_word(
+	uint32 hash,
+	uint32 word)
+{
+	word*= 0xcc9e2d51;
+	word= rotate_left(word, 15);
+	word*= 0x1b873593;
+
+	hash^= word;
+	hash= rotate_left(hash, 13);
+	return hash*5 + 0xe6546b64;
+}
+
+static uint32 mix_bytes(
+	uint32 hash,
+	const void *data,
+	size_t length)
+{
+	const byte *p= static_cast<const byte *>(data);
+	uint32 word;
+
+	/* words are read little-endian whatever the machine, so the hash is the same everywhere */
+	for (; length>=sizeof(word); length-= sizeof(word), p+= sizeof(word))
+	{
+		word= p[0] | (p[1]<<8) | (p[2]<<16) | (static_cast<uint32>(p[3])<<24);
+		hash= mix_word(hash, word);
+	}
+	if (length)
+	{
+		word= 0;
+		for (size_t i= 0; i<length; ++i) word|= static_cast<uint32>(p[i])<<(8*i);
+		hash= mix_word(hash, word);
+	}
+
+	return hash;
+}
+
+static uint32 finish_hash(
+	uint32 hash,
+	size_t length)
+{
+	hash^= static_cast<uint32>(length);
+	hash^= hash>>16;
+	hash*= 0x85ebca6b;
+	hash^= hash>>13;
+	hash*= 0xc2b2ae35;
+	hash^= hash>>16;
+
+	return hash;
+}
+
+/* the packers skip over unused fields, so those have to be zeroed for every record */
+template <class T> static uint32 mix_record(
+	uint32 hash,
+	T record,
+	uint8 *(*pack)(uint8 *, T *, size_t),
+	size_t packed_length)
+{
+	assert(packed_length<=sizeof(packed_record));
+	memset(packed_record, 0, packed_length);
+	pack(packed_record, &record, 1);
+
+	return mix_bytes(hash, packed_record, packed_length);
+}
+
+template <class T> static uint32 hash_used_slots(
+	slot_pool& pool,
+	const vector<T>& list,
+	uint8 *(*pack)(uint8 *, T *, size_t),
+	size_t packed_length)
+{
+	uint32 hash= 0;
+	size_t length= 0;
+
+	for (int16 index= pool.first_used(); index!=NONE; index= pool.next_used(index))
+	{
+		hash= mix_word(hash, index);
+		hash= mix_record(hash, list[index], pack, packed_length);
+		length+= packed_length;
+	}
+
+	return finish_hash(hash, length);
+}
+
+template <class T> static uint32 hash_list(
+	const vector<T>& list,
+	uint8 *(*pack)(uint8 *, T *, size_t),
+	size_t packed_length)
+{
+	uint32 hash= 0;
+
+	for (size_t index= 0; index<list.size(); ++index)
+	{
+		hash= mix_record(hash, list[index], pack, packed_length);
+	}
+
+	return finish_hash(hash, list.size()*packed_length);
+}
@@ -0,0 +1,71 @@
+#ifndef __WORLD_HASH_H
+#define __WORLD_HASH_H
+
+/*
+WORLD_HASH.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Per-tick hashes of the simulation, one per subsystem, for finding out exactly when (and
+	where) a network game or a film replay stopped doing what it did the first time.  Hashes
+	are of the structures as saved games pack them, field by field, so padding and stale bytes
+	don't count and they compare between machines of either byte order.
+*/
+
+#include "cseries.h"
+
+/* ---------- constants */
+
+enum /* subsystems */
+{
+	_hash_dynamic_world,
+	_hash_random_seed,
+	_hash_players,
+	_hash_objects,
+	_hash_monsters,
+	_hash_projectiles,
+	_hash_effects,
+	_hash_platforms,
+	_hash_lights,
+	_hash_media,
+	NUMBER_OF_WORLD_HASH_SUBSYSTEMS
+};
+
+/* ---------- structures */
+
+struct world_hash
+{
+	int32 tick;
+	uint32 combined;
+	uint32 subsystems[NUMBER_OF_WORLD_HASH_SUBSYSTEMS];
+};
+
+/* ---------- prototypes/WORLD_HASH.CPP */
+
+/* called at the end of every tick */
+void update_world_hash(void);
+const struct world_hash *get_world_hash(void);
+
+void calculate_world_hash(struct world_hash *hash);
+
+const char *get_world_hash_subsystem_name(short subsystem);
+
+/* microseconds for iteration_count hashes of the current world */
+uint64 benchmark_world_hash(int32 iteration_count);
+
+#endif
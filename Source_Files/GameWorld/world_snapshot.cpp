@@ -0,0 +1,254 @@
+/*
+WORLD_SNAPSHOT.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	every region is a flat array of plain structures, so a snapshot is a list of memcpy()s into
+	(or out of) the arena; the few pieces of state kept in containers (slot pools, the animated
+	scenery list, Lua) are copied by assignment next to it.
+*/
+
+#include "cseries.h"
+#include "map.h"
+#include "world_snapshot.h"
+#include "player.h"
+#include "weapons.h"
+#include "monsters.h"
+#include "projectiles.h"
+#include "effects.h"
+#include "platforms.h"
+#include "lightsource.h"
+#include "media.h"
+#include "scenery.h"
+#include "flood_map.h"
+#include "computer_interface.h"
+#include "lua_script.h"
+#include "Logging.h"
+
+#include <string.h>
+
+#include <vector>
+using std::vector;
+
+/* ---------- structures */
+
+struct snapshot_region
+{
+	void *data;
+	size_t length;
+};
+
+/* ---------- globals */
+
+static vector<snapshot_region> snapshot_regions;
+
+/* ---------- private prototypes */
+
+static void collect_snapshot_regions(void);
+static void add_snapshot_region(void *data, size_t length);
+template <class T> static void add_snapshot_region(vector<T>& list);
+
+static bool snapshot_matches_level(struct world_snapshot *snapshot);
+
+/* ---------- code */
+
+void take_world_snapshot(
+	struct world_snapshot *snapshot,
+	bool include_lua)
+{
+	size_t total_length= 0;
+	size_t i;
+
+	collect_snapshot_regions();
+	snapshot->region_lengths.resize(snapshot_regions.size());
+	for (i= 0; i<snapshot_regions.size(); ++i)
+	{
+		snapshot->region_lengths[i]= snapshot_regions[i].length;
+		total_length+= snapshot_regions[i].length;
+	}
+
+	/* keeps its capacity, so after the first snapshot this doesn't allocate */
+	snapshot->arena.resize(total_length);
+
+	byte *p= snapshot->arena.data();
+	for (i= 0; i<snapshot_regions.size(); ++i)
+	{
+		memcpy(p, snapshot_regions[i].data, snapshot_regions[i].length);
+		p+= snapshot_regions[i].length;
+	}
+
+	snapshot->object_slots= ObjectSlots;
+	snapshot->monster_slots= MonsterSlots;
+	snapshot->projectile_slots= ProjectileSlots;
+	snapshot->effect_slots= EffectSlots;
+	snapshot->animated_scenery= get_animated_scenery();
+	snapshot->random_seed= get_random_seed();
+	snapshot->path_cache_checkpoint= checkpoint_path_cache();
+
+	snapshot->includes_lua= include_lua;
+	if (include_lua) save_lua_snapshot(snapshot->lua_states);
+	else snapshot->lua_states.clear();
+
+	snapshot->valid= true;
+}
+
+bool restore_world_snapshot(
+	struct world_snapshot *snapshot)
+{
+	collect_snapshot_regions();
+	if (!snapshot_matches_level(snapshot))
+	{
+		logWarning("world snapshot doesn't match the current level; not restored");
+		return false;
+	}
+
+	const byte *p= snapshot->arena.data();
+	for (size_t i= 0; i<snapshot_regions.size(); ++i)
+	{
+		memcpy(snapshot_regions[i].data, p, snapshot_regions[i].length);
+		p+= snapshot_regions[i].length;
+	}
+
+	ObjectSlots= snapshot->object_slots;
+	MonsterSlots= snapshot->monster_slots;
+	ProjectileSlots= snapshot->projectile_slots;
+	EffectSlots= snapshot->effect_slots;
+	set_animated_scenery(snapshot->animated_scenery);
+	set_random_seed(snapshot->random_seed);
+
+	/* routes found since the snapshot were found in a world that no longer exists */
+	rewind_path_cache(snapshot->path_cache_checkpoint);
+
+	if (snapshot->includes_lua) restore_lua_snapshot(snapshot->lua_states);
+
+	return true;
+}
+
+void benchmark_world_snapshot(
+	int32 iteration_count,
+	struct world_snapshot_benchmark *results)
+{
+	struct world_snapshot snapshot, check;
+	int32 i;
+
+	obj_clear(*results);
+	if (!dynamic_world || !dynamic_world->polygon_count || iteration_count<=0) return;
+
+	/* grow the arena before we start timing */
+	take_world_snapshot(&snapshot);
+
+	uint64 start= machine_microsecond_count();
+	for (i= 0; i<iteration_count; ++i) take_world_snapshot(&snapshot);
+	results->take_microseconds= machine_microsecond_count() - start;
+
+	start= machine_microsecond_count();
+	for (i= 0; i<iteration_count; ++i) restore_world_snapshot(&snapshot);
+	results->restore_microseconds= machine_microsecond_count() - start;
+
+	/* a round trip must leave every region exactly as it was */
+	take_world_snapshot(&check);
+	size_t offset= 0;
+	for (size_t region_index= 0; region_index<snapshot.region_lengths.size(); ++region_index)
+	{
+		size_t length= snapshot.region_lengths[region_index];
+
+		if (memcmp(&snapshot.arena[offset], &check.arena[offset], length)) results->mismatch_count+= 1;
+		offset+= length;
+	}
+
+	/* only timed going out; restoring would swap live tables out from under the scripts */
+	start= machine_microsecond_count();
+	save_lua_snapshot(snapshot.lua_states);
+	results->lua_microseconds= machine_microsecond_count() - start;
+	for (std::map<int, std::string>::iterator it= snapshot.lua_states.begin(); it!=snapshot.lua_states.end(); ++it)
+	{
+		results->lua_bytes+= it->second.size();
+	}
+
+	results->iteration_count= iteration_count;
+	results->region_count= snapshot.region_lengths.size();
+	results->snapshot_bytes= snapshot.arena.size();
+}
+
+/* ---------- private code */
+
+static void collect_snapshot_regions(
+	void)
+{
+	snapshot_regions.clear();
+
+	add_snapshot_region(static_world, sizeof(struct static_data));
+	add_snapshot_region(dynamic_world, sizeof(struct dynamic_data));
+
+	add_snapshot_region(players, dynamic_world->player_count*sizeof(struct player_data));
+	add_snapshot_region(get_weapon_array(), calculate_weapon_array_length());
+	add_snapshot_region(get_player_terminal_array(), calculate_player_terminal_array_length());
+	add_snapshot_region(team_damage_given, sizeof(team_damage_given));
+	add_snapshot_region(team_damage_taken, sizeof(team_damage_taken));
+	add_snapshot_region(team_monster_damage_taken, sizeof(team_monster_damage_taken));
+	add_snapshot_region(team_monster_damage_given, sizeof(team_monster_damage_given));
+	add_snapshot_region(team_friendly_fire, sizeof(team_friendly_fire));
+
+	add_snapshot_region(ObjectList);
+	add_snapshot_region(MonsterList);
+	add_snapshot_region(ProjectileList);
+	add_snapshot_region(EffectList);
+	add_snapshot_region(PolygonFirstObstacle);
+	add_snapshot_region(ObjectNextObstacle);
+
+	add_snapshot_region(EndpointList);
+	add_snapshot_region(LineList);
+	add_snapshot_region(SideList);
+	add_snapshot_region(PolygonList);
+	add_snapshot_region(PlatformList);
+	add_snapshot_region(LightList);
+	add_snapshot_region(MediaList);
+
+	add_snapshot_region(get_placement_info(), 2*MAXIMUM_OBJECT_TYPES*sizeof(struct object_frequency_definition));
+	add_snapshot_region(get_path_array(), calculate_path_array_length());
+}
+
+static void add_snapshot_region(
+	void *data,
+	size_t length)
+{
+	struct snapshot_region region;
+
+	region.data= data;
+	region.length= data ? length : 0;
+	snapshot_regions.push_back(region);
+}
+
+template <class T> static void add_snapshot_region(
+	vector<T>& list)
+{
+	add_snapshot_region(list.data(), list.size()*sizeof(T));
+}
+
+static bool snapshot_matches_level(
+	struct world_snapshot *snapshot)
+{
+	if (!snapshot->valid || snapshot->region_lengths.size()!=snapshot_regions.size()) return false;
+
+	for (size_t i= 0; i<snapshot_regions.size(); ++i)
+	{
+		if (snapshot->region_lengths[i]!=snapshot_regions[i].length) return false;
+	}
+
+	return true;
+}
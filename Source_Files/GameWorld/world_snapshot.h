@@ -0,0 +1,78 @@
+#ifndef __WORLD_SNAPSHOT_H
+#define __WORLD_SNAPSHOT_H
+
+/*
+WORLD_SNAPSHOT.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	In-memory copies of the whole simulation: static and dynamic world, every entity list,
+	map geometry, platforms, lights, media, players and their weapons and terminals, paths,
+	placement, the random seed and, if asked for, the persistent tables of running Lua scripts.
+	Everything goes into one arena in one pass and comes back out the same way; the arena is
+	kept between snapshots, so taking one every tick doesn't allocate.
+
+	A snapshot is only good for the level it was taken on.  Lua script globals and locals are
+	not captured, only the tables scripts keep their custom fields in.  Neither is the automap,
+	which only records what players have seen and never feeds back into the game.
+*/
+
+#include "cseries.h"
+#include "slot_pool.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/* ---------- structures */
+
+struct world_snapshot
+{
+	bool valid;
+
+	std::vector<byte> arena;
+	std::vector<size_t> region_lengths; /* to notice the level changed under us */
+
+	slot_pool object_slots, monster_slots, projectile_slots, effect_slots;
+	std::vector<short> animated_scenery;
+	uint16 random_seed;
+	uint32 path_cache_checkpoint;
+
+	bool includes_lua;
+	std::map<int, std::string> lua_states;
+
+	world_snapshot() : valid(false), random_seed(0), path_cache_checkpoint(0), includes_lua(false) {}
+};
+
+struct world_snapshot_benchmark
+{
+	int32 iteration_count, region_count, mismatch_count;
+	uint32 snapshot_bytes, lua_bytes;
+	uint64 take_microseconds, restore_microseconds, lua_microseconds;
+};
+
+/* ---------- prototypes/WORLD_SNAPSHOT.CPP */
+
+void take_world_snapshot(struct world_snapshot *snapshot, bool include_lua= false);
+
+/* false (and nothing touched) if the snapshot is empty or from another level */
+bool restore_world_snapshot(struct world_snapshot *snapshot);
+
+void benchmark_world_snapshot(int32 iteration_count, struct world_snapshot_benchmark *results);
+
+#endif
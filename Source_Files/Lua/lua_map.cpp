@@ -30,6 +30,7 @@ LUA_MAP.CPP
 #include "lua_templates.h"
 #include "lightsource.h"
 #include "map.h"
+#include "flood_map.h"
 #include "media.h"
 #include "platforms.h"
 #include "OGL_Setup.h"
@@ -599,6 +600,7 @@ static int Lua_Polygon_Floor_Set_Height(lua_State *L)
 		recalculate_redundant_endpoint_data(polygon->endpoint_indexes[i]);
 		recalculate_redundant_line_data(polygon->line_indexes[i]);
 	}
+	invalidate_path_cache();
 	return 0;
 }
 
@@ -753,6 +755,7 @@ static int Lua_Polygon_Ceiling_Set_Height(lua_State *L)
 		recalculate_redundant_endpoint_data(polygon->endpoint_indexes[i]);
 		recalculate_redundant_line_data(polygon->line_indexes[i]);
 	}
+	invalidate_path_cache();
 	return 0;
 }
 
@@ -1386,6 +1389,7 @@ static int Lua_Polygon_Set_Media(lua_State *L)
 	}
 
 	polygon->media_index = media_index;
+	invalidate_path_cache();
 	return 0;
 }
 		
@@ -1396,6 +1400,7 @@ static int Lua_Polygon_Set_Permutation(lua_State *L)
 	
 	int permutation = static_cast<int>(lua_tonumber(L, 2));
 	get_polygon_data(Lua_Polygon::Index(L, 1))->permutation = permutation;
+	invalidate_path_cache();
 	return 0;
 }
 
@@ -1418,6 +1423,7 @@ static int Lua_Polygon_Set_Type(lua_State *L)
 	}
 
 	get_polygon_data(Lua_Polygon::Index(L, 1))->type = type;
+	invalidate_path_cache();
 	return 0;
 }
 
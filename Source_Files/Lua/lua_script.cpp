@@ -197,6 +197,9 @@ int GetLuaGameEndCondition() {
 	return _game_normal_end_condition;
 }
 
+void save_lua_snapshot(std::map<int, std::string>& snapshot) { snapshot.clear(); }
+void restore_lua_snapshot(const std::map<int, std::string>& snapshot) {}
+
 #else /* HAVE_LUA */
 
 bool mute_lua = false;
@@ -347,6 +350,11 @@ public:
 	int RestorePassed(const std::string& s);
 	int RestoreAll(const std::string& s);
 
+	void RestoreSnapshot(const std::string& s) {
+		RestoreAll(s);
+		lua_pop(State(), 1);
+	}
+
 private:
 	bool running_;
 	int num_scripts_;
@@ -2237,6 +2245,27 @@ size_t save_lua_states()
 	return length;
 }
 
+void save_lua_snapshot(std::map<int, std::string>& snapshot)
+{
+	snapshot.clear();
+	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
+	{
+		snapshot[it->first] = it->second->SaveAll();
+	}
+}
+
+void restore_lua_snapshot(const std::map<int, std::string>& snapshot)
+{
+	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
+	{
+		std::map<int, std::string>::const_iterator saved = snapshot.find(it->first);
+		if (saved != snapshot.end())
+		{
+			it->second->RestoreSnapshot(saved->second);
+		}
+	}
+}
+
 void pack_lua_states(uint8* data, size_t length)
 {
 	io::stream_buffer<io::array_sink> sb(reinterpret_cast<char*>(data), length);
@@ -93,6 +93,10 @@ void unpack_lua_states(uint8* data, size_t length);
 size_t save_lua_states();
 void pack_lua_states(uint8* data, size_t length);
 
+// persistent tables of every running script, by script type, for world snapshots
+void save_lua_snapshot(std::map<int, std::string>& snapshot);
+void restore_lua_snapshot(const std::map<int, std::string>& snapshot);
+
 ActionQueues* GetLuaActionQueues();
 
 void MarkLuaCollections(bool active);
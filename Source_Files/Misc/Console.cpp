@@ -40,6 +40,22 @@
 #include "FileHandler.h"
 #include "game_wad.h"
 
+// for benchmarks
+#include "map.h"
+#include "flood_map.h"
+#include "polygon_visibility.h"
+#include "world_snapshot.h"
+#include "world_hash.h"
+#include "interpolated_world.h"
+#include "render.h"
+#include "screen.h"
+#include "span_kernels.h"
+#include "present_kernels.h"
+#include "wad.h"
+#include "crc.h"
+#include "QuickSave.h"
+#include "InfoTreeCache.h"
+
 #include <boost/algorithm/string/predicate.hpp>
 
 using namespace std;
@@ -51,6 +67,8 @@ Console::Console() : m_active(false), m_carnage_messages_exist(false), m_use_lua
 	m_command_iter = m_prev_commands.end();
 	m_carnage_messages.resize(NUMBER_OF_PROJECTILE_TYPES);
 	register_save_commands();
+	register_benchmark_commands();
+	register_render_commands();
 }
 
 Console *Console::instance() {
@@ -451,6 +469,607 @@ void Console::register_save_commands()
 	register_command("save", saveParser);
 }
 	
+struct benchmark_polygon_index
+{
+	void operator() (const std::string& arg) const {
+		polygon_location_index_benchmark results;
+		int32 samples = atoi(arg.c_str());
+		if (samples <= 0) samples = 100000;
+
+		benchmark_polygon_location_index(samples, &results);
+		if (!results.sample_count)
+		{
+			screen_printf("No polygon location index; load a level first");
+			return;
+		}
+
+		screen_printf("polygon index: %d lookups, scan %.1f ms, index %.1f ms, %d mismatches, %d unbounded polygons",
+			      results.sample_count,
+			      results.scan_microseconds / 1000.0,
+			      results.index_microseconds / 1000.0,
+			      results.mismatch_count,
+			      results.unbounded_polygon_count);
+		logNote("polygon location index benchmark: %d lookups, scan %llu us, index %llu us, %d mismatches, %d unbounded polygons",
+			results.sample_count,
+			(unsigned long long) results.scan_microseconds,
+			(unsigned long long) results.index_microseconds,
+			results.mismatch_count,
+			results.unbounded_polygon_count);
+	}
+};
+
+struct benchmark_flood
+{
+	void operator() (const std::string&) const {
+		flood_map_benchmark results;
+
+		benchmark_flood_map(&results);
+		if (!results.flood_count)
+		{
+			screen_printf("No polygons to flood; load a level first");
+			return;
+		}
+
+		screen_printf("flood map: %d floods, %d polygons, heap %.1f ms, linear %.1f ms, %d mismatches",
+			      results.flood_count,
+			      results.polygons_visited,
+			      results.heap_microseconds / 1000.0,
+			      results.linear_microseconds / 1000.0,
+			      results.mismatch_count);
+		logNote("flood map benchmark: %d floods, %d polygons, heap %llu us, linear %llu us, %d mismatches",
+			results.flood_count,
+			results.polygons_visited,
+			(unsigned long long) results.heap_microseconds,
+			(unsigned long long) results.linear_microseconds,
+			results.mismatch_count);
+	}
+};
+
+struct benchmark_visibility
+{
+	void operator() (const std::string& arg) const {
+		polygon_visibility_benchmark results;
+		int32 samples = atoi(arg.c_str());
+		if (samples <= 0) samples = 100000;
+
+		benchmark_polygon_visibility(samples, &results);
+		if (!results.sample_count)
+		{
+			screen_printf("No visibility sets; load a level first");
+			return;
+		}
+
+		screen_printf("visibility: %d sightlines, %d rejected, walk %.1f ms, sets %.1f ms, %d mismatches, %d%% of pairs visible",
+			      results.sample_count,
+			      results.rejected_count,
+			      results.walk_microseconds / 1000.0,
+			      results.visibility_microseconds / 1000.0,
+			      results.mismatch_count,
+			      (int) (100.0 * results.visible_pair_count / ((double) results.polygon_count * results.polygon_count)));
+		logNote("visibility benchmark: %d sightlines, %d rejected, walk %llu us, sets %llu us, %d mismatches, %d of %d pairs visible",
+			results.sample_count,
+			results.rejected_count,
+			(unsigned long long) results.walk_microseconds,
+			(unsigned long long) results.visibility_microseconds,
+			results.mismatch_count,
+			results.visible_pair_count,
+			results.polygon_count * results.polygon_count);
+	}
+};
+
+struct benchmark_path_cache
+{
+	void operator() (const std::string&) const {
+		path_cache_statistics statistics;
+		get_path_cache_statistics(&statistics);
+
+		int32 lookups = statistics.hit_count + statistics.miss_count;
+		if (!lookups)
+		{
+			screen_printf("No cached paths requested on this level yet");
+			return;
+		}
+
+		double miss_microseconds = statistics.miss_count ? (double) statistics.miss_microseconds / statistics.miss_count : 0.0;
+		double saved_microseconds = statistics.hit_count * miss_microseconds - statistics.hit_microseconds;
+
+		screen_printf("path cache: %d hits, %d misses (%d%% hit rate), %d invalidated, %.1f us per flood, %.1f ms saved",
+			      statistics.hit_count,
+			      statistics.miss_count,
+			      (int) (100.0 * statistics.hit_count / lookups),
+			      statistics.invalidation_count,
+			      miss_microseconds,
+			      saved_microseconds / 1000.0);
+		logNote("path cache benchmark: %d hits, %d misses, %d invalidated, hits %llu us, misses %llu us, about %.0f us saved",
+			statistics.hit_count,
+			statistics.miss_count,
+			statistics.invalidation_count,
+			(unsigned long long) statistics.hit_microseconds,
+			(unsigned long long) statistics.miss_microseconds,
+			saved_microseconds);
+	}
+};
+
+struct benchmark_snapshot
+{
+	void operator() (const std::string& arg) const {
+		world_snapshot_benchmark results;
+		int32 iterations = atoi(arg.c_str());
+		if (iterations <= 0) iterations = 1000;
+
+		benchmark_world_snapshot(iterations, &results);
+		if (!results.iteration_count)
+		{
+			screen_printf("No world to snapshot; load a level first");
+			return;
+		}
+
+		double take_microseconds = (double) results.take_microseconds / results.iteration_count;
+		double restore_microseconds = (double) results.restore_microseconds / results.iteration_count;
+
+		screen_printf("snapshot: %d regions, %.1f KB, take %.1f us, restore %.1f us (%.1f%% of a tick), %d mismatches, Lua %.1f KB in %.1f us",
+			      results.region_count,
+			      results.snapshot_bytes / 1024.0,
+			      take_microseconds,
+			      restore_microseconds,
+			      100.0 * (take_microseconds + restore_microseconds) * TICKS_PER_SECOND / 1000000.0,
+			      results.mismatch_count,
+			      results.lua_bytes / 1024.0,
+			      (double) results.lua_microseconds);
+		logNote("world snapshot benchmark: %d iterations, %d regions, %u bytes, take %llu us, restore %llu us, %d mismatches, Lua %u bytes in %llu us",
+			results.iteration_count,
+			results.region_count,
+			results.snapshot_bytes,
+			(unsigned long long) results.take_microseconds,
+			(unsigned long long) results.restore_microseconds,
+			results.mismatch_count,
+			results.lua_bytes,
+			(unsigned long long) results.lua_microseconds);
+	}
+};
+
+struct benchmark_world_hash_command
+{
+	void operator() (const std::string& arg) const {
+		int32 iterations = atoi(arg.c_str());
+		if (iterations <= 0) iterations = 1000;
+
+		if (!dynamic_world || !dynamic_world->polygon_count)
+		{
+			screen_printf("No world to hash; load a level first");
+			return;
+		}
+
+		uint64 microseconds = benchmark_world_hash(iterations);
+		double tick_microseconds = (double) microseconds / iterations;
+
+		screen_printf("world hash: %.1f us per tick (%.2f%% of a tick), current hash %08x",
+			      tick_microseconds,
+			      100.0 * tick_microseconds * TICKS_PER_SECOND / 1000000.0,
+			      get_world_hash()->combined);
+		logNote("world hash benchmark: %d iterations, %llu us",
+			iterations,
+			(unsigned long long) microseconds);
+	}
+};
+
+struct benchmark_software_render
+{
+	void operator() (const std::string& arg) const {
+		std::vector<software_rasterizer_benchmark> results;
+		int32 frames = atoi(arg.c_str());
+		if (frames <= 0) frames = 100;
+
+		int16 maximum_thread_count = MAX(SDL_GetCPUCount(), 2);
+		if (!benchmark_software_rendering(frames, maximum_thread_count, results) || results.empty())
+		{
+			screen_printf("Software rendering benchmark needs the software renderer and a game view");
+			return;
+		}
+
+		double one_thread_fps = 1000000.0 * results[0].frame_count / MAX(results[0].microseconds, 1);
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const software_rasterizer_benchmark& result = results[i];
+			double fps = 1000000.0 * result.frame_count / MAX(result.microseconds, 1);
+
+			screen_printf("%d thread%s: %.1f fps, %.2fx%s",
+				      result.thread_count,
+				      result.thread_count == 1 ? "" : "s",
+				      fps,
+				      fps / one_thread_fps,
+				      result.matches_one_thread ? "" : ", PIXELS DIFFER");
+			logNote("software rendering benchmark: %d threads, %d frames, %llu us, %s",
+				result.thread_count,
+				result.frame_count,
+				(unsigned long long) result.microseconds,
+				result.matches_one_thread ? "matches one thread" : "differs from one thread");
+		}
+	}
+};
+
+struct benchmark_span_kernels_command
+{
+	void operator() (const std::string& arg) const {
+		static const char *mode_names[] = { "off", "fast", "nice" };
+		std::vector<span_kernel_benchmark> results;
+		short depth = atoi(arg.c_str()) == 16 ? 16 : 32;
+
+		/* the usual SDL layouts: RGB565 and XRGB8888 */
+		if (depth == 16)
+			benchmark_span_kernels(depth, 0xf800, 0x07e0, 0x001f, results);
+		else
+			benchmark_span_kernels(depth, 0x00ff0000, 0x0000ff00, 0x000000ff, results);
+
+		screen_printf("span kernels (%d-bit), in use: %s", depth, get_span_kernels_name(get_span_kernels()));
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const span_kernel_benchmark& result = results[i];
+
+			screen_printf("%s, blend %s: horizontal %.0f MP/s, vertical %.0f MP/s%s",
+				      get_span_kernels_name(result.kernels),
+				      mode_names[result.mode],
+				      result.horizontal_megapixels,
+				      result.vertical_megapixels,
+				      result.matches_scalar ? "" : ", PIXELS DIFFER");
+			logNote("span kernel benchmark: %d-bit %s blend %s: horizontal %.1f MP/s, vertical %.1f MP/s, %s",
+				depth,
+				get_span_kernels_name(result.kernels),
+				mode_names[result.mode],
+				result.horizontal_megapixels,
+				result.vertical_megapixels,
+				result.matches_scalar ? "matches scalar" : "differs from scalar");
+		}
+	}
+};
+
+// .benchmark present [16|32] [WxH]; defaults to 32-bit 2560x1440, big enough to be split among threads
+struct benchmark_present_command
+{
+	void operator() (const std::string& arg) const {
+		std::vector<present_benchmark> results;
+		pair<string, string> args = split(arg);
+		short depth = atoi(args.first.c_str()) == 16 ? 16 : 32;
+		int width = 2560, height = 1440;
+
+		if (sscanf(args.second.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+		{
+			width = 2560;
+			height = 1440;
+		}
+
+		benchmark_present_kernels(depth, width, height, results);
+		if (results.empty())
+		{
+			screen_printf("Couldn't allocate %dx%d %d-bit surfaces", width, height, depth);
+			return;
+		}
+
+		screen_printf("present (%d-bit %dx%d):", depth, width, height);
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const present_benchmark& result = results[i];
+
+			screen_printf("%s, %d thread%s: gamma %.0f MP/s (%.1fx), doubling %.0f MP/s (%.1fx)%s",
+				      get_present_kernels_name(result.kernels),
+				      result.thread_count,
+				      result.thread_count == 1 ? "" : "s",
+				      result.gamma_megapixels,
+				      result.gamma_megapixels / results[0].gamma_megapixels,
+				      result.quadruple_megapixels,
+				      result.quadruple_megapixels / results[0].quadruple_megapixels,
+				      result.matches_reference ? "" : ", PIXELS DIFFER");
+			logNote("present benchmark: %d-bit %dx%d %s, %d threads: gamma %.1f MP/s, doubling %.1f MP/s, %s",
+				depth,
+				width,
+				height,
+				get_present_kernels_name(result.kernels),
+				result.thread_count,
+				result.gamma_megapixels,
+				result.quadruple_megapixels,
+				result.matches_reference ? "matches per-pixel loops" : "differs from per-pixel loops");
+		}
+	}
+};
+
+// .benchmark wad_load [file]; defaults to the current map file
+struct benchmark_wad_load_command
+{
+	void operator() (const std::string& arg) const {
+		FileSpecifier file = arg.empty() ? get_map_file() : FileSpecifier(arg);
+		wad_loading_benchmark results[2];
+
+		if (!benchmark_wad_loading(file, &results[0], &results[1]))
+		{
+			screen_printf("Couldn't load every level of %s", utf8_to_mac_roman(file.GetPath()).c_str());
+			return;
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+			const wad_loading_benchmark& result = results[i];
+			char memory[64];
+
+			if (result.memory_known)
+				sprintf(memory, "peak %u KB resident, %u KB private", result.peak_resident_kilobytes, result.peak_private_kilobytes);
+			else
+				strcpy(memory, "memory not available");
+
+			screen_printf("%s: %d levels, %u KB in %llu us, %s",
+				      result.mapped ? "mapped" : "copied",
+				      result.level_count,
+				      result.bytes / 1024,
+				      (unsigned long long) result.microseconds,
+				      memory);
+			logNote("wad load benchmark: %s %s, %d levels, %u bytes, %llu us, %s",
+				file.GetPath(),
+				result.mapped ? "mapped" : "copied",
+				result.level_count,
+				result.bytes,
+				(unsigned long long) result.microseconds,
+				memory);
+		}
+
+		if (results[0].checksum != results[1].checksum)
+			screen_printf("Mapped and copied levels DIFFER");
+	}
+};
+
+// .benchmark crc [file]; checksums 64 MB in memory with each kernel, then the file
+// (the current map file by default) read every way it can be
+struct benchmark_crc_command
+{
+	void operator() (const std::string& arg) const {
+		FileSpecifier file = arg.empty() ? get_map_file() : FileSpecifier(arg);
+		std::vector<crc_benchmark> results;
+		const int32 buffer_length = 64 * 1024 * 1024;
+
+		benchmark_crc(buffer_length, &file, results);
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const crc_benchmark& result = results[i];
+
+			screen_printf("%s, %s: %.0f MB/s%s",
+				      get_crc_kernel_name(result.kernel),
+				      get_crc_file_method_name(result.file_method),
+				      result.megabytes,
+				      result.matches_reference ? "" : ", CRC DIFFERS");
+			logNote("crc benchmark: %s %s %s: %.1f MB/s, crc %08x, %s",
+				result.file_method == NONE ? "memory" : file.GetPath(),
+				get_crc_kernel_name(result.kernel),
+				get_crc_file_method_name(result.file_method),
+				result.megabytes,
+				result.crc,
+				result.matches_reference ? "matches byte-wise loop" : "differs from byte-wise loop");
+		}
+	}
+};
+
+// .benchmark save; saves the game to a scratch file the old way and in the background,
+// and compares how long each holds up the game
+struct benchmark_save_command
+{
+	void operator() (const std::string&) const {
+		quick_save_benchmark results;
+
+		if (game_is_networked || !benchmark_quick_save(results))
+		{
+			screen_printf("Couldn't save the game");
+			return;
+		}
+
+		screen_printf("saving %u KB: old way %llu us, now %llu us on the game thread and %llu us writing%s",
+			      results.bytes / 1024,
+			      (unsigned long long) results.synchronous_microseconds,
+			      (unsigned long long) results.snapshot_microseconds,
+			      (unsigned long long) results.writer_microseconds,
+			      results.matches ? "" : ", FILES DIFFER");
+		logNote("save benchmark: %u bytes, synchronous %llu us, snapshot %llu us, writer %llu us, %s",
+			results.bytes,
+			(unsigned long long) results.synchronous_microseconds,
+			(unsigned long long) results.snapshot_microseconds,
+			(unsigned long long) results.writer_microseconds,
+			results.matches ? "files match" : "files differ");
+	}
+};
+
+// .benchmark xml_cache; parses every cached XML file and rebuilds it from the cache,
+// which is what startup does for MML scripts, plugins and themes
+struct benchmark_xml_cache_command
+{
+	void operator() (const std::string&) const {
+		info_tree_cache_benchmark results;
+
+		InfoTreeCache::instance()->benchmark(results);
+		if (!results.file_count)
+		{
+			screen_printf("No XML files are cached");
+			return;
+		}
+
+		screen_printf("%d XML files, %u KB: parsing %llu us, cache %u KB in %llu us%s",
+			      results.file_count,
+			      results.xml_bytes / 1024,
+			      (unsigned long long) results.parse_microseconds,
+			      results.cached_bytes / 1024,
+			      (unsigned long long) results.cached_microseconds,
+			      results.mismatch_count ? ", TREES DIFFER" : "");
+		logNote("XML cache benchmark: %d files, %u bytes parsed in %llu us, %u bytes cached rebuilt in %llu us, %d mismatches",
+			results.file_count,
+			results.xml_bytes,
+			(unsigned long long) results.parse_microseconds,
+			results.cached_bytes,
+			(unsigned long long) results.cached_microseconds,
+			results.mismatch_count);
+	}
+};
+
+void Console::register_benchmark_commands()
+{
+	CommandParser benchmarkParser;
+	benchmarkParser.register_command("polygon_index", benchmark_polygon_index());
+	benchmarkParser.register_command("flood_map", benchmark_flood());
+	benchmarkParser.register_command("visibility", benchmark_visibility());
+	benchmarkParser.register_command("path_cache", benchmark_path_cache());
+	benchmarkParser.register_command("snapshot", benchmark_snapshot());
+	benchmarkParser.register_command("world_hash", benchmark_world_hash_command());
+	benchmarkParser.register_command("software_render", benchmark_software_render());
+	benchmarkParser.register_command("span_kernels", benchmark_span_kernels_command());
+	benchmarkParser.register_command("present", benchmark_present_command());
+	benchmarkParser.register_command("wad_load", benchmark_wad_load_command());
+	benchmarkParser.register_command("crc", benchmark_crc_command());
+	benchmarkParser.register_command("save", benchmark_save_command());
+	benchmarkParser.register_command("xml_cache", benchmark_xml_cache_command());
+	register_command("benchmark", benchmarkParser);
+}
+
+// .render_stats [on|off|overlay|csv [file]]; with no argument, prints the last frame
+struct render_stats_command
+{
+	void operator() (const std::string& arg) const {
+		extern bool ShowRenderStatistics;
+		pair<string, string> cr = split(arg);
+		string option = cr.first;
+		lowercase(option);
+
+		if (option == "on")
+		{
+			set_render_statistics(true);
+			screen_printf("Render statistics on");
+		}
+		else if (option == "off")
+		{
+			ShowRenderStatistics = false;
+			stop_render_statistics_log();
+			set_render_statistics(false);
+			screen_printf("Render statistics off");
+		}
+		else if (option == "overlay")
+		{
+			ShowRenderStatistics = !ShowRenderStatistics;
+			if (ShowRenderStatistics)
+				set_render_statistics(true);
+		}
+		else if (option == "csv")
+		{
+			string name = cr.second.empty() ? "Render Statistics.csv" : cr.second;
+			if (start_render_statistics_log(name.c_str()))
+				screen_printf("Writing render statistics to %s", name.c_str());
+			else
+				screen_printf("Couldn't open %s for render statistics", name.c_str());
+		}
+		else if (!render_statistics_active())
+		{
+			screen_printf("Render statistics are off; use .render_stats on, overlay or csv");
+		}
+		else
+		{
+			const render_statistics *statistics = get_render_statistics();
+			uint64 total = 0;
+
+			for (short stage = 0; stage < NUMBER_OF_RENDER_STAGES; ++stage)
+				total += statistics->microseconds[stage];
+			screen_printf("frame %d: %.2f ms, visibility tree reused in %.0f%% of frames",
+				      statistics->frame,
+				      total / 1000.0,
+				      100.0 * statistics->reused_tree_count / MAX(statistics->frame, 1));
+			for (short stage = 0; stage < NUMBER_OF_RENDER_STAGES; ++stage)
+				screen_printf("%s: %.2f ms", get_render_stage_name(stage), statistics->microseconds[stage] / 1000.0);
+
+			std::string counts;
+			for (short counter = 0; counter < NUMBER_OF_RENDER_COUNTERS; ++counter)
+			{
+				char count[64];
+				sprintf(count, "%s%s %d", counter ? ", " : "", get_render_counter_name(counter), statistics->counters[counter]);
+				counts += count;
+			}
+			screen_printf("%s", counts.c_str());
+		}
+	}
+};
+
+// .frame_stats [reset]; frame pacing and tick-to-screen latency since the last reset
+struct frame_stats_command
+{
+	void operator() (const std::string& arg) const {
+		string option = arg;
+		lowercase(option);
+
+		if (option == "reset")
+		{
+			reset_frame_statistics();
+			screen_printf("Frame statistics reset");
+			return;
+		}
+
+		const frame_statistics *statistics = get_frame_statistics();
+		if (statistics->frame_count < 2)
+		{
+			screen_printf("No frames drawn yet");
+			return;
+		}
+
+		double average = statistics->total_frame_microseconds / 1000.0 / (statistics->frame_count - 1);
+		screen_printf("%d frames for %d ticks (%d between ticks), interpolation %s",
+			      statistics->frame_count,
+			      statistics->tick_count,
+			      statistics->interpolated_frame_count,
+			      interpolated_world_active() ? "on" : "off");
+		screen_printf("frame time: %.2f ms average (%.1f fps), %.2f ms min, %.2f ms max",
+			      average,
+			      average > 0 ? 1000.0 / average : 0.0,
+			      statistics->minimum_frame_microseconds / 1000.0,
+			      statistics->maximum_frame_microseconds / 1000.0);
+		if (statistics->latency_count)
+			screen_printf("tick to screen: %.2f ms average, %.2f ms max",
+				      statistics->total_latency_microseconds / 1000.0 / statistics->latency_count,
+				      statistics->maximum_latency_microseconds / 1000.0);
+	}
+};
+
+// .shape_stats [reset]; shape bitmap streaming since the last reset
+struct shape_stats_command
+{
+	void operator() (const std::string& arg) const {
+		string option = arg;
+		lowercase(option);
+
+		if (option == "reset")
+		{
+			reset_shape_streaming_statistics();
+			screen_printf("Shape statistics reset");
+			return;
+		}
+
+		const shape_streaming_statistics *statistics = get_shape_streaming_statistics();
+		if (!statistics->active)
+		{
+			screen_printf("Shapes aren't streamed; set a shape memory budget and start a level");
+			return;
+		}
+
+		screen_printf("%d of %d bitmaps loaded, %.1f of %.0f MB",
+			      statistics->resident_bitmaps,
+			      statistics->streamed_bitmaps,
+			      statistics->resident_bytes / 1048576.0,
+			      statistics->budget_bytes / 1048576.0);
+		screen_printf("%u hits, %u misses, %u stalled frames (%.2f ms), %u read ahead, %u evicted",
+			      statistics->hits,
+			      statistics->misses,
+			      statistics->stalls,
+			      statistics->stall_microseconds / 1000.0,
+			      statistics->loaded_ahead,
+			      statistics->evicted);
+	}
+};
+
+void Console::register_render_commands()
+{
+	register_command("render_stats", render_stats_command());
+	register_command("frame_stats", frame_stats_command());
+	register_command("shape_stats", shape_stats_command());
+}
+
 void Console::clear_saves()
 {
 	last_level.clear();
@@ -200,6 +200,9 @@ const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_2;
 #include "motion_sensor.h" // for reset_motion_sensor()
 
 #include "lua_hud_script.h"
+#include "world_hash.h"
+#include "interpolated_world.h"
+#include "Logging.h"
 
 using alephone::Screen;
 
@@ -295,6 +298,7 @@ struct screen_data m1_display_screens[]= {
 /* -------------- local globals */
 static struct game_state game_state;
 static FileSpecifier DraggedReplayFile;
+static bool headless_replay_in_progress= false; /* nobody's watching; skip anything that waits for them */
 static bool interface_fade_in_progress= false;
 static short interface_fade_type;
 static short current_picture_clut_depth;
@@ -344,6 +348,8 @@ static void interface_fade_out(short pict_resource_number, bool fade_music);
 static bool can_interface_fade_out(void);
 static void transfer_to_new_level(short level_number);
 static void try_and_display_chapter_screen(short level, bool interface_table_is_valid, bool text_block);
+static void draw_timedemo_frame(const struct headless_timedemo *timedemo, SDL_Surface *surface,
+	const world_location3d *camera, struct headless_replay_results *results);
 
 static screen_data *get_screen_data(
 	short index);
@@ -1014,6 +1020,131 @@ bool handle_open_replay(FileSpecifier& File)
 	return success;
 }
 
+bool replay_film_headless(
+	FileSpecifier& File,
+	struct headless_replay_results *results,
+	const struct headless_timedemo *timedemo)
+{
+	/* a film that stops producing ticks without ending shouldn't hang the batch */
+	const int kMaximumStalledUpdates= 1000;
+	int stalled_updates= 0;
+	SDL_Surface *timedemo_surface= NULL;
+	bool success;
+
+	*results= headless_replay_results();
+
+	DraggedReplayFile= File;
+	headless_replay_in_progress= true;
+	success= begin_game(_replay_from_file, false);
+	if (success)
+	{
+		set_world_update_timing(true);
+		uint64 start= machine_microsecond_count();
+
+		while (game_state.state==_game_in_progress)
+		{
+			int32 ticks_before= get_world_update_timing()->tick_count;
+
+			pull_replay_tick_unthrottled();
+			if (game_state.state!=_game_in_progress) break;
+
+			update_world();
+			if (get_world_update_timing()->tick_count!=ticks_before) stalled_updates= 0;
+			else if (++stalled_updates>kMaximumStalledUpdates)
+			{
+				logError("headless replay stalled at tick %d", dynamic_world->tick_count);
+				success= false;
+				break;
+			}
+
+			if (timedemo && stalled_updates==0 && game_state.state==_game_in_progress)
+			{
+				if (!timedemo_surface && !(timedemo_surface= allocate_offscreen_view(timedemo->width, timedemo->height)))
+				{
+					logError("couldn't allocate a %dx%d timedemo view", timedemo->width, timedemo->height);
+					success= false;
+					break;
+				}
+
+				if (timedemo->camera_path_count)
+				{
+					/* the world stands still from here on; only the camera moves */
+					for (int32 i= 0; i<timedemo->camera_path_count; ++i)
+					{
+						draw_timedemo_frame(timedemo, timedemo_surface, timedemo->camera_path+i, results);
+					}
+					break;
+				}
+				draw_timedemo_frame(timedemo, timedemo_surface, NULL, results);
+			}
+		}
+
+		results->microseconds= machine_microsecond_count() - start;
+		results->tick_count= get_world_update_timing()->tick_count;
+		set_world_update_timing(false);
+
+		const struct world_hash *hash= get_world_hash();
+		results->final_tick= hash->tick;
+		results->final_world_hash= hash->combined;
+		results->world_hashes_match= film_world_hashes_match(&results->world_hashes_checked, &results->world_hashes_recorded);
+
+		/* the epilogue and failed level loads have already finished the game */
+		if (game_state.state==_game_in_progress || game_state.state==_switch_demo || game_state.state==_change_level)
+		{
+			finish_game(false);
+		}
+	}
+	headless_replay_in_progress= false;
+	if (timedemo_surface) SDL_FreeSurface(timedemo_surface);
+
+	return success;
+}
+
+static void draw_timedemo_frame(
+	const struct headless_timedemo *timedemo,
+	SDL_Surface *surface,
+	const world_location3d *camera,
+	struct headless_replay_results *results)
+{
+	int32 frame= results->frame_microseconds.size();
+	world_location3d located_camera;
+
+	if (camera && camera->polygon_index==NONE)
+	{
+		located_camera= *camera;
+		located_camera.polygon_index= world_point_to_polygon_index((world_point2d *) &located_camera.point);
+		if (located_camera.polygon_index==NONE)
+		{
+			logWarning("timedemo camera at %d, %d is outside the level; skipped", camera->point.x, camera->point.y);
+			return;
+		}
+		camera= &located_camera;
+	}
+
+	results->frame_microseconds.push_back((uint32) render_offscreen_view(surface, camera));
+
+	if (timedemo->frame_directory && timedemo->frame_interval>0 && frame%timedemo->frame_interval==0)
+	{
+		FileSpecifier file(timedemo->frame_directory);
+		char name[32];
+
+#ifdef HAVE_SDL_IMAGE
+		sprintf(name, "frame_%06d.png", frame);
+#else
+		sprintf(name, "frame_%06d.bmp", frame);
+#endif
+		file+= name;
+		if (save_offscreen_view(surface, file.GetPath()))
+		{
+			results->frames_saved++;
+		}
+		else
+		{
+			logWarning("couldn't save timedemo frame %s", file.GetPath());
+		}
+	}
+}
+
 // Called from within update_world..
 bool check_level_change(
 	void)
@@ -1205,7 +1336,21 @@ bool idle_game_state(uint32 time)
 			// ticks elapsed rather than the number of (potentially predictive) ticks elapsed.
 			// This is a guess.
 			if (theUpdateResult.first)
+			{
+				enter_interpolated_world();
 				render_screen(ticks_elapsed);
+				exit_interpolated_world();
+				record_frame_presented(true);
+			}
+			else if (game_state.state==_game_in_progress && interpolated_frame_fits())
+			{
+				/* nothing new from the world, but we're drawing between ticks; frames are drawn on
+					this thread, so not when the next tick is nearly due */
+				enter_interpolated_world();
+				render_screen(0);
+				exit_interpolated_world();
+				record_frame_presented(false);
+			}
 		}
 		
 		return theUpdateResult.first;
@@ -1897,8 +2042,11 @@ static void transfer_to_new_level(
 			// Enter_screen will be called again in start_game
 		}
 		set_keyboard_controller_status(false);
-		FindLevelMovie(entry.level_number);
-		show_movie(entry.level_number);
+		if (!headless_replay_in_progress)
+		{
+			FindLevelMovie(entry.level_number);
+			show_movie(entry.level_number);
+		}
 
 		// if this is the EPILOGUE_LEVEL_NUMBER, then it is time to get
 		// out of here already (as we've just played the epilogue movie,
@@ -1911,7 +2059,7 @@ static void transfer_to_new_level(
 			return;
 		}
 
-		if (!game_is_networked) try_and_display_chapter_screen(level_number, true, false);
+		if (!game_is_networked && !headless_replay_in_progress) try_and_display_chapter_screen(level_number, true, false);
 		success= goto_level(&entry, false, dynamic_world->player_count);
 		set_keyboard_controller_status(true);
 	}
@@ -2170,13 +2318,13 @@ static bool begin_game(
 	{
 		hide_cursor();
 		/* This has already been done to get to gather/join */
-		if(can_interface_fade_out()) 
+		if(can_interface_fade_out() && !headless_replay_in_progress) 
 		{
 			interface_fade_out(MAIN_MENU_BASE, true);
 		}
 
 		/* Try to display the first chapter screen.. */
-		if (user != _network_player && user != _demo)
+		if (user != _network_player && user != _demo && !headless_replay_in_progress)
 		{
 			FindLevelMovie(entry.level_number);
 			show_movie(entry.level_number);
@@ -2320,9 +2468,12 @@ static void finish_game(
 	/* Fade out! (Pray) */ // should be interface_color_table for valkyrie, but doesn't work.
 	Music::instance()->ClearLevelMusic();
 	Music::instance()->FadeOut(MACHINE_TICKS_PER_SECOND / 2);
-	full_fade(_cinematic_fade_out, interface_color_table);
-	paint_window_black();
-	full_fade(_end_cinematic_fade_out, interface_color_table);
+	if (!headless_replay_in_progress)
+	{
+		full_fade(_cinematic_fade_out, interface_color_table);
+		paint_window_black();
+		full_fade(_end_cinematic_fade_out, interface_color_table);
+	}
 
 	show_cursor();
 
@@ -2356,7 +2507,7 @@ static void finish_game(
 	} 
 	else
 #endif // !defined(DISABLE_NETWORKING)
-	if (game_state.user == _replay && !(dynamic_world->game_information.game_type == _game_of_kill_monsters && dynamic_world->player_count == 1))
+	if (game_state.user == _replay && !headless_replay_in_progress && !(dynamic_world->game_information.game_type == _game_of_kill_monsters && dynamic_world->player_count == 1))
 	{
 		game_state.state = _displaying_network_game_dialogs;
 
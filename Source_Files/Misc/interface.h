@@ -270,6 +270,35 @@ void draw_menu_button_for_command(short index);
 void update_interface_display(void);
 bool idle_game_state(uint32 ticks);
 void display_main_menu(void);
+
+struct headless_replay_results
+{
+	int32 tick_count;
+	uint64 microseconds;
+	int32 final_tick;
+	uint32 final_world_hash;
+	bool world_hashes_match;
+	int32 world_hashes_checked, world_hashes_recorded;
+
+	std::vector<uint32> frame_microseconds; /* render_view() time of each timedemo frame */
+	int32 frames_saved;
+};
+
+/* what to draw while replaying headless */
+struct headless_timedemo
+{
+	short width, height; /* of the offscreen view */
+	const struct world_location3d *camera_path; /* if any, drawn after the film's first tick instead of the rest of the film */
+	int32 camera_path_count;
+	const char *frame_directory; /* NULL to save no frames */
+	int32 frame_interval; /* save every this many frames */
+};
+
+/* plays a film as fast as update_world() will go; false if it couldn't be started or stalled
+	before it ended.  Draws nothing, unless there's a timedemo: then a frame is drawn offscreen
+	after every tick (or for every point on the camera path) with the software renderer */
+bool replay_film_headless(FileSpecifier& File, struct headless_replay_results *results,
+	const struct headless_timedemo *timedemo= NULL);
 void do_menu_item_command(short menu_id, short menu_item, bool cheat);
 bool interface_fade_finished(void);
 void stop_interface_fade(void);
@@ -326,6 +355,8 @@ void process_collection_sounds(short colleciton_code, void (*process_sound)(shor
 void mark_collection(short collection_code, bool loading);
 void strip_collection(short collection_code);
 void load_collections(bool with_progress_bar, bool is_opengl);
+/* builds or frees the software renderer's wall texture levels after the preference changes */
+void update_software_mipmaps(void);
 int count_replacement_collections();
 void load_replacement_collections();
 void unload_all_collections(void);
@@ -333,6 +364,26 @@ void unload_all_collections(void);
 void set_shapes_patch_data(uint8 *data, size_t length);
 uint8* get_shapes_patch_data(size_t &length);
 
+/* with a shape memory budget, collections' bitmaps stay in the shapes file until they're drawn
+	(or a loader thread reads them ahead), and those drawn least recently are let go when the
+	budget runs out; the interface collection is always loaded whole */
+struct shape_streaming_statistics
+{
+	bool active;
+	uint32 hits, misses; /* bitmaps asked for which were and weren't in memory */
+	uint32 stalls; /* frames which waited for at least one miss */
+	uint64 stall_microseconds;
+	uint32 loaded_ahead, evicted;
+	int32 resident_bitmaps, streamed_bitmaps;
+	uint64 resident_bytes, budget_bytes;
+};
+
+/* once a frame, before anything is drawn: takes in what the loader thread has read and
+	evicts bitmaps not drawn in the last two frames while over budget */
+void update_shape_streaming(void);
+const struct shape_streaming_statistics *get_shape_streaming_statistics(void);
+void reset_shape_streaming_statistics(void);
+
 // LP additions:
 // Whether or not collection is present
 bool is_collection_present(short collection_index);
@@ -380,6 +431,13 @@ bool has_recording_file(void);
 void increment_replay_speed(void);
 void decrement_replay_speed(void);
 void reset_recording_and_playback_queues(void);
+
+/* appends to the film being recorded, or checks against the one being replayed; false only
+	for the first tick a replay stops matching its recording */
+bool record_or_check_film_world_hash(uint32 world_hash);
+/* of the film being replayed, as far as it has got */
+bool film_world_hashes_match(int32 *checked_count, int32 *recorded_count);
+void pull_replay_tick_unthrottled(void);
 uint32 parse_keymap(void);
 
 /* ---------- prototypes/GAME_DIALOGS.C */
@@ -968,6 +968,20 @@ static const char *sw_sdl_driver_labels[5] = {
 	"Default", "None", "Direct3D", "OpenGL", NULL
 };
 
+static const char *sw_render_threads_labels[] = {
+	"Automatic", "1", "2", "4", "8", NULL
+};
+static const int16 sw_render_threads_values[] = {
+	0, 1, 2, 4, 8
+};
+
+static const char *shape_memory_labels[] = {
+	"Load Whole Levels", "16 MB", "32 MB", "64 MB", "128 MB", "256 MB", "512 MB", "1 GB", NULL
+};
+static const int16 shape_memory_values[] = {
+	0, 16, 32, 64, 128, 256, 512, 1024
+};
+
 static const char *gamma_labels[9] = {
 	"Darkest", "Darker", "Dark", "Normal", "Light", "Really Light", "Even Lighter", "Lightest", NULL
 };
@@ -1042,6 +1056,18 @@ static void software_rendering_options_dialog(void* arg)
 	w_select *sw_driver_w = new w_select(graphics_preferences->software_sdl_driver, sw_sdl_driver_labels);
 	table->dual_add(sw_driver_w->label("Acceleration"), d);
 	table->dual_add(sw_driver_w, d);
+
+	w_select *sw_render_threads_w = new w_select(0, sw_render_threads_labels);
+	for (int i = 0; sw_render_threads_labels[i] != NULL; ++i) {
+		if (sw_render_threads_values[i] == graphics_preferences->software_render_threads)
+			sw_render_threads_w->set_selection(i);
+	}
+	table->dual_add(sw_render_threads_w->label("Rendering Threads"), d);
+	table->dual_add(sw_render_threads_w, d);
+
+	w_toggle *sw_mipmaps_w = new w_toggle(graphics_preferences->software_mipmaps);
+	table->dual_add(sw_mipmaps_w->label("Smooth Distant Textures"), d);
+	table->dual_add(sw_mipmaps_w, d);
 	
 	placer->add(table, true);
 
@@ -1087,6 +1113,21 @@ static void software_rendering_options_dialog(void* arg)
 			graphics_preferences->software_sdl_driver = sw_driver_w->get_selection();
 			changed = true;
 		}
+
+		int16 sw_render_threads = sw_render_threads_values[sw_render_threads_w->get_selection()];
+		if (sw_render_threads != graphics_preferences->software_render_threads)
+		{
+			graphics_preferences->software_render_threads = sw_render_threads;
+			changed = true;
+		}
+
+		bool sw_mipmaps = sw_mipmaps_w->get_selection();
+		if (sw_mipmaps != graphics_preferences->software_mipmaps)
+		{
+			graphics_preferences->software_mipmaps = sw_mipmaps;
+			update_software_mipmaps();
+			changed = true;
+		}
 		
 		if (changed)
 			write_preferences();
@@ -1215,6 +1256,26 @@ static void graphics_dialog(void *arg)
 	table->dual_add(map_w->label("Overlay Map"), d);
 	table->dual_add(map_w, d);
 
+	w_toggle *interpolate_w = new w_toggle(graphics_preferences->interpolate_frames);
+	table->dual_add(interpolate_w->label("Interpolate Frames"), d);
+	table->dual_add(interpolate_w, d);
+
+	w_select_popup *shape_memory_w = new w_select_popup();
+	shape_memory_w->set_labels(build_stringvector_from_cstring_array(shape_memory_labels));
+	// a budget set by hand shows as the nearest one we offer, but never as no budget at all
+	int16 shape_memory_budget = graphics_preferences->shapes_file_memory_budget;
+	int shape_memory_index = 0;
+	if (shape_memory_budget) {
+		shape_memory_index = 1;
+		for (int i = 2; shape_memory_labels[i] != NULL; ++i) {
+			if (abs(shape_memory_values[i] - shape_memory_budget) < abs(shape_memory_values[shape_memory_index] - shape_memory_budget))
+				shape_memory_index = i;
+		}
+	}
+	shape_memory_w->set_selection(shape_memory_index);
+	table->dual_add(shape_memory_w->label("Shapes File Memory"), d);
+	table->dual_add(shape_memory_w, d);
+
 	placer->add(table, true);
 
 	placer->add(new w_spacer(), true);
@@ -1322,6 +1383,18 @@ static void graphics_dialog(void *arg)
 			graphics_preferences->screen_mode.camera_bob = camera_bob;
 			changed = true;
 		}
+
+		bool interpolate_frames = interpolate_w->get_selection() != 0;
+		if (interpolate_frames != graphics_preferences->interpolate_frames) {
+			graphics_preferences->interpolate_frames = interpolate_frames;
+			changed = true;
+		}
+
+		int16 shape_memory_budget = shape_memory_values[shape_memory_w->get_selection()];
+		if (shape_memory_budget != graphics_preferences->shapes_file_memory_budget) {
+			graphics_preferences->shapes_file_memory_budget = shape_memory_budget;
+			changed = true;
+		}
 		
 	    if (changed) {
 		    write_preferences();
@@ -3001,7 +3074,7 @@ void read_preferences ()
 	{
 		OFile.Close();
 		try {
-			InfoTree prefs = InfoTree::load_xml(FileSpec);
+			InfoTree prefs = InfoTree::load_xml(FileSpec, false);
 			InfoTree root = prefs.get_child("mara_prefs");
 			
 			std::string version = "";
@@ -3097,6 +3170,8 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.put_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
 	root.put_attr("software_sdl_driver", graphics_preferences->software_sdl_driver);
+	root.put_attr("software_render_threads", graphics_preferences->software_render_threads);
+	root.put_attr("software_mipmaps", graphics_preferences->software_mipmaps);
 	root.put_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.put_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
 	root.put_attr("geforce_fix", graphics_preferences->OGL_Configure.GeForceFix);
@@ -3105,6 +3180,8 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("use_npot", graphics_preferences->OGL_Configure.Use_NPOT);
 	root.put_attr("double_corpse_limit", graphics_preferences->double_corpse_limit);
 	root.put_attr("hog_the_cpu", graphics_preferences->hog_the_cpu);
+	root.put_attr("interpolate_frames", graphics_preferences->interpolate_frames);
+	root.put_attr("shapes_file_memory_budget", graphics_preferences->shapes_file_memory_budget);
 	root.put_attr("movie_export_video_quality", graphics_preferences->movie_export_video_quality);
 	root.put_attr("movie_export_audio_quality", graphics_preferences->movie_export_audio_quality);
 	
@@ -3440,6 +3517,7 @@ InfoTree environment_preferences_tree()
 	root.put_attr("hide_alephone_extensions", environment_preferences->hide_extensions);
 	root.put_attr("film_profile", static_cast<uint32>(environment_preferences->film_profile));
 	root.put_attr("maximum_quick_saves", environment_preferences->maximum_quick_saves);
+	root.put_attr("use_visibility_sets", environment_preferences->use_visibility_sets);
 
 	for (Plugins::iterator it = Plugins::instance()->begin(); it != Plugins::instance()->end(); ++it) {
 		if (it->compatible() && !it->enabled) {
@@ -3452,12 +3530,41 @@ InfoTree environment_preferences_tree()
 	return root;
 }
 
+// What the user chose, for settings overridden for this run only
+static bool acceleration_overridden = false, bit_depth_overridden = false;
+static short chosen_acceleration, chosen_bit_depth;
+
+void override_acceleration_for_session(short acceleration)
+{
+	if (!acceleration_overridden)
+		chosen_acceleration = graphics_preferences->screen_mode.acceleration;
+	acceleration_overridden = true;
+	graphics_preferences->screen_mode.acceleration = acceleration;
+}
+
+void override_bit_depth_for_session(short bit_depth)
+{
+	if (!bit_depth_overridden)
+		chosen_bit_depth = graphics_preferences->screen_mode.bit_depth;
+	bit_depth_overridden = true;
+	graphics_preferences->screen_mode.bit_depth = bit_depth;
+}
+
 void write_preferences()
 {
 	InfoTree root;
 	root.put_attr("version", A1_DATE_VERSION);
 	
+	// save what the user chose, not what this run is using
+	short session_acceleration = graphics_preferences->screen_mode.acceleration;
+	short session_bit_depth = graphics_preferences->screen_mode.bit_depth;
+	if (acceleration_overridden)
+		graphics_preferences->screen_mode.acceleration = chosen_acceleration;
+	if (bit_depth_overridden)
+		graphics_preferences->screen_mode.bit_depth = chosen_bit_depth;
 	root.put_child("graphics", graphics_preferences_tree());
+	graphics_preferences->screen_mode.acceleration = session_acceleration;
+	graphics_preferences->screen_mode.bit_depth = session_bit_depth;
 	root.put_child("player", player_preferences_tree());
 	root.put_child("input", input_preferences_tree());
 	root.put_child("sound", sound_preferences_tree());
@@ -3513,9 +3620,13 @@ static void default_graphics_preferences(graphics_preferences_data *preferences)
 
 	preferences->double_corpse_limit= false;
 	preferences->hog_the_cpu = false;
+	preferences->interpolate_frames = false;
+	preferences->shapes_file_memory_budget = 0;
 
 	preferences->software_alpha_blending = _sw_alpha_off;
 	preferences->software_sdl_driver = _sw_driver_default;
+	preferences->software_render_threads = 0;
+	preferences->software_mipmaps = false;
 
 	preferences->movie_export_video_quality = 50;
 	preferences->movie_export_audio_quality = 50;
@@ -3659,6 +3770,7 @@ static void default_environment_preferences(environment_preferences_data *prefer
 	preferences->hide_extensions = true;
 	preferences->film_profile = FILM_PROFILE_DEFAULT;
 	preferences->maximum_quick_saves = 0;
+	preferences->use_visibility_sets = true;
 }
 
 
@@ -3975,6 +4087,8 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.read_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
 	root.read_attr("software_sdl_driver", graphics_preferences->software_sdl_driver);
+	root.read_attr("software_render_threads", graphics_preferences->software_render_threads);
+	root.read_attr("software_mipmaps", graphics_preferences->software_mipmaps);
 	root.read_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.read_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
 	root.read_attr("geforce_fix", graphics_preferences->OGL_Configure.GeForceFix);
@@ -3983,6 +4097,8 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr("use_npot", graphics_preferences->OGL_Configure.Use_NPOT);
 	root.read_attr("double_corpse_limit", graphics_preferences->double_corpse_limit);
 	root.read_attr("hog_the_cpu", graphics_preferences->hog_the_cpu);
+	root.read_attr("interpolate_frames", graphics_preferences->interpolate_frames);
+	root.read_attr_bounded<int16>("shapes_file_memory_budget", graphics_preferences->shapes_file_memory_budget, 0, 16384);
 	root.read_attr_bounded<int16>("movie_export_video_quality", graphics_preferences->movie_export_video_quality, 0, 100);
 	root.read_attr_bounded<int16>("movie_export_audio_quality", graphics_preferences->movie_export_audio_quality, 0, 100);
 	
@@ -4384,6 +4500,7 @@ void parse_environment_preferences(InfoTree root, std::string version)
 		environment_preferences->film_profile = static_cast<FilmProfileType>(profile);
 	
 	root.read_attr("maximum_quick_saves", environment_preferences->maximum_quick_saves);
+	root.read_attr("use_visibility_sets", environment_preferences->use_visibility_sets);
 	
 	BOOST_FOREACH(InfoTree plugin, root.children_named("disable_plugin"))
 	{
@@ -87,8 +87,12 @@ struct graphics_preferences_data
 
 	int16 software_alpha_blending;
 	int16 software_sdl_driver;
+	int16 software_render_threads; // 0 for one per processor
+	bool software_mipmaps; // distant walls and floors from smaller copies of their textures
 
 	bool hog_the_cpu;
+	bool interpolate_frames; // draw between ticks, blending the last two
+	int16 shapes_file_memory_budget; // megabytes of the Shapes file's own bitmaps; replacement images aren't counted; 0 loads whole collections at level changes
 
 	int16 movie_export_video_quality;
     int16 movie_export_audio_quality;
@@ -254,6 +258,9 @@ struct environment_preferences_data
 
 	// how many auto-named save files to keep around (0 is unlimited)
 	uint32 maximum_quick_saves;
+
+	// precalculate (and cache) polygon visibility sets when a level loads
+	bool use_visibility_sets;
 };
 
 /* New preferences.. (this sorta defeats the purpose of this system, but not really) */
@@ -271,6 +278,11 @@ void read_preferences();
 void handle_preferences(void);
 void write_preferences(void);
 
+/* for this run only (headless replays, timedemos): the graphics preferences take the given
+	value, but write_preferences() goes on saving the one the user chose */
+void override_acceleration_for_session(short acceleration);
+void override_bit_depth_for_session(short bit_depth);
+
 void transition_preferences(const DirectorySpecifier& legacy_prefs_dir);
 
 #endif
@@ -99,6 +99,9 @@ Feb 20, 2002 (Woody Zenfell):
 #include "Movie.h"
 #include "InfoTree.h"
 
+#include <vector>
+using std::vector;
+
 /* ---------- constants */
 
 #define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
@@ -109,6 +112,11 @@ Feb 20, 2002 (Woody Zenfell):
 #define MAXIMUM_REPLAY_SPEED         5
 #define MINIMUM_REPLAY_SPEED        -5
 
+// World hashes follow the last chunk of a film: one uint32 per tick, then the count and the tag.
+// Older versions stop reading at the end-of-recording chunks and never see them.
+#define FILM_WORLD_HASH_TAG          FOUR_CHARS_TO_INT('w','h','s','h')
+#define SIZEOF_film_world_hash_footer 8
+
 /* ---------- macros */
 
 #define INCREMENT_QUEUE_COUNTER(c) { (c)++; if ((c)>=MAXIMUM_QUEUE_SIZE) (c) = 0; }
@@ -131,6 +139,11 @@ static OpenedFile FilmFile;
 
 struct replay_private_data replay;
 
+// one per tick since the film started
+static vector<uint32> film_world_hashes;
+static size_t film_world_hash_index;
+static bool film_world_hashes_diverged;
+
 #ifdef DEBUG
 ActionQueue *get_player_recording_queue(
 	short player_index)
@@ -149,6 +162,8 @@ static void read_recording_queue_chunks(void);
 static bool pull_flags_from_recording(short count);
 // LP modifications for object-oriented file handling; returns a test for end-of-file
 static bool vblFSRead(OpenedFile& File, int32 *count, void *dest, bool& HitEOF);
+static void write_film_world_hashes(void);
+static void read_film_world_hashes(void);
 static void record_action_flags(short player_identifier, const uint32 *action_flags, short count);
 static short get_recording_queue_size(short which_queue);
 
@@ -323,6 +338,23 @@ bool input_controller(
 	return true; // tells the time manager library to reschedule this task
 }
 
+/* headless replays don't wait for the heartbeat: hand update_world() the film's next tick as
+	soon as it has used up the last one, and end the replay when the film runs out */
+void pull_replay_tick_unthrottled(
+	void)
+{
+	if (!replay.game_is_being_replayed || heartbeat_count>dynamic_world->tick_count) return;
+
+	if (pull_flags_from_recording(1))
+	{
+		heartbeat_count+= 1;
+	}
+	else if (replay.have_read_last_chunk)
+	{
+		set_game_state(_switch_demo);
+	}
+}
+
 void process_action_flags(
 	short player_identifier, 
 	const uint32 *action_flags, 
@@ -555,6 +587,7 @@ bool setup_for_replay_from_file(
 		FilmFile.Read(SIZEOF_recording_header,Header);
 		unpack_recording_header(Header,&replay.header,1);
 		replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
+		read_film_world_hashes();
 	
 		/* Set to the mapfile this replay came from.. */
 		if(use_map_file(replay.header.map_checksum))
@@ -600,6 +633,7 @@ void start_recording(
 		if (FilmFileSpec.Open(FilmFile,true))
 		{
 			replay.game_is_being_recorded= true;
+			film_world_hashes.clear();
 	
 			// save a header containing information about the game.
 			byte Header[SIZEOF_recording_header];
@@ -620,11 +654,23 @@ void stop_recording(
 		int32 total_length;
 
 		assert(replay.valid);
+
+		// The hashes can only go after the flags if every player's last chunk ends with an
+		// end-of-recording indicator; otherwise a reader would take them for more flags.
+		bool every_chunk_ends= true;
+		for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+		{
+			if (get_recording_queue_size(player_index)>=RECORD_CHUNK_SIZE) every_chunk_ends= false;
+		}
+		
 		for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
 		{
 			save_recording_queue_chunk(player_index);
 		}
 
+		if (every_chunk_ends) write_film_world_hashes();
+		film_world_hashes.clear();
+
 		/* Rewrite the header, since it has the new length */
 		FilmFile.SetPosition(0);
 		byte Header[SIZEOF_recording_header];
@@ -668,6 +714,7 @@ void rewind_recording(
 		
 		// Use the packed length here!!!
 		replay.header.length= SIZEOF_recording_header;
+		film_world_hashes.clear();
 	}
 }
 
@@ -744,6 +791,7 @@ void stop_replay(
 		assert(replay.valid);
 
 		replay.game_is_being_replayed= false;
+		film_world_hashes.clear();
 		if (replay.resource_data)
 		{
 			delete []replay.resource_data;
@@ -852,6 +900,86 @@ static void read_recording_queue_chunks(
 	}
 }
 
+bool record_or_check_film_world_hash(
+	uint32 world_hash)
+{
+	if (replay.game_is_being_recorded)
+	{
+		film_world_hashes.push_back(world_hash);
+	}
+	else if (replay.game_is_being_replayed && !film_world_hashes_diverged && film_world_hash_index<film_world_hashes.size())
+	{
+		if (film_world_hashes[film_world_hash_index++]!=world_hash)
+		{
+			film_world_hashes_diverged= true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool film_world_hashes_match(
+	int32 *checked_count,
+	int32 *recorded_count)
+{
+	*checked_count= static_cast<int32>(film_world_hash_index);
+	*recorded_count= static_cast<int32>(film_world_hashes.size());
+
+	return !film_world_hashes_diverged;
+}
+
+static void write_film_world_hashes(
+	void)
+{
+	if (film_world_hashes.empty()) return;
+
+	int32 length= film_world_hashes.size()*sizeof(uint32) + SIZEOF_film_world_hash_footer;
+	vector<uint8> buffer(length);
+	uint8 *S= &buffer[0];
+
+	for (size_t i= 0; i<film_world_hashes.size(); ++i) ValueToStream(S,film_world_hashes[i]);
+	ValueToStream(S,static_cast<uint32>(film_world_hashes.size()));
+	ValueToStream(S,static_cast<uint32>(FILM_WORLD_HASH_TAG));
+
+	if (FilmFile.Write(length,&buffer[0])) replay.header.length+= length;
+}
+
+static void read_film_world_hashes(
+	void)
+{
+	int32 length;
+	uint8 Footer[SIZEOF_film_world_hash_footer];
+	uint32 count, tag;
+
+	film_world_hashes.clear();
+	film_world_hash_index= 0;
+	film_world_hashes_diverged= false;
+
+	if (!FilmFile.GetLength(length) || length<SIZEOF_recording_header+SIZEOF_film_world_hash_footer) return;
+	if (FilmFile.SetPosition(length-SIZEOF_film_world_hash_footer) && FilmFile.Read(SIZEOF_film_world_hash_footer,Footer))
+	{
+		uint8 *S= Footer;
+		StreamToValue(S,count);
+		StreamToValue(S,tag);
+
+		if (tag==FILM_WORLD_HASH_TAG && count<=uint32(length-SIZEOF_recording_header-SIZEOF_film_world_hash_footer)/sizeof(uint32))
+		{
+			vector<uint8> buffer(count*sizeof(uint32));
+
+			if (count && FilmFile.SetPosition(length-SIZEOF_film_world_hash_footer-count*sizeof(uint32)) &&
+				FilmFile.Read(buffer.size(),&buffer[0]))
+			{
+				S= &buffer[0];
+				film_world_hashes.resize(count);
+				for (size_t i= 0; i<count; ++i) StreamToValue(S,film_world_hashes[i]);
+			}
+		}
+	}
+
+	FilmFile.SetPosition(SIZEOF_recording_header);
+}
+
 /* This is gross, (Alain wrote it, not me!) but I don't have time to clean it up */
 static bool vblFSRead(
 	OpenedFile& File,
@@ -46,6 +46,10 @@ public:
 	virtual int32   GetUnconfirmedActionFlagsCount() = 0;
 	virtual uint32  PeekUnconfirmedActionFlag(int32 offset) = 0;
 	virtual void    UpdateUnconfirmedActionFlags() = 0;
+
+	// per-tick world hashes, compared among players by protocols that can
+	virtual void	ReportWorldHash(int32 inTick, const uint32* inHashes, size_t inCount) {}
+	virtual bool	GetWorldHashDivergence(int32& outTick, int16& outHashIndex, uint32& outPlayers) { return false; }
 	
 };
 
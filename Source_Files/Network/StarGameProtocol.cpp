@@ -205,6 +205,18 @@ StarGameProtocol::UpdateUnconfirmedActionFlags()
 	}
 }
 
+void
+StarGameProtocol::ReportWorldHash(int32 inTick, const uint32* inHashes, size_t inCount)
+{
+	spoke_report_world_hash(inTick, inHashes, inCount);
+}
+
+bool
+StarGameProtocol::GetWorldHashDivergence(int32& outTick, int16& outHashIndex, uint32& outPlayers)
+{
+	return spoke_take_world_hash_divergence(outTick, outHashIndex, outPlayers);
+}
+
 /* ZZZ addition:
 ---------------------------
 	make_player_really_net_dead
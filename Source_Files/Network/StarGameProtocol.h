@@ -49,6 +49,9 @@ public:
 	int32   GetUnconfirmedActionFlagsCount();
 	uint32  PeekUnconfirmedActionFlag(int32 offset);
 	void    UpdateUnconfirmedActionFlags();
+
+	void	ReportWorldHash(int32 inTick, const uint32* inHashes, size_t inCount);
+	bool	GetWorldHashDivergence(int32& outTick, int16& outHashIndex, uint32& outPlayers);
 };
 
 extern void DefaultStarPreferences();
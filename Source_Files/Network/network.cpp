@@ -2604,5 +2604,17 @@ void NetUpdateUnconfirmedActionFlags()
 	return sCurrentGameProtocol->UpdateUnconfirmedActionFlags();
 }
 
+void NetReportWorldHash(int32 inTick, const uint32* inHashes, size_t inCount)
+{
+	assert (sCurrentGameProtocol);
+	sCurrentGameProtocol->ReportWorldHash(inTick, inHashes, inCount);
+}
+
+bool NetGetWorldHashDivergence(int32& outTick, int16& outHashIndex, uint32& outPlayers)
+{
+	assert (sCurrentGameProtocol);
+	return sCurrentGameProtocol->GetWorldHashDivergence(outTick, outHashIndex, outPlayers);
+}
+
 #endif // !defined(DISABLE_NETWORKING)
 
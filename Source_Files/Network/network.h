@@ -289,6 +289,11 @@ int32 NetGetUnconfirmedActionFlagsCount(); // how many flags can we use for pred
 uint32 NetGetUnconfirmedActionFlag(int32 offset); // offset < GetUnconfirmedActionFlagsCount
 void NetUpdateUnconfirmedActionFlags();
 
+// world hashes, to catch games going out of sync; a divergence is reported once, naming the
+// first hash (subsystem) that differed and the players that disagreed
+void NetReportWorldHash(int32 inTick, const uint32* inHashes, size_t inCount);
+bool NetGetWorldHashDivergence(int32& outTick, int16& outHashIndex, uint32& outPlayers);
+
 struct NetworkStats
 {
 	enum {
@@ -46,6 +46,8 @@ enum {
         kPlayerNetDeadMessageType = 0x4e44,	// 'ND'
 	kSpokeToHubLossyByteStreamMessageType = 0x534c,	// 'SL'
 	kHubToSpokeLossyByteStreamMessageType = 0x484c, // 'HL'
+	kSpokeToHubWorldHashMessageType = 0x5748, // 'WH'
+	kHubToSpokeWorldHashDivergenceMessageType = 0x5744, // 'WD'
 
 	kSpokeToHubIdentification = 0x4944,   // 'ID'
 	kSpokeToHubGameDataPacketV1Magic = 0x5331, // 'S1'
@@ -56,6 +58,8 @@ enum {
 
         kPregameTicks = TICKS_PER_SECOND * 3,	// Synchronization/timing adjustment before real data
         kActionFlagsSerializedLength = 4,	// bytes for each serialized action_flags_t (should be elsewhere)
+	kWorldHashReportPeriod = TICKS_PER_SECOND / 2,	// spokes report the world hash of every tick divisible by this
+	kMaximumWorldHashCount = 32,	// hashes (subsystems) per report
 	
 	kStarPacketHeaderSize = 4, // 2 bytes for packet magic, 2 for CRC
 };
@@ -87,6 +91,8 @@ extern int32 spoke_latency(); // in ms, kNetLatencyInvalid if not yet valid
 extern int32 hub_latency(int player_index); // in ms, kNetLatencyInvalid if not valid, kNetLatencyDisconnected if d/c
 extern TickBasedActionQueue* spoke_get_unconfirmed_flags_queue();
 extern int32 spoke_get_smallest_unconfirmed_tick();
+extern void spoke_report_world_hash(int32 inTick, const uint32* inHashes, size_t inCount);
+extern bool spoke_take_world_hash_divergence(int32& outTick, int16& outHashIndex, uint32& outPlayers);
 extern void DefaultSpokePreferences();
 extern InfoTree SpokePreferencesTree();
 extern void SpokeParsePreferencesTree(InfoTree prefs, std::string version);
@@ -236,6 +236,9 @@ struct NetworkPlayer_hub {
 	std::deque<int32> mLatencyBuffer;
 
 	NetworkStats mStats;
+
+	// the last few world hashes the player reported, by game tick
+	std::map<int32, std::vector<uint32> > mWorldHashes;
 };
 
 // Housekeeping queues:
@@ -323,6 +326,25 @@ static CircularQueue<HubLossyByteStreamChunkDescriptor> sOutgoingLossyByteStream
 static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
 
 
+// Once two players report different world hashes for the same tick, we tell everyone (the same
+// way as with netdead players: in every packet until they've ACKed past mNoticeTick) and stop
+// comparing.  Later divergences are just consequences of the first.
+enum {
+	kWorldHashHistoryLength = 8
+};
+
+struct WorldHashDivergence
+{
+	bool	mFound;
+	int32	mTick;
+	int16	mHashIndex;
+	uint32	mPlayers;
+	int32	mNoticeTick;
+};
+
+static WorldHashDivergence sWorldHashDivergence;
+
+
 static myTMTaskPtr	sHubTickTask = NULL;
 static bool		sHubActive = false;	// used to enable the packet handler
 static bool		sHubInitialized = false;
@@ -338,6 +360,7 @@ static void hub_received_ping_request(AIStream& ps, NetAddrBlock address);
 static void hub_received_ping_response(AIStream& ps, NetAddrBlock address);
 static void process_messages(AIStream& ps, int inSenderIndex);
 static void process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType);
+static void process_world_hash_message(AIStream& ps, int inSenderIndex, uint16 inLength);
 static void make_player_netdead(int inPlayerIndex);
 static bool hub_tick();
 static void send_packets();
@@ -531,6 +554,7 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 		thePlayer.mStats.latency = NetworkStats::invalid;
 		thePlayer.mStats.jitter = NetworkStats::invalid;
 		thePlayer.mStats.errors = 0;
+		thePlayer.mWorldHashes.clear();
 
                 sFlagsQueues[i].reset(theFirstTick);
 		sLateFlagsQueues[i].reset(theFirstTick);
@@ -546,6 +570,7 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
         sLastNetworkTickSent = 0;
 	sLastRealUpdate = 0;
 	sLaggingPlayersBitmask = 0;
+	obj_clear(sWorldHashDivergence);
 
         sHubActive = true;
 
@@ -1241,6 +1266,57 @@ process_lossy_byte_stream_message(AIStream& ps, int inSenderIndex, uint16 inLeng
 
 
 
+static void
+process_world_hash_message(AIStream& ps, int inSenderIndex, uint16 inLength)
+{
+	assert(inSenderIndex >= 0 && inSenderIndex < static_cast<int>(sNetworkPlayers.size()));
+
+	size_t theStartOfMessage = ps.tellg();
+
+	int32 theTick;
+	uint16 theCount;
+	ps >> theTick >> theCount;
+
+	std::vector<uint32> theHashes(std::min(theCount, static_cast<uint16>(kMaximumWorldHashCount)));
+	for(size_t i = 0; i < theHashes.size(); i++)
+		ps >> theHashes[i];
+	ps.ignore(inLength - (ps.tellg() - theStartOfMessage));
+
+	NetworkPlayer_hub& theSender = sNetworkPlayers[inSenderIndex];
+	if(sWorldHashDivergence.mFound || theSender.mWorldHashes.count(theTick))
+		return;
+
+	theSender.mWorldHashes[theTick] = theHashes;
+	if(theSender.mWorldHashes.size() > kWorldHashHistoryLength)
+		theSender.mWorldHashes.erase(theSender.mWorldHashes.begin());
+
+	for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+	{
+		if(i == static_cast<size_t>(inSenderIndex))
+			continue;
+
+		std::map<int32, std::vector<uint32> >::const_iterator theOther = sNetworkPlayers[i].mWorldHashes.find(theTick);
+		if(theOther == sNetworkPlayers[i].mWorldHashes.end() || theOther->second.size() != theHashes.size())
+			continue;
+
+		for(size_t j = 0; j < theHashes.size(); j++)
+		{
+			if(theOther->second[j] != theHashes[j])
+			{
+				sWorldHashDivergence.mFound = true;
+				sWorldHashDivergence.mTick = theTick;
+				sWorldHashDivergence.mHashIndex = j;
+				sWorldHashDivergence.mPlayers = (((uint32)1) << i) | (((uint32)1) << inSenderIndex);
+				sWorldHashDivergence.mNoticeTick = sSmallestIncompleteTick;
+				logWarningNMT("world hashes of players %d and %d diverged at tick %d (hash %d)", i, inSenderIndex, theTick, j);
+				return;
+			}
+		}
+	}
+}
+
+
+
 static void
 process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 {
@@ -1252,6 +1328,8 @@ process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 
 	if(inMessageType == kSpokeToHubLossyByteStreamMessageType)
 		process_lossy_byte_stream_message(ps, inSenderIndex, theMessageLength);
+	else if(inMessageType == kSpokeToHubWorldHashMessageType)
+		process_world_hash_message(ps, inSenderIndex, theMessageLength);
 	else
 	{
 		// Currently we ignore (skip) all optional messages
@@ -1492,6 +1570,18 @@ send_packets()
                                         }
                                 }
 
+				// World hash divergence?
+				if(sWorldHashDivergence.mFound && thePlayer.mSmallestUnacknowledgedTick <= sWorldHashDivergence.mNoticeTick)
+				{
+					uint16 theMessageLength = sizeof(sWorldHashDivergence.mTick) + sizeof(sWorldHashDivergence.mHashIndex) + sizeof(sWorldHashDivergence.mPlayers);
+					
+					ps << (uint16)kHubToSpokeWorldHashDivergenceMessageType
+						<< theMessageLength
+						<< sWorldHashDivergence.mTick
+						<< sWorldHashDivergence.mHashIndex
+						<< sWorldHashDivergence.mPlayers;
+				}
+
 				// Lossy streaming data?
 				if(haveLossyData && ((theDescriptor.mDestinations & (((uint32)1) << i)) != 0))
 				{
@@ -48,6 +48,7 @@
 #include "InfoTree.h"
 
 #include <map>
+#include <algorithm> // std::min()
 
 extern void make_player_really_net_dead(size_t inPlayerIndex);
 extern void call_distribution_response_function_if_available(byte* inBuffer, uint16 inBufferSize, int16 inDistributionType, uint8 inSendingPlayerIndex);
@@ -146,6 +147,23 @@ static CircularQueue<SpokeLossyByteStreamChunkDescriptor> sOutgoingLossyByteStre
 // This is currently used only to hold incoming streaming data until it's passed to the upper-level code
 static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
 
+// The latest world hash we're telling the hub about; we put it in a few packets in a row since
+// any one of them could be lost.
+enum {
+	kWorldHashReportRepeats = 4
+};
+
+static int32 sOutgoingWorldHashTick;
+static vector<uint32> sOutgoingWorldHashes;
+static int sOutgoingWorldHashSendsRemaining;
+
+// The first divergence the hub told us about, held until the game asks for it.
+static bool sHeardWorldHashDivergence;
+static bool sWorldHashDivergenceTaken;
+static int32 sWorldHashDivergenceTick;
+static int16 sWorldHashDivergenceHashIndex;
+static uint32 sWorldHashDivergencePlayers;
+
 
 static void spoke_became_disconnected();
 static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags);
@@ -156,6 +174,7 @@ static void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketP
 static void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+static void handle_world_hash_divergence_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType);
 static bool spoke_tick();
 static void send_packet();
@@ -261,11 +280,16 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
 	sOutgoingLossyByteStreamDescriptors.reset();
 	sOutgoingLossyByteStreamData.reset();
 
+	sOutgoingWorldHashSendsRemaining = 0;
+	sHeardWorldHashDivergence = false;
+	sWorldHashDivergenceTaken = false;
+
         sMessageTypeToMessageHandler.clear();
         sMessageTypeToMessageHandler[kEndOfMessagesMessageType] = handle_end_of_messages_message;
         sMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = handle_timing_adjustment_message;
         sMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = handle_player_net_dead_message;
 	sMessageTypeToMessageHandler[kHubToSpokeLossyByteStreamMessageType] = handle_lossy_byte_stream_message;
+	sMessageTypeToMessageHandler[kHubToSpokeWorldHashDivergenceMessageType] = handle_world_hash_divergence_message;
 
         sNeedToSendLocalOutgoingBuffer = false;
 
@@ -883,6 +907,34 @@ handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingC
 
 
 
+static void
+handle_world_hash_divergence_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+{
+	uint16 theMessageLength;
+	ps >> theMessageLength;
+
+	size_t theStartOfMessage = ps.tellg();
+
+	int32 theTick;
+	int16 theHashIndex;
+	uint32 thePlayers;
+	ps >> theTick >> theHashIndex >> thePlayers;
+
+	// skip anything a later version might have added
+	ps.ignore(theMessageLength - (ps.tellg() - theStartOfMessage));
+
+	if(!sHeardWorldHashDivergence)
+	{
+		sHeardWorldHashDivergence = true;
+		sWorldHashDivergenceTick = theTick;
+		sWorldHashDivergenceHashIndex = theHashIndex;
+		sWorldHashDivergencePlayers = thePlayers;
+		logWarningNMT("hub says world hashes diverged at tick %d (hash %d, players 0x%x)", theTick, theHashIndex, thePlayers);
+	}
+}
+
+
+
 static void
 process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType)
 {
@@ -1062,6 +1114,21 @@ send_packet()
 			ps.write(sScratchBuffer, theDescriptor.mLength);
 		}
 		
+		// World hash?
+		if(sOutgoingWorldHashSendsRemaining > 0)
+		{
+			sOutgoingWorldHashSendsRemaining--;
+
+			uint16 theMessageLength = sizeof(sOutgoingWorldHashTick) + sizeof(uint16) + sOutgoingWorldHashes.size() * sizeof(uint32);
+
+			ps << (uint16)kSpokeToHubWorldHashMessageType
+				<< theMessageLength
+				<< sOutgoingWorldHashTick
+				<< (uint16)sOutgoingWorldHashes.size();
+			for(size_t i = 0; i < sOutgoingWorldHashes.size(); i++)
+				ps << sOutgoingWorldHashes[i];
+		}
+		
                 // No more messages
                 ps << (uint16)kEndOfMessagesMessageType;
         
@@ -1143,6 +1210,32 @@ int32 spoke_get_smallest_unconfirmed_tick()
 {
 	return sSmallestUnconfirmedTick;
 }
+
+void
+spoke_report_world_hash(int32 inTick, const uint32* inHashes, size_t inCount)
+{
+	if(inTick % kWorldHashReportPeriod != 0)
+		return;
+
+	MyTMMutexTaker mutex;
+	sOutgoingWorldHashTick = inTick;
+	sOutgoingWorldHashes.assign(inHashes, inHashes + std::min(inCount, static_cast<size_t>(kMaximumWorldHashCount)));
+	sOutgoingWorldHashSendsRemaining = kWorldHashReportRepeats;
+}
+
+bool
+spoke_take_world_hash_divergence(int32& outTick, int16& outHashIndex, uint32& outPlayers)
+{
+	MyTMMutexTaker mutex;
+	if(!sHeardWorldHashDivergence || sWorldHashDivergenceTaken)
+		return false;
+
+	sWorldHashDivergenceTaken = true;
+	outTick = sWorldHashDivergenceTick;
+	outHashIndex = sWorldHashDivergenceHashIndex;
+	outPlayers = sWorldHashDivergencePlayers;
+	return true;
+}
 		
 
 enum {
@@ -3122,6 +3122,20 @@ void OGL_RenderLines(const std::vector<world_point2d>& points, float thickness)
 	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 	
 	std::vector<GLfloat> coords;
+	OGL_GetLineTriangles(points, thickness, coords);
+	
+	if (!coords.empty())
+	{
+		glVertexPointer(2, GL_FLOAT, 0, &coords.front());
+		glDrawArrays(GL_TRIANGLES, 0, coords.size() / 2);
+	}
+	
+	glEnable(GL_TEXTURE_2D);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+void OGL_GetLineTriangles(const std::vector<world_point2d>& points, float thickness, std::vector<float>& coords)
+{
 	for (size_t i = 1; i < points.size(); i += 2)
 	{
 		world_point2d prev = points[i - 1];
@@ -3153,15 +3167,6 @@ void OGL_RenderLines(const std::vector<world_point2d>& points, float thickness)
 		coords.push_back(cur.x - yd);
 		coords.push_back(cur.y + xd);
 	}
-	
-	if (!coords.empty())
-	{
-		glVertexPointer(2, GL_FLOAT, 0, &coords.front());
-		glDrawArrays(GL_TRIANGLES, 0, coords.size() / 2);
-	}
-	
-	glEnable(GL_TEXTURE_2D);
-	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
 // Render the console cursor
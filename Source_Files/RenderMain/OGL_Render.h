@@ -110,6 +110,9 @@ void OGL_RenderFrame(float x, float y, float w, float h, float thickness);
 // Render lines (for overhead map)
 void OGL_RenderLines(const std::vector<world_point2d>& points, float thickness);
 
+// The triangles OGL_RenderLines() draws, appended to coords as x, y pairs
+void OGL_GetLineTriangles(const std::vector<world_point2d>& points, float thickness, std::vector<float>& coords);
+
 // Returns whether or not 2D stuff is to be piped through OpenGL
 bool OGL_Get2D();
 
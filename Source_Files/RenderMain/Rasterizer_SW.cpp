@@ -0,0 +1,269 @@
+/*
+RASTERIZER_SW.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Threaded drawing for the software rasterizer.  A frame is recorded between Begin() and
+	End(), then every thread draws the whole recording into its own vertical strip of the
+	screen; the mappers clip to the strip (see scottish_textures.cpp), so the strips never
+	share a pixel and need no locking.  The recording is only read while the strips draw.
+*/
+
+#include "cseries.h"
+#include "Rasterizer_SW.h"
+#include "Logging.h"
+
+#include <limits.h>
+
+/* ---------- constants */
+
+#define MAXIMUM_RASTERIZER_THREADS 16
+
+/* ---------- structures */
+
+struct Rasterizer_SW_Class::strip_worker
+{
+	Rasterizer_SW_Class rasterizer;
+	const Rasterizer_SW_Class *frame;
+
+	SDL_Thread *thread;
+	SDL_sem *start, *finished;
+	bool quit;
+};
+
+/* ---------- private prototypes */
+
+static short strip_edge(int strip_index, int strip_count, short width);
+
+/* ---------- code */
+
+Rasterizer_SW_Class::~Rasterizer_SW_Class()
+{
+	/* no SDL calls here; SDL may already be gone, so SetThreadCount(1) before it goes */
+	assert(workers.empty());
+
+	if (owns_tables)
+	{
+		delete []scratch_table0;
+		delete []scratch_table1;
+		delete [](char *)precalculation_table;
+	}
+}
+
+void Rasterizer_SW_Class::SetThreadCount(int Count)
+{
+	if (Count<=0) Count= SDL_GetCPUCount();
+	Count= PIN(Count, 1, MAXIMUM_RASTERIZER_THREADS);
+	if (Count==thread_count) return;
+
+	stop_workers();
+	start_workers(Count-1);
+	thread_count= workers.size()+1;
+}
+
+void Rasterizer_SW_Class::Begin()
+{
+	span_count= pixel_count= 0;
+	recording= thread_count>1;
+	if (recording)
+	{
+		recorded_calls.clear();
+		recorded_polygons.clear();
+		recorded_rectangles.clear();
+	}
+}
+
+void Rasterizer_SW_Class::End()
+{
+	if (!recording) return;
+	recording= false;
+
+	int strip_count= workers.size()+1;
+	size_t worker_index;
+
+	/* hand the other strips out first, so the workers get going while we draw ours */
+	for (worker_index= 0; worker_index<workers.size(); ++worker_index)
+	{
+		strip_worker *worker= workers[worker_index];
+
+		worker->rasterizer.view= view;
+		worker->rasterizer.screen= screen;
+		worker->rasterizer.set_strip(strip_edge(worker_index+1, strip_count, screen->width),
+			strip_edge(worker_index+2, strip_count, screen->width));
+		worker->rasterizer.strip_random_seed= *random_seed;
+		worker->rasterizer.counting= counting;
+		worker->rasterizer.span_count= worker->rasterizer.pixel_count= 0;
+		worker->frame= this;
+		SDL_SemPost(worker->start);
+	}
+
+	/* the first strip is ours; drawing it moves the real seed on just as one thread would */
+	set_strip(0, strip_edge(1, strip_count, screen->width));
+	draw_recorded_frame(*this);
+	set_strip(0, SHRT_MAX);
+
+	for (worker_index= 0; worker_index<workers.size(); ++worker_index)
+	{
+		SDL_SemWait(workers[worker_index]->finished);
+		span_count+= workers[worker_index]->rasterizer.span_count;
+		pixel_count+= workers[worker_index]->rasterizer.pixel_count;
+	}
+}
+
+/* ---------- private code */
+
+void Rasterizer_SW_Class::set_strip(
+	short x0,
+	short x1)
+{
+	strip_x0= x0;
+	strip_x1= x1;
+}
+
+void Rasterizer_SW_Class::record(
+	const polygon_definition& polygon,
+	int16 type)
+{
+	recorded_call call= {type, static_cast<int32>(recorded_polygons.size())};
+
+	recorded_polygons.push_back(polygon);
+	recorded_calls.push_back(call);
+}
+
+void Rasterizer_SW_Class::record(
+	const rectangle_definition& rectangle)
+{
+	recorded_call call= {_record_rectangle, static_cast<int32>(recorded_rectangles.size())};
+
+	recorded_rectangles.push_back(rectangle);
+	recorded_calls.push_back(call);
+}
+
+/* the mappers scribble on what they're given (rectangles get their clipping rewritten), and
+	every strip needs the original, so each call gets a copy */
+void Rasterizer_SW_Class::draw_recorded_frame(
+	const Rasterizer_SW_Class& frame)
+{
+	for (size_t call_index= 0; call_index<frame.recorded_calls.size(); ++call_index)
+	{
+		const recorded_call& call= frame.recorded_calls[call_index];
+
+		switch (call.type)
+		{
+			case _record_horizontal_polygon:
+			{
+				polygon_definition polygon= frame.recorded_polygons[call.index];
+				texture_horizontal_polygon(polygon);
+				break;
+			}
+
+			case _record_vertical_polygon:
+			{
+				polygon_definition polygon= frame.recorded_polygons[call.index];
+				texture_vertical_polygon(polygon);
+				break;
+			}
+
+			case _record_rectangle:
+			{
+				rectangle_definition rectangle= frame.recorded_rectangles[call.index];
+				texture_rectangle(rectangle);
+				break;
+			}
+
+			default:
+				assert(false);
+				break;
+		}
+	}
+}
+
+void Rasterizer_SW_Class::start_workers(
+	int count)
+{
+	for (int worker_index= 0; worker_index<count; ++worker_index)
+	{
+		strip_worker *worker= new strip_worker;
+
+		worker->rasterizer.owns_tables= true;
+		worker->rasterizer.allocate_tables();
+		worker->rasterizer.random_seed= &worker->rasterizer.strip_random_seed;
+		worker->frame= NULL;
+		worker->quit= false;
+		worker->start= SDL_CreateSemaphore(0);
+		worker->finished= SDL_CreateSemaphore(0);
+		worker->thread= (worker->start && worker->finished) ?
+			SDL_CreateThread(worker_loop, "Rasterizer_SW_strip", worker) : NULL;
+
+		if (!worker->thread)
+		{
+			logWarning("couldn't start software rasterizer thread %d: %s", worker_index+1, SDL_GetError());
+			if (worker->start) SDL_DestroySemaphore(worker->start);
+			if (worker->finished) SDL_DestroySemaphore(worker->finished);
+			delete worker;
+			break;
+		}
+
+		workers.push_back(worker);
+	}
+}
+
+void Rasterizer_SW_Class::stop_workers(
+	void)
+{
+	for (size_t worker_index= 0; worker_index<workers.size(); ++worker_index)
+	{
+		strip_worker *worker= workers[worker_index];
+
+		worker->quit= true;
+		SDL_SemPost(worker->start);
+		SDL_WaitThread(worker->thread, NULL);
+		SDL_DestroySemaphore(worker->start);
+		SDL_DestroySemaphore(worker->finished);
+		delete worker;
+	}
+	workers.clear();
+}
+
+int Rasterizer_SW_Class::worker_loop(
+	void *data)
+{
+	strip_worker *worker= static_cast<strip_worker *>(data);
+
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+		if (worker->quit) break;
+
+		worker->rasterizer.draw_recorded_frame(*worker->frame);
+		SDL_SemPost(worker->finished);
+	}
+
+	return 0;
+}
+
+/* strips are as even as they can be with every inside edge a multiple of four */
+static short strip_edge(
+	int strip_index,
+	int strip_count,
+	short width)
+{
+	if (strip_index>=strip_count) return width;
+
+	return static_cast<short>((width*strip_index/strip_count)&~3);
+}
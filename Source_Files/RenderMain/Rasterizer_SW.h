@@ -27,6 +27,11 @@
 
 #include "Rasterizer.h"
 
+#include <vector>
+
+struct _vertical_polygon_data;
+struct _horizontal_polygon_line_data;
+
 
 class Rasterizer_SW_Class: public RasterizerClass
 {
@@ -41,6 +46,24 @@ public:
 	// be sure to call it before doing any rendering
 	void SetView(view_data& View) {view = &View;}
 	
+	// How many threads draw each frame; 0 means one per processor.
+	// With more than one, everything between Begin() and End() is only recorded,
+	// and End() has each thread draw all of it into its own strip of the screen.
+	// The result is the same, pixel for pixel, as drawing it with one.
+	// Set it back to 1 before SDL shuts down, to stop the threads.
+	void SetThreadCount(int Count);
+	int GetThreadCount() const {return thread_count;}
+	
+	void Begin();
+	void End();
+	
+	// Lines (rows of floors and ceilings, columns of walls and sprites) and pixels
+	// drawn since Begin(), from every thread once End() returns; counting them costs
+	// a pass over every polygon's lines, so it's only done when asked for
+	void SetCounting(bool Counting) {counting = Counting;}
+	int32 GetSpanCount() const {return span_count;}
+	int32 GetPixelCount() const {return pixel_count;}
+	
 	// Rendering calls
 	// These are defined in scottish_textures.c (too great a name to change)
 	
@@ -49,6 +72,67 @@ public:
 	void texture_vertical_polygon(polygon_definition& textured_polygon);
 	
 	void texture_rectangle(rectangle_definition& textured_rectangle);
+	
+	Rasterizer_SW_Class();
+	~Rasterizer_SW_Class();
+	
+private:
+	// Scratch and precalculation tables; the screen's rasterizer uses the ones
+	// allocate_texture_tables() sets aside at launch, strip rasterizers their own
+	short *scratch_table0, *scratch_table1;
+	void *precalculation_table;
+	bool owns_tables;
+	
+	// Only columns strip_x0 to strip_x1-1 get drawn; strip edges are multiples of 4,
+	// so the vertical mapper groups its columns the same way it does for the whole screen
+	short strip_x0, strip_x1;
+	
+	// Static transfer's noise generator; strip rasterizers step their own copy
+	// through every static column of the frame, drawing or not, so they all
+	// see the noise the screen's rasterizer would have
+	uint16 *random_seed;
+	uint16 strip_random_seed;
+	
+	bool counting;
+	int32 span_count, pixel_count;
+	
+	void allocate_tables();
+	void set_strip(short x0, short x1);
+	bool polygon_misses_strip(polygon_definition& polygon);
+	bool clip_vertical_polygon_lines(_vertical_polygon_data *data, short *&y0_table, short *&y1_table);
+	void clip_horizontal_polygon_lines(_horizontal_polygon_line_data *data, short *x0_table, short *x1_table,
+		short line_count, bool landscaped);
+	void count_vertical_polygon_lines(_vertical_polygon_data *data, short *y0_table, short *y1_table);
+	void count_horizontal_polygon_lines(short *x0_table, short *x1_table, short line_count);
+	
+	// The recorded frame, in drawing order
+	enum {_record_horizontal_polygon, _record_vertical_polygon, _record_rectangle};
+	struct recorded_call
+	{
+		int16 type;
+		int32 index;
+	};
+	std::vector<recorded_call> recorded_calls;
+	std::vector<polygon_definition> recorded_polygons;
+	std::vector<rectangle_definition> recorded_rectangles;
+	bool recording;
+	
+	void record(const polygon_definition& polygon, int16 type);
+	void record(const rectangle_definition& rectangle);
+	void draw_recorded_frame(const Rasterizer_SW_Class& frame);
+	
+	// Strip rasterizers beyond the first, which the calling thread draws itself
+	struct strip_worker;
+	std::vector<strip_worker *> workers;
+	int thread_count;
+	
+	void start_workers(int count);
+	void stop_workers();
+	static int worker_loop(void *data);
+	
+	// Not copyable; owns threads and tables
+	Rasterizer_SW_Class(const Rasterizer_SW_Class&);
+	Rasterizer_SW_Class& operator=(const Rasterizer_SW_Class&);
 };
 
 
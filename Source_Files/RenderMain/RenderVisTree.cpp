@@ -38,6 +38,8 @@ Oct 13, 2000
 #include "map.h"
 #include "RenderVisTree.h"
 
+#include <string.h>
+
 
 // LP: "recommended" sizes of stuff in growable lists
 #define POLYGON_QUEUE_SIZE 256
@@ -83,7 +85,9 @@ inline void INITIALIZE_NODE(node_data *node, short node_polygon_index, uint16 no
 
 // Inits everything
 RenderVisTreeClass::RenderVisTreeClass():
-	view(NULL), mark_as_explored(false), add_to_automap(true)
+	tree_is_cached(false),
+	view(NULL), mark_as_explored(false), add_to_automap(true),
+	reuse_tree(true), tree_was_reused(false), built_tree_count(0), reused_tree_count(0)
 {
 	PolygonQueue.reserve(POLYGON_QUEUE_SIZE);
 	EndpointClips.reserve(MAXIMUM_ENDPOINT_CLIPS);
@@ -97,6 +101,9 @@ void RenderVisTreeClass::Resize(size_t NumEndpoints, size_t NumLines)
 {
 	endpoint_x_coordinates.resize(NumEndpoints);
 	line_clip_indexes.resize(NumLines);
+	
+	// Called whenever a map is loaded
+	InvalidateTree();
 }
 
 // Add a polygon to the polygon queue
@@ -110,6 +117,7 @@ void RenderVisTreeClass::PUSH_POLYGON_INDEX(short polygon_index)
 		else
 			PolygonQueue.push_back(polygon_index);
 		polygon_queue_size++;
+		VisiblePolygons.push_back(polygon_index);
 		
 		// polygon_queue[polygon_queue_size++]= polygon_index;
 		SET_RENDER_FLAG(polygon_index, _polygon_is_visible);
@@ -121,8 +129,20 @@ void RenderVisTreeClass::build_render_tree()
 {
 	assert(view);	// Idiot-proofing
 
+	tree_was_reused= reuse_tree && reuse_render_tree();
+	if (tree_was_reused)
+	{
+		reused_tree_count++;
+		return;
+	}
+	built_tree_count++;
+
 	/* initialize the queue where we remember polygons we need to fire at */
 	initialize_polygon_queue();
+	VisiblePolygons.clear();
+	VisitedEndpoints.clear();
+	AutomapLines.clear();
+	LineClipSources.clear();
 
 	/* initialize our node list to contain the root, etc. */
 	initialize_render_tree();
@@ -188,9 +208,184 @@ void RenderVisTreeClass::build_render_tree()
 				}
 				
 				SET_RENDER_FLAG(endpoint_index, _endpoint_has_been_visited);
+				VisitedEndpoints.push_back(endpoint_index);
 			}
 		}
 	}
+	
+	if (reuse_tree) cache_render_tree();
+}
+
+/* ---------- reusing the last frame's render tree */
+
+// Everything about the view that the rays, endpoint transforms and endpoint clips depend on,
+// and then everything else the line clips depend on
+void RenderVisTreeClass::get_tree_view_keys(
+	int32 *tree_key,
+	int32 *line_clip_key)
+{
+	int32 *key= tree_key;
+	
+	*key++= view->origin.x;
+	*key++= view->origin.y;
+	*key++= view->origin_polygon_index;
+	*key++= view->yaw;
+	*key++= view->screen_width;
+	*key++= view->half_screen_width;
+	*key++= view->world_to_screen_x;
+	*key++= view->left_edge.i;
+	*key++= view->left_edge.j;
+	*key++= view->right_edge.i;
+	*key++= view->right_edge.j;
+	*key++= view->untransformed_left_edge.i;
+	*key++= view->untransformed_left_edge.j;
+	*key++= view->untransformed_right_edge.i;
+	*key++= view->untransformed_right_edge.j;
+	assert(key==tree_key+TREE_VIEW_KEY_SIZE);
+	
+	key= line_clip_key;
+	*key++= view->origin.z;
+	*key++= view->dtanpitch;
+	*key++= view->screen_height;
+	*key++= view->half_screen_height;
+	*key++= view->world_to_screen_y;
+	*key++= view->top_edge.i;
+	*key++= view->top_edge.j;
+	*key++= view->bottom_edge.i;
+	*key++= view->bottom_edge.j;
+	assert(key==line_clip_key+LINE_CLIP_VIEW_KEY_SIZE);
+}
+
+// What the tree read from the map: the visible polygons' heights, and their lines' and
+// endpoints' positions, heights and solidity (platforms change these)
+void RenderVisTreeClass::gather_tree_dependencies(
+	vector<int16>& dependencies)
+{
+	dependencies.clear();
+	for (size_t i= 0; i<VisiblePolygons.size(); ++i)
+	{
+		short polygon_index= VisiblePolygons[i];
+		if (polygon_index<0 || polygon_index>=dynamic_world->polygon_count)
+		{
+			// Can't be the same map; make sure the comparison fails
+			dependencies.push_back(NONE);
+			continue;
+		}
+		polygon_data *polygon= get_polygon_data(polygon_index);
+		
+		dependencies.push_back(polygon_index);
+		dependencies.push_back(polygon->floor_height);
+		dependencies.push_back(polygon->ceiling_height);
+		dependencies.push_back(polygon->vertex_count);
+		for (short vertex_index= 0; vertex_index<polygon->vertex_count; ++vertex_index)
+		{
+			endpoint_data *endpoint= get_endpoint_data(polygon->endpoint_indexes[vertex_index]);
+			line_data *line= get_line_data(polygon->line_indexes[vertex_index]);
+			
+			dependencies.push_back(polygon->endpoint_indexes[vertex_index]);
+			dependencies.push_back(endpoint->vertex.x);
+			dependencies.push_back(endpoint->vertex.y);
+			dependencies.push_back(ENDPOINT_IS_TRANSPARENT(endpoint) ? 1 : 0);
+			dependencies.push_back(polygon->adjacent_polygon_indexes[vertex_index]);
+			dependencies.push_back(LINE_IS_TRANSPARENT(line) ? 1 : 0);
+			dependencies.push_back(line->highest_adjacent_floor);
+			dependencies.push_back(line->lowest_adjacent_ceiling);
+		}
+	}
+}
+
+void RenderVisTreeClass::cache_render_tree()
+{
+	get_tree_view_keys(tree_view_key, line_clip_view_key);
+	gather_tree_dependencies(TreeDependencies);
+	CachedRenderFlags= RenderFlagList;
+	
+	CachedNodeLinks.resize(Nodes.size());
+	NodeList::iterator node= Nodes.begin();
+	for (size_t i= 0; i<Nodes.size(); ++i, ++node)
+	{
+		CachedNodeLinks[i].reference= node->reference;
+		CachedNodeLinks[i].siblings= node->siblings;
+		CachedNodeLinks[i].children= node->children;
+	}
+	
+	tree_is_cached= true;
+}
+
+// Puts the last tree back, if it's still what build_render_tree() would build; the nodes,
+// clips and endpoint screen coordinates have been left alone since
+bool RenderVisTreeClass::reuse_render_tree()
+{
+	if (!tree_is_cached) return false;
+	
+	int32 new_tree_key[TREE_VIEW_KEY_SIZE], new_line_clip_key[LINE_CLIP_VIEW_KEY_SIZE];
+	get_tree_view_keys(new_tree_key, new_line_clip_key);
+	if (memcmp(new_tree_key, tree_view_key, sizeof(tree_view_key))) return false;
+	
+	gather_tree_dependencies(ScratchDependencies);
+	if (ScratchDependencies!=TreeDependencies) return false;
+	
+	RenderFlagList= CachedRenderFlags;
+	
+	NodeList::iterator node= Nodes.begin();
+	for (size_t i= 0; i<Nodes.size(); ++i, ++node)
+	{
+		node->reference= CachedNodeLinks[i].reference;
+		node->siblings= CachedNodeLinks[i].siblings;
+		node->children= CachedNodeLinks[i].children;
+	}
+	
+	// Others (the M1 exploration tree) transform endpoints for their own views
+	for (size_t i= 0; i<VisitedEndpoints.size(); ++i)
+	{
+		endpoint_data *endpoint= get_endpoint_data(VisitedEndpoints[i]);
+		endpoint->transformed= endpoint->vertex;
+		transform_overflow_point2d(&endpoint->transformed, (world_point2d *) &view->origin, view->yaw, &endpoint->flags);
+	}
+	
+	// Sorting and object placement add their own windows
+	ClippingWindows.clear();
+	
+	// Rebuilt in the same order, so the nodes' line clip indexes still hold
+	if (memcmp(new_line_clip_key, line_clip_view_key, sizeof(line_clip_view_key)))
+	{
+		LineClips.resize(NUMBER_OF_INITIAL_LINE_CLIPS);
+		
+		line_clip_data *line= &LineClips[indexTOP_AND_BOTTOM_OF_SCREEN];
+		line->flags= _clip_up|_clip_down;
+		line->x0= 0;
+		line->x1= view->screen_width;
+		line->top_y= 0; short_to_long_2d(view->top_edge,line->top_vector);
+		line->bottom_y= view->screen_height; short_to_long_2d(view->bottom_edge,line->bottom_vector);
+		
+		for (size_t i= 0; i<LineClipSources.size(); ++i)
+		{
+			CLEAR_RENDER_FLAG(LineClipSources[i].line_index, _line_has_clip_data);
+			calculate_line_clipping_information(LineClipSources[i].line_index, LineClipSources[i].clip_flags);
+		}
+		memcpy(line_clip_view_key, new_line_clip_key, sizeof(line_clip_view_key));
+		CachedRenderFlags= RenderFlagList;
+	}
+	
+	// The automap might have been cleared, and exploring polygons is idempotent
+	for (size_t i= 0; i<VisiblePolygons.size(); ++i)
+	{
+		short polygon_index= VisiblePolygons[i];
+		
+		if (add_to_automap) ADD_POLYGON_TO_AUTOMAP(polygon_index);
+		if (mark_as_explored)
+		{
+			polygon_data *polygon= get_polygon_data(polygon_index);
+			if (polygon->type == _polygon_must_be_explored) polygon->type = _polygon_is_normal;
+		}
+	}
+	if (add_to_automap)
+	{
+		for (size_t i= 0; i<AutomapLines.size(); ++i)
+			ADD_LINE_TO_AUTOMAP(AutomapLines[i]);
+	}
+	
+	return true;
 }
 
 /* ---------- building the render tree */
@@ -477,7 +672,11 @@ uint16 RenderVisTreeClass::next_polygon_along_line(
 		line_data *line= get_line_data(crossed_line_index);
 
 		/* add the line we crossed to the automap */
-		if (add_to_automap) ADD_LINE_TO_AUTOMAP(crossed_line_index);
+		if (add_to_automap)
+		{
+			ADD_LINE_TO_AUTOMAP(crossed_line_index);
+			AutomapLines.push_back(crossed_line_index);
+		}
 
 		/* if the line has a side facing this polygon, mark the side as visible */
 		if (crossed_side_index!=NONE) SET_RENDER_FLAG(crossed_side_index, _side_is_visible);
@@ -681,6 +880,12 @@ void RenderVisTreeClass::calculate_line_clipping_information(
 	SET_RENDER_FLAG(line_index, _line_has_clip_data);
 	line_clip_indexes[line_index]= static_cast<vector<size_t>::value_type>(LastIndex);
 	
+	if (LastIndex-NUMBER_OF_INITIAL_LINE_CLIPS==LineClipSources.size())
+	{
+		line_clip_source source= {line_index, clip_flags};
+		LineClipSources.push_back(source);
+	}
+	
 	data->flags= 0;
 
 	if (p0.x>0 && p1.x>0)
@@ -35,6 +35,11 @@ Sep. 15, 2000 (Loren Petrich):
 	
 Oct 13, 2000
 	LP: replaced GrowableLists and ResizableLists with STL vectors
+
+	build_render_tree() keeps the tree it built and hands it back next frame if the view
+	hasn't moved or turned and nothing the tree looked at (the heights and solidity of the
+	visible polygons and their lines and endpoints) has changed; if only the view's height or
+	pitch changed, just the line clips are redone
 */
 
 #include <deque>
@@ -188,6 +193,41 @@ class RenderVisTreeClass
 	
 	void ResetLineClips();
 	
+	// The last tree built, for build_render_tree() to reuse:
+	// what it was built from and what it marked, so it can be put back
+	enum {TREE_VIEW_KEY_SIZE = 15, LINE_CLIP_VIEW_KEY_SIZE = 9};
+	bool tree_is_cached;
+	int32 tree_view_key[TREE_VIEW_KEY_SIZE];
+	int32 line_clip_view_key[LINE_CLIP_VIEW_KEY_SIZE];
+	
+	vector<short> VisiblePolygons;		// in the order they were reached
+	vector<short> VisitedEndpoints;
+	vector<short> AutomapLines;			// every crossing, duplicates and all
+	vector<int16> TreeDependencies, ScratchDependencies;
+	vector<uint16> CachedRenderFlags;
+	
+	// What sort_render_tree() takes apart as it sorts
+	struct node_links
+	{
+		node_data **reference;
+		node_data *siblings;
+		node_data *children;
+	};
+	vector<node_links> CachedNodeLinks;
+	
+	// The line and flags each of LineClips (past the initial ones) was made from
+	struct line_clip_source
+	{
+		short line_index;
+		uint16 clip_flags;
+	};
+	vector<line_clip_source> LineClipSources;
+	
+	void get_tree_view_keys(int32 *tree_key, int32 *line_clip_key);
+	void gather_tree_dependencies(vector<int16>& dependencies);
+	void cache_render_tree();
+	bool reuse_render_tree();
+	
 public:
 
 	/* gives screen x-coordinates for a map endpoint (only valid if _endpoint_is_visible) */
@@ -227,6 +267,15 @@ public:
 	// the automap.
 	bool add_to_automap;
 	
+	// If true (default), the last frame's tree is reused when it can be;
+	// tree_was_reused tells how the last build_render_tree() went
+	bool reuse_tree;
+	bool tree_was_reused;
+	int32 built_tree_count, reused_tree_count;
+	
+	// Forgets the cached tree; the map changed under it
+	void InvalidateTree() {tree_is_cached = false;}
+	
 	// Resizes all the objects defined inside;
 	// the resizing is lazy
 	void Resize(size_t NumEndpoints, size_t NumLines);
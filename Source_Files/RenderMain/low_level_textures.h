@@ -34,6 +34,7 @@ Jan 30, 2000 (Loren Petrich):
 #include "preferences.h"
 #include "textures.h"
 #include "scottish_textures.h"
+#include "span_kernels.h"
 
 /* ---------- global state */
 
@@ -62,6 +63,11 @@ struct _horizontal_polygon_line_data
 	uint32 source_dx, source_dy;
 	
 	void *shading_table;
+
+	/* a square texture 32-downshift texels on a side: the bitmap itself, or one of its
+		mipmaps (ignored by the landscape mapper) */
+	pixel8 *texture;
+	int32 downshift;
 };
 
 /* ---------- texture vertical polygon */
@@ -149,6 +155,40 @@ void inline write_pixel(T *dst, pixel8 pixel, T *shading_table, uint8 *opacity_t
 	}	
 }
 
+/* the span kernels only do 16- and 32-bit pixels, and only the channel layouts they can
+	blend exactly.  unblended and fast-blended spans are all table lookups, which the scalar
+	loops do as quickly (see .benchmark span_kernels), so only nice blending uses them */
+template <typename T>
+inline bool use_span_kernels(struct span_blend& blend, int sw_alpha_blend, bool check_transparent,
+	pixel32 rmask, pixel32 gmask, pixel32 bmask)
+{
+	if (sizeof(T)==sizeof(pixel8) || !active_span_kernels || sw_alpha_blend!=_sw_alpha_nice) return false;
+
+	blend.mode= sw_alpha_blend;
+	blend.check_transparent= check_transparent;
+	return get_span_pixel_channels(rmask, gmask, bmask, sizeof(T), &blend.channels);
+}
+
+inline void span_kernel_horizontal(pixel8 *, int, const struct horizontal_span&, const struct span_blend&) {}
+inline void span_kernel_horizontal(pixel16 *write, int count, const struct horizontal_span& span, const struct span_blend& blend)
+{
+	active_span_kernels->horizontal16(write, count, span, blend);
+}
+inline void span_kernel_horizontal(pixel32 *write, int count, const struct horizontal_span& span, const struct span_blend& blend)
+{
+	active_span_kernels->horizontal32(write, count, span, blend);
+}
+
+inline void span_kernel_quad(pixel8 *, int, int, struct vertical_quad&, const struct span_blend&) {}
+inline void span_kernel_quad(pixel16 *write, int bytes_per_row, int count, struct vertical_quad& quad, const struct span_blend& blend)
+{
+	active_span_kernels->quad16(write, bytes_per_row, count, quad, blend);
+}
+inline void span_kernel_quad(pixel32 *write, int bytes_per_row, int count, struct vertical_quad& quad, const struct span_blend& blend)
+{
+	active_span_kernels->quad32(write, bytes_per_row, count, quad, blend);
+}
+
 template <typename T, int sw_alpha_blend>
 void texture_horizontal_polygon_lines
 (
@@ -163,6 +203,7 @@ void texture_horizontal_polygon_lines
 	uint8 *opacity_table = 0
 )
 {
+	(void) (texture);
 	(void) (view);
 
 	pixel32 rmask = 0;
@@ -179,22 +220,32 @@ void texture_horizontal_polygon_lines
 		bmask = fmt->Bmask;
 	}
 
+	struct span_blend blend;
+	bool kernels= use_span_kernels<T>(blend, sw_alpha_blend, false, rmask, gmask, bmask);
+
 	while ((line_count-= 1)>=0)
 	{
 		short x0= *x0_table++, x1= *x1_table++;
 		
 		T *shading_table= (T *)data->shading_table;
 		T *write= (T *) screen->row_addresses[y0] + x0;
-		pixel8 *base_address= texture->row_addresses[0];
+		pixel8 *base_address= data->texture;
+		int downshift= data->downshift;
 		uint32 source_x= data->source_x;
 		uint32 source_y= data->source_y;
 		uint32 source_dx= data->source_dx;
 		uint32 source_dy= data->source_dy;
 		short count= x1-x0;
 		
-		while ((count-= 1)>=0)
+		if (kernels)
 		{
-			write_pixel<T, sw_alpha_blend, false>(write++, base_address[((source_y>>(HORIZONTAL_HEIGHT_DOWNSHIFT-7))&(0x7f<<7))+(source_x>>HORIZONTAL_WIDTH_DOWNSHIFT)], shading_table, opacity_table, rmask, gmask, bmask);
+			struct horizontal_span span= {base_address, downshift, source_x, source_y, source_dx, source_dy, shading_table, opacity_table};
+			
+			span_kernel_horizontal(write, count, span, blend);
+		}
+		else while ((count-= 1)>=0)
+		{
+			write_pixel<T, sw_alpha_blend, false>(write++, base_address[((source_y>>downshift)<<(32-downshift))+(source_x>>downshift)], shading_table, opacity_table, rmask, gmask, bmask);
 			
 			source_x+= source_dx, source_y+= source_dy;
 		}
@@ -285,6 +336,9 @@ void texture_vertical_polygon_lines(
 		bmask = fmt->Bmask;
 	}
 
+	struct span_blend blend;
+	bool kernels= use_span_kernels<T>(blend, sw_alpha_blend, check_transparent, rmask, gmask, bmask);
+
 	while (line_count>0)	
 	{
 		if (line_count<4 || (x&3) || aborted)
@@ -395,7 +449,21 @@ void texture_vertical_polygon_lines(
 				count= MIN(dy0, dy1), count= MIN(count, dy2), count= MIN(count, dy3);
 				ymax+= count;
 				
-				for (; count>0; --count)
+				if (kernels && count>0)
+				{
+					struct vertical_quad quad= {
+						{read0, read1, read2, read3},
+						{texture_y0, texture_y1, texture_y2, texture_y3},
+						{texture_dy0, texture_dy1, texture_dy2, texture_dy3},
+						{shading_table0, shading_table1, shading_table2, shading_table3},
+						downshift, opacity_table};
+					
+					span_kernel_quad(write, bytes_per_row, count, quad, blend);
+					texture_y0= quad.texture_y[0], texture_y1= quad.texture_y[1];
+					texture_y2= quad.texture_y[2], texture_y3= quad.texture_y[3];
+					write = (T *)((byte *)write + count*bytes_per_row);
+				}
+				else for (; count>0; --count)
 				{
 					write_pixel<T, sw_alpha_blend, check_transparent>(write, read0[texture_y0>>downshift], shading_table0, opacity_table, rmask, gmask, bmask);
 					texture_y0+= texture_dy0;
@@ -580,17 +648,22 @@ void randomize_vertical_polygon_lines(
 	struct _vertical_polygon_data *data,
 	short *y0_table,
 	short *y1_table,
-	uint16 transfer_data)
+	uint16 transfer_data,
+	uint16& random_seed,
+	short strip_x0,
+	short strip_x1)
 {
 	struct _vertical_polygon_line_data *line= (struct _vertical_polygon_line_data *) (data+1);
 	short bytes_per_row= screen->bytes_per_row;
 	int line_count= data->width;
 	int x= data->x0;
-	uint16 seed= texture_random_seed();
+	uint16 seed= random_seed;
 	uint16 drop_less_than= transfer_data;
 
 	(void) (view);
 
+	/* columns outside [strip_x0, strip_x1) still step the seed, so every strip of the screen
+		gets the same noise */
 	while ((line_count-= 1)>=0)
 	{
 		short y0= *y0_table++, y1= *y1_table++;
@@ -598,12 +671,13 @@ void randomize_vertical_polygon_lines(
 		pixel8 *read= line->texture;
 		_fixed texture_y= line->texture_y, texture_dy= line->texture_dy;
 		short count= y1-y0;
+		bool visible= x>=strip_x0 && x<strip_x1;
 
 		while ((count-=1)>=0)
 		{
 			if (!check_transparent || read[texture_y>>(data->downshift)])
 			{
-				if (seed >= drop_less_than) *write = randomize_vertical_polygon_lines_write<T>(seed);
+				if (visible && seed >= drop_less_than) *write = randomize_vertical_polygon_lines_write<T>(seed);
 				if (seed&1) seed= (seed>>1)^0xb400; else seed= seed>>1;
 			}
 
@@ -615,5 +689,5 @@ void randomize_vertical_polygon_lines(
 		x+= 1;
 	}
 	
-	texture_random_seed() = seed;
+	random_seed = seed;
 }
@@ -234,6 +234,7 @@ extern WindowPtr screen_window;
 #include "RenderPlaceObjs.h"
 #include "RenderRasterize.h"
 #include "Rasterizer_SW.h"
+#include "low_level_textures.h"
 #ifdef HAVE_OPENGL
 #include "Rasterizer_OGL.h"
 #include "RenderRasterize_Shader.h"
@@ -241,6 +242,9 @@ extern WindowPtr screen_window;
 #endif
 #include "preferences.h"
 #include "screen.h"
+#include "FileHandler.h"
+
+#include <stdio.h>
 
 /* use native alignment */
 #if defined (powerc) || defined (__powerc)
@@ -305,6 +309,35 @@ static const int TICKS_PER_EXPLORE = 4;
 static struct view_data explore_view;
 static RenderVisTreeClass explore_tree;
 
+/* render statistics; each mark charges the time since the last one to a stage */
+static bool render_statistics_enabled= false;
+static struct render_statistics render_statistics, last_render_statistics;
+static uint64 render_statistics_mark;
+static FILE *render_statistics_log= NULL;
+
+static const char *render_stage_names[NUMBER_OF_RENDER_STAGES]=
+{
+	"visibility tree",
+	"polygon sorting",
+	"object placement",
+	"rasterizing",
+	"viewer sprites",
+	"finishing"
+};
+
+static const char *render_counter_names[NUMBER_OF_RENDER_COUNTERS]=
+{
+	"nodes",
+	"clipping windows",
+	"sorted polygons",
+	"objects",
+	"tree reused",
+	"spans",
+	"pixels"
+};
+
+extern DirectorySpecifier log_dir;
+
 void OGL_Rasterizer_Init() {
 	
 #ifdef HAVE_OPENGL
@@ -322,6 +355,13 @@ static void update_render_effect(struct view_data *view);
 static void shake_view_origin(struct view_data *view, world_distance delta);
 
 static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr);
+
+static void stop_rasterizer_threads(void);
+
+static inline bool collecting_render_statistics(void);
+static void start_render_statistics(void);
+static inline void mark_render_stage(short stage);
+static void finish_render_statistics(void);
 void position_sprite_axis(short *x0, short *x1, short scale_width, short screen_width,
 	short positioning_mode, _fixed position, bool flip, world_distance world_left, world_distance world_right);
 
@@ -424,6 +464,9 @@ void render_view(
 	struct view_data *view,
 	struct bitmap_definition *software_render_dest)
 {
+	/* shape bitmaps may be evicted between frames, never while one is being drawn */
+	update_shape_streaming();
+
 	update_view_data(view);
 
 	/* clear the render flags */
@@ -447,10 +490,13 @@ void render_view(
 		// LP: the render objects have a pointer to the current view in them,
 		// so that one can get rid of redundant references to it in them.
 		
+		start_render_statistics();
+		
 		// LP: now from the visibility-tree class
 		/* build the render tree, regardless of map mode, so the automap updates while active */
 		RenderVisTree.view = view;
 		RenderVisTree.build_render_tree();
+		mark_render_stage(_render_stage_visibility_tree);
 		
 		/* do something complicated and difficult to explain */
 		if (!view->overhead_map_active || map_is_translucent())
@@ -460,11 +506,13 @@ void render_view(
 				clipping information for each polygon */
 			RenderSortPoly.view = view;
 			RenderSortPoly.sort_render_tree();
+			mark_render_stage(_render_stage_polygon_sorting);
 			
 			// LP: now from the object-placement class
 			/* build the render object list by looking at the sorted render tree */
 			RenderPlaceObjs.view = view;
 			RenderPlaceObjs.build_render_object_list();
+			mark_render_stage(_render_stage_object_placement);
 			
 			// LP addition: set the current rasterizer to whichever is appropriate here
 			RasterizerClass *RasPtr;
@@ -476,6 +524,15 @@ void render_view(
 #endif
 				assert(software_render_dest);
 				Rasterizer_SW.screen = software_render_dest;
+				static bool stop_registered= false;
+				if (!stop_registered)
+				{
+					/* registered after SDL's shutdown, so it runs first */
+					atexit(stop_rasterizer_threads);
+					stop_registered= true;
+				}
+				Rasterizer_SW.SetThreadCount(graphics_preferences->software_render_threads);
+				Rasterizer_SW.SetCounting(collecting_render_statistics());
 				RasPtr = &Rasterizer_SW;
 #ifdef HAVE_OPENGL
 			}
@@ -498,16 +555,27 @@ void render_view(
 			RenPtr->view = view;
 			RenPtr->RasPtr = RasPtr;
 			RenPtr->render_tree();
+			mark_render_stage(_render_stage_rasterizing);
 			
 			// LP: won't put this into a separate class
 			/* render the players weapons, etc. */
                         if (!RenPtr->renders_viewer_sprites_in_tree()) {
                             render_viewer_sprite_layer(view, RasPtr);
                         }
+			mark_render_stage(_render_stage_viewer_sprites);
 			
 			// Finish rendering main view
 			RasPtr->End();
+			mark_render_stage(_render_stage_finishing);
+			
+			if (RasPtr==&Rasterizer_SW && collecting_render_statistics())
+			{
+				render_statistics.counters[_render_counter_spans]= Rasterizer_SW.GetSpanCount();
+				render_statistics.counters[_render_counter_pixels]= Rasterizer_SW.GetPixelCount();
+			}
 		}
+		
+		finish_render_statistics();
 
 		if (view->overhead_map_active)
 		{
@@ -525,6 +593,125 @@ void start_render_effect(
 	view->effect_phase= NONE;
 }
 
+void benchmark_software_rasterizer(
+	struct view_data *view,
+	struct bitmap_definition *destination,
+	int32 frame_count,
+	int16 maximum_thread_count,
+	vector<software_rasterizer_benchmark>& results)
+{
+	struct view_data original_view= *view;
+	int16 original_thread_count= graphics_preferences->software_render_threads;
+	uint16 original_random_seed= texture_random_seed();
+	vector<byte> one_thread_pixels;
+	
+	results.clear();
+	for (int16 thread_count= 1; thread_count<=maximum_thread_count; ++thread_count)
+	{
+		struct software_rasterizer_benchmark result;
+		vector<byte> pixels;
+		
+		/* every pass draws the same frames, static and all */
+		*view= original_view;
+		texture_random_seed()= original_random_seed;
+		graphics_preferences->software_render_threads= thread_count;
+		
+		uint64 start= machine_microsecond_count();
+		for (int32 frame= 0; frame<frame_count; ++frame) render_view(view, destination);
+		result.microseconds= machine_microsecond_count() - start;
+		result.frame_count= frame_count;
+		result.thread_count= Rasterizer_SW.GetThreadCount();
+		
+		for (short row= 0; row<destination->height; ++row)
+		{
+			pixels.insert(pixels.end(), destination->row_addresses[row], destination->row_addresses[row] + destination->bytes_per_row);
+		}
+		if (thread_count==1) one_thread_pixels.swap(pixels);
+		result.matches_one_thread= thread_count==1 || pixels==one_thread_pixels;
+		
+		results.push_back(result);
+	}
+	
+	*view= original_view;
+	graphics_preferences->software_render_threads= original_thread_count;
+}
+
+void set_render_statistics(
+	bool enabled)
+{
+	if (enabled && !render_statistics_active())
+	{
+		obj_clear(render_statistics);
+		obj_clear(last_render_statistics);
+	}
+	render_statistics_enabled= enabled;
+}
+
+bool render_statistics_active(
+	void)
+{
+	return collecting_render_statistics();
+}
+
+const struct render_statistics *get_render_statistics(
+	void)
+{
+	return &last_render_statistics;
+}
+
+const char *get_render_stage_name(
+	short stage)
+{
+	return (stage>=0 && stage<NUMBER_OF_RENDER_STAGES) ? render_stage_names[stage] : "unknown";
+}
+
+const char *get_render_counter_name(
+	short counter)
+{
+	return (counter>=0 && counter<NUMBER_OF_RENDER_COUNTERS) ? render_counter_names[counter] : "unknown";
+}
+
+bool start_render_statistics_log(
+	const char *name)
+{
+	FileSpecifier file= log_dir;
+	short stage, counter;
+
+	stop_render_statistics_log();
+	if (!render_statistics_active())
+	{
+		obj_clear(render_statistics);
+		obj_clear(last_render_statistics);
+	}
+
+	file+= name;
+	render_statistics_log= fopen(file.GetPath(), "w");
+	if (!render_statistics_log) return false;
+
+	fprintf(render_statistics_log, "frame");
+	for (stage= 0; stage<NUMBER_OF_RENDER_STAGES; ++stage) fprintf(render_statistics_log, ",%s us", render_stage_names[stage]);
+	for (counter= 0; counter<NUMBER_OF_RENDER_COUNTERS; ++counter) fprintf(render_statistics_log, ",%s", render_counter_names[counter]);
+	fprintf(render_statistics_log, "\n");
+
+	return true;
+}
+
+void stop_render_statistics_log(
+	void)
+{
+	if (render_statistics_log)
+	{
+		fclose(render_statistics_log);
+		render_statistics_log= NULL;
+	}
+}
+
+bool render_statistics_log_active(
+	void)
+{
+	return render_statistics_log!=NULL;
+}
+
 void check_m1_exploration(void)
 {
 	// Are we even on an exploration mission?
@@ -572,6 +759,8 @@ void check_m1_exploration(void)
 		explore_tree.view = &explore_view;
 		explore_tree.add_to_automap = false;
 		explore_tree.mark_as_explored = true;
+		// It looks through a different player's eyes each time
+		explore_tree.reuse_tree = false;
 		explore_tree.Resize(MAXIMUM_ENDPOINTS_PER_MAP, MAXIMUM_LINES_PER_MAP);
 	}
 
@@ -933,6 +1122,74 @@ void instantiate_polygon_transfer_mode(
 	}
 }
 
+/* ---------- render statistics */
+
+static inline bool collecting_render_statistics(
+	void)
+{
+	return render_statistics_enabled || render_statistics_log;
+}
+
+/* the rasterizer is a global, so it's destroyed after SDL has shut down; its threads have to
+	be gone by then */
+static void stop_rasterizer_threads(
+	void)
+{
+	Rasterizer_SW.SetThreadCount(1);
+}
+
+static void start_render_statistics(
+	void)
+{
+	if (collecting_render_statistics())
+	{
+		int32 frame= render_statistics.frame;
+		int32 reused_tree_count= render_statistics.reused_tree_count;
+
+		obj_clear(render_statistics);
+		render_statistics.frame= frame+1;
+		render_statistics.reused_tree_count= reused_tree_count;
+		render_statistics_mark= machine_microsecond_count();
+	}
+}
+
+static inline void mark_render_stage(
+	short stage)
+{
+	if (collecting_render_statistics())
+	{
+		uint64 now= machine_microsecond_count();
+
+		render_statistics.microseconds[stage]+= now-render_statistics_mark;
+		render_statistics_mark= now;
+	}
+}
+
+/* the tree and lists are read once everything's been added to them */
+static void finish_render_statistics(
+	void)
+{
+	short stage, counter;
+
+	if (!collecting_render_statistics()) return;
+
+	render_statistics.counters[_render_counter_nodes]= RenderVisTree.Nodes.size();
+	render_statistics.counters[_render_counter_clipping_windows]= RenderVisTree.ClippingWindows.size();
+	render_statistics.counters[_render_counter_sorted_polygons]= RenderSortPoly.SortedNodes.size();
+	render_statistics.counters[_render_counter_objects]= RenderPlaceObjs.RenderObjects.size();
+	render_statistics.counters[_render_counter_tree_reused]= RenderVisTree.tree_was_reused ? 1 : 0;
+	render_statistics.reused_tree_count+= render_statistics.counters[_render_counter_tree_reused];
+	last_render_statistics= render_statistics;
+
+	if (render_statistics_log)
+	{
+		fprintf(render_statistics_log, "%d", render_statistics.frame);
+		for (stage= 0; stage<NUMBER_OF_RENDER_STAGES; ++stage) fprintf(render_statistics_log, ",%llu", (unsigned long long) render_statistics.microseconds[stage]);
+		for (counter= 0; counter<NUMBER_OF_RENDER_COUNTERS; ++counter) fprintf(render_statistics_log, ",%d", render_statistics.counters[counter]);
+		fprintf(render_statistics_log, "\n");
+	}
+}
+
 /* ---------- viewer sprite layer (i.e., weapons) */
 
 static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr)
@@ -147,6 +147,7 @@ struct view_data
 
 #define TEST_RENDER_FLAG(index, flag) (render_flags[index]&(flag))
 #define SET_RENDER_FLAG(index, flag) render_flags[index]|= (flag)
+#define CLEAR_RENDER_FLAG(index, flag) render_flags[index]&= ~(flag)
 
 #define RENDER_FLAGS_BUFFER_SIZE MAX(MAX(MAXIMUM_ENDPOINTS_PER_MAP,MAXIMUM_LINES_PER_MAP),MAX(MAXIMUM_SIDES_PER_MAP,MAXIMUM_POLYGONS_PER_MAP))
 //#define RENDER_FLAGS_BUFFER_SIZE (8*KILO)
@@ -170,6 +171,47 @@ enum /* render flags */
 	_endpoint_has_been_transformed= 1<<_endpoint_has_been_transformed_bit
 };
 
+enum /* render stages, timed by render_view() */
+{
+	_render_stage_visibility_tree,
+	_render_stage_polygon_sorting,
+	_render_stage_object_placement,
+	_render_stage_rasterizing, /* clipping and texture mapping (recording, when threaded) */
+	_render_stage_viewer_sprites,
+	_render_stage_finishing, /* the rasterizer's End(); threaded drawing happens here */
+	NUMBER_OF_RENDER_STAGES
+};
+
+enum /* render counters */
+{
+	_render_counter_nodes, /* in the visibility tree */
+	_render_counter_clipping_windows,
+	_render_counter_sorted_polygons,
+	_render_counter_objects,
+	_render_counter_tree_reused, /* 1 if last frame's visibility tree was reused */
+	_render_counter_spans, /* software only */
+	_render_counter_pixels, /* software only */
+	NUMBER_OF_RENDER_COUNTERS
+};
+
+/* ---------- structures */
+
+struct software_rasterizer_benchmark
+{
+	int16 thread_count;
+	int32 frame_count;
+	uint64 microseconds;
+	bool matches_one_thread; /* same pixels as the one-thread pass */
+};
+
+struct render_statistics
+{
+	int32 frame; /* frames collected since statistics were turned on */
+	int32 reused_tree_count; /* of those frames */
+	uint64 microseconds[NUMBER_OF_RENDER_STAGES];
+	int32 counters[NUMBER_OF_RENDER_COUNTERS];
+};
+
 /* ---------- globals */
 
 extern vector<uint16> RenderFlagList;
@@ -186,6 +228,24 @@ void render_view(struct view_data *view, struct bitmap_definition *software_rend
 
 void start_render_effect(struct view_data *view, short effect);
 
+/* draws the view frame_count times with the software rasterizer on each of 1 to
+	maximum_thread_count threads; the view is put back as it was before each pass */
+void benchmark_software_rasterizer(struct view_data *view, struct bitmap_definition *destination,
+	int32 frame_count, int16 maximum_thread_count, vector<software_rasterizer_benchmark>& results);
+
+/* collection costs a timer read per stage; it stays on while a CSV log is open */
+void set_render_statistics(bool enabled);
+bool render_statistics_active(void);
+/* the last frame render_view() drew with statistics on */
+const struct render_statistics *get_render_statistics(void);
+const char *get_render_stage_name(short stage);
+const char *get_render_counter_name(short counter);
+
+/* one line per frame, appended to the given file in the log directory */
+bool start_render_statistics_log(const char *name);
+void stop_render_statistics_log(void);
+bool render_statistics_log_active(void);
+
 void check_m1_exploration(void);
 
 
@@ -207,4 +267,7 @@ void instantiate_polygon_transfer_mode(view_data *view,
 
 void ResetOverheadMap();
 
+// Forget the map's cached polygons and lines; called when entering a level
+void ResetOverheadMapLayers();
+
 #endif
@@ -170,15 +170,26 @@ static void calculate_shading_table(void * &result,view_data *view, void *shadin
 	} 
 }
 
+/* the mipmap level with closest to one texel per pixel, for a texture which moves step>>shift
+	texels from one pixel to the next */
+static inline short choose_mipmap_level(uint32 step, short shift)
+{
+	short level= 0;
+
+	while (level<MAXIMUM_BITMAP_MIPMAP_LEVEL && step>=(uint32(2)<<(shift+level))) level+= 1;
+
+	return level;
+}
+
 /* ---------- globals */
 
 /* these tables are used by the polygon rasterizer (to store the x-coordinates of the left and
 	right lines of the current polygon), the trapezoid rasterizer (to store the y-coordinates
 	of the top and bottom of the current trapezoid) and the rectangle mapper (for its
 	vertical and if necessary horizontal distortion tables).  these are not necessary as
-	globals, just as global storage. */
-static short *scratch_table0 = NULL, *scratch_table1 = NULL;
-static void *precalculation_table = NULL;
+	globals, just as global storage.  strip rasterizers drawing on other threads get their own. */
+static short *shared_scratch_table0 = NULL, *shared_scratch_table1 = NULL;
+static void *shared_precalculation_table = NULL;
 
 /* ---------- private prototypes */
 
@@ -204,9 +215,41 @@ static void _prelandscape_horizontal_polygon_lines(struct polygon_definition *po
 void allocate_texture_tables(
 	void)
 {
-	scratch_table0= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
-	scratch_table1= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
-	precalculation_table= (void*)new char[MAXIMUM_PRECALCULATION_TABLE_ENTRY_SIZE*MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	shared_scratch_table0= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	shared_scratch_table1= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	shared_precalculation_table= (void*)new char[MAXIMUM_PRECALCULATION_TABLE_ENTRY_SIZE*MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	fc_assert(shared_scratch_table0&&shared_scratch_table1&&shared_precalculation_table);
+
+	choose_span_kernels();
+}
+
+Rasterizer_SW_Class::Rasterizer_SW_Class() :
+	view(NULL), screen(NULL),
+	scratch_table0(NULL), scratch_table1(NULL), precalculation_table(NULL), owns_tables(false),
+	strip_x0(0), strip_x1(SHRT_MAX),
+	random_seed(&texture_random_seed()), strip_random_seed(0),
+	counting(false), span_count(0), pixel_count(0),
+	recording(false), thread_count(1)
+{
+}
+
+/* the screen's rasterizer is constructed before allocate_texture_tables() runs, so it picks up
+	the shared tables the first time it draws */
+void Rasterizer_SW_Class::allocate_tables(
+	void)
+{
+	if (owns_tables)
+	{
+		scratch_table0= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+		scratch_table1= new short[MAXIMUM_SCRATCH_TABLE_ENTRIES];
+		precalculation_table= (void*)new char[MAXIMUM_PRECALCULATION_TABLE_ENTRY_SIZE*MAXIMUM_SCRATCH_TABLE_ENTRIES];
+	}
+	else
+	{
+		scratch_table0= shared_scratch_table0;
+		scratch_table1= shared_scratch_table1;
+		precalculation_table= shared_precalculation_table;
+	}
 	fc_assert(scratch_table0&&scratch_table1&&precalculation_table);
 }
 
@@ -218,11 +261,19 @@ void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& texture
 
 	fc_assert(polygon->vertex_count>=MINIMUM_VERTICES_PER_SCREEN_POLYGON&&polygon->vertex_count<MAXIMUM_VERTICES_PER_SCREEN_POLYGON);
 
+	if (recording)
+	{
+		record(textured_polygon, _record_horizontal_polygon);
+		return;
+	}
+	if (!precalculation_table) allocate_tables();
+
 	/* if we get static, tinted or landscaped transfer modes punt to the vertical polygon mapper */
 	if (polygon->transfer_mode == _static_transfer) {
 		texture_vertical_polygon(textured_polygon);
 		return;
 	}
+	if (polygon_misses_strip(textured_polygon)) return;
 
 	/* locate the vertically highest (closest to zero) and lowest (farthest from zero) vertices */
 	highest_vertex= lowest_vertex= 0;
@@ -322,6 +373,9 @@ void Rasterizer_SW_Class::texture_horizontal_polygon(polygon_definition& texture
 			default:
 				VHALT_DEBUG(csprintf(temporary, "horizontal_polygons dont support mode #%d", polygon->transfer_mode));
 		}
+		clip_horizontal_polygon_lines((struct _horizontal_polygon_line_data *)precalculation_table, left_table, right_table,
+			aggregate_total_line_count, polygon->transfer_mode==_big_landscaped_transfer);
+		if (counting) count_horizontal_polygon_lines(left_table, right_table, aggregate_total_line_count);
 		
 		/* render all lines */
 		switch (bit_depth)
@@ -435,10 +489,19 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
 
 	fc_assert(polygon->vertex_count>=MINIMUM_VERTICES_PER_SCREEN_POLYGON&&polygon->vertex_count<MAXIMUM_VERTICES_PER_SCREEN_POLYGON);
 
+	if (recording)
+	{
+		record(textured_polygon, _record_vertical_polygon);
+		return;
+	}
+	if (!precalculation_table) allocate_tables();
+
     if (polygon->transfer_mode == _big_landscaped_transfer) {
         texture_horizontal_polygon(textured_polygon);
         return;
     }
+	/* static has to be walked in every strip to keep the noise in step */
+	if (polygon->transfer_mode != _static_transfer && polygon_misses_strip(textured_polygon)) return;
      
 	/* locate the horizontally highest (closest to zero) and lowest (farthest from zero) vertices */
 	highest_vertex= lowest_vertex= 0;
@@ -529,6 +592,9 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
               _pretexture_vertical_polygon_lines(polygon, screen, view, (struct _vertical_polygon_data *)precalculation_table, vertices[highest_vertex].x, left_table, right_table, aggregate_total_line_count);
           }
           else VHALT_DEBUG(csprintf(temporary, "vertical_polygons dont support mode #%d", polygon->transfer_mode));
+		if (polygon->transfer_mode != _static_transfer &&
+			!clip_vertical_polygon_lines((struct _vertical_polygon_data *)precalculation_table, left_table, right_table)) return;
+		if (counting) count_vertical_polygon_lines((struct _vertical_polygon_data *)precalculation_table, left_table, right_table);
           
 		/* render all lines */
 		switch (bit_depth)
@@ -544,9 +610,9 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
 						break;
 					case _static_transfer:
 						if (polygon->texture->flags&_TRANSPARENT_BIT)
-							randomize_vertical_polygon_lines<pixel8, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+							randomize_vertical_polygon_lines<pixel8, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 						else
-							randomize_vertical_polygon_lines<pixel8, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+							randomize_vertical_polygon_lines<pixel8, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 						break;
 						
 				default:
@@ -592,9 +658,9 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
 				break;
 				case _static_transfer:
 					if (polygon->texture->flags & _TRANSPARENT_BIT) {
-						randomize_vertical_polygon_lines<pixel16, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+						randomize_vertical_polygon_lines<pixel16, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 					} else {
-						randomize_vertical_polygon_lines<pixel16, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+						randomize_vertical_polygon_lines<pixel16, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 					}
 					break;
 				default:
@@ -638,9 +704,9 @@ void Rasterizer_SW_Class::texture_vertical_polygon(polygon_definition& textured_
 					}
 					case _static_transfer:
 						if (polygon->texture->flags & _TRANSPARENT_BIT)
-							randomize_vertical_polygon_lines<pixel32, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+							randomize_vertical_polygon_lines<pixel32, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 						else
-							randomize_vertical_polygon_lines<pixel32, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data);
+							randomize_vertical_polygon_lines<pixel32, false>(screen, view, (struct _vertical_polygon_data *)precalculation_table, left_table, right_table, polygon->transfer_data, *random_seed, strip_x0, strip_x1);
 						break;
 						
 				default:
@@ -660,6 +726,13 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 {
 	rectangle_definition *rectangle = &textured_rectangle;	// Reference to pointer
 
+	if (recording)
+	{
+		record(textured_rectangle);
+		return;
+	}
+	if (!precalculation_table) allocate_tables();
+
 	if (rectangle->x0<rectangle->x1 && rectangle->y0<rectangle->y1)
 	{
 		/* subsume screen boundaries into clipping parameters */
@@ -677,7 +750,8 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 		/* only continue if we have a non-empty rectangle, at least some of which is on the screen */
 		if (rectangle->clip_left<rectangle->clip_right && rectangle->clip_top<rectangle->clip_bottom &&
 			rectangle->clip_right>0 && rectangle->clip_left<screen->width &&
-			rectangle->clip_bottom>0 && rectangle->clip_top<screen->height)
+			rectangle->clip_bottom>0 && rectangle->clip_top<screen->height &&
+			(rectangle->transfer_mode==_static_transfer || (rectangle->clip_right>strip_x0 && rectangle->clip_left<strip_x1)))
 		{
 			short delta; /* scratch */
 			short screen_width= rectangle->x1-rectangle->x0;
@@ -803,6 +877,10 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 					fc_assert(y0<=screen->height);
 					fc_assert(y1<=screen->height);
 				}
+				
+				y0_table= scratch_table0, y1_table= scratch_table1;
+				if (rectangle->transfer_mode!=_static_transfer && !clip_vertical_polygon_lines(header, y0_table, y1_table)) return;
+				if (counting) count_vertical_polygon_lines(header, y0_table, y1_table);
 		
 				switch (bit_depth)
 				{
@@ -811,17 +889,17 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 						{
 							case _textured_transfer:
 								texture_vertical_polygon_lines<pixel8, _sw_alpha_off, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1);
+									y0_table, y1_table);
 								break;
 							
 							case _static_transfer:
 								randomize_vertical_polygon_lines<pixel8, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data, *random_seed, strip_x0, strip_x1);
 								break;
 							
 							case _tinted_transfer:
 								tint_vertical_polygon_lines<pixel8>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data);
 								break;
 							
 							default:
@@ -834,17 +912,17 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 						switch (rectangle->transfer_mode)
 						{
 							case _textured_transfer:
-								texture_vertical_polygon_lines<pixel16, _sw_alpha_off, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, scratch_table0, scratch_table1);
+								texture_vertical_polygon_lines<pixel16, _sw_alpha_off, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table, y0_table, y1_table);
 								break;
 								
 							case _static_transfer:
 								randomize_vertical_polygon_lines<pixel16, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data, *random_seed, strip_x0, strip_x1);
 								break;
 							
 							case _tinted_transfer:
 								tint_vertical_polygon_lines<pixel16>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data);
 								break;
 							
 							default:
@@ -858,17 +936,17 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 						{
 							case _textured_transfer:
 								texture_vertical_polygon_lines<pixel32, _sw_alpha_off, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1);
+									y0_table, y1_table);
 								break;
 							
 							case _static_transfer:
 								randomize_vertical_polygon_lines<pixel32, true>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data, *random_seed, strip_x0, strip_x1);
 								break;
 							
 							case _tinted_transfer:
 								tint_vertical_polygon_lines<pixel32>(screen, view, (struct _vertical_polygon_data *)precalculation_table,
-									scratch_table0, scratch_table1, rectangle->transfer_data);
+									y0_table, y1_table, rectangle->transfer_data);
 								break;
 							
 							default:
@@ -888,6 +966,103 @@ void Rasterizer_SW_Class::texture_rectangle(rectangle_definition& textured_recta
 
 /* ---------- private code */
 
+bool Rasterizer_SW_Class::polygon_misses_strip(
+	polygon_definition& polygon)
+{
+	if (strip_x0<=0 && strip_x1>=screen->width) return false;
+
+	short x0= SHRT_MAX, x1= SHRT_MIN;
+	for (short vertex= 0; vertex<polygon.vertex_count; ++vertex)
+	{
+		x0= MIN(x0, polygon.vertices[vertex].x);
+		x1= MAX(x1, polygon.vertices[vertex].x);
+	}
+
+	return x1<=strip_x0 || x0>=strip_x1;
+}
+
+/* drops the columns outside the strip from precalculated vertical lines and their y-tables;
+	false if there are none left to draw */
+bool Rasterizer_SW_Class::clip_vertical_polygon_lines(
+	struct _vertical_polygon_data *data,
+	short *&y0_table,
+	short *&y1_table)
+{
+	if (strip_x0<=0 && strip_x1>=screen->width) return true;
+
+	short x0= MAX(data->x0, strip_x0);
+	short x1= MIN(data->x0+data->width, strip_x1);
+	if (x0>=x1) return false;
+
+	if (x0>data->x0)
+	{
+		struct _vertical_polygon_line_data *lines= (struct _vertical_polygon_line_data *) (data+1);
+		short delta= x0-data->x0;
+
+		memmove(lines, lines+delta, (x1-x0)*sizeof(struct _vertical_polygon_line_data));
+		y0_table+= delta, y1_table+= delta;
+	}
+	data->x0= x0;
+	data->width= x1-x0;
+
+	return true;
+}
+
+/* trims each precalculated horizontal line to the strip, stepping its texture coordinates
+	across the columns cut off on the left exactly as the line mapper would have */
+void Rasterizer_SW_Class::clip_horizontal_polygon_lines(
+	struct _horizontal_polygon_line_data *data,
+	short *x0_table,
+	short *x1_table,
+	short line_count,
+	bool landscaped)
+{
+	if (strip_x0<=0 && strip_x1>=screen->width) return;
+
+	for (; line_count>0; --line_count, ++data, ++x0_table, ++x1_table)
+	{
+		if (*x0_table<strip_x0)
+		{
+			uint32 delta= strip_x0-*x0_table;
+
+			data->source_x+= delta*data->source_dx;
+			/* landscapes keep their texture row in source_y */
+			if (!landscaped) data->source_y+= delta*data->source_dy;
+			*x0_table= strip_x0;
+		}
+		if (*x1_table>strip_x1) *x1_table= strip_x1;
+		if (*x1_table<*x0_table) *x1_table= *x0_table;
+	}
+}
+
+/* static transfer isn't clipped to the strip (see randomize_vertical_polygon_lines()), so
+	columns outside it are left out here */
+void Rasterizer_SW_Class::count_vertical_polygon_lines(
+	struct _vertical_polygon_data *data,
+	short *y0_table,
+	short *y1_table)
+{
+	for (short x= 0; x<data->width; ++x)
+	{
+		if (data->x0+x<strip_x0 || data->x0+x>=strip_x1) continue;
+
+		span_count+= 1;
+		pixel_count+= y1_table[x]-y0_table[x];
+	}
+}
+
+void Rasterizer_SW_Class::count_horizontal_polygon_lines(
+	short *x0_table,
+	short *x1_table,
+	short line_count)
+{
+	for (short line= 0; line<line_count; ++line)
+	{
+		span_count+= 1;
+		pixel_count+= x1_table[line]-x0_table[line];
+	}
+}
+
 /* starting at x0 and for line_count vertical lines between *y0 and *y1, precalculate all the
 	information _texture_vertical_polygon_lines will need to work */
 static void _pretexture_vertical_polygon_lines(
@@ -905,6 +1080,7 @@ static void _pretexture_vertical_polygon_lines(
 	int32 unadjusted_ty_denominator= view->world_to_screen_y*polygon->vector.k;
 	int32 tx_numerator, tx_denominator, tx_numerator_delta, tx_denominator_delta;
 	struct _vertical_polygon_line_data *line= (struct _vertical_polygon_line_data *) (data+1);
+	const struct bitmap_mipmaps *mipmaps= graphics_preferences->software_mipmaps ? get_bitmap_mipmaps(polygon->texture) : NULL;
 
 	(void) (screen);
 
@@ -1000,7 +1176,18 @@ static void _pretexture_vertical_polygon_lines(
 //			data->n= VERTICAL_TEXTURE_DOWNSHIFT;
 			line->texture_y= ty<<VERTICAL_TEXTURE_FREE_BITS;
 			line->texture_dy= ty_delta<<(VERTICAL_TEXTURE_FREE_BITS-8);
-			line->texture= polygon->texture->row_addresses[x0];
+			if (mipmaps)
+			{
+				/* by how fast the column runs down the texture; how fast the wall runs across it
+					isn't known until the next column */
+				short level= choose_mipmap_level(ty_delta, VERTICAL_TEXTURE_DOWNSHIFT-(VERTICAL_TEXTURE_FREE_BITS-8));
+				
+				line->texture= mipmaps->columns[level] + (x0>>level)*VERTICAL_TEXTURE_WIDTH;
+			}
+			else
+			{
+				line->texture= polygon->texture->row_addresses[x0];
+			}
 			
 			line+= 1;
 		}
@@ -1026,6 +1213,7 @@ static void _pretexture_horizontal_polygon_lines(
 	int32 hsine, dhsine;
 	int32 hworld_to_screen;
 	bool higher_precision= polygon->origin.z>-WORLD_ONE && polygon->origin.z<WORLD_ONE;
+	const struct bitmap_mipmaps *mipmaps= graphics_preferences->software_mipmaps ? get_bitmap_mipmaps(polygon->texture) : NULL;
 
 	(void) (screen);
 	
@@ -1079,6 +1267,18 @@ static void _pretexture_horizontal_polygon_lines(
 			data->source_x= source_x<<HORIZONTAL_FREE_BITS, data->source_dx= source_dx<<HORIZONTAL_FREE_BITS;
 			data->source_y= source_y<<HORIZONTAL_FREE_BITS, data->source_dy= source_dy<<HORIZONTAL_FREE_BITS;
 		
+			if (mipmaps)
+			{
+				short level= choose_mipmap_level(MAX(ABS(source_dx), ABS(source_dy)), HORIZONTAL_WIDTH_DOWNSHIFT-HORIZONTAL_FREE_BITS);
+				
+				data->texture= mipmaps->squares[level];
+				data->downshift= HORIZONTAL_WIDTH_DOWNSHIFT+level;
+			}
+			else
+			{
+				data->texture= polygon->texture->row_addresses[0];
+				data->downshift= HORIZONTAL_WIDTH_DOWNSHIFT;
+			}
 
 		/* get shading table (with absolute value of depth) */
 		if ((depth= hworld_to_screen/screen_y)<0) depth= -depth;
@@ -110,9 +110,18 @@ Jan 17, 2001 (Loren Petrich):
 
 #include "Packing.h"
 #include "SW_Texture_Extras.h"
+#include "preferences.h"
 
 #include <SDL_rwops.h>
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define HAVE_SSE2_SHADING
+#include <emmintrin.h>
+#endif
 
 #include <boost/shared_ptr.hpp>
 
@@ -131,6 +140,27 @@ Jan 17, 2001 (Loren Petrich):
 	looks like through the light enhancement goggles */
 #define NUMBER_OF_TINT_TABLES 1
 
+/* 32-bit color has the most */
+#define MAXIMUM_NUMBER_OF_SHADING_TABLES 256
+
+enum /* shading pixel layouts */
+{
+	_shading_pixel_mapped, /* SDL_MapRGB() of the top 8 bits of each component */
+	_shading_pixel_xrgb1555, /* RGBCOLOR_TO_PIXEL16() */
+	_shading_pixel_xrgb8888 /* RGBCOLOR_TO_PIXEL32() */
+};
+
+/* the only size of wall texture the software renderer's mappers handle */
+#define MIPMAP_TEXTURE_SIZE 128
+
+enum /* streamed bitmap states */
+{
+	_bitmap_not_loaded,
+	_bitmap_queued, /* waiting for the loader thread, or being read by it */
+	_bitmap_loaded,
+	_bitmap_pinned /* patched, or lent out as a surface; never evicted */
+};
+
 // Moved from shapes_macintosh.c:
 
 // Possibly of historical interest:
@@ -158,10 +188,93 @@ inline short memory_error() {return 0;}
 
 /* ---------- structures */
 
+/* the aggregate color table as it stood when one clut's shading tables would have been built */
+struct shading_table_source
+{
+	short color_count;
+	struct rgb_color_value colors[PIXEL8_MAXIMUM_COLORS];
+	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS]; /* from the primary clut; alternate cluts only */
+};
+
+struct shading_table_job
+{
+	short collection_index;
+	short collection_bit_depth;
+	bool is_opengl;
+	
+	std::vector<shading_table_source> sources; /* one per clut */
+};
+
+/* jobs first, first+stride, ... */
+struct shading_table_worker
+{
+	std::vector<shading_table_job> *jobs;
+	size_t first, stride;
+};
+
+/* a collection's shading tables from the last time they were built, and what they were built
+	from; levels mostly reload the same collections with the same colors */
+struct cached_shading_tables
+{
+	std::vector<byte> key;
+	std::vector<byte> tables;
+};
+
+/* what it takes to bring a collection's bitmaps in one at a time */
+struct streamed_collection
+{
+	bool streamed;
+	bool remapped; /* update_color_environment() has been through; arriving bitmaps get the same */
+	bool mipmappable; /* a wall collection remapped for the software renderer */
+	bool mipmapped; /* ... and smooth distant textures are on, so its bitmaps have levels */
+	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS];
+
+	std::vector<int32> bitmap_offsets; /* in the shapes file; NONE if it isn't there */
+	std::vector<byte> bitmap_states;
+	std::vector<uint32> bitmap_last_used; /* frame */
+};
+
+/* a request to the loader thread, and then what it read */
+struct streamed_bitmap
+{
+	short collection_index, bitmap_index;
+	int32 offset;
+	uint32 generation;
+	std::vector<uint8> data;
+};
+
+/* a remapped color of the collection being mipmapped, 8 bits per channel */
+struct mipmap_color
+{
+	int32 red, green, blue;
+	bool luminescent;
+};
+
 /* ---------- globals */
 
 extern SDL_Surface* world_pixels;
 
+static std::unordered_map<const bitmap_definition *, bitmap_mipmaps> bitmap_mipmap_table;
+
+static cached_shading_tables shading_table_cache[MAXIMUM_COLLECTIONS];
+
+static streamed_collection streamed_collections[MAXIMUM_COLLECTIONS];
+static shape_streaming_statistics streaming_statistics;
+static uint64 shape_memory_budget= 0; /* bytes; zero loads whole collections */
+static uint32 streaming_frame= 1, last_stalled_frame= 0;
+
+/* the loader thread reads through its own handle on the shapes file; the rest of what it
+	shares with us is guarded by shape_loader_lock */
+static FileSpecifier ShapesFileSpec;
+static OpenedFile ShapesLoaderFile;
+static SDL_Thread *shape_loader_thread= NULL;
+static SDL_mutex *shape_loader_lock= NULL;
+static SDL_cond *shape_loader_changed= NULL;
+static std::deque<streamed_bitmap> shape_loader_requests, shape_loader_results;
+static bool shape_loader_busy= false, shape_loader_quit= false;
+static short shape_loader_collection= NONE, shape_loader_bitmap= NONE; /* being read */
+static uint32 shape_loader_generation= 0; /* results from before the last cancel are dropped */
+
 #include "shape_definitions.h"
 
 static pixel16 *global_shading_table16= (pixel16 *) NULL;
@@ -184,6 +297,10 @@ bool shapes_file_is_m1() { return shapes_file_version == M1_SHAPES_VERSION; }
 
 static void update_color_environment(bool is_opengl);
 static short find_or_add_color(struct rgb_color_value *color, struct rgb_color_value *colors, short *color_count, bool update_flags);
+static void build_collection_mipmaps(short collection_index, struct rgb_color_value *primary_colors, short color_count,
+	short first_bitmap_index, short bitmap_count);
+static pixel8 nearest_mipmap_color(int32 red, int32 green, int32 blue, bool luminescent, const std::vector<mipmap_color>& palette,
+	const std::vector<pixel8> *candidates, std::vector<int16>& nearest);
 static void _change_clut(void (*change_clut_proc)(struct color_table *color_table), struct rgb_color_value *colors, short color_count);
 
 static void build_shading_tables8(struct rgb_color_value *colors, short color_count, pixel8 *shading_tables);
@@ -191,6 +308,11 @@ static void build_shading_tables16(struct rgb_color_value *colors, short color_c
 static void build_shading_tables32(struct rgb_color_value *colors, short color_count, pixel32 *shading_tables, byte *remapping_table, bool is_opengl);
 static void build_global_shading_table16(void);
 static void build_global_shading_table32(void);
+static void build_shading_pixels(struct rgb_color_value *color, SDL_PixelFormat *fmt, short layout, pixel32 *pixels);
+
+static void build_shading_table_jobs(std::vector<shading_table_job>& jobs);
+static int shading_table_worker_loop(void *data);
+static void build_collection_shading_tables(shading_table_job& job);
 
 static bool get_next_color_run(struct rgb_color_value *colors, short color_count, short *start, short *count);
 static bool new_color_run(struct rgb_color_value *_new, struct rgb_color_value *last);
@@ -213,6 +335,23 @@ static bool load_collection(short collection_index, bool strip);
 static void shutdown_shape_handler(void);
 static void close_shapes_file(void);
 
+static void start_shape_loader(void);
+static void stop_shape_loader(void);
+static int shape_loader_loop(void *data);
+static void cancel_shape_loader_requests(void);
+static void queue_streamed_bitmaps(void);
+static void queue_streamed_texture(shape_descriptor texture);
+static void queue_streamed_bitmap(short collection_index, short bitmap_index);
+static void take_loaded_bitmaps(void);
+static void wait_for_streamed_bitmap(short collection_index, short bitmap_index);
+static void read_streamed_bitmap(short collection_index, short bitmap_index);
+static void install_streamed_bitmap(short collection_index, short bitmap_index, std::vector<uint8>& data);
+static void touch_streamed_bitmap(short collection_index, short bitmap_index);
+static void pin_streamed_bitmap(short collection_index, short bitmap_index);
+static void evict_streamed_bitmaps(void);
+static void finish_streamed_collections(void);
+static void count_streamed_bitmaps(void);
+
 // static byte *make_stripped_collection(byte *collection);
 
 /* --------- collection accessor prototypes */
@@ -227,6 +366,8 @@ static void *get_collection_tint_tables(short collection_index, short tint_index
 static struct rgb_color_value *get_collection_colors(short collection_index, short clut_number);
 static struct high_level_shape_definition *get_high_level_shape_definition(short collection_index, short high_level_shape_index);
 static struct bitmap_definition *get_bitmap_definition(short collection_index, short bitmap_index);
+static struct bitmap_definition *get_loaded_bitmap_definition(short collection_index, short bitmap_index);
+static bool bitmap_exists(short collection_index, short bitmap_index);
 
 
 #include <SDL_endian.h>
@@ -334,6 +475,10 @@ SDL_Surface *get_shape_surface(int shape, int inCollection, byte** outPointerToP
         } // inIllumination < 0
         
         
+	// Unpacked bitmaps are drawn straight from the collection, for as long as the caller keeps the surface
+	if (bitmap->bytes_per_row != NONE)
+		pin_streamed_bitmap(collection_index, low_level_shape->bitmap_index);
+
 	SDL_Surface *s = NULL;
 	if (bitmap->bytes_per_row == NONE) {
 
@@ -832,9 +977,22 @@ static bool load_collection(short collection_index, bool strip)
 		SDL_RWread(p, &t[0], sizeof(uint32), cd->bitmap_count);
 		byte_swap_memory(&t[0], _4byte, cd->bitmap_count);
 
-		for (int i = 0; i < cd->bitmap_count; i++) {
-			SDL_RWseek(p, src_offset + t[i], RW_SEEK_SET);
-			load_bitmap(cd->bitmaps[i], p, shapes_file_version);
+		// With a memory budget, bitmaps stay in the file until they're wanted;
+		// the HUD draws into the interface collection's, so it's always loaded whole
+		streamed_collection& streamed = streamed_collections[collection_index];
+		streamed.streamed = shape_memory_budget && shapes_file_version == M2_SHAPES_VERSION && cd->type != _interface_collection;
+		streamed.remapped = false;
+		if (streamed.streamed) {
+			streamed.bitmap_offsets.resize(cd->bitmap_count);
+			streamed.bitmap_states.assign(cd->bitmap_count, _bitmap_not_loaded);
+			streamed.bitmap_last_used.assign(cd->bitmap_count, 0);
+			for (int i = 0; i < cd->bitmap_count; i++)
+				streamed.bitmap_offsets[i] = src_offset + t[i];
+		} else {
+			for (int i = 0; i < cd->bitmap_count; i++) {
+				SDL_RWseek(p, src_offset + t[i], RW_SEEK_SET);
+				load_bitmap(cd->bitmaps[i], p, shapes_file_version);
+			}
 		}
 	}
 
@@ -851,6 +1009,8 @@ static bool load_collection(short collection_index, bool strip)
 	if (header->shading_tables == NULL) {
 		delete header->collection;
 		header->collection = NULL;
+		streamed_collections[collection_index].streamed = false;
+		streamed_collections[collection_index].bitmap_states.clear();
 		return false;
 	}
 
@@ -866,10 +1026,23 @@ static bool load_collection(short collection_index, bool strip)
 static void unload_collection(struct collection_header *header)
 {
 	assert(header->collection);
+	for (size_t i= 0; i<header->collection->bitmaps.size(); ++i)
+	{
+		if (!header->collection->bitmaps[i].empty())
+		{
+			bitmap_mipmap_table.erase((bitmap_definition *) &header->collection->bitmaps[i][0]);
+		}
+	}
 	delete header->collection;
 	free(header->shading_tables);
 	header->collection = NULL;
 	header->shading_tables = NULL;
+
+	streamed_collection& streamed = streamed_collections[header - collection_headers];
+	streamed.streamed = streamed.remapped = streamed.mipmappable = streamed.mipmapped = false;
+	streamed.bitmap_offsets.clear();
+	streamed.bitmap_states.clear();
+	streamed.bitmap_last_used.clear();
 }
 
 #define ENDC_TAG FOUR_CHARS_TO_INT('e', 'n', 'd', 'c')
@@ -934,6 +1107,13 @@ void load_shapes_patch(SDL_RWops *p, bool override_replacements)
 					{
 						load_collection_definition(header->collection, p);
 						color_counts[collection_index] = header->collection->color_count;
+						streamed_collection& streamed = streamed_collections[collection_index];
+						if (streamed.streamed) {
+							// Bitmaps the patch adds aren't in the shapes file
+							streamed.bitmap_offsets.resize(header->collection->bitmap_count, NONE);
+							streamed.bitmap_states.resize(header->collection->bitmap_count, _bitmap_not_loaded);
+							streamed.bitmap_last_used.resize(header->collection->bitmap_count, 0);
+						}
 						allocate_shading_tables(collection_index, false);
 						header->status|=markPATCHED;
 
@@ -982,9 +1162,10 @@ void load_shapes_patch(SDL_RWops *p, bool override_replacements)
 					if (cd && patch_bit_depth == 8 && bitmap_index < cd->bitmaps.size())
 					{
 						load_bitmap(cd->bitmaps[bitmap_index], p, M2_SHAPES_VERSION);
+						pin_streamed_bitmap(collection_index, bitmap_index);
 						if (override_replacements)
 						{
-							get_bitmap_definition(collection_index, bitmap_index)->flags |= _PATCHED_BIT;
+							get_loaded_bitmap_definition(collection_index, bitmap_index)->flags |= _PATCHED_BIT;
 						}
 					}
 					else
@@ -1041,6 +1222,10 @@ void initialize_shape_handler()
 
 void open_shapes_file(FileSpecifier& File)
 {
+	// Bitmaps still in the old file can't be read from the new one
+	finish_streamed_collections();
+	stop_shape_loader();
+
 	bool m1_loaded = false;
 	if (File.Open(M1ShapesFile) && M1ShapesFile.Check('.','2','5','6',128))
 	{
@@ -1091,6 +1276,7 @@ void open_shapes_file(FileSpecifier& File)
 		
 		delete []CollHdrStream;
 		
+		ShapesFileSpec = File;
 	}
 	set_shapes_images_file(File);
 }
@@ -1109,6 +1295,7 @@ static void close_shapes_file(void)
 
 static void shutdown_shape_handler(void)
 {
+	stop_shape_loader();
 	close_shapes_file();
 }
 
@@ -1157,6 +1344,7 @@ void unload_all_collections(
 	struct collection_header *header;
 	short collection_index;
 	
+	cancel_shape_loader_requests();
 	for (collection_index= 0, header= collection_headers; collection_index<MAXIMUM_COLLECTIONS; ++collection_index, ++header)
 	{
 		if (collection_loaded(header))
@@ -1165,6 +1353,7 @@ void unload_all_collections(
 		}
 		OGL_UnloadModelsImages(collection_index);
 	}
+	count_streamed_bitmaps();
 }
 
 void mark_collection(
@@ -1223,8 +1412,7 @@ short get_shape_descriptors(
 			{
 				struct low_level_shape_definition *low_level_shape= get_low_level_shape_definition(collection_index, low_level_shape_index);
 				if (!low_level_shape) continue;
-				struct bitmap_definition *bitmap= get_bitmap_definition(collection_index, low_level_shape->bitmap_index);
-				if (!bitmap) continue;
+				if (!bitmap_exists(collection_index, low_level_shape->bitmap_index)) continue;
 				
 				count+= collection->clut_count;
 				if (buffer)
@@ -1380,6 +1568,46 @@ void *get_global_shading_table(
 	return shading_table;
 }
 
+const struct bitmap_mipmaps *get_bitmap_mipmaps(
+	const struct bitmap_definition *bitmap)
+{
+	std::unordered_map<const bitmap_definition *, bitmap_mipmaps>::const_iterator i= bitmap_mipmap_table.find(bitmap);
+
+	return i!=bitmap_mipmap_table.end() ? &i->second : NULL;
+}
+
+void update_software_mipmaps(
+	void)
+{
+	short collection_index;
+
+	for (collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		struct collection_definition *collection= get_collection_definition(collection_index);
+		struct streamed_collection& streamed= streamed_collections[collection_index];
+		bool mipmapped= streamed.mipmappable && graphics_preferences->software_mipmaps;
+
+		if (!collection || mipmapped==streamed.mipmapped) continue;
+
+		if (mipmapped)
+		{
+			build_collection_mipmaps(collection_index, get_collection_colors(collection_index, 0)+NUMBER_OF_PRIVATE_COLORS,
+				collection->color_count-NUMBER_OF_PRIVATE_COLORS, 0, collection->bitmap_count);
+		}
+		else
+		{
+			for (size_t i= 0; i<collection->bitmaps.size(); ++i)
+			{
+				if (!collection->bitmaps[i].empty())
+				{
+					bitmap_mipmap_table.erase((bitmap_definition *) &collection->bitmaps[i][0]);
+				}
+			}
+		}
+		streamed.mipmapped= mipmapped;
+	}
+}
+
 void load_collections(
 	bool with_progress_bar,
 	bool is_opengl)
@@ -1396,6 +1624,10 @@ void load_collections(
 	
 	free_and_unlock_memory(); /* do our best to get a big, unfragmented heap */
 	
+	/* nothing the loader thread is reading will be wanted */
+	cancel_shape_loader_requests();
+	shape_memory_budget= static_cast<uint64>(graphics_preferences->shapes_file_memory_budget)<<20;
+	
 	/* first go through our list of shape collections and dispose of any collections which
 		were marked for unloading.  at the same time, unlock all those collections which
 		will be staying (so the heap can move around) */
@@ -1460,6 +1692,9 @@ void load_collections(
 		(finally) update the screen to reflect our changes */
 	update_color_environment(is_opengl);
 
+	count_streamed_bitmaps();
+	queue_streamed_bitmaps();
+
 	// load software enhancements
 	if (!is_opengl) {
 		for (collection_index= 0, header= collection_headers; collection_index < MAXIMUM_COLLECTIONS; ++collection_index, ++header)
@@ -1507,9 +1742,447 @@ void load_replacement_collections()
 }
 
 #endif
-		
+
+void update_shape_streaming(
+	void)
+{
+	if (!streaming_statistics.active) return;
+
+	streaming_frame+= 1;
+	take_loaded_bitmaps();
+	if (streaming_statistics.resident_bytes>shape_memory_budget) evict_streamed_bitmaps();
+}
+
+const struct shape_streaming_statistics *get_shape_streaming_statistics(
+	void)
+{
+	return &streaming_statistics;
+}
+
+void reset_shape_streaming_statistics(
+	void)
+{
+	streaming_statistics.hits= streaming_statistics.misses= streaming_statistics.stalls= 0;
+	streaming_statistics.stall_microseconds= 0;
+	streaming_statistics.loaded_ahead= streaming_statistics.evicted= 0;
+}
+
 /* ---------- private code */
 
+/* ---------- shape streaming */
+
+static void start_shape_loader(
+	void)
+{
+	if (shape_loader_thread) return;
+
+	if (!ShapesLoaderFile.IsOpen() && !ShapesFileSpec.Open(ShapesLoaderFile)) return;
+	if (!shape_loader_lock) shape_loader_lock= SDL_CreateMutex();
+	if (!shape_loader_changed) shape_loader_changed= SDL_CreateCond();
+	if (!shape_loader_lock || !shape_loader_changed) return;
+
+	/* without the thread, every bitmap is read when it's first drawn */
+	shape_loader_quit= false;
+	shape_loader_thread= SDL_CreateThread(shape_loader_loop, "shapes_loader", NULL);
+}
+
+static void stop_shape_loader(
+	void)
+{
+	cancel_shape_loader_requests();
+	if (shape_loader_thread)
+	{
+		SDL_LockMutex(shape_loader_lock);
+		shape_loader_quit= true;
+		SDL_CondBroadcast(shape_loader_changed);
+		SDL_UnlockMutex(shape_loader_lock);
+
+		SDL_WaitThread(shape_loader_thread, NULL);
+		shape_loader_thread= NULL;
+	}
+	shape_loader_results.clear();
+	ShapesLoaderFile.Close();
+}
+
+/* reads bitmaps as they're asked for, and nothing else; installing them is left to us */
+static int shape_loader_loop(
+	void *data)
+{
+	(void) data;
+
+	SDL_LockMutex(shape_loader_lock);
+	while (!shape_loader_quit)
+	{
+		if (shape_loader_requests.empty())
+		{
+			SDL_CondWait(shape_loader_changed, shape_loader_lock);
+		}
+		else
+		{
+			struct streamed_bitmap request= shape_loader_requests.front();
+			SDL_RWops *p= ShapesLoaderFile.GetRWops();
+
+			shape_loader_requests.pop_front();
+			shape_loader_busy= true;
+			shape_loader_collection= request.collection_index;
+			shape_loader_bitmap= request.bitmap_index;
+			SDL_UnlockMutex(shape_loader_lock);
+
+			SDL_RWseek(p, request.offset, RW_SEEK_SET);
+			load_bitmap(request.data, p, M2_SHAPES_VERSION);
+
+			SDL_LockMutex(shape_loader_lock);
+			shape_loader_busy= false;
+			shape_loader_collection= shape_loader_bitmap= NONE;
+			shape_loader_results.push_back(streamed_bitmap());
+			std::swap(shape_loader_results.back(), request);
+			SDL_CondBroadcast(shape_loader_changed);
+		}
+	}
+	SDL_UnlockMutex(shape_loader_lock);
+
+	return 0;
+}
+
+/* drops whatever the loader thread hasn't handed over; those bitmaps go back to not loaded */
+static void cancel_shape_loader_requests(
+	void)
+{
+	if (!shape_loader_lock) return;
+
+	std::deque<streamed_bitmap> requests;
+
+	SDL_LockMutex(shape_loader_lock);
+	requests.swap(shape_loader_requests);
+	requests.insert(requests.end(), shape_loader_results.begin(), shape_loader_results.end());
+	shape_loader_results.clear();
+	if (shape_loader_busy)
+	{
+		requests.push_back(streamed_bitmap());
+		requests.back().collection_index= shape_loader_collection;
+		requests.back().bitmap_index= shape_loader_bitmap;
+	}
+	shape_loader_generation+= 1;
+	SDL_UnlockMutex(shape_loader_lock);
+
+	for (std::deque<streamed_bitmap>::iterator request= requests.begin(); request!=requests.end(); ++request)
+	{
+		struct streamed_collection& streamed= streamed_collections[request->collection_index];
+
+		if (request->bitmap_index<static_cast<short>(streamed.bitmap_states.size()) &&
+			streamed.bitmap_states[request->bitmap_index]==_bitmap_queued)
+		{
+			streamed.bitmap_states[request->bitmap_index]= _bitmap_not_loaded;
+		}
+	}
+}
+
+/* after a level's collections are loaded: everything streamed, the map's own walls, floors
+	and ceilings first, for the loader thread to read ahead until the budget runs out */
+static void queue_streamed_bitmaps(
+	void)
+{
+	short collection_index, bitmap_index;
+	int32 index;
+
+	if (!streaming_statistics.active) return;
+	start_shape_loader();
+	if (!shape_loader_thread) return;
+
+	SDL_LockMutex(shape_loader_lock);
+	if (dynamic_world)
+	{
+		for (index= 0; index<dynamic_world->polygon_count && index<static_cast<int32>(PolygonList.size()); ++index)
+		{
+			queue_streamed_texture(map_polygons[index].floor_texture);
+			queue_streamed_texture(map_polygons[index].ceiling_texture);
+		}
+		for (index= 0; index<dynamic_world->side_count && index<static_cast<int32>(SideList.size()); ++index)
+		{
+			queue_streamed_texture(map_sides[index].primary_texture.texture);
+			queue_streamed_texture(map_sides[index].secondary_texture.texture);
+			queue_streamed_texture(map_sides[index].transparent_texture.texture);
+		}
+	}
+	for (collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		for (bitmap_index= 0; bitmap_index<static_cast<short>(streamed_collections[collection_index].bitmap_states.size()); ++bitmap_index)
+		{
+			queue_streamed_bitmap(collection_index, bitmap_index);
+		}
+	}
+	SDL_CondBroadcast(shape_loader_changed);
+	SDL_UnlockMutex(shape_loader_lock);
+}
+
+/* with shape_loader_lock held */
+static void queue_streamed_texture(
+	shape_descriptor texture)
+{
+	if (texture==UNONE) return;
+
+	short collection_index= GET_COLLECTION(GET_DESCRIPTOR_COLLECTION(texture));
+	struct low_level_shape_definition *low_level_shape= get_low_level_shape_definition(collection_index, GET_DESCRIPTOR_SHAPE(texture));
+
+	if (low_level_shape) queue_streamed_bitmap(collection_index, low_level_shape->bitmap_index);
+}
+
+/* with shape_loader_lock held */
+static void queue_streamed_bitmap(
+	short collection_index,
+	short bitmap_index)
+{
+	struct streamed_collection& streamed= streamed_collections[collection_index];
+
+	if (streamed.streamed && bitmap_index>=0 && bitmap_index<static_cast<short>(streamed.bitmap_states.size()) &&
+		streamed.bitmap_states[bitmap_index]==_bitmap_not_loaded && streamed.bitmap_offsets[bitmap_index]!=NONE)
+	{
+		struct streamed_bitmap& request= *shape_loader_requests.insert(shape_loader_requests.end(), streamed_bitmap());
+
+		request.collection_index= collection_index;
+		request.bitmap_index= bitmap_index;
+		request.offset= streamed.bitmap_offsets[bitmap_index];
+		request.generation= shape_loader_generation;
+		streamed.bitmap_states[bitmap_index]= _bitmap_queued;
+	}
+}
+
+/* installs what the loader thread has read; once over budget, it stops reading ahead */
+static void take_loaded_bitmaps(
+	void)
+{
+	if (!shape_loader_lock) return;
+
+	std::deque<streamed_bitmap> results;
+	uint32 generation;
+
+	SDL_LockMutex(shape_loader_lock);
+	results.swap(shape_loader_results);
+	generation= shape_loader_generation;
+	SDL_UnlockMutex(shape_loader_lock);
+
+	for (std::deque<streamed_bitmap>::iterator result= results.begin(); result!=results.end(); ++result)
+	{
+		struct streamed_collection& streamed= streamed_collections[result->collection_index];
+
+		if (result->generation==generation && result->bitmap_index<static_cast<short>(streamed.bitmap_states.size()) &&
+			streamed.bitmap_states[result->bitmap_index]==_bitmap_queued)
+		{
+			install_streamed_bitmap(result->collection_index, result->bitmap_index, result->data);
+			streaming_statistics.loaded_ahead+= 1;
+		}
+	}
+
+	if (streaming_statistics.resident_bytes>shape_memory_budget) cancel_shape_loader_requests();
+}
+
+/* takes the bitmap back if the loader thread hasn't started on it, or else waits for it */
+static void wait_for_streamed_bitmap(
+	short collection_index,
+	short bitmap_index)
+{
+	SDL_LockMutex(shape_loader_lock);
+	for (std::deque<streamed_bitmap>::iterator request= shape_loader_requests.begin(); request!=shape_loader_requests.end(); ++request)
+	{
+		if (request->collection_index==collection_index && request->bitmap_index==bitmap_index)
+		{
+			shape_loader_requests.erase(request);
+			break;
+		}
+	}
+	while (shape_loader_busy && shape_loader_collection==collection_index && shape_loader_bitmap==bitmap_index)
+	{
+		SDL_CondWait(shape_loader_changed, shape_loader_lock);
+	}
+	SDL_UnlockMutex(shape_loader_lock);
+
+	take_loaded_bitmaps();
+	if (streamed_collections[collection_index].bitmap_states[bitmap_index]==_bitmap_queued)
+	{
+		streamed_collections[collection_index].bitmap_states[bitmap_index]= _bitmap_not_loaded;
+	}
+}
+
+static void read_streamed_bitmap(
+	short collection_index,
+	short bitmap_index)
+{
+	std::vector<uint8> data;
+	SDL_RWops *p= ShapesFile.GetRWops();
+
+	if (!p) return;
+	SDL_RWseek(p, streamed_collections[collection_index].bitmap_offsets[bitmap_index], RW_SEEK_SET);
+	load_bitmap(data, p, M2_SHAPES_VERSION);
+	install_streamed_bitmap(collection_index, bitmap_index, data);
+}
+
+/* the bitmap as load_collection() would have left it, and as update_color_environment()
+	leaves it if that has already been through the collection */
+static void install_streamed_bitmap(
+	short collection_index,
+	short bitmap_index,
+	std::vector<uint8>& data)
+{
+	struct collection_definition *collection= get_collection_definition(collection_index);
+	struct streamed_collection& streamed= streamed_collections[collection_index];
+	std::vector<uint8>& bitmap_data= collection->bitmaps[bitmap_index];
+
+	if (data.empty()) return;
+
+	bitmap_data.swap(data);
+	streamed.bitmap_states[bitmap_index]= _bitmap_loaded;
+	streaming_statistics.resident_bitmaps+= 1;
+	streaming_statistics.resident_bytes+= bitmap_data.size();
+
+	if (streamed.remapped)
+	{
+		struct bitmap_definition *bitmap= (struct bitmap_definition *) &bitmap_data[0];
+
+		bitmap->row_addresses[0]= calculate_bitmap_origin(bitmap);
+		precalculate_bitmap_row_addresses(bitmap);
+		remap_bitmap(bitmap, streamed.remapping_table);
+
+		if (streamed.mipmapped)
+		{
+			build_collection_mipmaps(collection_index, get_collection_colors(collection_index, 0)+NUMBER_OF_PRIVATE_COLORS,
+				collection->color_count-NUMBER_OF_PRIVATE_COLORS, bitmap_index, 1);
+		}
+	}
+}
+
+/* every bitmap asked for comes through here; a miss stalls whoever asked until it's read */
+static void touch_streamed_bitmap(
+	short collection_index,
+	short bitmap_index)
+{
+	struct streamed_collection& streamed= streamed_collections[collection_index];
+
+	streamed.bitmap_last_used[bitmap_index]= streaming_frame;
+	if (streamed.bitmap_states[bitmap_index]==_bitmap_loaded || streamed.bitmap_states[bitmap_index]==_bitmap_pinned)
+	{
+		streaming_statistics.hits+= 1;
+		return;
+	}
+	if (streamed.bitmap_offsets[bitmap_index]==NONE) return;
+
+	uint64 start= machine_microsecond_count();
+
+	streaming_statistics.misses+= 1;
+	if (streamed.bitmap_states[bitmap_index]==_bitmap_queued) wait_for_streamed_bitmap(collection_index, bitmap_index);
+	if (streamed.bitmap_states[bitmap_index]==_bitmap_not_loaded) read_streamed_bitmap(collection_index, bitmap_index);
+
+	streaming_statistics.stall_microseconds+= machine_microsecond_count()-start;
+	if (last_stalled_frame!=streaming_frame)
+	{
+		streaming_statistics.stalls+= 1;
+		last_stalled_frame= streaming_frame;
+	}
+}
+
+static void pin_streamed_bitmap(
+	short collection_index,
+	short bitmap_index)
+{
+	struct streamed_collection& streamed= streamed_collections[collection_index];
+
+	if (streamed.streamed && bitmap_index>=0 && bitmap_index<static_cast<short>(streamed.bitmap_states.size()) &&
+		get_loaded_bitmap_definition(collection_index, bitmap_index))
+	{
+		streamed.bitmap_states[bitmap_index]= _bitmap_pinned;
+	}
+}
+
+/* least recently drawn first, down to the budget; nothing drawn in this frame or the last
+	goes, so a view that needs more than the budget doesn't thrash */
+static void evict_streamed_bitmaps(
+	void)
+{
+	std::vector<std::pair<uint32, int32> > candidates; /* last used, collection and bitmap */
+	short collection_index, bitmap_index;
+
+	for (collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		struct streamed_collection& streamed= streamed_collections[collection_index];
+
+		for (bitmap_index= 0; bitmap_index<static_cast<short>(streamed.bitmap_states.size()); ++bitmap_index)
+		{
+			if (streamed.bitmap_states[bitmap_index]==_bitmap_loaded && streamed.bitmap_last_used[bitmap_index]+1<streaming_frame)
+			{
+				candidates.push_back(std::pair<uint32, int32>(streamed.bitmap_last_used[bitmap_index], (collection_index<<16)|bitmap_index));
+			}
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	for (size_t i= 0; i<candidates.size() && streaming_statistics.resident_bytes>shape_memory_budget; ++i)
+	{
+		collection_index= candidates[i].second>>16;
+		bitmap_index= candidates[i].second&0xffff;
+
+		std::vector<uint8>& bitmap_data= get_collection_definition(collection_index)->bitmaps[bitmap_index];
+
+		bitmap_mipmap_table.erase((bitmap_definition *) &bitmap_data[0]);
+		streaming_statistics.resident_bitmaps-= 1;
+		streaming_statistics.resident_bytes-= bitmap_data.size();
+		std::vector<uint8>().swap(bitmap_data);
+		streamed_collections[collection_index].bitmap_states[bitmap_index]= _bitmap_not_loaded;
+		streaming_statistics.evicted+= 1;
+	}
+}
+
+/* reads in every bitmap still in the file, and stops streaming */
+static void finish_streamed_collections(
+	void)
+{
+	short collection_index, bitmap_index;
+
+	cancel_shape_loader_requests();
+	for (collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		struct streamed_collection& streamed= streamed_collections[collection_index];
+
+		for (bitmap_index= 0; bitmap_index<static_cast<short>(streamed.bitmap_states.size()); ++bitmap_index)
+		{
+			if (streamed.bitmap_states[bitmap_index]==_bitmap_not_loaded && streamed.bitmap_offsets[bitmap_index]!=NONE)
+			{
+				read_streamed_bitmap(collection_index, bitmap_index);
+			}
+		}
+		streamed.streamed= false;
+		streamed.bitmap_offsets.clear();
+		streamed.bitmap_states.clear();
+		streamed.bitmap_last_used.clear();
+	}
+	count_streamed_bitmaps();
+}
+
+static void count_streamed_bitmaps(
+	void)
+{
+	short collection_index, bitmap_index;
+
+	streaming_statistics.active= false;
+	streaming_statistics.resident_bitmaps= streaming_statistics.streamed_bitmaps= 0;
+	streaming_statistics.resident_bytes= 0;
+	streaming_statistics.budget_bytes= shape_memory_budget;
+	for (collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		struct streamed_collection& streamed= streamed_collections[collection_index];
+
+		if (!streamed.streamed) continue;
+		streaming_statistics.active= true;
+		for (bitmap_index= 0; bitmap_index<static_cast<short>(streamed.bitmap_states.size()); ++bitmap_index)
+		{
+			if (streamed.bitmap_states[bitmap_index]==_bitmap_loaded || streamed.bitmap_states[bitmap_index]==_bitmap_pinned)
+			{
+				streaming_statistics.resident_bitmaps+= 1;
+				streaming_statistics.resident_bytes+= get_collection_definition(collection_index)->bitmaps[bitmap_index].size();
+			}
+		}
+		streaming_statistics.streamed_bitmaps+= streamed.bitmap_states.size();
+	}
+}
+
 static void precalculate_bit_depth_constants(
 	void)
 {
@@ -1595,6 +2268,136 @@ static short find_or_add_color(
 	return (*color_count)++;
 }
 
+/* box-filter each 128x128 bitmap of a freshly remapped wall collection down to 16x16.  averaged
+	texels are matched to the collection's own colors, so alternate color tables still remap
+	them, and only to colors which glow (or don't) like most of the texels they replace;
+	transparent bitmaps stay transparent where most of the texels were */
+static void build_collection_mipmaps(
+	short collection_index,
+	struct rgb_color_value *primary_colors,
+	short color_count,
+	short first_bitmap_index,
+	short bitmap_count)
+{
+	struct collection_definition *collection= get_collection_definition(collection_index);
+	std::vector<mipmap_color> palette(PIXEL8_MAXIMUM_COLORS);
+	std::vector<pixel8> candidates[2]; /* dull, self-luminescent */
+	std::vector<int16> nearest(2<<15, NONE);
+	short color_index, bitmap_index;
+
+	for (color_index= 0; color_index<color_count; ++color_index)
+	{
+		struct rgb_color_value *color= primary_colors+color_index;
+		struct mipmap_color& entry= palette[color->value];
+
+		entry.red= color->red>>8, entry.green= color->green>>8, entry.blue= color->blue>>8;
+		entry.luminescent= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? true : false;
+		/* zero is reserved for transparent pixels */
+		if (color->value) candidates[entry.luminescent].push_back(color->value);
+	}
+	if (candidates[0].empty() && candidates[1].empty()) return;
+
+	for (bitmap_index= first_bitmap_index; bitmap_index<first_bitmap_index+bitmap_count; ++bitmap_index)
+	{
+		struct bitmap_definition *bitmap= get_loaded_bitmap_definition(collection_index, bitmap_index);
+		if (!bitmap || bitmap->width!=MIPMAP_TEXTURE_SIZE || bitmap->height!=MIPMAP_TEXTURE_SIZE ||
+			bitmap->bytes_per_row!=MIPMAP_TEXTURE_SIZE)
+		{
+			continue;
+		}
+
+		bool transparent= (bitmap->flags&_TRANSPARENT_BIT) ? true : false;
+		struct bitmap_mipmaps& mipmaps= bitmap_mipmap_table[bitmap];
+		size_t texel_count= 0;
+		short level;
+
+		for (level= 1; level<=MAXIMUM_BITMAP_MIPMAP_LEVEL; ++level)
+		{
+			short size= MIPMAP_TEXTURE_SIZE>>level;
+			texel_count+= size*size + size*MIPMAP_TEXTURE_SIZE;
+		}
+		mipmaps.texels.resize(texel_count);
+		mipmaps.squares[0]= mipmaps.columns[0]= bitmap->row_addresses[0];
+
+		pixel8 *next= &mipmaps.texels[0];
+		for (level= 1; level<=MAXIMUM_BITMAP_MIPMAP_LEVEL; ++level)
+		{
+			short size= MIPMAP_TEXTURE_SIZE>>level, span= 1<<level;
+			pixel8 *square= mipmaps.squares[level]= next;
+			pixel8 *columns= mipmaps.columns[level]= next+size*size;
+			short row, column, i, j;
+
+			next+= size*size + size*MIPMAP_TEXTURE_SIZE;
+
+			/* filtering each level straight from the bitmap keeps rounding from piling up */
+			for (row= 0; row<size; ++row)
+			{
+				for (column= 0; column<size; ++column)
+				{
+					int32 red= 0, green= 0, blue= 0;
+					short opaque= 0, luminescent= 0;
+
+					for (i= 0; i<span; ++i)
+					{
+						pixel8 *read= bitmap->row_addresses[row*span+i] + column*span;
+
+						for (j= 0; j<span; ++j)
+						{
+							pixel8 texel= read[j];
+
+							if (transparent && !texel) continue;
+							red+= palette[texel].red, green+= palette[texel].green, blue+= palette[texel].blue;
+							if (palette[texel].luminescent) luminescent+= 1;
+							opaque+= 1;
+						}
+					}
+
+					*square++= (2*opaque<span*span) ? 0 :
+						nearest_mipmap_color(red/opaque, green/opaque, blue/opaque, 2*luminescent>opaque, palette, candidates, nearest);
+				}
+			}
+
+			/* stretch each column back to full height for the wall mapper */
+			for (row= 0; row<size; ++row)
+			{
+				pixel8 *read= mipmaps.squares[level] + row*size;
+
+				for (i= 0; i<MIPMAP_TEXTURE_SIZE; ++i) *columns++= read[i>>level];
+			}
+		}
+	}
+}
+
+/* colors are looked up once per 15-bit bucket, which is as close as a mipmap needs to be */
+static pixel8 nearest_mipmap_color(
+	int32 red,
+	int32 green,
+	int32 blue,
+	bool luminescent,
+	const std::vector<mipmap_color>& palette,
+	const std::vector<pixel8> *candidates,
+	std::vector<int16>& nearest)
+{
+	if (candidates[luminescent].empty()) luminescent= !luminescent;
+
+	int16& match= nearest[(luminescent ? (1<<15) : 0) | ((red>>3)<<10) | ((green>>3)<<5) | (blue>>3)];
+	if (match==NONE)
+	{
+		int32 best_distance= INT32_MAX;
+
+		for (size_t i= 0; i<candidates[luminescent].size(); ++i)
+		{
+			const struct mipmap_color& color= palette[candidates[luminescent][i]];
+			int32 distance= (color.red-red)*(color.red-red) + (color.green-green)*(color.green-green) +
+				(color.blue-blue)*(color.blue-blue);
+
+			if (distance<best_distance) best_distance= distance, match= candidates[luminescent][i];
+		}
+	}
+
+	return static_cast<pixel8>(match);
+}
+
 static void update_color_environment(
 	bool is_opengl)
 {
@@ -1604,6 +2407,7 @@ static void update_color_environment(
 	
 	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS];
 	struct rgb_color_value colors[PIXEL8_MAXIMUM_COLORS];
+	std::vector<shading_table_job> jobs;
 
 	memset(remapping_table, 0, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
 
@@ -1638,10 +2442,19 @@ static void update_color_environment(
 					find_or_add_color(&primary_colors[color_index], colors, &color_count);
 			}
 			
-			/* then remap the collection and recalculate the base addresses of each bitmap */
+			/* then remap the collection and recalculate the base addresses of each bitmap; the
+				bitmaps of a streamed collection which are still in the file get the same when they
+				come in */
+			struct streamed_collection& streamed= streamed_collections[collection_index];
+			
+			streamed.remapped= streamed.streamed;
+			streamed.mipmappable= !is_opengl && collection->type==_wall_collection;
+			streamed.mipmapped= streamed.mipmappable && graphics_preferences->software_mipmaps;
+			objlist_copy(streamed.remapping_table, remapping_table, PIXEL8_MAXIMUM_COLORS);
 			for (bitmap_index= 0; bitmap_index<collection->bitmap_count; ++bitmap_index)
 			{
-				struct bitmap_definition *bitmap= get_bitmap_definition(collection_index, bitmap_index);
+				struct bitmap_definition *bitmap= get_loaded_bitmap_definition(collection_index, bitmap_index);
+				if (!bitmap && streamed.streamed) continue;
 				assert(bitmap);
 				
 				/* calculate row base addresses ... */
@@ -1652,67 +2465,41 @@ static void update_color_environment(
 				remap_bitmap(bitmap, remapping_table);
 			}
 			
-			/* build a shading table for each clut in this collection */
+			/* the software renderer can draw distant walls and floors from smaller copies */
+			if (streamed.mipmapped)
+			{
+				build_collection_mipmaps(collection_index, primary_colors, collection->color_count-NUMBER_OF_PRIVATE_COLORS, 0, collection->bitmap_count);
+			}
+			
+			/* gather what the shading tables for each clut in this collection are built from;
+				every collection's tables are built at once below */
+			struct shading_table_job& job= *jobs.insert(jobs.end(), shading_table_job());
+			
+			job.collection_index= collection_index;
+			job.collection_bit_depth= collection->type==_interface_collection ? 8 : bit_depth;
+			job.is_opengl= is_opengl;
+			job.sources.resize(collection->clut_count);
 			for (clut_index= 0; clut_index<collection->clut_count; ++clut_index)
 			{
-				void *primary_shading_table= get_collection_shading_tables(collection_index, 0);
-				short collection_bit_depth= collection->type==_interface_collection ? 8 : bit_depth;
-
+				struct shading_table_source& source= job.sources[clut_index];
+				
 				if (clut_index)
 				{
 					struct rgb_color_value *alternate_colors= get_collection_colors(collection_index, clut_index)+NUMBER_OF_PRIVATE_COLORS;
 					assert(alternate_colors);
-					void *alternate_shading_table= get_collection_shading_tables(collection_index, clut_index);
-					pixel8 shading_remapping_table[PIXEL8_MAXIMUM_COLORS];
-					
-					memset(shading_remapping_table, 0, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
-					
-//					dprintf("alternate clut %d entries;dm #%d #%d", collection->color_count, alternate_colors, collection->color_count*sizeof(ColorSpec));
 					
 					/* build a remapping table for the primary shading table which we can use to
 						calculate this alternate shading table */
-					for (color_index= 0; color_index<PIXEL8_MAXIMUM_COLORS; ++color_index) shading_remapping_table[color_index]= static_cast<pixel8>(color_index);
+					for (color_index= 0; color_index<PIXEL8_MAXIMUM_COLORS; ++color_index) source.remapping_table[color_index]= static_cast<pixel8>(color_index);
 					for (color_index= 0; color_index<collection->color_count-NUMBER_OF_PRIVATE_COLORS; ++color_index)
 					{
-						shading_remapping_table[find_or_add_color(&primary_colors[color_index], colors, &color_count, false)]= 
+						source.remapping_table[find_or_add_color(&primary_colors[color_index], colors, &color_count, false)]= 
 							find_or_add_color(&alternate_colors[color_index], colors, &color_count);
 					}
-//					shading_remapping_table[iBLACK]= iBLACK; /* make iBLACK==>iBLACK remapping explicit */
-
-					switch (collection_bit_depth)
-					{
-						case 8:
-							/* duplicate the primary shading table and remap it */
-							memcpy(alternate_shading_table, primary_shading_table, get_shading_table_size(collection_index));
-							map_bytes((unsigned char *)alternate_shading_table, shading_remapping_table, get_shading_table_size(collection_index));
-							break;
-						
-						case 16:
-							build_shading_tables16(colors, color_count, (pixel16 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						case 32:
-							build_shading_tables32(colors, color_count, (pixel32 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						default:
-							assert(false);
-							break;
-					}
-				}
-				else
-				{
-					/* build the primary shading table */
-					switch (collection_bit_depth)
-					{
-					case 8: build_shading_tables8(colors, color_count, (unsigned char *)primary_shading_table); break;
-					case 16: build_shading_tables16(colors, color_count, (pixel16 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-					case 32: build_shading_tables32(colors, color_count,  (pixel32 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-						default:
-							assert(false);
-							break;
-					}
 				}
+				
+				objlist_copy(source.colors, colors, PIXEL8_MAXIMUM_COLORS);
+				source.color_count= color_count;
 			}
 			
 			build_collection_tinting_table(colors, color_count, collection_index, is_opengl);
@@ -1729,6 +2516,8 @@ static void update_color_environment(
 //	dump_colors(colors, color_count);
 #endif
 
+	build_shading_table_jobs(jobs);
+
 	/* change the screen clut and rebuild our shading tables */
 	_change_clut(change_screen_clut, colors, color_count);
 }
@@ -1849,34 +2638,23 @@ static void build_shading_tables16(
 {
 	short i;
 	short start, count, level;
+	pixel32 pixels[MAXIMUM_NUMBER_OF_SHADING_TABLES];
 	
 	objlist_set(shading_tables, 0, PIXEL8_MAXIMUM_COLORS);
 
-	SDL_PixelFormat *fmt = &pixel_format_16;
-	
 	start= 0, count= 0;
 	while (get_next_color_run(colors, color_count, &start, &count))
 	{
 		for (i=0;i<count;++i)
 		{
+			struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
+			
 			assert(number_of_shading_tables > 1);
+			// Find optimal pixel value for video display, or Mac xRGB 1555 pixel format
+			build_shading_pixels(color, &pixel_format_16, is_opengl ? _shading_pixel_xrgb1555 : _shading_pixel_mapped, pixels);
 			for (level= 0; level<number_of_shading_tables; ++level)
 			{
-				struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
-				short multiplier= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? ((number_of_shading_tables>>1)+(level>>1)) : level;
-				if (!is_opengl)
-					// Find optimal pixel value for video display
-					shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-						SDL_MapRGB(fmt,
-						           ((color->red * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->green * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->blue * multiplier) / (number_of_shading_tables-1)) >> 8);
-				else
-				// Mac xRGB 1555 pixel format
-				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-					RGBCOLOR_TO_PIXEL16((color->red*multiplier)/(number_of_shading_tables-1),
-						(color->green*multiplier)/(number_of_shading_tables-1),
-						(color->blue*multiplier)/(number_of_shading_tables-1));
+				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= static_cast<pixel16>(pixels[level]);
 			}
 		}
 	}
@@ -1891,40 +2669,233 @@ static void build_shading_tables32(
 {
 	short i;
 	short start, count, level;
+	pixel32 pixels[MAXIMUM_NUMBER_OF_SHADING_TABLES];
 	
 	objlist_set(shading_tables, 0, PIXEL8_MAXIMUM_COLORS);
 	
-	SDL_PixelFormat *fmt = &pixel_format_32;
-
 	start= 0, count= 0;
 	while (get_next_color_run(colors, color_count, &start, &count))
 	{
 		for (i= 0; i<count; ++i)
 		{
+			struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
+			
 			assert(number_of_shading_tables > 1);
+			// Find optimal pixel value for video display, or Mac xRGB 8888 pixel format
+			build_shading_pixels(color, &pixel_format_32, is_opengl ? _shading_pixel_xrgb8888 : _shading_pixel_mapped, pixels);
 			for (level= 0; level<number_of_shading_tables; ++level)
 			{
-				struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
-				short multiplier= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? ((number_of_shading_tables>>1)+(level>>1)) : level;
-				
-				if (!is_opengl)
-					// Find optimal pixel value for video display
-					shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-						SDL_MapRGB(fmt,
-						           ((color->red * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->green * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->blue * multiplier) / (number_of_shading_tables-1)) >> 8);
-				else
-				// Mac xRGB 8888 pixel format
-				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-					RGBCOLOR_TO_PIXEL32((color->red*multiplier)/(number_of_shading_tables-1),
-						(color->green*multiplier)/(number_of_shading_tables-1),
-						(color->blue*multiplier)/(number_of_shading_tables-1));
+				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= pixels[level];
 			}
 		}
 	}
 }
 
+static inline pixel32 pack_shading_pixel(
+	int32 red,
+	int32 green,
+	int32 blue,
+	SDL_PixelFormat *fmt,
+	short layout)
+{
+	switch (layout)
+	{
+		case _shading_pixel_xrgb1555: return RGBCOLOR_TO_PIXEL16(red, green, blue);
+		case _shading_pixel_xrgb8888: return RGBCOLOR_TO_PIXEL32(red, green, blue);
+		default: return SDL_MapRGB(fmt, red>>8, green>>8, blue>>8);
+	}
+}
+
+#ifdef HAVE_SSE2_SHADING
+/* pack_shading_pixel() four at a time; SDL_MapRGB() only for formats without a palette */
+static inline __m128i pack_shading_pixels_sse2(
+	__m128i red,
+	__m128i green,
+	__m128i blue,
+	SDL_PixelFormat *fmt,
+	short layout)
+{
+	switch (layout)
+	{
+		case _shading_pixel_xrgb1555:
+			return _mm_or_si128(_mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(red, 1), _mm_set1_epi32(0x7C00)),
+				_mm_and_si128(_mm_srli_epi32(green, 6), _mm_set1_epi32(0x03E0))),
+				_mm_and_si128(_mm_srli_epi32(blue, 11), _mm_set1_epi32(0x001F)));
+		
+		case _shading_pixel_xrgb8888:
+			return _mm_or_si128(_mm_or_si128(
+				_mm_and_si128(_mm_slli_epi32(red, 8), _mm_set1_epi32(0x00FF0000)),
+				_mm_and_si128(green, _mm_set1_epi32(0x0000FF00))),
+				_mm_and_si128(_mm_srli_epi32(blue, 8), _mm_set1_epi32(0x000000FF)));
+		
+		default:
+			return _mm_or_si128(_mm_or_si128(
+				_mm_sll_epi32(_mm_srl_epi32(red, _mm_cvtsi32_si128(8+fmt->Rloss)), _mm_cvtsi32_si128(fmt->Rshift)),
+				_mm_sll_epi32(_mm_srl_epi32(green, _mm_cvtsi32_si128(8+fmt->Gloss)), _mm_cvtsi32_si128(fmt->Gshift))),
+				_mm_or_si128(_mm_sll_epi32(_mm_srl_epi32(blue, _mm_cvtsi32_si128(8+fmt->Bloss)), _mm_cvtsi32_si128(fmt->Bshift)),
+				_mm_set1_epi32(fmt->Amask)));
+	}
+}
+#endif
+
+/* one color at every shading level: each component is scaled to (component*multiplier)/
+	(number_of_shading_tables-1) and packed as the layout asks.  the SSE2 loop divides in single
+	precision, which truncates to the same integers: the products fit in 24 bits, and a
+	quotient below 65536 which isn't whole is at least 1/255 short of the next integer, more
+	than the half-ulp (1/512) the divide can round it up by */
+static void build_shading_pixels(
+	struct rgb_color_value *color,
+	SDL_PixelFormat *fmt,
+	short layout,
+	pixel32 *pixels)
+{
+	bool luminescent= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? true : false;
+	short level= 0;
+
+#ifdef HAVE_SSE2_SHADING
+	if (layout!=_shading_pixel_mapped || !fmt->palette)
+	{
+		__m128 red= _mm_set1_ps(color->red), green= _mm_set1_ps(color->green), blue= _mm_set1_ps(color->blue);
+		__m128 divisor= _mm_set1_ps((float) (number_of_shading_tables-1));
+
+		for (; level+4<=number_of_shading_tables; level+= 4)
+		{
+			__m128i multipliers= _mm_setr_epi32(level, level+1, level+2, level+3);
+			if (luminescent) multipliers= _mm_add_epi32(_mm_set1_epi32(number_of_shading_tables>>1), _mm_srli_epi32(multipliers, 1));
+			__m128 scale= _mm_cvtepi32_ps(multipliers);
+
+			_mm_storeu_si128((__m128i *) (pixels+level), pack_shading_pixels_sse2(
+				_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(red, scale), divisor)),
+				_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(green, scale), divisor)),
+				_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(blue, scale), divisor)),
+				fmt, layout));
+		}
+	}
+#endif
+
+	for (; level<number_of_shading_tables; ++level)
+	{
+		short multiplier= luminescent ? ((number_of_shading_tables>>1)+(level>>1)) : level;
+
+		pixels[level]= pack_shading_pixel((color->red*multiplier)/(number_of_shading_tables-1),
+			(color->green*multiplier)/(number_of_shading_tables-1),
+			(color->blue*multiplier)/(number_of_shading_tables-1), fmt, layout);
+	}
+}
+
+/* builds each collection's shading tables on its own thread, up to one per processor */
+static void build_shading_table_jobs(
+	std::vector<shading_table_job>& jobs)
+{
+	if (jobs.empty()) return;
+
+	int thread_count= PIN(SDL_GetCPUCount(), 1, static_cast<int>(jobs.size()));
+	std::vector<shading_table_worker> workers(thread_count);
+	std::vector<SDL_Thread *> threads(thread_count, static_cast<SDL_Thread *>(NULL));
+	int thread_index;
+
+	for (thread_index= 0; thread_index<thread_count; ++thread_index)
+	{
+		workers[thread_index].jobs= &jobs;
+		workers[thread_index].first= thread_index;
+		workers[thread_index].stride= thread_count;
+	}
+
+	/* this thread takes the first share, and the share of any thread which couldn't start */
+	for (thread_index= 1; thread_index<thread_count; ++thread_index)
+	{
+		threads[thread_index]= SDL_CreateThread(shading_table_worker_loop, "shapes_shadingTables", &workers[thread_index]);
+	}
+	shading_table_worker_loop(&workers[0]);
+	for (thread_index= 1; thread_index<thread_count; ++thread_index)
+	{
+		if (threads[thread_index]) SDL_WaitThread(threads[thread_index], NULL);
+		else shading_table_worker_loop(&workers[thread_index]);
+	}
+}
+
+static int shading_table_worker_loop(
+	void *data)
+{
+	struct shading_table_worker *worker= static_cast<shading_table_worker *>(data);
+
+	for (size_t job_index= worker->first; job_index<worker->jobs->size(); job_index+= worker->stride)
+	{
+		build_collection_shading_tables((*worker->jobs)[job_index]);
+	}
+
+	return 0;
+}
+
+/* only touches this collection's tables and its slot in the cache */
+static void build_collection_shading_tables(
+	shading_table_job& job)
+{
+	byte *tables= static_cast<byte *>(get_collection_shading_tables(job.collection_index, 0));
+	size_t table_size= get_shading_table_size(job.collection_index);
+	struct cached_shading_tables& cache= shading_table_cache[job.collection_index];
+	std::vector<byte> key;
+	short clut_index;
+
+	if (!tables) return;
+
+	/* everything the tables depend on */
+	int16 parameters[]= {job.collection_bit_depth, job.is_opengl, bit_depth, number_of_shading_tables, static_cast<int16>(job.sources.size())};
+	key.insert(key.end(), (byte *) parameters, (byte *) (parameters+sizeof(parameters)/sizeof(parameters[0])));
+	for (clut_index= 0; clut_index<static_cast<short>(job.sources.size()); ++clut_index)
+	{
+		struct shading_table_source& source= job.sources[clut_index];
+
+		key.insert(key.end(), (byte *) &source.color_count, (byte *) (&source.color_count+1));
+		key.insert(key.end(), (byte *) source.colors, (byte *) (source.colors+source.color_count));
+		if (clut_index) key.insert(key.end(), source.remapping_table, source.remapping_table+source.color_count);
+	}
+
+	if (key==cache.key && cache.tables.size()==table_size*job.sources.size())
+	{
+		objlist_copy(tables, &cache.tables[0], cache.tables.size());
+		return;
+	}
+
+	for (clut_index= 0; clut_index<static_cast<short>(job.sources.size()); ++clut_index)
+	{
+		struct shading_table_source& source= job.sources[clut_index];
+		void *shading_table= tables + clut_index*table_size;
+
+		switch (job.collection_bit_depth)
+		{
+			case 8:
+				if (clut_index)
+				{
+					/* duplicate the primary shading table and remap it */
+					memcpy(shading_table, tables, table_size);
+					map_bytes((unsigned char *)shading_table, source.remapping_table, table_size);
+				}
+				else
+				{
+					build_shading_tables8(source.colors, source.color_count, (unsigned char *)shading_table);
+				}
+				break;
+			
+			case 16:
+				build_shading_tables16(source.colors, source.color_count, (pixel16 *)shading_table, clut_index ? source.remapping_table : (byte *) NULL, job.is_opengl);
+				break;
+			
+			case 32:
+				build_shading_tables32(source.colors, source.color_count, (pixel32 *)shading_table, clut_index ? source.remapping_table : (byte *) NULL, job.is_opengl);
+				break;
+			
+			default:
+				assert(false);
+				break;
+		}
+	}
+
+	cache.key.swap(key);
+	cache.tables.assign(tables, tables+table_size*job.sources.size());
+}
+
 static void build_global_shading_table16(
 	void)
 {
@@ -2344,6 +3315,7 @@ struct low_level_shape_definition *get_low_level_shape_definition(
 		return NULL;
 }
 
+// Brings the bitmap in from the shapes file if it's streamed and not loaded
 static struct bitmap_definition *get_bitmap_definition(
 	short collection_index,
 	short bitmap_index)
@@ -2353,12 +3325,39 @@ static struct bitmap_definition *get_bitmap_definition(
 	if (!(bitmap_index >= 0 && bitmap_index < definition->bitmaps.size()))
 		return NULL;
 	
+	if (streamed_collections[collection_index].streamed)
+		touch_streamed_bitmap(collection_index, bitmap_index);
+	
+	return get_loaded_bitmap_definition(collection_index, bitmap_index);
+}
+
+static struct bitmap_definition *get_loaded_bitmap_definition(
+	short collection_index,
+	short bitmap_index)
+{
+	collection_definition *definition = get_collection_definition(collection_index);
+	if (!definition) return NULL;
+	if (!(bitmap_index >= 0 && bitmap_index < definition->bitmaps.size()))
+		return NULL;
+	
 	if (definition->bitmaps[bitmap_index].empty())
 		return NULL;
 
 	return (bitmap_definition *) &definition->bitmaps[bitmap_index][0];
 }
 
+// Loaded, or waiting in the shapes file
+static bool bitmap_exists(
+	short collection_index,
+	short bitmap_index)
+{
+	if (get_loaded_bitmap_definition(collection_index, bitmap_index)) return true;
+	
+	streamed_collection& streamed = streamed_collections[collection_index];
+	return streamed.streamed && bitmap_index >= 0 && bitmap_index < streamed.bitmap_offsets.size() &&
+		streamed.bitmap_offsets[bitmap_index] != NONE;
+}
+
 static void *get_collection_shading_tables(
 	short collection_index,
 	short clut_index)
@@ -0,0 +1,870 @@
+/*
+SPAN_KERNELS.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	x86 has no byte gather, so texels are still fetched a lane at a time; texel addresses are
+	stepped, and shading entries looked up (AVX2 gathers them for 32-bit screens), blended
+	and stored a vector at a time.  Spans shorter than a vector, and the leftovers at the end
+	of each, go through write_pixel() like they always did.
+
+	alpha_blend() works on each field in place; a field of w bits at shift s comes out as
+	b + floor((f-b)*alpha/256) in w bits, which is what the kernels compute with the fields
+	shifted down to the bottom of each lane.  That stays exact as long as the product fits
+	the lane and, for 32-bit pixels, the field ends below bit 24 (above that, alpha_blend()'s
+	int conversion wraps); get_span_pixel_channels() turns down anything else.
+*/
+
+#include "cseries.h"
+#include "span_kernels.h"
+#include "low_level_textures.h"
+#include "Logging.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_SPAN_KERNELS
+#include <immintrin.h>
+#define SSE2_FUNCTION __attribute__((target("sse2")))
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HAVE_SPAN_KERNELS
+#include <immintrin.h>
+#define SSE2_FUNCTION
+#define AVX2_FUNCTION
+#endif
+
+/* ---------- constants */
+
+#define BENCHMARK_WIDTH 640
+#define BENCHMARK_HEIGHT 480
+#define BENCHMARK_PASSES 10
+
+/* ---------- globals */
+
+const struct span_kernel_set *active_span_kernels= NULL;
+
+static int16 active_span_kernels_index= _span_kernels_scalar;
+
+/* ---------- private prototypes */
+
+template <typename T> static void scalar_horizontal(T *write, int count, const struct horizontal_span& span,
+	const struct span_blend& blend);
+template <typename T> static void scalar_quad(T *write, int bytes_per_row, int count, struct vertical_quad& quad,
+	const struct span_blend& blend);
+
+template <typename T> static void benchmark_span_kernel_set(const struct span_kernel_set *kernels, short mode,
+	pixel32 rmask, pixel32 gmask, pixel32 bmask, struct span_kernel_benchmark *result, std::vector<T>& pixels);
+
+/* ---------- scalar kernels */
+
+/* the benchmark's reference; the game itself runs the loops in low_level_textures.h */
+static const struct span_kernel_set scalar_span_kernels=
+{
+	"scalar",
+	scalar_horizontal<pixel16>, scalar_horizontal<pixel32>,
+	scalar_quad<pixel16>, scalar_quad<pixel32>
+};
+
+static inline pixel32 channel_mask(
+	const struct span_blend& blend,
+	short channel)
+{
+	return blend.channels.mask[channel]<<blend.channels.shift[channel];
+}
+
+template <typename T, int sw_alpha_blend>
+static inline void scalar_horizontal_pixels(
+	T *write,
+	int count,
+	uint32 source_x,
+	uint32 source_y,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	T *shading_table= (T *) span.shading_table;
+	uint8 *opacity_table= (uint8 *) span.opacity_table;
+	pixel32 rmask= 0, gmask= 0, bmask= 0;
+
+	if (sw_alpha_blend==_sw_alpha_nice)
+	{
+		rmask= channel_mask(blend, 0), gmask= channel_mask(blend, 1), bmask= channel_mask(blend, 2);
+	}
+
+	while ((count-= 1)>=0)
+	{
+		write_pixel<T, sw_alpha_blend, false>(write++, span.texture[((source_y>>span.downshift)<<(32-span.downshift))+(source_x>>span.downshift)],
+			shading_table, opacity_table, rmask, gmask, bmask);
+		source_x+= span.source_dx, source_y+= span.source_dy;
+	}
+}
+
+/* count pixels starting step pixels into the span */
+template <typename T>
+static void finish_horizontal_span(
+	T *write,
+	int count,
+	int step,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	uint32 source_x= span.source_x + (uint32)step*span.source_dx;
+	uint32 source_y= span.source_y + (uint32)step*span.source_dy;
+
+	switch (blend.mode)
+	{
+		case _sw_alpha_fast: scalar_horizontal_pixels<T, _sw_alpha_fast>(write, count, source_x, source_y, span, blend); break;
+		case _sw_alpha_nice: scalar_horizontal_pixels<T, _sw_alpha_nice>(write, count, source_x, source_y, span, blend); break;
+		default: scalar_horizontal_pixels<T, _sw_alpha_off>(write, count, source_x, source_y, span, blend); break;
+	}
+}
+
+template <typename T>
+static void scalar_horizontal(
+	T *write,
+	int count,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	finish_horizontal_span(write, count, 0, span, blend);
+}
+
+template <typename T, int sw_alpha_blend, bool check_transparent>
+static inline void scalar_quad_pixels(
+	T *write,
+	int bytes_per_row,
+	int count,
+	struct vertical_quad& quad,
+	const struct span_blend& blend)
+{
+	uint8 *opacity_table= (uint8 *) quad.opacity_table;
+	pixel32 rmask= 0, gmask= 0, bmask= 0;
+
+	if (sw_alpha_blend==_sw_alpha_nice)
+	{
+		rmask= channel_mask(blend, 0), gmask= channel_mask(blend, 1), bmask= channel_mask(blend, 2);
+	}
+
+	for (; count>0; --count)
+	{
+		for (int lane= 0; lane<4; ++lane)
+		{
+			write_pixel<T, sw_alpha_blend, check_transparent>(write+lane, quad.read[lane][quad.texture_y[lane]>>quad.downshift],
+				(T *) quad.shading_table[lane], opacity_table, rmask, gmask, bmask);
+			quad.texture_y[lane]+= quad.texture_dy[lane];
+		}
+		write= (T *)((byte *)write + bytes_per_row);
+	}
+}
+
+template <typename T>
+static void scalar_quad(
+	T *write,
+	int bytes_per_row,
+	int count,
+	struct vertical_quad& quad,
+	const struct span_blend& blend)
+{
+	if (blend.check_transparent)
+	{
+		switch (blend.mode)
+		{
+			case _sw_alpha_fast: scalar_quad_pixels<T, _sw_alpha_fast, true>(write, bytes_per_row, count, quad, blend); break;
+			case _sw_alpha_nice: scalar_quad_pixels<T, _sw_alpha_nice, true>(write, bytes_per_row, count, quad, blend); break;
+			default: scalar_quad_pixels<T, _sw_alpha_off, true>(write, bytes_per_row, count, quad, blend); break;
+		}
+	}
+	else
+	{
+		switch (blend.mode)
+		{
+			case _sw_alpha_fast: scalar_quad_pixels<T, _sw_alpha_fast, false>(write, bytes_per_row, count, quad, blend); break;
+			case _sw_alpha_nice: scalar_quad_pixels<T, _sw_alpha_nice, false>(write, bytes_per_row, count, quad, blend); break;
+			default: scalar_quad_pixels<T, _sw_alpha_off, false>(write, bytes_per_row, count, quad, blend); break;
+		}
+	}
+}
+
+#ifdef HAVE_SPAN_KERNELS
+
+/* ---------- SSE2 kernels */
+
+SSE2_FUNCTION static inline __m128i blend32_sse2(
+	__m128i fg,
+	__m128i bg,
+	__m128i alpha,
+	const struct span_blend& blend)
+{
+	switch (blend.mode)
+	{
+		case _sw_alpha_fast:
+			return _mm_add_epi32(_mm_srli_epi32(_mm_and_si128(_mm_xor_si128(fg, bg), _mm_set1_epi32(0xfffefefe)), 1), _mm_and_si128(fg, bg));
+
+		case _sw_alpha_nice:
+		{
+			__m128i result= _mm_setzero_si128();
+
+			for (short channel= 0; channel<3; ++channel)
+			{
+				__m128i shift= _mm_cvtsi32_si128(blend.channels.shift[channel]);
+				__m128i mask= _mm_set1_epi32(blend.channels.mask[channel]);
+				__m128i f= _mm_and_si128(_mm_srl_epi32(fg, shift), mask);
+				__m128i b= _mm_and_si128(_mm_srl_epi32(bg, shift), mask);
+				/* the low halves hold f-b and alpha, the high halves of alpha are zero */
+				__m128i product= _mm_madd_epi16(_mm_sub_epi32(f, b), alpha);
+
+				result= _mm_or_si128(result, _mm_sll_epi32(_mm_and_si128(_mm_add_epi32(b, _mm_srai_epi32(product, 8)), mask), shift));
+			}
+			return result;
+		}
+
+		default:
+			return fg;
+	}
+}
+
+SSE2_FUNCTION static inline __m128i blend16_sse2(
+	__m128i fg,
+	__m128i bg,
+	__m128i alpha,
+	const struct span_blend& blend)
+{
+	switch (blend.mode)
+	{
+		case _sw_alpha_fast:
+			return _mm_add_epi16(_mm_srli_epi16(_mm_and_si128(_mm_xor_si128(fg, bg), _mm_set1_epi16((short)0xf7de)), 1), _mm_and_si128(fg, bg));
+
+		case _sw_alpha_nice:
+		{
+			__m128i result= _mm_setzero_si128();
+
+			for (short channel= 0; channel<3; ++channel)
+			{
+				__m128i shift= _mm_cvtsi32_si128(blend.channels.shift[channel]);
+				__m128i mask= _mm_set1_epi16((short)blend.channels.mask[channel]);
+				__m128i f= _mm_and_si128(_mm_srl_epi16(fg, shift), mask);
+				__m128i b= _mm_and_si128(_mm_srl_epi16(bg, shift), mask);
+				__m128i product= _mm_mullo_epi16(_mm_sub_epi16(f, b), alpha);
+
+				result= _mm_or_si128(result, _mm_sll_epi16(_mm_and_si128(_mm_add_epi16(b, _mm_srai_epi16(product, 8)), mask), shift));
+			}
+			return result;
+		}
+
+		default:
+			return fg;
+	}
+}
+
+SSE2_FUNCTION static inline __m128i texel_index_sse2(
+	__m128i x,
+	__m128i y,
+	const struct horizontal_span& span)
+{
+	__m128i downshift= _mm_cvtsi32_si128(span.downshift), upshift= _mm_cvtsi32_si128(32-span.downshift);
+
+	return _mm_add_epi32(_mm_sll_epi32(_mm_srl_epi32(y, downshift), upshift), _mm_srl_epi32(x, downshift));
+}
+
+SSE2_FUNCTION static inline __m128i lane_steps_sse2(
+	uint32 start,
+	uint32 delta)
+{
+	return _mm_setr_epi32(start, start+delta, start+2*delta, start+3*delta);
+}
+
+/* look up lane_count texels' shading (and opacity) */
+template <typename T, int lane_count>
+static inline void fetch_texels(
+	const pixel8 *texture,
+	const int32 *index,
+	const T *shading_table,
+	const uint8 *opacity_table,
+	T *pixels,
+	T *alphas)
+{
+	for (int lane= 0; lane<lane_count; ++lane)
+	{
+		pixel8 texel= texture[index[lane]];
+
+		pixels[lane]= shading_table[texel];
+		alphas[lane]= opacity_table ? opacity_table[texel] : 0;
+	}
+}
+
+SSE2_FUNCTION static void horizontal32_sse2(
+	pixel32 *write,
+	int count,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	const pixel32 *shading_table= (const pixel32 *) span.shading_table;
+	const uint8 *opacity_table= blend.mode==_sw_alpha_nice ? span.opacity_table : NULL;
+	__m128i x= lane_steps_sse2(span.source_x, span.source_dx), y= lane_steps_sse2(span.source_y, span.source_dy);
+	__m128i x_step= _mm_set1_epi32(4*span.source_dx), y_step= _mm_set1_epi32(4*span.source_dy);
+	int step= 0;
+
+	for (; count-step>=4; step+= 4)
+	{
+		int32 index[4];
+		pixel32 pixels[4], alphas[4];
+
+		_mm_storeu_si128((__m128i *)index, texel_index_sse2(x, y, span));
+		fetch_texels<pixel32, 4>(span.texture, index, shading_table, opacity_table, pixels, alphas);
+
+		__m128i *destination= (__m128i *)(write+step);
+		_mm_storeu_si128(destination, blend32_sse2(_mm_loadu_si128((__m128i *)pixels), _mm_loadu_si128(destination),
+			_mm_loadu_si128((__m128i *)alphas), blend));
+
+		x= _mm_add_epi32(x, x_step), y= _mm_add_epi32(y, y_step);
+	}
+
+	finish_horizontal_span(write+step, count-step, step, span, blend);
+}
+
+SSE2_FUNCTION static void horizontal16_sse2(
+	pixel16 *write,
+	int count,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	const pixel16 *shading_table= (const pixel16 *) span.shading_table;
+	const uint8 *opacity_table= blend.mode==_sw_alpha_nice ? span.opacity_table : NULL;
+	__m128i x= lane_steps_sse2(span.source_x, span.source_dx), y= lane_steps_sse2(span.source_y, span.source_dy);
+	__m128i x_step= _mm_set1_epi32(4*span.source_dx), y_step= _mm_set1_epi32(4*span.source_dy);
+	int step= 0;
+
+	for (; count-step>=8; step+= 8)
+	{
+		int32 index[8];
+		pixel16 pixels[8], alphas[8];
+
+		_mm_storeu_si128((__m128i *)index, texel_index_sse2(x, y, span));
+		x= _mm_add_epi32(x, x_step), y= _mm_add_epi32(y, y_step);
+		_mm_storeu_si128((__m128i *)(index+4), texel_index_sse2(x, y, span));
+		x= _mm_add_epi32(x, x_step), y= _mm_add_epi32(y, y_step);
+		fetch_texels<pixel16, 8>(span.texture, index, shading_table, opacity_table, pixels, alphas);
+
+		__m128i *destination= (__m128i *)(write+step);
+		_mm_storeu_si128(destination, blend16_sse2(_mm_loadu_si128((__m128i *)pixels), _mm_loadu_si128(destination),
+			_mm_loadu_si128((__m128i *)alphas), blend));
+	}
+
+	finish_horizontal_span(write+step, count-step, step, span, blend);
+}
+
+/* one row of four columns; sets texels to each column's texel */
+template <typename T>
+static inline void fetch_quad_row(
+	struct vertical_quad& quad,
+	const uint8 *opacity_table,
+	T *pixels,
+	T *alphas,
+	T *texels)
+{
+	for (int lane= 0; lane<4; ++lane)
+	{
+		pixel8 texel= quad.read[lane][quad.texture_y[lane]>>quad.downshift];
+
+		texels[lane]= texel;
+		pixels[lane]= ((const T *) quad.shading_table[lane])[texel];
+		alphas[lane]= opacity_table ? opacity_table[texel] : 0;
+		quad.texture_y[lane]+= quad.texture_dy[lane];
+	}
+}
+
+SSE2_FUNCTION static void quad32_sse2(
+	pixel32 *write,
+	int bytes_per_row,
+	int count,
+	struct vertical_quad& quad,
+	const struct span_blend& blend)
+{
+	const uint8 *opacity_table= blend.mode==_sw_alpha_nice ? quad.opacity_table : NULL;
+
+	for (; count>0; --count)
+	{
+		pixel32 pixels[4], alphas[4], texels[4];
+
+		fetch_quad_row<pixel32>(quad, opacity_table, pixels, alphas, texels);
+
+		__m128i *destination= (__m128i *) write;
+		__m128i bg= _mm_loadu_si128(destination);
+		__m128i result= blend32_sse2(_mm_loadu_si128((__m128i *)pixels), bg, _mm_loadu_si128((__m128i *)alphas), blend);
+
+		if (blend.check_transparent)
+		{
+			__m128i transparent= _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)texels), _mm_setzero_si128());
+			result= _mm_or_si128(_mm_and_si128(transparent, bg), _mm_andnot_si128(transparent, result));
+		}
+		_mm_storeu_si128(destination, result);
+
+		write= (pixel32 *)((byte *)write + bytes_per_row);
+	}
+}
+
+SSE2_FUNCTION static void quad16_sse2(
+	pixel16 *write,
+	int bytes_per_row,
+	int count,
+	struct vertical_quad& quad,
+	const struct span_blend& blend)
+{
+	const uint8 *opacity_table= blend.mode==_sw_alpha_nice ? quad.opacity_table : NULL;
+
+	for (; count>0; --count)
+	{
+		pixel16 pixels[8]= {0}, alphas[8]= {0}, texels[8]= {0};
+
+		fetch_quad_row<pixel16>(quad, opacity_table, pixels, alphas, texels);
+
+		__m128i *destination= (__m128i *) write;
+		__m128i bg= _mm_loadl_epi64(destination);
+		__m128i result= blend16_sse2(_mm_loadu_si128((__m128i *)pixels), bg, _mm_loadu_si128((__m128i *)alphas), blend);
+
+		if (blend.check_transparent)
+		{
+			__m128i transparent= _mm_cmpeq_epi16(_mm_loadu_si128((__m128i *)texels), _mm_setzero_si128());
+			result= _mm_or_si128(_mm_and_si128(transparent, bg), _mm_andnot_si128(transparent, result));
+		}
+		_mm_storel_epi64(destination, result);
+
+		write= (pixel16 *)((byte *)write + bytes_per_row);
+	}
+}
+
+static const struct span_kernel_set sse2_span_kernels=
+{
+	"SSE2",
+	horizontal16_sse2, horizontal32_sse2,
+	quad16_sse2, quad32_sse2
+};
+
+/* ---------- AVX2 kernels */
+
+AVX2_FUNCTION static inline __m256i blend32_avx2(
+	__m256i fg,
+	__m256i bg,
+	__m256i alpha,
+	const struct span_blend& blend)
+{
+	switch (blend.mode)
+	{
+		case _sw_alpha_fast:
+			return _mm256_add_epi32(_mm256_srli_epi32(_mm256_and_si256(_mm256_xor_si256(fg, bg), _mm256_set1_epi32(0xfffefefe)), 1), _mm256_and_si256(fg, bg));
+
+		case _sw_alpha_nice:
+		{
+			__m256i result= _mm256_setzero_si256();
+
+			for (short channel= 0; channel<3; ++channel)
+			{
+				__m128i shift= _mm_cvtsi32_si128(blend.channels.shift[channel]);
+				__m256i mask= _mm256_set1_epi32(blend.channels.mask[channel]);
+				__m256i f= _mm256_and_si256(_mm256_srl_epi32(fg, shift), mask);
+				__m256i b= _mm256_and_si256(_mm256_srl_epi32(bg, shift), mask);
+				__m256i product= _mm256_madd_epi16(_mm256_sub_epi32(f, b), alpha);
+
+				result= _mm256_or_si256(result, _mm256_sll_epi32(_mm256_and_si256(_mm256_add_epi32(b, _mm256_srai_epi32(product, 8)), mask), shift));
+			}
+			return result;
+		}
+
+		default:
+			return fg;
+	}
+}
+
+AVX2_FUNCTION static inline __m256i blend16_avx2(
+	__m256i fg,
+	__m256i bg,
+	__m256i alpha,
+	const struct span_blend& blend)
+{
+	switch (blend.mode)
+	{
+		case _sw_alpha_fast:
+			return _mm256_add_epi16(_mm256_srli_epi16(_mm256_and_si256(_mm256_xor_si256(fg, bg), _mm256_set1_epi16((short)0xf7de)), 1), _mm256_and_si256(fg, bg));
+
+		case _sw_alpha_nice:
+		{
+			__m256i result= _mm256_setzero_si256();
+
+			for (short channel= 0; channel<3; ++channel)
+			{
+				__m128i shift= _mm_cvtsi32_si128(blend.channels.shift[channel]);
+				__m256i mask= _mm256_set1_epi16((short)blend.channels.mask[channel]);
+				__m256i f= _mm256_and_si256(_mm256_srl_epi16(fg, shift), mask);
+				__m256i b= _mm256_and_si256(_mm256_srl_epi16(bg, shift), mask);
+				__m256i product= _mm256_mullo_epi16(_mm256_sub_epi16(f, b), alpha);
+
+				result= _mm256_or_si256(result, _mm256_sll_epi16(_mm256_and_si256(_mm256_add_epi16(b, _mm256_srai_epi16(product, 8)), mask), shift));
+			}
+			return result;
+		}
+
+		default:
+			return fg;
+	}
+}
+
+AVX2_FUNCTION static inline __m256i texel_index_avx2(
+	__m256i x,
+	__m256i y,
+	const struct horizontal_span& span)
+{
+	__m128i downshift= _mm_cvtsi32_si128(span.downshift), upshift= _mm_cvtsi32_si128(32-span.downshift);
+
+	return _mm256_add_epi32(_mm256_sll_epi32(_mm256_srl_epi32(y, downshift), upshift), _mm256_srl_epi32(x, downshift));
+}
+
+AVX2_FUNCTION static inline __m256i lane_steps_avx2(
+	uint32 start,
+	uint32 delta)
+{
+	return _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_mullo_epi32(_mm256_set1_epi32(delta), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+AVX2_FUNCTION static void horizontal32_avx2(
+	pixel32 *write,
+	int count,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	const int *shading_table= (const int *) span.shading_table;
+	const uint8 *opacity_table= span.opacity_table;
+	bool nice= blend.mode==_sw_alpha_nice;
+	__m256i x= lane_steps_avx2(span.source_x, span.source_dx), y= lane_steps_avx2(span.source_y, span.source_dy);
+	__m256i x_step= _mm256_set1_epi32(8*span.source_dx), y_step= _mm256_set1_epi32(8*span.source_dy);
+	int step= 0;
+
+	for (; count-step>=8; step+= 8)
+	{
+		int32 index[8], texels[8], alphas[8];
+
+		_mm256_storeu_si256((__m256i *)index, texel_index_avx2(x, y, span));
+		for (int lane= 0; lane<8; ++lane)
+		{
+			texels[lane]= span.texture[index[lane]];
+			alphas[lane]= nice ? opacity_table[texels[lane]] : 0;
+		}
+
+		/* shading tables are whole 256-entry tables, so gathering from them is safe */
+		__m256i fg= _mm256_i32gather_epi32(shading_table, _mm256_loadu_si256((__m256i *)texels), 4);
+		__m256i *destination= (__m256i *)(write+step);
+		_mm256_storeu_si256(destination, blend32_avx2(fg, _mm256_loadu_si256(destination), _mm256_loadu_si256((__m256i *)alphas), blend));
+
+		x= _mm256_add_epi32(x, x_step), y= _mm256_add_epi32(y, y_step);
+	}
+
+	finish_horizontal_span(write+step, count-step, step, span, blend);
+}
+
+AVX2_FUNCTION static void horizontal16_avx2(
+	pixel16 *write,
+	int count,
+	const struct horizontal_span& span,
+	const struct span_blend& blend)
+{
+	const pixel16 *shading_table= (const pixel16 *) span.shading_table;
+	const uint8 *opacity_table= blend.mode==_sw_alpha_nice ? span.opacity_table : NULL;
+	__m256i x= lane_steps_avx2(span.source_x, span.source_dx), y= lane_steps_avx2(span.source_y, span.source_dy);
+	__m256i x_step= _mm256_set1_epi32(8*span.source_dx), y_step= _mm256_set1_epi32(8*span.source_dy);
+	int step= 0;
+
+	for (; count-step>=16; step+= 16)
+	{
+		int32 index[16];
+		pixel16 pixels[16], alphas[16];
+
+		_mm256_storeu_si256((__m256i *)index, texel_index_avx2(x, y, span));
+		x= _mm256_add_epi32(x, x_step), y= _mm256_add_epi32(y, y_step);
+		_mm256_storeu_si256((__m256i *)(index+8), texel_index_avx2(x, y, span));
+		x= _mm256_add_epi32(x, x_step), y= _mm256_add_epi32(y, y_step);
+		fetch_texels<pixel16, 16>(span.texture, index, shading_table, opacity_table, pixels, alphas);
+
+		__m256i *destination= (__m256i *)(write+step);
+		_mm256_storeu_si256(destination, blend16_avx2(_mm256_loadu_si256((__m256i *)pixels), _mm256_loadu_si256(destination),
+			_mm256_loadu_si256((__m256i *)alphas), blend));
+	}
+
+	finish_horizontal_span(write+step, count-step, step, span, blend);
+}
+
+/* four columns are only a quarter of an AVX2 register; the quads stay SSE2 */
+static const struct span_kernel_set avx2_span_kernels=
+{
+	"AVX2",
+	horizontal16_avx2, horizontal32_avx2,
+	quad16_sse2, quad32_sse2
+};
+
+#endif
+
+/* ---------- code */
+
+static const struct span_kernel_set *span_kernel_sets[NUMBER_OF_SPAN_KERNEL_SETS]=
+{
+	NULL,
+#ifdef HAVE_SPAN_KERNELS
+	&sse2_span_kernels,
+	&avx2_span_kernels
+#else
+	NULL,
+	NULL
+#endif
+};
+
+void choose_span_kernels(
+	void)
+{
+	int16 kernels= _span_kernels_scalar;
+
+	if (span_kernels_available(_span_kernels_avx2)) kernels= _span_kernels_avx2;
+	else if (span_kernels_available(_span_kernels_sse2)) kernels= _span_kernels_sse2;
+
+	set_span_kernels(kernels);
+	logNote("software rasterizer span kernels: %s", get_span_kernels_name(kernels));
+}
+
+bool span_kernels_available(
+	int16 kernels)
+{
+	switch (kernels)
+	{
+		case _span_kernels_scalar:
+			return true;
+
+#ifdef HAVE_SPAN_KERNELS
+		case _span_kernels_sse2:
+			return SDL_HasSSE2();
+
+		case _span_kernels_avx2:
+#if SDL_VERSION_ATLEAST(2,0,4)
+			return SDL_HasAVX2();
+#else
+			return false;
+#endif
+#endif
+
+		default:
+			return false;
+	}
+}
+
+void set_span_kernels(
+	int16 kernels)
+{
+	assert(span_kernels_available(kernels));
+
+	active_span_kernels_index= kernels;
+	active_span_kernels= span_kernel_sets[kernels];
+}
+
+int16 get_span_kernels(
+	void)
+{
+	return active_span_kernels_index;
+}
+
+const char *get_span_kernels_name(
+	int16 kernels)
+{
+	if (kernels==_span_kernels_scalar) return scalar_span_kernels.name;
+
+	return (kernels>=0 && kernels<NUMBER_OF_SPAN_KERNEL_SETS && span_kernel_sets[kernels]) ?
+		span_kernel_sets[kernels]->name : "unavailable";
+}
+
+bool get_span_pixel_channels(
+	pixel32 rmask,
+	pixel32 gmask,
+	pixel32 bmask,
+	size_t pixel_size,
+	struct span_pixel_channels *channels)
+{
+	pixel32 masks[3]= {rmask, gmask, bmask};
+
+	for (short channel= 0; channel<3; ++channel)
+	{
+		pixel32 mask= masks[channel];
+		int16 shift= 0, width= 0;
+
+		if (!mask) return false;
+		while (!(mask&1)) mask>>= 1, shift+= 1;
+		while (mask&1) mask>>= 1, width+= 1;
+		if (mask) return false; /* not one run of bits */
+
+		/* (f-b)*alpha has to fit a 16-bit lane; and see the top of the file for bit 24 */
+		if (pixel_size==sizeof(pixel16) ? (width>7 || shift+width>16) : (width>15 || shift+width>24)) return false;
+
+		channels->shift[channel]= shift;
+		channels->mask[channel]= (1<<width)-1;
+	}
+
+	return true;
+}
+
+void benchmark_span_kernels(
+	short depth,
+	pixel32 rmask,
+	pixel32 gmask,
+	pixel32 bmask,
+	std::vector<span_kernel_benchmark>& results)
+{
+	results.clear();
+	if (depth!=16 && depth!=32) return;
+
+	for (short mode= _sw_alpha_off; mode<=_sw_alpha_nice; ++mode)
+	{
+		std::vector<pixel16> reference16, pixels16;
+		std::vector<pixel32> reference32, pixels32;
+
+		for (int16 kernels= _span_kernels_scalar; kernels<NUMBER_OF_SPAN_KERNEL_SETS; ++kernels)
+		{
+			struct span_kernel_benchmark result;
+
+			if (!span_kernels_available(kernels)) continue;
+			const struct span_kernel_set *set= kernels==_span_kernels_scalar ? &scalar_span_kernels : span_kernel_sets[kernels];
+
+			result.kernels= kernels;
+			result.mode= mode;
+			if (depth==16)
+			{
+				benchmark_span_kernel_set<pixel16>(set, mode, rmask, gmask, bmask, &result, pixels16);
+				if (kernels==_span_kernels_scalar) reference16.swap(pixels16);
+				result.matches_scalar= kernels==_span_kernels_scalar || pixels16==reference16;
+			}
+			else
+			{
+				benchmark_span_kernel_set<pixel32>(set, mode, rmask, gmask, bmask, &result, pixels32);
+				if (kernels==_span_kernels_scalar) reference32.swap(pixels32);
+				result.matches_scalar= kernels==_span_kernels_scalar || pixels32==reference32;
+			}
+
+			results.push_back(result);
+		}
+	}
+}
+
+/* ---------- private code */
+
+static inline uint32 benchmark_random(
+	uint32& seed)
+{
+	seed= seed*1664525 + 1013904223;
+	return seed;
+}
+
+/* the same texture, tables, starting screen and spans every time; pixels is what's drawn */
+template <typename T>
+static void benchmark_span_kernel_set(
+	const struct span_kernel_set *kernels,
+	short mode,
+	pixel32 rmask,
+	pixel32 gmask,
+	pixel32 bmask,
+	struct span_kernel_benchmark *result,
+	std::vector<T>& pixels)
+{
+	void (*horizontal)(T *, int, const struct horizontal_span&, const struct span_blend&);
+	void (*quad)(T *, int, int, struct vertical_quad&, const struct span_blend&);
+	std::vector<pixel8> texture(128*128);
+	std::vector<T> shading_table(MAXIMUM_SHADING_TABLE_INDEXES);
+	std::vector<uint8> opacity_table(MAXIMUM_SHADING_TABLE_INDEXES);
+	uint32 seed= 0x5eed;
+	size_t i;
+	int pass, row, column;
+
+	if (sizeof(T)==sizeof(pixel16))
+	{
+		horizontal= (void (*)(T *, int, const struct horizontal_span&, const struct span_blend&)) kernels->horizontal16;
+		quad= (void (*)(T *, int, int, struct vertical_quad&, const struct span_blend&)) kernels->quad16;
+	}
+	else
+	{
+		horizontal= (void (*)(T *, int, const struct horizontal_span&, const struct span_blend&)) kernels->horizontal32;
+		quad= (void (*)(T *, int, int, struct vertical_quad&, const struct span_blend&)) kernels->quad32;
+	}
+
+	/* every eighth texel or so is transparent */
+	for (i= 0; i<texture.size(); ++i) texture[i]= (benchmark_random(seed)>>24) & ((benchmark_random(seed)&0x70) ? 0xff : 0);
+	for (i= 0; i<shading_table.size(); ++i) shading_table[i]= (T) benchmark_random(seed);
+	for (i= 0; i<opacity_table.size(); ++i) opacity_table[i]= benchmark_random(seed)>>24;
+	pixels.resize(BENCHMARK_WIDTH*BENCHMARK_HEIGHT);
+	for (i= 0; i<pixels.size(); ++i) pixels[i]= (T) benchmark_random(seed);
+
+	struct span_blend blend;
+	blend.mode= mode;
+	blend.check_transparent= false;
+	if (mode==_sw_alpha_nice && !get_span_pixel_channels(rmask, gmask, bmask, sizeof(T), &blend.channels))
+	{
+		/* the scalar loops would be drawing anyway */
+		obj_clear(blend.channels);
+	}
+
+	double horizontal_pixels= 0, vertical_pixels= (double) BENCHMARK_PASSES*BENCHMARK_WIDTH*(BENCHMARK_HEIGHT/2);
+	uint64 start= machine_microsecond_count();
+	for (pass= 0; pass<BENCHMARK_PASSES; ++pass)
+	{
+		uint32 span_seed= 0x5a5a;
+
+		for (row= 0; row<BENCHMARK_HEIGHT; ++row)
+		{
+			struct horizontal_span span;
+			int x0= benchmark_random(span_seed)%16;
+
+			span.texture= &texture[0];
+			span.downshift= HORIZONTAL_WIDTH_DOWNSHIFT;
+			span.source_x= benchmark_random(span_seed), span.source_y= benchmark_random(span_seed);
+			span.source_dx= benchmark_random(span_seed)>>6, span.source_dy= benchmark_random(span_seed)>>6;
+			span.shading_table= &shading_table[0];
+			span.opacity_table= &opacity_table[0];
+			horizontal(&pixels[row*BENCHMARK_WIDTH + x0], BENCHMARK_WIDTH - x0, span, blend);
+			horizontal_pixels+= BENCHMARK_WIDTH - x0;
+		}
+	}
+	uint64 horizontal_microseconds= machine_microsecond_count() - start;
+
+	blend.check_transparent= true;
+	start= machine_microsecond_count();
+	for (pass= 0; pass<BENCHMARK_PASSES; ++pass)
+	{
+		uint32 quad_seed= 0xa5a5;
+
+		for (column= 0; column<BENCHMARK_WIDTH; column+= 4)
+		{
+			struct vertical_quad columns;
+
+			for (int lane= 0; lane<4; ++lane)
+			{
+				columns.read[lane]= &texture[(benchmark_random(quad_seed)&0x7f)<<7];
+				columns.texture_y[lane]= benchmark_random(quad_seed);
+				columns.texture_dy[lane]= benchmark_random(quad_seed)>>6;
+				columns.shading_table[lane]= &shading_table[0];
+			}
+			columns.downshift= VERTICAL_TEXTURE_DOWNSHIFT;
+			columns.opacity_table= &opacity_table[0];
+			quad(&pixels[column], BENCHMARK_WIDTH*sizeof(T), BENCHMARK_HEIGHT/2, columns, blend);
+		}
+	}
+	uint64 vertical_microseconds= machine_microsecond_count() - start;
+
+	result->horizontal_megapixels= horizontal_pixels/MAX(horizontal_microseconds, 1);
+	result->vertical_megapixels= vertical_pixels/MAX(vertical_microseconds, 1);
+}
@@ -0,0 +1,127 @@
+#ifndef __SPAN_KERNELS_H
+#define __SPAN_KERNELS_H
+
+/*
+SPAN_KERNELS.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	SSE2 and AVX2 versions of the innermost loops of low_level_textures.h, for 16- and 32-bit
+	screens: a horizontal span of a floor or ceiling, and one row of the vertical mapper's
+	four-column groups.  Texel addresses, shading lookups, blending and stores are done 4 to 16
+	pixels at a time, and the pixels come out exactly as the scalar loops would draw them.
+	The game only uses them for nice transparency blending, where they pay off; the scalar
+	loops are still the reference, and what everything else gets.
+*/
+
+#include "cseries.h"
+
+#include <vector>
+
+/* ---------- constants */
+
+enum /* kernel sets */
+{
+	_span_kernels_scalar,
+	_span_kernels_sse2,
+	_span_kernels_avx2,
+	NUMBER_OF_SPAN_KERNEL_SETS
+};
+
+/* ---------- structures */
+
+/* the red, green and blue fields of a pixel, each as a shift and a mask of low bits */
+struct span_pixel_channels
+{
+	int16 shift[3];
+	uint32 mask[3];
+};
+
+struct span_blend
+{
+	int16 mode; /* _sw_alpha_off, _sw_alpha_fast or _sw_alpha_nice */
+	bool check_transparent; /* leave the screen alone where the texel is zero */
+	struct span_pixel_channels channels; /* for _sw_alpha_nice */
+};
+
+/* one line of texture_horizontal_polygon_lines() */
+struct horizontal_span
+{
+	const pixel8 *texture; /* square, 32-downshift bits on a side */
+	int downshift;
+	uint32 source_x, source_y;
+	uint32 source_dx, source_dy;
+	const void *shading_table;
+	const uint8 *opacity_table;
+};
+
+/* the four columns of texture_vertical_polygon_lines()' parallel map; texture_y is left
+	where the scalar loop would have left it */
+struct vertical_quad
+{
+	const pixel8 *read[4];
+	uint32 texture_y[4], texture_dy[4];
+	const void *shading_table[4];
+	int downshift;
+	const uint8 *opacity_table;
+};
+
+struct span_kernel_set
+{
+	const char *name;
+
+	void (*horizontal16)(pixel16 *write, int count, const struct horizontal_span& span, const struct span_blend& blend);
+	void (*horizontal32)(pixel32 *write, int count, const struct horizontal_span& span, const struct span_blend& blend);
+
+	void (*quad16)(pixel16 *write, int bytes_per_row, int count, struct vertical_quad& quad, const struct span_blend& blend);
+	void (*quad32)(pixel32 *write, int bytes_per_row, int count, struct vertical_quad& quad, const struct span_blend& blend);
+};
+
+struct span_kernel_benchmark
+{
+	int16 kernels;
+	int16 mode;
+	double horizontal_megapixels, vertical_megapixels; /* per second */
+	bool matches_scalar;
+};
+
+/* ---------- globals */
+
+/* NULL when the scalar loops are drawing */
+extern const struct span_kernel_set *active_span_kernels;
+
+/* ---------- prototypes/SPAN_KERNELS.CPP */
+
+/* picks the best set this processor runs; called at launch */
+void choose_span_kernels(void);
+
+bool span_kernels_available(int16 kernels);
+void set_span_kernels(int16 kernels);
+int16 get_span_kernels(void);
+const char *get_span_kernels_name(int16 kernels);
+
+/* false if the kernels can't reproduce alpha_blend() exactly for these masks */
+bool get_span_pixel_channels(pixel32 rmask, pixel32 gmask, pixel32 bmask, size_t pixel_size,
+	struct span_pixel_channels *channels);
+
+/* draws the same spans and quads into an offscreen buffer of the given depth with every
+	available kernel set and blend mode, checking each against the scalar loops */
+void benchmark_span_kernels(short depth, pixel32 rmask, pixel32 gmask, pixel32 bmask,
+	std::vector<span_kernel_benchmark>& results);
+
+#endif
@@ -72,6 +72,25 @@ public:
 	void clear() { buf.clear(); }
 };
 
+/* box-filtered copies of a 128x128 wall texture for the software renderer; level n is 128>>n
+	texels on a side, and level 0 is the bitmap itself */
+enum
+{
+	MAXIMUM_BITMAP_MIPMAP_LEVEL= 3 /* 16x16 */
+};
+
+struct bitmap_mipmaps
+{
+	/* each level as a square in the bitmap's own order, for the floor mapper */
+	pixel8 *squares[MAXIMUM_BITMAP_MIPMAP_LEVEL+1];
+	
+	/* each level's columns stretched back to 128 texels, so the wall mapper's downshift and
+		vertical wrapping work unchanged on them */
+	pixel8 *columns[MAXIMUM_BITMAP_MIPMAP_LEVEL+1];
+	
+	std::vector<pixel8> texels;
+};
+
 /* ---------- prototypes/TEXTURES.C */
 
 /* assumes pixel data follows bitmap_definition structure immediately */
@@ -83,5 +102,11 @@ void precalculate_bitmap_row_addresses(struct bitmap_definition *texture);
 void map_bytes(byte *buffer, byte *table, int32 size);
 void remap_bitmap(struct bitmap_definition *bitmap,	pixel8 *table);
 
+/* ---------- prototypes/SHAPES.CPP */
+
+/* NULL unless the bitmap is a 128x128 wall texture loaded for the software renderer while
+	smooth distant textures are on */
+const struct bitmap_mipmaps *get_bitmap_mipmaps(const struct bitmap_definition *bitmap);
+
 #endif
 
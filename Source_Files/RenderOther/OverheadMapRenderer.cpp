@@ -83,142 +83,53 @@ void OverheadMapClass::Render(overhead_map_data& Control)
 	
 	transform_endpoints_for_overhead_map(Control);
 	
-	// LP addition
-	begin_polygons();
-	
-	/* shade all visible polygons */
-	for (i=0;i<dynamic_world->polygon_count;++i)
+	if (Control.mode==_rendering_game_map)
 	{
-		struct polygon_data *polygon= get_polygon_data(i);
-		if (POLYGON_IS_IN_AUTOMAP(i) && TEST_STATE_FLAG(i, _polygon_on_automap)
-			&&(polygon->floor_transfer_mode!=_xfer_landscape||polygon->ceiling_transfer_mode!=_xfer_landscape))
+		draw_static_layer(Control);
+	}
+	else
+	{
+		// LP addition
+		begin_polygons();
+		
+		/* shade all visible polygons */
+		for (i=0;i<dynamic_world->polygon_count;++i)
 		{
-			
-			if (!POLYGON_IS_DETACHED(polygon))
+			if (TEST_STATE_FLAG(i, _polygon_on_automap))
 			{
-				short color;
+				short color= get_polygon_color(i);
 				
-				switch (polygon->type)
+				if (color!=NONE)
 				{
-					case _polygon_is_platform:
-						color= PLATFORM_IS_SECRET(get_platform_data(polygon->permutation)) ?
-							_polygon_color : _polygon_platform_color;
-						if (PLATFORM_IS_FLOODED(get_platform_data(polygon->permutation)))
-						{
-							short adj_index = find_flooding_polygon(i);
-							if (adj_index != NONE)
-							{
-								switch (get_polygon_data(adj_index)->type)
-								{
-									case _polygon_is_minor_ouch:
-										color = _polygon_minor_ouch_color;
-										break;
-									case _polygon_is_major_ouch:
-										color = _polygon_major_ouch_color;
-										break;
-								}
-							}
-						}
-						break;
-					
-					case _polygon_is_minor_ouch:
-						color = _polygon_minor_ouch_color;
-						break;
-					
-					case _polygon_is_major_ouch:
-						color = _polygon_major_ouch_color;
-						break;
-                        
-					case _polygon_is_teleporter:
-						color = _polygon_teleporter_color;
-						break;
-                        
-				case _polygon_is_hill:
-					color = _polygon_hill_color;
-					break;
-					
-					default:
-						color= _polygon_color;
-						break;
+					struct polygon_data *polygon= get_polygon_data(i);
+					draw_polygon(polygon->vertex_count, polygon->endpoint_indexes, color, scale);
 				}
-
-				if (polygon->media_index!=NONE)
-				{
-					struct media_data *media= get_media_data(polygon->media_index);
-					
-					// LP change: idiot-proofing
-					if (media)
-					{
-						if (media->height>=polygon->floor_height)
-						{
-							switch (media->type)
-							{
-								case _media_water: color= _polygon_water_color; break;
-								case _media_lava: color= _polygon_lava_color; break;
-								case _media_goo: color= _polygon_goo_color; break;
-								// LP change: separated sewage and JjaroGoo
-								case _media_sewage: color= _polygon_sewage_color; break;
-								case _media_jjaro: color = _polygon_jjaro_color; break;
-							}
-						}
-					}
-				}
-				
-				draw_polygon(polygon->vertex_count, polygon->endpoint_indexes, color, scale);
 			}
 		}
-	}
-
-	// LP addition
-	end_polygons();
-
-	// LP addition
-	begin_lines();
-	
-	/* draw all visible lines */
-	for (i=0;i<dynamic_world->line_count;++i)
-	{
-		short line_color= NONE;
-		struct line_data *line= get_line_data(i);
 		
-		if (LINE_IS_IN_AUTOMAP(i))
+		// LP addition
+		end_polygons();
+		
+		// LP addition
+		begin_lines();
+		
+		/* draw all visible lines */
+		for (i=0;i<dynamic_world->line_count;++i)
 		{
+			struct line_data *line= get_line_data(i);
+			
 			if ((line->clockwise_polygon_owner!=NONE && TEST_STATE_FLAG(line->clockwise_polygon_owner, _polygon_on_automap)) ||
 				(line->counterclockwise_polygon_owner!=NONE && TEST_STATE_FLAG(line->counterclockwise_polygon_owner, _polygon_on_automap)))
 			{
-				struct polygon_data *clockwise_polygon= line->clockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->clockwise_polygon_owner);
-				struct polygon_data *counterclockwise_polygon= line->counterclockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->counterclockwise_polygon_owner);
-
-				if (LINE_IS_SOLID(line) || LINE_IS_VARIABLE_ELEVATION(line))
-				{
-					if (LINE_IS_LANDSCAPED(line))
-					{
-						if ((!clockwise_polygon||clockwise_polygon->floor_transfer_mode!=_xfer_landscape) &&
-							(!counterclockwise_polygon||counterclockwise_polygon->floor_transfer_mode!=_xfer_landscape))
-						{
-							line_color= _elevation_line_color;
-						}
-					}
-					else
-					{
-						line_color= _solid_line_color;
-					}
-				}
-				else
-				{
-					if (clockwise_polygon->floor_height!=counterclockwise_polygon->floor_height)
-					{
-						line_color= LINE_IS_LANDSCAPED(line) ? NONE : static_cast<short>(_elevation_line_color);
-					}
-				}
+				short line_color= get_line_color(i);
+				
+				if (line_color!=NONE) draw_line(i, line_color, scale);
 			}
-			
-			if (line_color!=NONE) draw_line(i, line_color, scale);
 		}
+		
+		// LP addition
+		end_lines();
 	}
-
-	// LP addition
-	end_lines();
 	
 	/* print all visible tags */
 	if (scale!=OVERHEAD_MAP_MINIMUM_SCALE)
@@ -392,6 +303,228 @@ void OverheadMapClass::Render(overhead_map_data& Control)
 }
 
 
+// The color a polygon on the automap is shaded with, or NONE if it isn't shaded
+
+short OverheadMapClass::get_polygon_color(
+	short polygon_index)
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	short color;
+	
+	if (!POLYGON_IS_IN_AUTOMAP(polygon_index) ||
+		(polygon->floor_transfer_mode==_xfer_landscape&&polygon->ceiling_transfer_mode==_xfer_landscape) ||
+		POLYGON_IS_DETACHED(polygon))
+	{
+		return NONE;
+	}
+	
+	switch (polygon->type)
+	{
+		case _polygon_is_platform:
+			color= PLATFORM_IS_SECRET(get_platform_data(polygon->permutation)) ?
+				_polygon_color : _polygon_platform_color;
+			if (PLATFORM_IS_FLOODED(get_platform_data(polygon->permutation)))
+			{
+				short adj_index = find_flooding_polygon(polygon_index);
+				if (adj_index != NONE)
+				{
+					switch (get_polygon_data(adj_index)->type)
+					{
+						case _polygon_is_minor_ouch:
+							color = _polygon_minor_ouch_color;
+							break;
+						case _polygon_is_major_ouch:
+							color = _polygon_major_ouch_color;
+							break;
+					}
+				}
+			}
+			break;
+		
+		case _polygon_is_minor_ouch:
+			color = _polygon_minor_ouch_color;
+			break;
+		
+		case _polygon_is_major_ouch:
+			color = _polygon_major_ouch_color;
+			break;
+            
+		case _polygon_is_teleporter:
+			color = _polygon_teleporter_color;
+			break;
+            
+	case _polygon_is_hill:
+		color = _polygon_hill_color;
+		break;
+		
+		default:
+			color= _polygon_color;
+			break;
+	}
+
+	if (polygon->media_index!=NONE)
+	{
+		struct media_data *media= get_media_data(polygon->media_index);
+		
+		// LP change: idiot-proofing
+		if (media)
+		{
+			if (media->height>=polygon->floor_height)
+			{
+				switch (media->type)
+				{
+					case _media_water: color= _polygon_water_color; break;
+					case _media_lava: color= _polygon_lava_color; break;
+					case _media_goo: color= _polygon_goo_color; break;
+					// LP change: separated sewage and JjaroGoo
+					case _media_sewage: color= _polygon_sewage_color; break;
+					case _media_jjaro: color = _polygon_jjaro_color; break;
+				}
+			}
+		}
+	}
+	
+	return color;
+}
+
+
+// The color a line on the automap is drawn with, or NONE if it isn't drawn
+
+short OverheadMapClass::get_line_color(
+	short line_index)
+{
+	struct line_data *line= get_line_data(line_index);
+	struct polygon_data *clockwise_polygon, *counterclockwise_polygon;
+	short line_color= NONE;
+	
+	if (!LINE_IS_IN_AUTOMAP(line_index)) return NONE;
+	
+	clockwise_polygon= line->clockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->clockwise_polygon_owner);
+	counterclockwise_polygon= line->counterclockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->counterclockwise_polygon_owner);
+
+	if (LINE_IS_SOLID(line) || LINE_IS_VARIABLE_ELEVATION(line))
+	{
+		if (LINE_IS_LANDSCAPED(line))
+		{
+			if ((!clockwise_polygon||clockwise_polygon->floor_transfer_mode!=_xfer_landscape) &&
+				(!counterclockwise_polygon||counterclockwise_polygon->floor_transfer_mode!=_xfer_landscape))
+			{
+				line_color= _elevation_line_color;
+			}
+		}
+		else
+		{
+			line_color= _solid_line_color;
+		}
+	}
+	else
+	{
+		if (clockwise_polygon->floor_height!=counterclockwise_polygon->floor_height)
+		{
+			line_color= LINE_IS_LANDSCAPED(line) ? NONE : static_cast<short>(_elevation_line_color);
+		}
+	}
+	
+	return line_color;
+}
+
+
+// The polygons and lines of the game map are worked out every frame, which is cheap,
+// but only handed to the renderer when they (or the scale) change; with the translucent
+// map up during play, that's the difference between drawing the whole map every frame
+// and drawing it a few times a level.
+
+void OverheadMapClass::draw_static_layer(
+	overhead_map_data& Control)
+{
+	short scale= Control.scale;
+	bool changed= !LayerValid || scale!=LayerScale;
+	short i;
+	
+	NewLayerPolygons.clear();
+	for (i=0;i<dynamic_world->polygon_count;++i)
+	{
+		layer_item item;
+		
+		item.index= i;
+		item.color= get_polygon_color(i);
+		if (item.color!=NONE) NewLayerPolygons.push_back(item);
+	}
+	
+	NewLayerLines.clear();
+	for (i=0;i<dynamic_world->line_count;++i)
+	{
+		layer_item item;
+		
+		item.index= i;
+		item.color= get_line_color(i);
+		if (item.color!=NONE) NewLayerLines.push_back(item);
+	}
+	
+	// Kept in map order, so overlapping polygons draw as they always have; the renderers
+	// batch each run of adjacent items with the same color
+	if (NewLayerPolygons!=LayerPolygons || NewLayerLines!=LayerLines)
+	{
+		LayerPolygons.swap(NewLayerPolygons);
+		LayerLines.swap(NewLayerLines);
+		changed= true;
+	}
+	LayerScale= scale;
+	LayerValid= true;
+	
+	if (begin_static_layer(Control, changed))
+	{
+		transform_endpoints_for_static_layer(scale);
+		
+		begin_polygons();
+		for (size_t k=0; k<LayerPolygons.size(); ++k)
+		{
+			struct polygon_data *polygon= get_polygon_data(LayerPolygons[k].index);
+			draw_polygon(polygon->vertex_count, polygon->endpoint_indexes, LayerPolygons[k].color, scale);
+		}
+		end_polygons();
+		
+		begin_lines();
+		for (size_t k=0; k<LayerLines.size(); ++k)
+		{
+			draw_line(LayerLines[k].index, LayerLines[k].color, scale);
+		}
+		end_lines();
+	}
+	
+	end_static_layer(Control);
+}
+
+
+// Where the layer's origin is on the screen
+
+world_point2d OverheadMapClass::GetLayerOffset(
+	overhead_map_data& Control)
+{
+	world_point2d offset;
+	
+	offset.x= Control.left + Control.half_width - (Control.origin.x>>(WORLD_TO_SCREEN_SCALE_ONE-Control.scale));
+	offset.y= Control.top + Control.half_height - (Control.origin.y>>(WORLD_TO_SCREEN_SCALE_ONE-Control.scale));
+	
+	return offset;
+}
+
+
+void OverheadMapClass::transform_endpoints_for_static_layer(
+	short scale)
+{
+	short i;
+	
+	for (i=0;i<dynamic_world->endpoint_count;++i)
+	{
+		struct endpoint_data *endpoint= get_endpoint_data(i);
+		
+		endpoint->transformed.x= endpoint->vertex.x>>(WORLD_TO_SCREEN_SCALE_ONE-scale);
+		endpoint->transformed.y= endpoint->vertex.y>>(WORLD_TO_SCREEN_SCALE_ONE-scale);
+	}
+}
+
+
 void OverheadMapClass::transform_endpoints_for_overhead_map(
 	struct overhead_map_data& Control)
 {
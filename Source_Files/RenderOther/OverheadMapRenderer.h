@@ -38,6 +38,8 @@ Dec 17, 2000 (Loren Petrich):
 #include "shell.h"
 #include "FontHandler.h"
 
+#include <vector>
+
 
 /* ---------- constants */
 
@@ -167,6 +169,26 @@ class OverheadMapClass
 	
 	// For the false automap
 	byte *saved_automap_lines, *saved_automap_polygons;
+	
+	// The static layer: the game map's polygons and lines with their colors,
+	// in map order; the new ones are compared with these every frame
+	struct layer_item
+	{
+		short index, color;
+		
+		bool operator==(const layer_item& Item) const {return index==Item.index && color==Item.color;}
+		bool operator!=(const layer_item& Item) const {return !(*this==Item);}
+	};
+	
+	std::vector<layer_item> LayerPolygons, LayerLines;
+	std::vector<layer_item> NewLayerPolygons, NewLayerLines;
+	short LayerScale;
+	bool LayerValid;
+	
+	short get_polygon_color(short polygon_index);
+	short get_line_color(short line_index);
+	void draw_static_layer(overhead_map_data &Control);
+	void transform_endpoints_for_static_layer(short scale);
 
 protected:
 
@@ -219,6 +241,18 @@ protected:
 		FontSpecifier& FontData,
 		short justify) {}
 	
+	// The game map's polygons and lines are drawn as a layer, with coordinates relative to
+	// GetLayerOffset(), and only when begin_static_layer() asks for them; it's told when
+	// they have changed since the last frame, so a renderer can keep them and draw them
+	// from its own cache in end_static_layer().  Other maps are drawn as they always were.
+	virtual bool begin_static_layer(
+		overhead_map_data& Control,
+		bool changed) {return true;}
+	virtual void end_static_layer(
+		overhead_map_data& Control) {}
+	
+	world_point2d GetLayerOffset(overhead_map_data& Control);
+	
 	virtual void set_path_drawing(rgb_color& color) {}
 	virtual void draw_path(
 		short step,	// 0: first point
@@ -321,7 +355,11 @@ public:
 	void Render(overhead_map_data& Control);
 	
 	// Constructor (idiot-proofer)
-	OverheadMapClass(): ConfigPtr(NULL) {}
+	OverheadMapClass(): saved_automap_lines(NULL), saved_automap_polygons(NULL),
+		LayerScale(0), LayerValid(false), ConfigPtr(NULL) {}
+	
+	// Forget the static layer; for a new level, whose map may look just like the old one's
+	void InvalidateStaticLayer() {LayerValid = false;}
 
 	// Destructor
 	virtual ~OverheadMapClass() {}
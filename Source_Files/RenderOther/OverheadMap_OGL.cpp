@@ -100,6 +100,73 @@ static inline bool ColorsEqual(rgb_color& Color1, rgb_color& Color2)
 // these are defined in OGL_Render.cpp
 extern short ViewWidth, ViewHeight;
 
+bool OverheadMap_OGL_Class::begin_static_layer(
+	overhead_map_data& Control,
+	bool changed)
+{
+	if (!changed) return false;
+	
+	LayerPolygonBatches.clear();
+	LayerLineBatches.clear();
+	RecordingLayer = true;
+	return true;
+}
+
+void OverheadMap_OGL_Class::end_static_layer(
+	overhead_map_data& Control)
+{
+	RecordingLayer = false;
+	
+	world_point2d Offset = GetLayerOffset(Control);
+	
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glTranslatef(Offset.x,Offset.y,0);
+	
+	// Polygons, then the lines over them, as they were before
+	glDisable(GL_TEXTURE_2D);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	for (size_t k=0; k<LayerPolygonBatches.size(); k++)
+	{
+		LayerBatch& Batch = LayerPolygonBatches[k];
+		SetColor(Batch.Color);
+		glVertexPointer(2,GL_FLOAT,0,Batch.Triangles.data());
+		glDrawArrays(GL_TRIANGLES,0,Batch.Triangles.size()/2);
+	}
+	for (size_t k=0; k<LayerLineBatches.size(); k++)
+	{
+		LayerBatch& Batch = LayerLineBatches[k];
+		if (Batch.Triangles.empty()) continue;
+		SetColor(Batch.Color);
+		glVertexPointer(2,GL_FLOAT,0,Batch.Triangles.data());
+		glDrawArrays(GL_TRIANGLES,0,Batch.Triangles.size()/2);
+	}
+	
+	// OGL_RenderLines() leaves these on
+	if (!LayerLineBatches.empty())
+	{
+		glEnable(GL_TEXTURE_2D);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	
+	glPopMatrix();
+}
+
+// The batch to add to: the last one, if it has the same color and pen size
+OverheadMap_OGL_Class::LayerBatch& OverheadMap_OGL_Class::GetLayerBatch(
+	vector<LayerBatch>& Batches,
+	rgb_color& Color,
+	short PenSize)
+{
+	if (Batches.empty() || !ColorsEqual(Batches.back().Color,Color) || Batches.back().PenSize != PenSize)
+	{
+		Batches.push_back(LayerBatch());
+		Batches.back().Color = Color;
+		Batches.back().PenSize = PenSize;
+	}
+	return Batches.back();
+}
+
 void OverheadMap_OGL_Class::begin_overall()
 {
 
@@ -156,6 +223,21 @@ void OverheadMap_OGL_Class::draw_polygon(
 	short *vertices,
 	rgb_color& color)
 {
+	if (RecordingLayer)
+	{
+		vector<float>& Triangles = GetLayerBatch(LayerPolygonBatches,color,0).Triangles;
+		for (int k=2; k<vertex_count; k++)
+		{
+			world_point2d& v0 = GetVertex(vertices[0]);
+			world_point2d& v1 = GetVertex(vertices[k-1]);
+			world_point2d& v2 = GetVertex(vertices[k]);
+			Triangles.push_back(v0.x); Triangles.push_back(v0.y);
+			Triangles.push_back(v1.x); Triangles.push_back(v1.y);
+			Triangles.push_back(v2.x); Triangles.push_back(v2.y);
+		}
+		return;
+	}
+	
 	// Test whether the polygon parameters have changed
 	bool AreColorsEqual = ColorsEqual(color,SavedColor);
 	
@@ -181,6 +263,7 @@ void OverheadMap_OGL_Class::draw_polygon(
 
 void OverheadMap_OGL_Class::end_polygons()
 {
+	if (RecordingLayer) return;
 	DrawCachedPolygons();
 }
 
@@ -207,6 +290,14 @@ void OverheadMap_OGL_Class::draw_line(
 	rgb_color& color,
 	short pen_size)
 {
+	if (RecordingLayer)
+	{
+		vector<world_point2d>& LineEnds = GetLayerBatch(LayerLineBatches,color,pen_size).LineEnds;
+		LineEnds.push_back(GetVertex(vertices[0]));
+		LineEnds.push_back(GetVertex(vertices[1]));
+		return;
+	}
+	
 	// Test whether the line parameters have changed
 	bool AreColorsEqual = ColorsEqual(color,SavedColor);
 	bool AreLinesEquallyWide = (pen_size == SavedPenSize);
@@ -233,6 +324,16 @@ void OverheadMap_OGL_Class::draw_line(
 
 void OverheadMap_OGL_Class::end_lines()
 {
+	if (RecordingLayer)
+	{
+		for (size_t k=0; k<LayerLineBatches.size(); k++)
+		{
+			LayerBatch& Batch = LayerLineBatches[k];
+			OGL_GetLineTriangles(Batch.LineEnds,Batch.PenSize,Batch.Triangles);
+			Batch.LineEnds.clear();
+		}
+		return;
+	}
 	DrawCachedLines();
 }
 
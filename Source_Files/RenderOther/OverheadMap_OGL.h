@@ -35,6 +35,13 @@ Oct 13, 2000 (Loren Petrich)
 
 class OverheadMap_OGL_Class: public OverheadMapClass
 {
+	bool begin_static_layer(
+		overhead_map_data& Control,
+		bool changed);
+	
+	void end_static_layer(
+		overhead_map_data& Control);
+	
 	void begin_overall();
 	void end_overall();
 	
@@ -100,8 +107,23 @@ class OverheadMap_OGL_Class: public OverheadMapClass
 	
 	// Cached lines For drawing monster paths
 	vector<world_point2d> PathPoints;
-
+	
+	// The static layer, kept as triangles in one batch per color (and pen size, for lines);
+	// it's recorded instead of drawn when it changes, and drawn from here every frame
+	struct LayerBatch
+	{
+		rgb_color Color;
+		short PenSize;
+		vector<world_point2d> LineEnds;
+		vector<float> Triangles;
+	};
+	vector<LayerBatch> LayerPolygonBatches, LayerLineBatches;
+	bool RecordingLayer;
+	
+	LayerBatch& GetLayerBatch(vector<LayerBatch>& Batches, rgb_color& Color, short PenSize);
+	
 public:
+	OverheadMap_OGL_Class(): RecordingLayer(false) {}
 };
 
 #endif
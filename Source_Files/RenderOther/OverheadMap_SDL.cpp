@@ -33,6 +33,73 @@
 extern SDL_Surface *draw_surface;
 
 
+/*
+ *  Static layer
+ */
+
+bool OverheadMap_SDL_Class::begin_static_layer(overhead_map_data &Control, bool changed)
+{
+	world_point2d offset = GetLayerOffset(Control);
+	int margin_x = Control.width / 4, margin_y = Control.height / 4;
+	int layer_width = Control.width + 2 * margin_x, layer_height = Control.height + 2 * margin_y;
+	SDL_PixelFormat *format = draw_surface->format;
+
+	// Drop the layer if the map's size or pixel format changed
+	if (LayerSurface && (LayerSurface->w != layer_width || LayerSurface->h != layer_height ||
+		LayerSurface->format->BitsPerPixel != format->BitsPerPixel ||
+		LayerSurface->format->Rmask != format->Rmask ||
+		LayerSurface->format->Gmask != format->Gmask ||
+		LayerSurface->format->Bmask != format->Bmask)) {
+		SDL_FreeSurface(LayerSurface);
+		LayerSurface = NULL;
+		changed = true;
+	}
+
+	// Still good if the map hasn't scrolled past the margin
+	int x = LayerOrigin.x - offset.x + Control.left, y = LayerOrigin.y - offset.y + Control.top;
+	if (LayerSurface && !changed &&
+		x >= 0 && y >= 0 && x + Control.width <= layer_width && y + Control.height <= layer_height)
+		return false;
+
+	if (!LayerSurface) {
+		LayerSurface = SDL_CreateRGBSurface(SDL_SWSURFACE, layer_width, layer_height, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, 0);
+		if (LayerSurface)
+			SDL_SetSurfaceBlendMode(LayerSurface, SDL_BLENDMODE_NONE);
+	}
+
+	if (LayerSurface) {
+		// Centered on the map as it is now
+		SDL_FillRect(LayerSurface, NULL, SDL_MapRGB(LayerSurface->format, 0, 0, 0));
+		LayerOrigin.x = offset.x - Control.left + margin_x;
+		LayerOrigin.y = offset.y - Control.top + margin_y;
+	} else {
+		// No memory for it; draw it straight to the map
+		LayerOrigin = offset;
+	}
+	DrawingLayer = true;
+	return true;
+}
+
+void OverheadMap_SDL_Class::end_static_layer(overhead_map_data &Control)
+{
+	DrawingLayer = false;
+
+	// Without a layer surface, it was drawn straight to the map
+	if (!LayerSurface)
+		return;
+
+	world_point2d offset = GetLayerOffset(Control);
+	SDL_Rect source = {LayerOrigin.x - offset.x + Control.left, LayerOrigin.y - offset.y + Control.top, Control.width, Control.height};
+	SDL_Rect destination = {Control.left, Control.top, Control.width, Control.height};
+	SDL_BlitSurface(LayerSurface, &source, draw_surface, &destination);
+}
+
+SDL_Surface *OverheadMap_SDL_Class::target_surface()
+{
+	return DrawingLayer && LayerSurface ? LayerSurface : draw_surface;
+}
+
+
 /*
  *  Draw polygon
  */
@@ -48,15 +115,21 @@ void OverheadMap_SDL_Class::draw_polygon(short vertex_count, short *vertices, rg
 		max_vertices = vertex_count;
 	}
 
-	// Copy vertex array
-	for (int i=0; i<vertex_count; i++)
+	// Copy vertex array, moving layer vertices to where the layer is being drawn
+	for (int i=0; i<vertex_count; i++) {
 		vertex_array[i] = GetVertex(vertices[i]);
+		if (DrawingLayer) {
+			vertex_array[i].x += LayerOrigin.x;
+			vertex_array[i].y += LayerOrigin.y;
+		}
+	}
 
 	// Get color
-	uint32 pixel = SDL_MapRGB(draw_surface->format, color.red >> 8, color.green >> 8, color.blue >> 8);
+	SDL_Surface *s = target_surface();
+	uint32 pixel = SDL_MapRGB(s->format, color.red >> 8, color.green >> 8, color.blue >> 8);
 
 	// Draw polygon
-	::draw_polygon(draw_surface, vertex_array, vertex_count, pixel);
+	::draw_polygon(s, vertex_array, vertex_count, pixel);
 }
 
 
@@ -67,14 +140,21 @@ void OverheadMap_SDL_Class::draw_polygon(short vertex_count, short *vertices, rg
 void OverheadMap_SDL_Class::draw_line(short *vertices, rgb_color &color, short pen_size)
 {
 	// Get start and end points
-	world_point2d *v1 = &GetVertex(vertices[0]);
-	world_point2d *v2 = &GetVertex(vertices[1]);
+	world_point2d v1 = GetVertex(vertices[0]);
+	world_point2d v2 = GetVertex(vertices[1]);
+	if (DrawingLayer) {
+		v1.x += LayerOrigin.x;
+		v1.y += LayerOrigin.y;
+		v2.x += LayerOrigin.x;
+		v2.y += LayerOrigin.y;
+	}
 
 	// Get color
-	uint32 pixel = SDL_MapRGB(draw_surface->format, color.red >> 8, color.green >> 8, color.blue >> 8);
+	SDL_Surface *s = target_surface();
+	uint32 pixel = SDL_MapRGB(s->format, color.red >> 8, color.green >> 8, color.blue >> 8);
 
 	// Draw line
-	::draw_line(draw_surface, v1, v2, pixel, pen_size);
+	::draw_line(s, &v1, &v2, pixel, pen_size);
 }
 
 
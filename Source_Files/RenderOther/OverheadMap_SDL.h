@@ -30,7 +30,17 @@
 
 
 class OverheadMap_SDL_Class : public OverheadMapClass {
+public:
+	OverheadMap_SDL_Class() : LayerSurface(NULL), DrawingLayer(false) {}
+
 protected:
+	bool begin_static_layer(
+		overhead_map_data &Control,
+		bool changed);
+
+	void end_static_layer(
+		overhead_map_data &Control);
+
 	void draw_polygon(
 		short vertex_count,
 		short *vertices,
@@ -71,8 +81,16 @@ protected:
 		world_point2d &location);
 
 private:
+	SDL_Surface *target_surface();
+
 	uint32 path_pixel;
 	world_point2d path_point;
+
+	// The static layer, drawn with a margin around the map so that it can scroll
+	// a while before it has to be drawn again
+	SDL_Surface *LayerSurface;
+	world_point2d LayerOrigin;	// where the layer's (0, 0) is drawn
+	bool DrawingLayer;
 };
 
 #endif
@@ -616,6 +616,18 @@ bool player_in_terminal_mode(
 	return in_terminal_mode;
 }
 
+void *get_player_terminal_array(
+	void)
+{
+	return player_terminals;
+}
+
+int32 calculate_player_terminal_array_length(
+	void)
+{
+	return MAXIMUM_NUMBER_OF_PLAYERS*sizeof(struct player_terminal_data);
+}
+
 void _render_computer_interface(void)
 {
 	struct player_terminal_data *terminal_data= get_player_terminal_data(current_player_index);
@@ -109,6 +109,10 @@ void abort_terminal_mode(short player_index);
 
 bool player_in_terminal_mode(short player_index);
 
+// the unpacked terminal state of every player, for world snapshots
+void *get_player_terminal_array(void);
+int32 calculate_player_terminal_array_length(void);
+
 // LP: to pack and unpack this data;
 // these hide the unpacked data from the outside world.
 // "Map terminal" means the terminal data read in from the map;
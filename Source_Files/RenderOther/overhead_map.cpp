@@ -340,6 +340,15 @@ void _render_overhead_map(
 }
 
 
+void ResetOverheadMapLayers()
+{
+	OverheadMap_SW.InvalidateStaticLayer();
+#ifdef HAVE_OPENGL
+	OverheadMap_OGL.InvalidateStaticLayer();
+#endif
+}
+
+
 void ResetOverheadMap()
 {
 	// Default: nothing (mapping is cumulative)
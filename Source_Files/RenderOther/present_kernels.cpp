@@ -0,0 +1,916 @@
+/*
+PRESENT_KERNELS.CPP
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	the old gamma loop took each field of a pixel up to 8 bits, through its ramp and back
+	down into the destination's field; every step of that depends only on the field (or,
+	for 16-bit pixels, only on the pixel), so the tables hold exactly what it computed and
+	are rebuilt whenever the ramps (they change every tick of a fade) or the layouts do.
+	pixels that don't fit the tables (mixed depths, fields wider than 8 bits) still go
+	through the old loop.
+
+	x86 has no 16-bit gather, so the AVX2 16-bit kernel gathers 32 bits at a time out of
+	the 64K table (which has a spare entry at the end for the last one to read into) and
+	keeps the low half.
+*/
+
+#include "cseries.h"
+#include "present_kernels.h"
+#include "preferences.h"
+#include "world.h"
+
+#include <string.h>
+#include <math.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_PRESENT_KERNELS
+#include <immintrin.h>
+#define SSE2_FUNCTION __attribute__((target("sse2")))
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HAVE_PRESENT_KERNELS
+#include <immintrin.h>
+#define SSE2_FUNCTION
+#define AVX2_FUNCTION
+#endif
+
+/* ---------- constants */
+
+enum
+{
+	MAXIMUM_PRESENT_THREADS= 8,
+	PRESENT_THREADING_PIXELS= 1920*1080, /* frames bigger than this are split among threads */
+	BENCHMARK_PASSES= 20
+};
+
+/* ---------- structures */
+
+struct pixel_layout
+{
+	int bytes_per_pixel;
+	uint32 mask[3];
+	uint8 shift[3], loss[3];
+};
+
+struct gamma_lookup
+{
+	bool valid;
+	uint16 ramps[3][256];
+	pixel_layout source, destination;
+
+	bool whole_pixels; /* 16-bit, through pixels16 */
+	bool fields; /* 32-bit, through fields32 */
+
+	std::vector<uint16> pixels16;
+	uint32 fields32[3][256];
+};
+
+struct present_kernel_set
+{
+	const char *name;
+
+	void (*gamma16)(const uint16 *src, uint16 *dst, int count, const gamma_lookup& lookup);
+	void (*gamma32)(const uint32 *src, uint32 *dst, int count, const gamma_lookup& lookup);
+
+	/* src's pixels twice each into both rows */
+	void (*quadruple8)(const pixel8 *src, pixel8 *dst0, pixel8 *dst1, int count);
+	void (*quadruple16)(const pixel16 *src, pixel16 *dst0, pixel16 *dst1, int count);
+	void (*quadruple32)(const pixel32 *src, pixel32 *dst0, pixel32 *dst1, int count);
+};
+
+struct gamma_job
+{
+	const gamma_lookup *lookup;
+	const struct present_kernel_set *kernels; /* NULL for the old loop */
+	SDL_Surface *src, *dst;
+};
+
+struct quadruple_job
+{
+	const struct present_kernel_set *kernels; /* NULL for the old loop */
+	SDL_Surface *src, *dst;
+	SDL_Rect rect;
+};
+
+typedef void (*row_procedure)(void *job, int first_row, int last_row);
+
+struct present_worker
+{
+	SDL_Thread *thread;
+	SDL_sem *start, *finished;
+
+	row_procedure procedure;
+	void *job;
+	int first_row, last_row;
+	bool quit;
+};
+
+/* ---------- globals */
+
+static const struct present_kernel_set *active_present_kernels= NULL;
+
+static gamma_lookup gamma_tables;
+
+static std::vector<present_worker *> present_workers;
+
+/* ---------- private prototypes */
+
+static void gamma_correct(SDL_Surface *src, SDL_Surface *dst, const uint16 *red, const uint16 *green,
+	const uint16 *blue, const struct present_kernel_set *kernels, int16 thread_count);
+static void quadruple(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect,
+	const struct present_kernel_set *kernels, int16 thread_count);
+
+static void get_pixel_layout(const SDL_PixelFormat *format, pixel_layout *layout);
+static bool pixel_layouts_equal(const pixel_layout& a, const pixel_layout& b);
+static void update_gamma_lookup(gamma_lookup& lookup, const SDL_PixelFormat *source, const SDL_PixelFormat *destination,
+	const uint16 *red, const uint16 *green, const uint16 *blue);
+static inline uint32 gamma_correct_pixel(const gamma_lookup& lookup, uint32 pixel);
+
+static void gamma_rows(void *job, int first_row, int last_row);
+static void quadruple_rows(void *job, int first_row, int last_row);
+
+static int16 present_thread_count(size_t pixel_count);
+static void split_rows(int row_count, int16 thread_count, row_procedure procedure, void *job);
+static int present_worker_loop(void *data);
+static void stop_present_workers(void);
+
+static const struct present_kernel_set *get_present_kernel_set(int16 kernels);
+static bool present_kernels_available(int16 kernels);
+
+/* ---------- scalar kernels */
+
+static void scalar_gamma16(
+	const uint16 *src,
+	uint16 *dst,
+	int count,
+	const gamma_lookup& lookup)
+{
+	const uint16 *table= &lookup.pixels16[0];
+
+	for (int i= 0; i<count; ++i) dst[i]= table[src[i]];
+}
+
+static void scalar_gamma32(
+	const uint32 *src,
+	uint32 *dst,
+	int count,
+	const gamma_lookup& lookup)
+{
+	const pixel_layout& layout= lookup.source;
+
+	for (int i= 0; i<count; ++i)
+	{
+		uint32 pixel= src[i];
+
+		dst[i]= lookup.fields32[0][(pixel&layout.mask[0])>>layout.shift[0]] |
+			lookup.fields32[1][(pixel&layout.mask[1])>>layout.shift[1]] |
+			lookup.fields32[2][(pixel&layout.mask[2])>>layout.shift[2]];
+	}
+}
+
+template <class T>
+static void scalar_quadruple(
+	const T *src,
+	T *dst0,
+	T *dst1,
+	int count)
+{
+	for (int x= 0; x<count; ++x)
+	{
+		T p= src[x];
+		dst0[x*2]= dst0[x*2+1]= p;
+		dst1[x*2]= dst1[x*2+1]= p;
+	}
+}
+
+static const struct present_kernel_set scalar_present_kernels=
+{
+	"scalar",
+	scalar_gamma16, scalar_gamma32,
+	scalar_quadruple<pixel8>, scalar_quadruple<pixel16>, scalar_quadruple<pixel32>
+};
+
+#ifdef HAVE_PRESENT_KERNELS
+
+/* ---------- SSE2 kernels */
+
+/* SSE2 can't gather, so gamma stays with the tables a pixel at a time */
+
+SSE2_FUNCTION static void sse2_quadruple8(
+	const pixel8 *src,
+	pixel8 *dst0,
+	pixel8 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+16<=count; x+= 16)
+	{
+		__m128i pixels= _mm_loadu_si128((const __m128i *) (src+x));
+		__m128i low= _mm_unpacklo_epi8(pixels, pixels);
+		__m128i high= _mm_unpackhi_epi8(pixels, pixels);
+
+		_mm_storeu_si128((__m128i *) (dst0+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst0+2*x+16), high);
+		_mm_storeu_si128((__m128i *) (dst1+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst1+2*x+16), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+SSE2_FUNCTION static void sse2_quadruple16(
+	const pixel16 *src,
+	pixel16 *dst0,
+	pixel16 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+8<=count; x+= 8)
+	{
+		__m128i pixels= _mm_loadu_si128((const __m128i *) (src+x));
+		__m128i low= _mm_unpacklo_epi16(pixels, pixels);
+		__m128i high= _mm_unpackhi_epi16(pixels, pixels);
+
+		_mm_storeu_si128((__m128i *) (dst0+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst0+2*x+8), high);
+		_mm_storeu_si128((__m128i *) (dst1+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst1+2*x+8), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+SSE2_FUNCTION static void sse2_quadruple32(
+	const pixel32 *src,
+	pixel32 *dst0,
+	pixel32 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+4<=count; x+= 4)
+	{
+		__m128i pixels= _mm_loadu_si128((const __m128i *) (src+x));
+		__m128i low= _mm_unpacklo_epi32(pixels, pixels);
+		__m128i high= _mm_unpackhi_epi32(pixels, pixels);
+
+		_mm_storeu_si128((__m128i *) (dst0+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst0+2*x+4), high);
+		_mm_storeu_si128((__m128i *) (dst1+2*x), low);
+		_mm_storeu_si128((__m128i *) (dst1+2*x+4), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+static const struct present_kernel_set sse2_present_kernels=
+{
+	"SSE2",
+	scalar_gamma16, scalar_gamma32,
+	sse2_quadruple8, sse2_quadruple16, sse2_quadruple32
+};
+
+/* ---------- AVX2 kernels */
+
+AVX2_FUNCTION static void avx2_gamma16(
+	const uint16 *src,
+	uint16 *dst,
+	int count,
+	const gamma_lookup& lookup)
+{
+	const int *table= (const int *) &lookup.pixels16[0];
+	const __m256i low_half= _mm256_set1_epi32(0xffff);
+	int i= 0;
+
+	for (; i+16<=count; i+= 16)
+	{
+		__m256i pixels= _mm256_loadu_si256((const __m256i *) (src+i));
+		__m256i first= _mm256_cvtepu16_epi32(_mm256_castsi256_si128(pixels));
+		__m256i second= _mm256_cvtepu16_epi32(_mm256_extracti128_si256(pixels, 1));
+
+		first= _mm256_and_si256(_mm256_i32gather_epi32(table, first, 2), low_half);
+		second= _mm256_and_si256(_mm256_i32gather_epi32(table, second, 2), low_half);
+
+		/* packus works within each 128-bit half; put the quarters back in order */
+		__m256i packed= _mm256_permute4x64_epi64(_mm256_packus_epi32(first, second), 0xd8);
+		_mm256_storeu_si256((__m256i *) (dst+i), packed);
+	}
+	scalar_gamma16(src+i, dst+i, count-i, lookup);
+}
+
+AVX2_FUNCTION static void avx2_gamma32(
+	const uint32 *src,
+	uint32 *dst,
+	int count,
+	const gamma_lookup& lookup)
+{
+	const pixel_layout& layout= lookup.source;
+	__m128i shifts[3];
+	__m256i masks[3];
+	int i= 0;
+
+	for (int field= 0; field<3; ++field)
+	{
+		shifts[field]= _mm_cvtsi32_si128(layout.shift[field]);
+		masks[field]= _mm256_set1_epi32(layout.mask[field]>>layout.shift[field]);
+	}
+
+	for (; i+8<=count; i+= 8)
+	{
+		__m256i pixels= _mm256_loadu_si256((const __m256i *) (src+i));
+		__m256i result= _mm256_setzero_si256();
+
+		for (int field= 0; field<3; ++field)
+		{
+			__m256i index= _mm256_and_si256(_mm256_srl_epi32(pixels, shifts[field]), masks[field]);
+			result= _mm256_or_si256(result, _mm256_i32gather_epi32((const int *) lookup.fields32[field], index, 4));
+		}
+		_mm256_storeu_si256((__m256i *) (dst+i), result);
+	}
+	scalar_gamma32(src+i, dst+i, count-i, lookup);
+}
+
+/* unpack works within each 128-bit half, so the 64-bit quarters go in as 0, 2, 1, 3 to
+	come out as 0011 2233 and 4455 6677 */
+AVX2_FUNCTION static void avx2_quadruple8(
+	const pixel8 *src,
+	pixel8 *dst0,
+	pixel8 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+32<=count; x+= 32)
+	{
+		__m256i pixels= _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (src+x)), 0xd8);
+		__m256i low= _mm256_unpacklo_epi8(pixels, pixels);
+		__m256i high= _mm256_unpackhi_epi8(pixels, pixels);
+
+		_mm256_storeu_si256((__m256i *) (dst0+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst0+2*x+32), high);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x+32), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+AVX2_FUNCTION static void avx2_quadruple16(
+	const pixel16 *src,
+	pixel16 *dst0,
+	pixel16 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+16<=count; x+= 16)
+	{
+		__m256i pixels= _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (src+x)), 0xd8);
+		__m256i low= _mm256_unpacklo_epi16(pixels, pixels);
+		__m256i high= _mm256_unpackhi_epi16(pixels, pixels);
+
+		_mm256_storeu_si256((__m256i *) (dst0+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst0+2*x+16), high);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x+16), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+AVX2_FUNCTION static void avx2_quadruple32(
+	const pixel32 *src,
+	pixel32 *dst0,
+	pixel32 *dst1,
+	int count)
+{
+	int x= 0;
+
+	for (; x+8<=count; x+= 8)
+	{
+		__m256i pixels= _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (src+x)), 0xd8);
+		__m256i low= _mm256_unpacklo_epi32(pixels, pixels);
+		__m256i high= _mm256_unpackhi_epi32(pixels, pixels);
+
+		_mm256_storeu_si256((__m256i *) (dst0+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst0+2*x+8), high);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x), low);
+		_mm256_storeu_si256((__m256i *) (dst1+2*x+8), high);
+	}
+	scalar_quadruple(src+x, dst0+2*x, dst1+2*x, count-x);
+}
+
+static const struct present_kernel_set avx2_present_kernels=
+{
+	"AVX2",
+	avx2_gamma16, avx2_gamma32,
+	avx2_quadruple8, avx2_quadruple16, avx2_quadruple32
+};
+
+#endif
+
+/* ---------- code */
+
+void choose_present_kernels(
+	void)
+{
+	int16 kernels;
+
+	for (kernels= NUMBER_OF_PRESENT_KERNEL_SETS-1; kernels>_present_kernels_scalar; --kernels)
+	{
+		if (present_kernels_available(kernels)) break;
+	}
+	active_present_kernels= get_present_kernel_set(kernels);
+}
+
+const char *get_present_kernels_name(
+	int16 kernels)
+{
+	if (kernels==NONE) return "per-pixel";
+
+	const struct present_kernel_set *set= get_present_kernel_set(kernels);
+	return set ? set->name : "unavailable";
+}
+
+void gamma_correct_surface(
+	SDL_Surface *src,
+	SDL_Surface *dst,
+	const uint16 *red,
+	const uint16 *green,
+	const uint16 *blue)
+{
+	if (!active_present_kernels) choose_present_kernels();
+
+	gamma_correct(src, dst, red, green, blue, active_present_kernels, present_thread_count(src->w*src->h));
+}
+
+void quadruple_surface(
+	SDL_Surface *src,
+	SDL_Surface *dst,
+	const SDL_Rect& dst_rect)
+{
+	if (!active_present_kernels) choose_present_kernels();
+
+	quadruple(src, dst, dst_rect, active_present_kernels, present_thread_count(dst_rect.w*dst_rect.h));
+}
+
+void benchmark_present_kernels(
+	short depth,
+	int width,
+	int height,
+	std::vector<present_benchmark>& results)
+{
+	uint32 red_mask= depth==16 ? 0xf800 : 0xff0000;
+	uint32 green_mask= depth==16 ? 0x07e0 : 0x00ff00;
+	uint32 blue_mask= depth==16 ? 0x001f : 0x0000ff;
+	SDL_Surface *source= SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, depth, red_mask, green_mask, blue_mask, 0);
+	SDL_Surface *corrected= SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, depth, red_mask, green_mask, blue_mask, 0);
+	SDL_Surface *quadrupled= SDL_CreateRGBSurface(SDL_SWSURFACE, 2*width, 2*height, depth, red_mask, green_mask, blue_mask, 0);
+	std::vector<byte> reference_corrected, reference_quadrupled;
+	uint16 ramps[3][256];
+	int16 thread_count= graphics_preferences->software_render_threads;
+
+	results.clear();
+	if (!source || !corrected || !quadrupled) goto done;
+
+	/* noise through a darkening ramp, a bit different for each field, like a fade's */
+	for (int row= 0; row<height; ++row)
+	{
+		uint8 *pixels= (uint8 *) source->pixels + row*source->pitch;
+		for (int i= 0; i<width*source->format->BytesPerPixel; ++i) pixels[i]= local_random();
+	}
+	for (int field= 0; field<3; ++field)
+	{
+		for (int i= 0; i<256; ++i) ramps[field][i]= (uint16) (65535.0*pow(i/255.0, 1.2+0.1*field));
+	}
+
+	if (thread_count<=0) thread_count= SDL_GetCPUCount();
+	thread_count= PIN(thread_count, 1, MAXIMUM_PRESENT_THREADS);
+
+	for (int16 kernels= NONE; kernels<NUMBER_OF_PRESENT_KERNEL_SETS; ++kernels)
+	{
+		const struct present_kernel_set *set= kernels==NONE ? NULL : get_present_kernel_set(kernels);
+		if (kernels!=NONE && !set) continue;
+
+		for (int16 threads= 1; threads<=thread_count; threads= threads==1 && thread_count>1 ? thread_count : threads+thread_count)
+		{
+			struct present_benchmark result;
+			SDL_Rect rect= { 0, 0, 2*width, 2*height };
+
+			result.kernels= kernels;
+			result.thread_count= threads;
+
+			uint64 start= machine_microsecond_count();
+			for (int pass= 0; pass<BENCHMARK_PASSES; ++pass)
+			{
+				gamma_correct(source, corrected, ramps[0], ramps[1], ramps[2], set, threads);
+			}
+			uint64 gamma_microseconds= MAX(machine_microsecond_count()-start, 1);
+
+			start= machine_microsecond_count();
+			for (int pass= 0; pass<BENCHMARK_PASSES; ++pass)
+			{
+				quadruple(corrected, quadrupled, rect, set, threads);
+			}
+			uint64 quadruple_microseconds= MAX(machine_microsecond_count()-start, 1);
+
+			result.gamma_megapixels= (double) width*height*BENCHMARK_PASSES/gamma_microseconds;
+			result.quadruple_megapixels= 4.0*width*height*BENCHMARK_PASSES/quadruple_microseconds;
+
+			std::vector<byte> corrected_pixels, quadrupled_pixels;
+			for (int row= 0; row<height; ++row)
+			{
+				byte *pixels= (byte *) corrected->pixels + row*corrected->pitch;
+				corrected_pixels.insert(corrected_pixels.end(), pixels, pixels+width*corrected->format->BytesPerPixel);
+			}
+			for (int row= 0; row<2*height; ++row)
+			{
+				byte *pixels= (byte *) quadrupled->pixels + row*quadrupled->pitch;
+				quadrupled_pixels.insert(quadrupled_pixels.end(), pixels, pixels+2*width*quadrupled->format->BytesPerPixel);
+			}
+			if (kernels==NONE)
+			{
+				reference_corrected.swap(corrected_pixels);
+				reference_quadrupled.swap(quadrupled_pixels);
+				result.matches_reference= true;
+			}
+			else
+			{
+				result.matches_reference= corrected_pixels==reference_corrected && quadrupled_pixels==reference_quadrupled;
+			}
+
+			results.push_back(result);
+			if (kernels==NONE) break; /* the old loops only ever ran on one thread */
+		}
+	}
+
+done:
+	if (source) SDL_FreeSurface(source);
+	if (corrected) SDL_FreeSurface(corrected);
+	if (quadrupled) SDL_FreeSurface(quadrupled);
+}
+
+/* ---------- private code */
+
+static void gamma_correct(
+	SDL_Surface *src,
+	SDL_Surface *dst,
+	const uint16 *red,
+	const uint16 *green,
+	const uint16 *blue,
+	const struct present_kernel_set *kernels,
+	int16 thread_count)
+{
+	if (SDL_MUSTLOCK(dst))
+	{
+		if (SDL_LockSurface(dst)<0) return;
+	}
+
+	update_gamma_lookup(gamma_tables, src->format, dst->format, red, green, blue);
+	if (gamma_tables.source.bytes_per_pixel==2 || gamma_tables.source.bytes_per_pixel==4)
+	{
+		gamma_job job;
+
+		job.lookup= &gamma_tables;
+		job.kernels= kernels;
+		job.src= src;
+		job.dst= dst;
+		split_rows(MIN(src->h, dst->h), thread_count, gamma_rows, &job);
+	}
+
+	if (SDL_MUSTLOCK(dst))
+		SDL_UnlockSurface(dst);
+}
+
+static void quadruple(
+	SDL_Surface *src,
+	SDL_Surface *dst,
+	const SDL_Rect& dst_rect,
+	const struct present_kernel_set *kernels,
+	int16 thread_count)
+{
+	quadruple_job job;
+
+	job.kernels= kernels;
+	job.src= src;
+	job.dst= dst;
+	job.rect= dst_rect;
+	split_rows(dst_rect.h/2, thread_count, quadruple_rows, &job);
+}
+
+static void get_pixel_layout(
+	const SDL_PixelFormat *format,
+	pixel_layout *layout)
+{
+	layout->bytes_per_pixel= format->BytesPerPixel;
+	layout->mask[0]= format->Rmask, layout->shift[0]= format->Rshift, layout->loss[0]= format->Rloss;
+	layout->mask[1]= format->Gmask, layout->shift[1]= format->Gshift, layout->loss[1]= format->Gloss;
+	layout->mask[2]= format->Bmask, layout->shift[2]= format->Bshift, layout->loss[2]= format->Bloss;
+}
+
+static bool pixel_layouts_equal(
+	const pixel_layout& a,
+	const pixel_layout& b)
+{
+	if (a.bytes_per_pixel!=b.bytes_per_pixel) return false;
+	for (int field= 0; field<3; ++field)
+	{
+		if (a.mask[field]!=b.mask[field] || a.shift[field]!=b.shift[field] || a.loss[field]!=b.loss[field]) return false;
+	}
+
+	return true;
+}
+
+static void update_gamma_lookup(
+	gamma_lookup& lookup,
+	const SDL_PixelFormat *source,
+	const SDL_PixelFormat *destination,
+	const uint16 *red,
+	const uint16 *green,
+	const uint16 *blue)
+{
+	pixel_layout source_layout, destination_layout;
+
+	get_pixel_layout(source, &source_layout);
+	get_pixel_layout(destination, &destination_layout);
+	if (lookup.valid && pixel_layouts_equal(source_layout, lookup.source) &&
+		pixel_layouts_equal(destination_layout, lookup.destination) &&
+		!memcmp(red, lookup.ramps[0], sizeof(lookup.ramps[0])) &&
+		!memcmp(green, lookup.ramps[1], sizeof(lookup.ramps[1])) &&
+		!memcmp(blue, lookup.ramps[2], sizeof(lookup.ramps[2])))
+	{
+		return;
+	}
+
+	lookup.valid= true;
+	lookup.source= source_layout;
+	lookup.destination= destination_layout;
+	memcpy(lookup.ramps[0], red, sizeof(lookup.ramps[0]));
+	memcpy(lookup.ramps[1], green, sizeof(lookup.ramps[1]));
+	memcpy(lookup.ramps[2], blue, sizeof(lookup.ramps[2]));
+
+	lookup.whole_pixels= source_layout.bytes_per_pixel==2 && destination_layout.bytes_per_pixel==2;
+	lookup.fields= source_layout.bytes_per_pixel==4 && destination_layout.bytes_per_pixel==4;
+	for (int field= 0; field<3; ++field)
+	{
+		if ((source_layout.mask[field]>>source_layout.shift[field])>255) lookup.fields= false;
+	}
+
+	if (lookup.whole_pixels)
+	{
+		lookup.pixels16.resize(65536+1);
+		for (uint32 pixel= 0; pixel<65536; ++pixel) lookup.pixels16[pixel]= gamma_correct_pixel(lookup, pixel);
+		lookup.pixels16[65536]= 0;
+	}
+	if (lookup.fields)
+	{
+		for (int field= 0; field<3; ++field)
+		{
+			for (uint32 value= 0; value<256; ++value)
+			{
+				/* this field alone, keeping only what lands in its own destination field */
+				uint32 pixel= (value<<source_layout.shift[field])&source_layout.mask[field];
+				lookup.fields32[field][value]= gamma_correct_pixel(lookup, pixel) & destination_layout.mask[field];
+			}
+		}
+	}
+}
+
+/* the old loop, a pixel at a time */
+static inline uint32 gamma_correct_pixel(
+	const gamma_lookup& lookup,
+	uint32 pixel)
+{
+	const pixel_layout& s= lookup.source;
+	const pixel_layout& d= lookup.destination;
+	uint8 src_r, src_g, src_b;
+	uint8 dst_r, dst_g, dst_b;
+
+	src_r= ((pixel & s.mask[0]) >> s.shift[0]) << s.loss[0];
+	src_g= ((pixel & s.mask[1]) >> s.shift[1]) << s.loss[1];
+	src_b= ((pixel & s.mask[2]) >> s.shift[2]) << s.loss[2];
+	dst_r= lookup.ramps[0][src_r] >> 8;
+	dst_g= lookup.ramps[1][src_g] >> 8;
+	dst_b= lookup.ramps[2][src_b] >> 8;
+
+	return (((dst_r >> d.loss[0]) << d.shift[0]) & d.mask[0]) |
+		(((dst_g >> d.loss[1]) << d.shift[1]) & d.mask[1]) |
+		(((dst_b >> d.loss[2]) << d.shift[2]) & d.mask[2]);
+}
+
+static void gamma_rows(
+	void *data,
+	int first_row,
+	int last_row)
+{
+	gamma_job *job= (gamma_job *) data;
+	const gamma_lookup& lookup= *job->lookup;
+	int width= MIN(job->src->w, job->dst->w);
+
+	for (int row= first_row; row<last_row; ++row)
+	{
+		uint8 *src= (uint8 *) job->src->pixels + row*job->src->pitch;
+		uint8 *dst= (uint8 *) job->dst->pixels + row*job->dst->pitch;
+
+		if (job->kernels && lookup.whole_pixels)
+		{
+			job->kernels->gamma16((const uint16 *) src, (uint16 *) dst, width, lookup);
+		}
+		else if (job->kernels && lookup.fields)
+		{
+			job->kernels->gamma32((const uint32 *) src, (uint32 *) dst, width, lookup);
+		}
+		else
+		{
+			for (int x= 0; x<width; ++x)
+			{
+				uint32 pixel= lookup.source.bytes_per_pixel==2 ? ((uint16 *) src)[x] : ((uint32 *) src)[x];
+				uint32 corrected= gamma_correct_pixel(lookup, pixel);
+
+				switch (lookup.destination.bytes_per_pixel)
+				{
+					case 2: ((uint16 *) dst)[x]= corrected; break;
+					case 4: ((uint32 *) dst)[x]= corrected; break;
+				}
+			}
+		}
+	}
+}
+
+static void quadruple_rows(
+	void *data,
+	int first_row,
+	int last_row)
+{
+	quadruple_job *job= (quadruple_job *) data;
+	const struct present_kernel_set *kernels= job->kernels ? job->kernels : &scalar_present_kernels;
+	int width= job->rect.w/2;
+	int bytes_per_pixel= job->src->format->BytesPerPixel;
+
+	for (int row= first_row; row<last_row; ++row)
+	{
+		const uint8 *src= (const uint8 *) job->src->pixels + row*job->src->pitch;
+		uint8 *dst0= (uint8 *) job->dst->pixels + (job->rect.y+2*row)*job->dst->pitch + job->rect.x*bytes_per_pixel;
+		uint8 *dst1= dst0 + job->dst->pitch;
+
+		switch (bytes_per_pixel)
+		{
+			case 1:
+				kernels->quadruple8((const pixel8 *) src, (pixel8 *) dst0, (pixel8 *) dst1, width);
+				break;
+			case 2:
+				kernels->quadruple16((const pixel16 *) src, (pixel16 *) dst0, (pixel16 *) dst1, width);
+				break;
+			case 4:
+				kernels->quadruple32((const pixel32 *) src, (pixel32 *) dst0, (pixel32 *) dst1, width);
+				break;
+		}
+	}
+}
+
+static int16 present_thread_count(
+	size_t pixel_count)
+{
+	if (pixel_count<=PRESENT_THREADING_PIXELS) return 1;
+
+	int16 thread_count= graphics_preferences->software_render_threads;
+	if (thread_count<=0) thread_count= SDL_GetCPUCount();
+
+	return PIN(thread_count, 1, MAXIMUM_PRESENT_THREADS);
+}
+
+/* rows [0, row_count) in thread_count bands; the first band is ours */
+static void split_rows(
+	int row_count,
+	int16 thread_count,
+	row_procedure procedure,
+	void *job)
+{
+	thread_count= PIN(thread_count, 1, MAX(row_count, 1));
+	while ((int16) present_workers.size()<thread_count-1)
+	{
+		present_worker *worker= new present_worker;
+
+		worker->start= SDL_CreateSemaphore(0);
+		worker->finished= SDL_CreateSemaphore(0);
+		worker->quit= false;
+		worker->thread= worker->start && worker->finished ?
+			SDL_CreateThread(present_worker_loop, "present_rows", worker) : NULL;
+		if (!worker->thread)
+		{
+			if (worker->start) SDL_DestroySemaphore(worker->start);
+			if (worker->finished) SDL_DestroySemaphore(worker->finished);
+			delete worker;
+			break;
+		}
+		if (present_workers.empty()) atexit(stop_present_workers);
+		present_workers.push_back(worker);
+	}
+	thread_count= MIN(thread_count, (int16) present_workers.size()+1);
+
+	for (int16 band= 1; band<thread_count; ++band)
+	{
+		present_worker *worker= present_workers[band-1];
+
+		worker->procedure= procedure;
+		worker->job= job;
+		worker->first_row= (row_count*band)/thread_count;
+		worker->last_row= (row_count*(band+1))/thread_count;
+		SDL_SemPost(worker->start);
+	}
+
+	procedure(job, 0, row_count/thread_count);
+
+	for (int16 band= 1; band<thread_count; ++band)
+	{
+		SDL_SemWait(present_workers[band-1]->finished);
+	}
+}
+
+static int present_worker_loop(
+	void *data)
+{
+	present_worker *worker= (present_worker *) data;
+
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+		if (worker->quit) break;
+
+		worker->procedure(worker->job, worker->first_row, worker->last_row);
+		SDL_SemPost(worker->finished);
+	}
+
+	return 0;
+}
+
+static void stop_present_workers(
+	void)
+{
+	for (size_t i= 0; i<present_workers.size(); ++i)
+	{
+		present_worker *worker= present_workers[i];
+
+		worker->quit= true;
+		SDL_SemPost(worker->start);
+		SDL_WaitThread(worker->thread, NULL);
+		SDL_DestroySemaphore(worker->start);
+		SDL_DestroySemaphore(worker->finished);
+		delete worker;
+	}
+	present_workers.clear();
+}
+
+static const struct present_kernel_set *get_present_kernel_set(
+	int16 kernels)
+{
+	if (!present_kernels_available(kernels)) return NULL;
+
+	switch (kernels)
+	{
+		case _present_kernels_scalar: return &scalar_present_kernels;
+#ifdef HAVE_PRESENT_KERNELS
+		case _present_kernels_sse2: return &sse2_present_kernels;
+		case _present_kernels_avx2: return &avx2_present_kernels;
+#endif
+		default: return NULL;
+	}
+}
+
+static bool present_kernels_available(
+	int16 kernels)
+{
+	switch (kernels)
+	{
+		case _present_kernels_scalar:
+			return true;
+
+#ifdef HAVE_PRESENT_KERNELS
+		case _present_kernels_sse2:
+			return SDL_HasSSE2();
+
+		case _present_kernels_avx2:
+#if SDL_VERSION_ATLEAST(2,0,4)
+			return SDL_HasAVX2();
+#else
+			return false;
+#endif
+#endif
+
+		default:
+			return false;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef __PRESENT_KERNELS_H
+#define __PRESENT_KERNELS_H
+
+/*
+PRESENT_KERNELS.H
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	The last steps of a software frame: gamma correcting the rendered view and doubling it
+	up to the screen in low resolution.  Gamma goes through lookup tables built from the
+	current gamma ramps (one 64K table for 16-bit pixels, one 256-entry table per channel
+	for 32-bit ones) and, with AVX2, is gathered 8 pixels at a time; doubling is done a
+	vector at a time with SSE2 or AVX2.  Above 1080p the rows are split among the software
+	rendering threads.  The pixels come out exactly as the old per-pixel loops made them.
+*/
+
+#include "cseries.h"
+
+#include <SDL.h>
+#include <vector>
+
+/* ---------- constants */
+
+enum /* kernel sets */
+{
+	_present_kernels_scalar,
+	_present_kernels_sse2,
+	_present_kernels_avx2,
+	NUMBER_OF_PRESENT_KERNEL_SETS
+};
+
+/* ---------- structures */
+
+struct present_benchmark
+{
+	int16 kernels; /* NONE for the old per-pixel loops */
+	int16 thread_count;
+	double gamma_megapixels, quadruple_megapixels; /* per second */
+	bool matches_reference;
+};
+
+/* ---------- prototypes/PRESENT_KERNELS.CPP */
+
+/* picks the best set this processor runs; called at launch */
+void choose_present_kernels(void);
+const char *get_present_kernels_name(int16 kernels);
+
+/* dst gets src through the gamma ramps; both are the same size */
+void gamma_correct_surface(SDL_Surface *src, SDL_Surface *dst,
+	const uint16 *red, const uint16 *green, const uint16 *blue);
+
+/* each pixel of src becomes a 2x2 block of dst at dst_rect; same pixel size, both locked */
+void quadruple_surface(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect);
+
+/* times both steps at the given size and depth (16 or 32) with the old loops and every
+	available kernel set, on one thread and on the rendering threads, checking the pixels */
+void benchmark_present_kernels(short depth, int width, int height, std::vector<present_benchmark>& results);
+
+#endif
@@ -68,9 +68,14 @@
 #include "lua_hud_script.h"
 #include "HUDRenderer_Lua.h"
 #include "Movie.h"
+#include "present_kernels.h"
 
 #include <algorithm>
 
+#ifdef HAVE_SDL_IMAGE
+#include <SDL_image.h>
+#endif
+
 #if defined(__WIN32__) || (defined(__MACH__) && defined(__APPLE__))
 #define MUST_RELOAD_VIEW_CONTEXT
 #endif
@@ -137,10 +142,10 @@ static bool get_auto_resolution_size(short *w, short *h, struct screen_mode_data
 static void build_sdl_color_table(const color_table *color_table, SDL_Color *colors);
 static void reallocate_world_pixels(int width, int height);
 static void reallocate_map_pixels(int width, int height);
-static void apply_gamma(SDL_Surface *src, SDL_Surface *dst);
 static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez);
 static void update_fps_display(SDL_Surface *s);
 static void DisplayPosition(SDL_Surface *s);
+static void DisplayRenderStatistics(SDL_Surface *s);
 static void DisplayMessages(SDL_Surface *s);
 static void DisplayNetMicStatus(SDL_Surface *s);
 static void DrawSurface(SDL_Surface *s, SDL_Rect &dest_rect, SDL_Rect &src_rect);
@@ -190,6 +195,8 @@ void Screen::Initialize(screen_mode_data* mode)
 		pixel_format_32 = *pf;
 		SDL_FreeFormat(pf);
 
+		choose_present_kernels();
+
 		uncorrected_color_table = (struct color_table *)malloc(sizeof(struct color_table));
 		world_color_table = (struct color_table *)malloc(sizeof(struct color_table));
 		visible_color_table = (struct color_table *)malloc(sizeof(struct color_table));
@@ -1436,6 +1443,7 @@ void render_screen(short ticks_elapsed)
 		update_fps_display(disp_pixels);
 	  }
 	  DisplayPosition(disp_pixels);
+	  DisplayRenderStatistics(disp_pixels);
 	  DisplayNetMicStatus(disp_pixels);
 	  DisplayScores(disp_pixels);
 	}
@@ -1527,87 +1535,105 @@ void render_screen(short ticks_elapsed)
 }
 
 /*
- *  Blit world view to screen
+ *  Time the software renderer on the current view
  */
 
-template <class T>
-static inline void quadruple_surface(const T *src, int src_pitch, T *dst, int dst_pitch, const SDL_Rect &dst_rect)
-{
-	int width = dst_rect.w / 2;
-	int height = dst_rect.h / 2;
-	dst += dst_rect.y * dst_pitch / sizeof(T) + dst_rect.x;
-	T *dst2 = dst + dst_pitch / sizeof(T);
-
-	while (height-- > 0) {
-		for (int x=0; x<width; x++) {
-			T p = src[x];
-			dst[x * 2] = dst[x * 2 + 1] = p;
-			dst2[x * 2] = dst2[x * 2 + 1] = p;
+bool benchmark_software_rendering(int32 frame_count, int16 maximum_thread_count, std::vector<software_rasterizer_benchmark>& results)
+{
+	if (!in_game || OGL_IsActive() || software_render_dest.empty() ||
+	    world_view->overhead_map_active || world_view->terminal_mode_active)
+		return false;
+
+	benchmark_software_rasterizer(world_view, software_render_dest.get(), frame_count, maximum_thread_count, results);
+	return true;
+}
+
+/*
+ *  Draw views into offscreen surfaces, with no window involved (for timedemos)
+ */
+
+SDL_Surface *allocate_offscreen_view(int width, int height)
+{
+	SDL_Surface *surface;
+
+	// Same layouts as reallocate_world_pixels(), which is what the shading tables were built for
+	switch (bit_depth)
+	{
+	case 8:
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 8, 0, 0, 0, 0);
+		if (surface) {
+			SDL_Color colors[256];
+			build_sdl_color_table(world_color_table, colors);
+			SDL_SetPaletteColors(surface->format->palette, colors, 0, 256);
 		}
-		src += src_pitch / sizeof(T);
-		dst += dst_pitch * 2 / sizeof(T);
-		dst2 += dst_pitch * 2 / sizeof(T);
+		break;
+	case 16:
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 16, pixel_format_16.Rmask, pixel_format_16.Gmask, pixel_format_16.Bmask, 0);
+		break;
+	default:
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32, pixel_format_32.Rmask, pixel_format_32.Gmask, pixel_format_32.Bmask, 0);
+		break;
 	}
+
+	return surface;
 }
 
-static void apply_gamma(SDL_Surface *src, SDL_Surface *dst)
+uint64 render_offscreen_view(SDL_Surface *surface, const world_location3d *camera)
 {
-	if (SDL_MUSTLOCK(dst)) {
-	    if (SDL_LockSurface(dst) < 0) return;
-	}
-	uint32 px, dst_px;
-	uint8 src_r, src_g, src_b;
-	uint8 dst_r, dst_g, dst_b;
-	
-	uint32 srm = src->format->Rmask, sgm = src->format->Gmask, sbm = src->format->Bmask;
-	uint32 drm = dst->format->Rmask, dgm = dst->format->Gmask, dbm = dst->format->Bmask;
-	uint32 srs = src->format->Rshift, sgs = src->format->Gshift, sbs = src->format->Bshift;
-	uint32 drs = dst->format->Rshift, dgs = dst->format->Gshift, dbs = dst->format->Bshift;
-	uint32 srl = src->format->Rloss, sgl = src->format->Gloss, sbl = src->format->Bloss;
-	uint32 drl = dst->format->Rloss, dgl = dst->format->Gloss, dbl = dst->format->Bloss;
-	
-	int sbpp = src->format->BytesPerPixel;
-	int dbpp = dst->format->BytesPerPixel;
-	uint8 *sptr = static_cast<uint8*>(src->pixels);
-	uint8 *dptr = static_cast<uint8*>(dst->pixels);
-	size_t numpixels = src->w * src->h;
-	for (size_t i = 0; i < numpixels; ++i) {
-		switch (sbpp) {
-			case 2:
-				px = reinterpret_cast<uint16*>(sptr)[i];
-				break;
-			case 4:
-				px = reinterpret_cast<uint32*>(sptr)[i];
-				break;
-			default:
-				return;
-		}
-	
-		src_r = ((px & srm) >> srs) << srl;
-		src_g = ((px & sgm) >> sgs) << sgl;
-		src_b = ((px & sbm) >> sbs) << sbl;
-		dst_r = current_gamma_r[src_r] >> 8;
-		dst_g = current_gamma_g[src_g] >> 8;
-		dst_b = current_gamma_b[src_b] >> 8;
-		dst_px = (((dst_r >> drl) << drs) & drm) |
-				 (((dst_g >> dgl) << dgs) & dgm) |
-				 (((dst_b >> dbl) << dbs) & dbm);
-			
-		switch (dbpp) {
-			case 2:
-				reinterpret_cast<uint16*>(dptr)[i] = dst_px;
-				break;
-			case 4:
-				reinterpret_cast<uint32*>(dptr)[i] = dst_px;
-				break;
-			default:
-				return;
-		}
+	if (OGL_IsActive())
+		return 0;
+
+	// A copy, so the game's own view (and its size) is left alone
+	static view_data view;
+	view = *world_view;
+
+	view.ticks_elapsed = 1;
+	view.tick_count = dynamic_world->tick_count;
+	view.maximum_depth_intensity = current_player->weapon_intensity;
+	view.shading_mode = current_player->infravision_duration ? _shading_infravision : _shading_normal;
+	view.overhead_map_active = false;
+	view.terminal_mode_active = false;
+	if (camera) {
+		view.origin = camera->point;
+		view.origin_polygon_index = camera->polygon_index;
+		view.yaw = camera->yaw;
+		view.pitch = camera->pitch;
+		view.show_weapons_in_hand = false;
+	} else {
+		view.origin = current_player->camera_location;
+		view.origin_polygon_index = current_player->camera_polygon_index;
+		view.yaw = current_player->facing;
+		view.pitch = current_player->elevation;
+		view.show_weapons_in_hand = true;
 	}
-	if (SDL_MUSTLOCK(dst))
-		SDL_UnlockSurface(dst);
+	view.virtual_yaw = view.yaw * FIXED_ONE;
+	view.virtual_pitch = view.pitch * FIXED_ONE;
+
+	view.screen_width = surface->w;
+	view.screen_height = surface->h;
+	view.standard_screen_width = 2 * surface->h;
+	initialize_view_data(&view);
+
+	bitmap_definition_buffer destination = bitmap_definition_of_sdl_surface(surface);
+
+	uint64 start = machine_microsecond_count();
+	render_view(&view, destination.get());
+	return machine_microsecond_count() - start;
 }
 
+bool save_offscreen_view(SDL_Surface *surface, const char *path)
+{
+#ifdef HAVE_SDL_IMAGE
+	return IMG_SavePNG(surface, path) == 0;
+#else
+	return SDL_SaveBMP(surface, path) == 0;
+#endif
+}
+
+/*
+ *  Blit world view to screen
+ */
+
 static inline bool pixel_formats_equal(SDL_PixelFormat* a, SDL_PixelFormat* b)
 {
 	return (a->BytesPerPixel == b->BytesPerPixel &&
@@ -1620,7 +1646,7 @@ static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez)
 {
 	SDL_Surface *s = world_pixels;
 	if (!using_default_gamma && bit_depth > 8) {
-		apply_gamma(world_pixels, world_pixels_corrected);
+		gamma_correct_surface(world_pixels, world_pixels_corrected, current_gamma_r, current_gamma_g, current_gamma_b);
 		s = world_pixels_corrected;
 	}
 		
@@ -1642,18 +1668,7 @@ static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez)
 			s = intermediary;
 		}
 
-		switch (s->format->BytesPerPixel) 
-		{
-		case 1:
-			quadruple_surface((pixel8 *)s->pixels, s->pitch, (pixel8 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
-		case 2:
-			quadruple_surface((pixel16 *)s->pixels, s->pitch, (pixel16 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
-		case 4:
-			quadruple_surface((pixel32 *)s->pixels, s->pitch, (pixel32 *)main_surface->pixels, main_surface->pitch, destination);
-			break;
-		}
+		quadruple_surface(s, main_surface, destination);
 		
 		if (SDL_MUSTLOCK(main_surface)) {
 			SDL_UnlockSurface(main_surface);
@@ -2008,7 +2023,7 @@ void draw_intro_screen(void)
 	{
 		SDL_Surface *s = Intro_Buffer;
 		if (!using_default_gamma && bit_depth > 8) {
-			apply_gamma(Intro_Buffer, Intro_Buffer_corrected);
+			gamma_correct_surface(Intro_Buffer, Intro_Buffer_corrected, current_gamma_r, current_gamma_g, current_gamma_b);
 			SDL_SetSurfaceBlendMode(Intro_Buffer_corrected, SDL_BLENDMODE_NONE);
 			s = Intro_Buffer_corrected;
 		}
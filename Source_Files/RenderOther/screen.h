@@ -181,6 +181,19 @@ void start_extravision_effect(bool out);
 
 void render_screen(short ticks_elapsed);
 
+// Draws the current view frame_count times on each of 1 to maximum_thread_count
+// software rendering threads; false unless a software-rendered game view is up
+struct software_rasterizer_benchmark;
+bool benchmark_software_rendering(int32 frame_count, int16 maximum_thread_count, std::vector<software_rasterizer_benchmark>& results);
+
+// Offscreen views for timedemos: a surface of the screen's depth, drawn into by the software
+// renderer from the camera (or, if NULL, the current player's eyes); returns the microseconds
+// render_view() took.  Frames are saved as PNG, or BMP without SDL_image
+struct world_location3d;
+SDL_Surface *allocate_offscreen_view(int width, int height);
+uint64 render_offscreen_view(SDL_Surface *surface, const struct world_location3d *camera = NULL);
+bool save_offscreen_view(SDL_Surface *surface, const char *path);
+
 void toggle_overhead_map_display_status(void);
 
 // Returns whether the size scale had been changed
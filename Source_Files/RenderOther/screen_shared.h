@@ -77,6 +77,8 @@ int32 frame_ticks[64];
 // whether to show one's position
 bool ShowPosition = false;
 bool ShowScores = false;
+// whether to show render_view()'s stage times and counts
+bool ShowRenderStatistics = false;
 
 // Whether rendering of the HUD has been requested
 static bool HUD_RenderRequest = false;
@@ -564,6 +566,41 @@ static void DisplayPosition(SDL_Surface *s)
 	
 }
 
+// Right-aligned in the top right corner, out of the way of the position and messages
+static void DisplayRenderStatistics(SDL_Surface *s)
+{
+	if (!ShowRenderStatistics || !render_statistics_active()) return;
+	
+	const render_statistics *Statistics = get_render_statistics();
+	
+	FontSpecifier& Font = GetOnScreenFont();
+	
+	DisplayTextDest = s;
+	DisplayTextFont = Font.Info;
+	DisplayTextStyle = Font.Style;
+	
+	short LineSpacing = Font.LineSpacing;
+	short Margin = LineSpacing/3;
+	short Y = LineSpacing;
+	uint64 Total = 0;
+	for (int i = 0; i < NUMBER_OF_RENDER_STAGES; i++)
+	{
+		Total += Statistics->microseconds[i];
+		sprintf(temporary, "%s %6.2f ms", get_render_stage_name(i), Statistics->microseconds[i]/1000.0);
+		DisplayText(s->w - Margin - DisplayTextWidth(temporary), Y, temporary);
+		Y += LineSpacing;
+	}
+	sprintf(temporary, "total %6.2f ms", Total/1000.0);
+	DisplayText(s->w - Margin - DisplayTextWidth(temporary), Y, temporary);
+	Y += LineSpacing;
+	for (int i = 0; i < NUMBER_OF_RENDER_COUNTERS; i++)
+	{
+		sprintf(temporary, "%s %8d", get_render_counter_name(i), Statistics->counters[i]);
+		DisplayText(s->w - Margin - DisplayTextWidth(temporary), Y, temporary);
+		Y += LineSpacing;
+	}
+}
+
 static void DisplayInputLine(SDL_Surface *s)
 {
   if (Console::instance()->input_active() && 
@@ -21,6 +21,7 @@
 */
 
 #include "InfoTree.h"
+#include "InfoTreeCache.h"
 #include "cseries.h"
 #include "game_errors.h"
 #include "shell.h"
@@ -30,8 +31,19 @@
 #include <boost/version.hpp>
 #include <boost/range/adaptor/map.hpp>
 
-InfoTree InfoTree::load_xml(FileSpecifier filename)
+InfoTree InfoTree::load_xml(FileSpecifier filename, bool use_cache)
 {
+	// parsed trees are kept between launches, unless the file changes
+	InfoTreeCache::stamp_t stamp;
+	bool cacheable = use_cache && InfoTreeCache::get_stamp(filename, stamp);
+	if (cacheable)
+	{
+		InfoTree tree;
+		if (InfoTreeCache::instance()->retrieve(filename, stamp, tree))
+			return tree;
+	}
+	uint64 start = machine_microsecond_count();
+	
 	// use rwops, in case file is inside a zip archive
 	OpenedFile file;
 	if (filename.Open(file))
@@ -44,7 +56,10 @@ InfoTree InfoTree::load_xml(FileSpecifier filename)
 		if (file.Read(data_size, &file_data[0]))
 		{
 			std::istringstream strm(std::string(file_data.begin(), file_data.end()));
-			return load_xml(strm);
+			InfoTree tree = load_xml(strm);
+			if (cacheable)
+				InfoTreeCache::instance()->store(filename, stamp, tree, machine_microsecond_count() - start);
+			return tree;
 		}
 	}
 	else
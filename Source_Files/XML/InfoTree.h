@@ -50,7 +50,9 @@ public:
 	explicit InfoTree(const data_type &data) : boost::property_tree::ptree(data) {}
 	InfoTree(const boost::property_tree::ptree &rhs) : boost::property_tree::ptree(rhs) {}
 	
-	static InfoTree load_xml(FileSpecifier filename);
+	// files the engine rewrites itself (preferences) change every launch, so
+	// there's no point keeping them in InfoTreeCache
+	static InfoTree load_xml(FileSpecifier filename, bool use_cache = true);
 	static InfoTree load_xml(std::istringstream& stream);
 	void save_xml(FileSpecifier filename) const;
 	void save_xml(std::ostringstream& stream) const;
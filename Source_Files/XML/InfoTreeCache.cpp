@@ -0,0 +1,385 @@
+/*
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Binary cache of parsed XML trees
+
+	The cache file is a header (magic, version, entry count) followed by the
+	entries: path, size, modification time and the tree.  A tree is its node's
+	data, its child count, and each child's key and tree.  Lengths and counts are
+	variable-length integers, seven bits a byte, so most take one byte.
+*/
+
+#include "InfoTreeCache.h"
+#include "Logging.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sstream>
+
+static const uint32 CACHE_MAGIC = 0x41315443;	// 'A1TC', native byte order
+static const uint32 CACHE_VERSION = 1;
+static const int MAXIMUM_TREE_DEPTH = 256;		// well past any real file; guards against damage
+static const char *CACHE_FILE_NAME = "InfoTrees.cache";
+
+static void get_cache_file(FileSpecifier& file)
+{
+	file.SetToMapCacheDir();
+	file.AddPart(CACHE_FILE_NAME);
+}
+
+// Writing
+
+static void write_varint(std::string& out, uint64 value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+static void write_string(std::string& out, const std::string& value)
+{
+	write_varint(out, value.size());
+	out.append(value);
+}
+
+static void write_tree(std::string& out, const boost::property_tree::ptree& tree)
+{
+	write_string(out, tree.data());
+	write_varint(out, tree.size());
+	for (boost::property_tree::ptree::const_iterator it = tree.begin(); it != tree.end(); ++it)
+	{
+		write_string(out, it->first);
+		write_tree(out, it->second);
+	}
+}
+
+// Reading; each returns false, and reads no further, if the data runs out
+
+static bool read_varint(const uint8 *&p, const uint8 *end, uint64& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (p == end)
+			return false;
+		uint8 byte = *p++;
+		value |= static_cast<uint64>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static bool read_string(const uint8 *&p, const uint8 *end, std::string& value)
+{
+	uint64 length;
+	if (!read_varint(p, end, length) || length > static_cast<uint64>(end - p))
+		return false;
+	value.assign(reinterpret_cast<const char *>(p), static_cast<size_t>(length));
+	p += length;
+	return true;
+}
+
+static bool read_tree(const uint8 *&p, const uint8 *end, boost::property_tree::ptree& tree, int depth)
+{
+	uint64 count;
+	std::string key;
+
+	if (depth > MAXIMUM_TREE_DEPTH || !read_string(p, end, tree.data()) || !read_varint(p, end, count))
+		return false;
+
+	for (uint64 i = 0; i < count; ++i)
+	{
+		if (!read_string(p, end, key))
+			return false;
+		// build the child in place; pushing a finished one would copy it
+		boost::property_tree::ptree& child = tree.push_back(std::make_pair(key, boost::property_tree::ptree()))->second;
+		if (!read_tree(p, end, child, depth + 1))
+			return false;
+	}
+	return true;
+}
+
+static bool read_tree(const uint8 *data, size_t length, InfoTree& tree)
+{
+	const uint8 *p = data;
+	tree.clear();
+	if (read_tree(p, data + length, tree, 0) && p == data + length)
+		return true;
+	tree.clear();
+	return false;
+}
+
+InfoTreeCache* InfoTreeCache::instance()
+{
+	static InfoTreeCache* m_instance = nullptr;
+	if (!m_instance) {
+		m_instance = new InfoTreeCache;
+	}
+
+	return m_instance;
+}
+
+bool InfoTreeCache::get_stamp(FileSpecifier& file, stamp_t& stamp)
+{
+	struct stat st;
+	if (stat(file.GetPath(), &st) < 0 || !S_ISREG(st.st_mode))
+		return false;
+
+	stamp.size = st.st_size;
+	stamp.seconds = st.st_mtime;
+#if defined(__linux__)
+	stamp.nanoseconds = st.st_mtim.tv_nsec;
+#elif defined(__APPLE__) && defined(__MACH__)
+	stamp.nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+	stamp.nanoseconds = 0;
+#endif
+	return true;
+}
+
+void InfoTreeCache::load_cache()
+{
+	m_loaded = true;
+
+	FileSpecifier file;
+	get_cache_file(file);
+	OpenedFile ofile;
+	if (!file.Exists() || !file.Open(ofile))
+		return;
+
+	const uint8 *data = NULL;
+	int32 length = 0;
+	m_mapping = ofile.Map();
+	if (m_mapping)
+	{
+		data = m_mapping->GetData();
+		length = m_mapping->GetLength();
+	}
+	else if (ofile.GetLength(length) && length > 0)
+	{
+		m_contents.resize(length);
+		if (!ofile.Read(length, &m_contents[0]))
+		{
+			m_contents.clear();
+			return;
+		}
+		data = &m_contents[0];
+	}
+
+	uint32 header[3];
+	if (length < static_cast<int32>(sizeof(header)))
+	{
+		release_cache();
+		return;
+	}
+	memcpy(header, data, sizeof(header));
+	if (header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION)
+	{
+		logNote("ignoring XML cache from another version");
+		release_cache();
+		return;
+	}
+
+	const uint8 *p = data + sizeof(header);
+	const uint8 *end = data + length;
+	for (uint32 i = 0; i < header[2]; ++i)
+	{
+		std::string path;
+		uint64 size, seconds, nanoseconds, tree_length;
+		if (!read_string(p, end, path) ||
+			!read_varint(p, end, size) ||
+			!read_varint(p, end, seconds) ||
+			!read_varint(p, end, nanoseconds) ||
+			!read_varint(p, end, tree_length) ||
+			tree_length > static_cast<uint64>(end - p))
+		{
+			logWarning("XML cache is damaged; ignoring the rest of it");
+			m_dirty = true;
+			break;
+		}
+
+		entry_t& entry = m_entries[path];
+		entry.stamp.size = static_cast<int64>(size);
+		entry.stamp.seconds = static_cast<int64>(seconds);
+		entry.stamp.nanoseconds = static_cast<int32>(nanoseconds);
+		entry.data = p;
+		entry.length = static_cast<size_t>(tree_length);
+		p += tree_length;
+	}
+}
+
+void InfoTreeCache::release_cache()
+{
+	m_entries.clear();
+	m_contents.clear();
+	if (m_mapping)
+	{
+		m_mapping->Release();
+		m_mapping = NULL;
+	}
+}
+
+bool InfoTreeCache::retrieve(FileSpecifier& file, const stamp_t& stamp, InfoTree& tree)
+{
+	if (!m_loaded)
+		load_cache();
+
+	m_used.insert(file.GetPath());
+	std::map<std::string, entry_t>::iterator it = m_entries.find(file.GetPath());
+	if (it == m_entries.end() || !(it->second.stamp == stamp))
+		return false;
+
+	uint64 start = machine_microsecond_count();
+	if (!read_tree(it->second.data, it->second.length, tree))
+	{
+		logWarning("XML cache entry for %s is damaged", file.GetPath());
+		m_entries.erase(it);
+		m_dirty = true;
+		return false;
+	}
+	m_statistics.hits++;
+	m_statistics.hit_microseconds += machine_microsecond_count() - start;
+	return true;
+}
+
+void InfoTreeCache::store(FileSpecifier& file, const stamp_t& stamp, const InfoTree& tree, uint64 parse_microseconds)
+{
+	if (!m_loaded)
+		load_cache();
+
+	m_used.insert(file.GetPath());
+	entry_t& entry = m_entries[file.GetPath()];
+	entry.stamp = stamp;
+	entry.blob.clear();
+	write_tree(entry.blob, tree);
+	entry.data = reinterpret_cast<const uint8 *>(entry.blob.data());
+	entry.length = entry.blob.size();
+	m_dirty = true;
+
+	m_statistics.misses++;
+	m_statistics.miss_microseconds += parse_microseconds;
+}
+
+void InfoTreeCache::save_cache(bool forget_unused)
+{
+	// only trees whose files are as they were are worth keeping, and at the end of
+	// a session only those it used; otherwise scenarios and plugins long gone would
+	// stay in the cache for good
+	std::string out;
+	uint32 header[3] = { CACHE_MAGIC, CACHE_VERSION, 0 };
+	out.append(reinterpret_cast<const char *>(header), sizeof(header));
+	for (std::map<std::string, entry_t>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		if (forget_unused && !m_used.count(it->first))
+		{
+			m_dirty = true;
+			continue;
+		}
+
+		FileSpecifier file(it->first);
+		stamp_t stamp;
+		if (!get_stamp(file, stamp) || !(stamp == it->second.stamp))
+		{
+			m_dirty = true;
+			continue;
+		}
+
+		write_string(out, it->first);
+		write_varint(out, static_cast<uint64>(stamp.size));
+		write_varint(out, static_cast<uint64>(stamp.seconds));
+		write_varint(out, static_cast<uint64>(stamp.nanoseconds));
+		write_varint(out, it->second.length);
+		out.append(reinterpret_cast<const char *>(it->second.data), it->second.length);
+		header[2]++;
+	}
+	if (!m_dirty)
+		return;
+	memcpy(&out[0], header, sizeof(header));
+
+	// the old file can't be replaced while it's mapped
+	release_cache();
+	m_loaded = false;
+
+	FileSpecifier file, temp_file;
+	get_cache_file(file);
+	temp_file.SetTempName(file);
+	OpenedFile ofile;
+	if (temp_file.Create(_typecode_unknown) && temp_file.Open(ofile, true))
+	{
+		bool written = ofile.Write(static_cast<int32>(out.size()), &out[0]);
+		ofile.Close();
+		if (!written || !temp_file.Rename(file))
+		{
+			logWarning("couldn't write the XML cache");
+			temp_file.Delete();
+		}
+	}
+	m_dirty = false;
+}
+
+void InfoTreeCache::benchmark(info_tree_cache_benchmark& results)
+{
+	obj_clear(results);
+	if (!m_loaded)
+		load_cache();
+
+	for (std::map<std::string, entry_t>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		FileSpecifier file(it->first);
+		OpenedFile ofile;
+		int32 length;
+		if (!file.Open(ofile) || !ofile.GetLength(length) || length <= 0)
+			continue;
+
+		results.file_count++;
+		results.xml_bytes += length;
+		results.cached_bytes += it->second.length;
+
+		// what loading it used to take: reading and parsing
+		uint64 start = machine_microsecond_count();
+		InfoTree parsed;
+		std::vector<char> file_data(length);
+		bool parsed_ok = ofile.Read(length, &file_data[0]);
+		if (parsed_ok)
+		{
+			try {
+				std::istringstream strm(std::string(file_data.begin(), file_data.end()));
+				parsed = InfoTree::load_xml(strm);
+			} catch (InfoTree::parse_error) {
+				parsed_ok = false;
+			}
+		}
+		results.parse_microseconds += machine_microsecond_count() - start;
+
+		// what it takes now: checking the stamp and rebuilding the tree
+		start = machine_microsecond_count();
+		InfoTree cached;
+		stamp_t stamp;
+		bool cached_ok = get_stamp(file, stamp) && stamp == it->second.stamp &&
+			read_tree(it->second.data, it->second.length, cached);
+		results.cached_microseconds += machine_microsecond_count() - start;
+
+		if (!parsed_ok || !cached_ok || parsed != cached)
+			results.mismatch_count++;
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef _INFO_TREE_CACHE_
+#define _INFO_TREE_CACHE_
+
+/*
+
+	Copyright (C) 1991-2001 and beyond by Bungie Studios, Inc.
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Parsed XML files (MML scripts, plugin descriptions, themes), kept between
+	launches in one binary file in the cache directory.  Each tree is keyed by
+	its file's path, size and modification time; the cache file is memory-mapped
+	and a tree is rebuilt from it only when asked for.  Files inside zip
+	archives aren't cached.
+*/
+
+#include "cseries.h"
+#include "FileHandler.h"
+#include "InfoTree.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct info_tree_cache_statistics {
+	int32 hits, misses;
+	uint64 hit_microseconds, miss_microseconds;
+};
+
+struct info_tree_cache_benchmark {
+	int32 file_count, mismatch_count;
+	uint32 xml_bytes, cached_bytes;
+	uint64 parse_microseconds, cached_microseconds;
+};
+
+class InfoTreeCache {
+public:
+	// When and how big the file was, so that a change can be noticed
+	struct stamp_t {
+		int64 size;
+		int64 seconds;
+		int32 nanoseconds;
+
+		bool operator==(const stamp_t& other) const {
+			return size == other.size && seconds == other.seconds && nanoseconds == other.nanoseconds;
+		}
+	};
+
+	static InfoTreeCache* instance();
+
+	// False if the file can't be cached (doesn't exist, or is inside a zip)
+	static bool get_stamp(FileSpecifier& file, stamp_t& stamp);
+
+	// True, with tree filled in, if there's a tree for the file as stamped
+	bool retrieve(FileSpecifier& file, const stamp_t& stamp, InfoTree& tree);
+	// Remembers the tree parsed from the file as it was when stamped
+	void store(FileSpecifier& file, const stamp_t& stamp, const InfoTree& tree, uint64 parse_microseconds);
+
+	// Writes out every tree whose file hasn't changed since, if anything changed;
+	// at shutdown, forget_unused also drops trees nothing asked for this session
+	void save_cache(bool forget_unused = false);
+
+	const info_tree_cache_statistics& statistics() const { return m_statistics; }
+
+	// Parses every cached file as XML and rebuilds it from the cache, comparing
+	// times and trees; this is the work saved at startup
+	void benchmark(info_tree_cache_benchmark& results);
+
+private:
+	InfoTreeCache() : m_mapping(NULL), m_loaded(false), m_dirty(false) { obj_clear(m_statistics); }
+
+	struct entry_t {
+		stamp_t stamp;
+		const uint8 *data;		// into the mapping, or into blob
+		size_t length;
+		std::string blob;		// only for trees parsed this launch
+	};
+
+	void load_cache();
+	void release_cache();
+
+	FileMapping *m_mapping;
+	std::vector<uint8> m_contents;	// if the cache file couldn't be mapped
+	std::map<std::string, entry_t> m_entries;
+	std::set<std::string> m_used;	// asked for this session; outlives reloading the file
+	bool m_loaded, m_dirty;
+	info_tree_cache_statistics m_statistics;
+};
+
+#endif
@@ -240,12 +240,9 @@ bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
 	OpenedFile file;
 	if (file_name.Open(file)) 
 	{
+		// the tree comes through the cache, which reads the file only if it has to
 		int32 data_size;
-		file.GetLength(data_size);
-		std::vector<char> file_data;
-		file_data.resize(data_size);
-
-		if (file.Read(data_size, &file_data[0]))
+		if (file.GetLength(data_size))
 		{
 			DirectorySpecifier current_plugin_directory;
 			file_name.ToDirectory(current_plugin_directory);
@@ -253,9 +250,8 @@ bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
 			char name[256];
 			current_plugin_directory.GetName(name);
 			
-			std::istringstream strm(std::string(file_data.begin(), file_data.end()));
 			try {
-				InfoTree root = InfoTree::load_xml(strm).get_child("plugin");
+				InfoTree root = InfoTree::load_xml(file_name).get_child("plugin");
 				
 				Plugin Data = Plugin();
 				Data.directory = current_plugin_directory;
@@ -23,6 +23,8 @@
 #include "cseries.h"
 #include "QuickSave.h"
 
+#include <algorithm>
+#include <deque>
 #include <fstream>
 #include <sstream>
 #include <boost/algorithm/string/replace.hpp>
@@ -417,6 +419,8 @@ size_t saved_game_was_networked(FileSpecifier& saved_game)
 
 bool load_quick_save_dialog(FileSpecifier& saved_game)
 {
+    // so the list has every save, and none is half written
+    flush_quick_saves();
     QuickSaves::instance()->enumerate();
 
     dialog d;
@@ -499,12 +503,13 @@ bool load_quick_save_dialog(FileSpecifier& saved_game)
 extern SDL_Surface *draw_surface;
 extern bool OGL_MapActive;
 
-static bool build_map_preview(std::ostringstream& ostream)
+// Drawing the map needs the game; encoding it doesn't
+static SDL_Surface *render_map_preview()
 {
     SDL_Rect r = {0, 0, RENDER_WIDTH, RENDER_HEIGHT};
     SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, r.w, r.h, 32, 0xff0000, 0x00ff00, 0x0000ff, 0);
     if (!surface)
-        return false;
+        return NULL;
 	
     SDL_FillRect(surface, &r, SDL_MapRGB(surface->format, 0, 0, 0));
 	
@@ -525,7 +530,12 @@ static bool build_map_preview(std::ostringstream& ostream)
     _render_overhead_map(&overhead_data);
     OGL_MapActive = old_OGL_MapActive;
     _restore_port();
-	
+
+    return surface;
+}
+
+static bool encode_map_preview(SDL_Surface *surface, std::ostringstream& ostream)
+{
     SDL_RWops *rwops = SDL_RWFromOStream(ostream);
 //#if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE)
 //    int ret = aoIMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
@@ -534,12 +544,22 @@ static bool build_map_preview(std::ostringstream& ostream)
 #else
     int ret = SDL_SaveBMP_RW(surface, rwops, false);
 #endif
-    SDL_FreeSurface(surface);
     SDL_RWclose(rwops);
 	
     return (ret == 0);
 }
 
+static bool build_map_preview(std::ostringstream& ostream)
+{
+    SDL_Surface *surface = render_map_preview();
+    if (!surface)
+        return false;
+
+    bool success = encode_map_preview(surface, ostream);
+    SDL_FreeSurface(surface);
+    return success;
+}
+
 std::string build_save_metadata(QuickSave& save)
 {
 	InfoTree pt;
@@ -652,7 +672,7 @@ void create_updated_save(QuickSave& save)
 	}
 }
 
-bool create_quick_save(void)
+static QuickSave new_quick_save()
 {
     QuickSave save;
 
@@ -685,14 +705,250 @@ bool create_quick_save(void)
 
     save.save_file.FromDirectory(quicksave_dir);
     save.save_file.AddPart(base + ".sgaA");
-	
-    std::string metadata = build_save_metadata(save);
+
+    return save;
+}
+
+// A save on its way to disk; everything in it belongs to the writer until it's finished
+struct QuickSaveJob {
+    QuickSave save;
+    std::string metadata;
+    saved_game_snapshot *snapshot;
+    SDL_Surface *preview;
+    quick_save_callback callback;
+
+    bool success;
+    short error;    // never the game error, which belongs to the game thread
+    uint64 snapshot_microseconds, writer_microseconds;
+};
+
+static SDL_Thread *writer_thread = NULL;
+static SDL_mutex *writer_lock = NULL;
+static SDL_cond *writer_changed = NULL;
+static std::deque<QuickSaveJob *> pending_jobs, finished_jobs;
+static bool writer_quitting = false;
+
+static void write_quick_save(QuickSaveJob *job)
+{
+    uint64 start = machine_microsecond_count();
     std::ostringstream image_stream;
-    bool success = build_map_preview(image_stream);
-    success = save_game_file(save.save_file, metadata, image_stream.str());
-    
-    if (success)
+
+    if (job->preview) {
+        encode_map_preview(job->preview, image_stream);
+        SDL_FreeSurface(job->preview);
+        job->preview = NULL;
+    }
+    short write_error = 0;
+    job->success = write_saved_game_snapshot(job->snapshot, job->metadata, image_stream.str(), &write_error) && !job->error;
+    if (write_error)
+        job->error = write_error;
+    free_saved_game_snapshot(job->snapshot);
+    job->snapshot = NULL;
+    job->writer_microseconds = machine_microsecond_count() - start;
+}
+
+// Takes jobs in order until there are none left and it's been told to quit
+static int quick_save_writer_loop(void *)
+{
+    SDL_LockMutex(writer_lock);
+    while (true) {
+        if (pending_jobs.empty()) {
+            if (writer_quitting)
+                break;
+            SDL_CondWait(writer_changed, writer_lock);
+            continue;
+        }
+
+        QuickSaveJob *job = pending_jobs.front();
+        SDL_UnlockMutex(writer_lock);
+        write_quick_save(job);
+        SDL_LockMutex(writer_lock);
+
+        pending_jobs.pop_front();
+        finished_jobs.push_back(job);
+        SDL_CondBroadcast(writer_changed);
+    }
+    SDL_UnlockMutex(writer_lock);
+
+    return 0;
+}
+
+static bool start_quick_save_writer()
+{
+    if (!writer_lock) writer_lock = SDL_CreateMutex();
+    if (!writer_changed) writer_changed = SDL_CreateCond();
+    if (!writer_lock || !writer_changed) return false;
+
+    if (!writer_thread) {
+        writer_quitting = false;
+        writer_thread = SDL_CreateThread(quick_save_writer_loop, "quick_save_writer", NULL);
+    }
+    return writer_thread != NULL;
+}
+
+static void finish_quick_save(QuickSaveJob *job)
+{
+    short err = job->error;
+
+    logNote("quick save %s: %s, %llu us on the game thread, %llu us writing",
+            job->save.save_file.GetPath(),
+            job->success ? "written" : "failed",
+            (unsigned long long) job->snapshot_microseconds,
+            (unsigned long long) job->writer_microseconds);
+
+    if (!job->success && err)
+        alert_user(infoError, strERRORS, fileError, err);
+
+    if (job->success)
         QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
+    if (job->callback)
+        job->callback(job->save, job->success);
+
+    delete job;
+}
+
+void idle_quick_saves(void)
+{
+    if (!writer_lock)
+        return;
+
+    std::deque<QuickSaveJob *> jobs;
+    SDL_LockMutex(writer_lock);
+    jobs.swap(finished_jobs);
+    SDL_UnlockMutex(writer_lock);
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+        finish_quick_save(jobs[i]);
+}
+
+void flush_quick_saves(void)
+{
+    if (writer_thread) {
+        SDL_LockMutex(writer_lock);
+        writer_quitting = true;
+        SDL_CondBroadcast(writer_changed);
+        SDL_UnlockMutex(writer_lock);
+
+        SDL_WaitThread(writer_thread, NULL);
+        writer_thread = NULL;
+    }
+
+    idle_quick_saves();
+}
+
+// Packs the game and draws the preview; NULL if it couldn't
+static QuickSaveJob *take_quick_save(const QuickSave& save, bool revert_to_it)
+{
+    uint64 start = machine_microsecond_count();
+    QuickSaveJob *job = new QuickSaveJob;
+
+    job->save = save;
+    job->metadata = build_save_metadata(job->save);
+    job->preview = render_map_preview();
+    job->snapshot = take_saved_game_snapshot(job->save.save_file, revert_to_it);
+    job->callback = NULL;
+    job->success = false;
+    job->error = 0;
+    if (error_pending()) {
+        // From taking the snapshot; the file is still written, but reported as failed,
+        // as a save always has been
+        job->error = get_game_error(NULL);
+        clear_game_error();
+    }
+    job->writer_microseconds = 0;
+    job->snapshot_microseconds = machine_microsecond_count() - start;
+
+    return job;
+}
+
+bool create_quick_save(quick_save_callback callback)
+{
+    QuickSaveJob *job = take_quick_save(new_quick_save(), true);
+    job->callback = callback;
+
+    if (!start_quick_save_writer()) {
+        // No thread; write it here, as it always used to be
+        write_quick_save(job);
+        finish_quick_save(job);
+        return true;
+    }
+
+    SDL_LockMutex(writer_lock);
+    pending_jobs.push_back(job);
+    SDL_CondBroadcast(writer_changed);
+    SDL_UnlockMutex(writer_lock);
+
+    return true;
+}
+
+static bool read_whole_file(FileSpecifier& file, std::vector<uint8>& data)
+{
+    OpenedFile ofile;
+    int32 length;
+
+    data.clear();
+    if (!file.Open(ofile) || !ofile.GetLength(length))
+        return false;
+    data.resize(length);
+    return length == 0 || ofile.Read(length, &data[0]);
+}
+
+// Saves the game to a scratch file twice, once the old way and once through the writer,
+// timing how long the game thread is held up each way
+bool benchmark_quick_save(quick_save_benchmark& results)
+{
+    QuickSave save = new_quick_save();
+    std::vector<uint8> synchronous_data, background_data;
+
+    obj_clear(results);
+    DirectorySpecifier quicksave_dir;
+    quicksave_dir.SetToQuickSavesDir();
+    save.save_file.FromDirectory(quicksave_dir);
+    save.save_file.AddPart("benchmark.sgaA");
+
+    flush_quick_saves();
+
+    // The old way: everything before the game goes on
+    uint64 start = machine_microsecond_count();
+    {
+        std::ostringstream image_stream;
+        build_map_preview(image_stream);
+        saved_game_snapshot *snapshot = take_saved_game_snapshot(save.save_file, false);
+        bool success = write_saved_game_snapshot(snapshot, build_save_metadata(save), image_stream.str(), NULL);
+        free_saved_game_snapshot(snapshot);
+        results.synchronous_microseconds = machine_microsecond_count() - start;
+
+        if (!success || !read_whole_file(save.save_file, synchronous_data)) {
+            save.save_file.Delete();
+            clear_game_error();
+            return false;
+        }
+        save.save_file.Delete();
+    }
+
+    // The new way: only the snapshot before the game goes on
+    QuickSaveJob *job = take_quick_save(save, false);
+    results.snapshot_microseconds = job->snapshot_microseconds;
+    if (start_quick_save_writer()) {
+        SDL_LockMutex(writer_lock);
+        pending_jobs.push_back(job);
+        SDL_CondBroadcast(writer_changed);
+        while (std::find(finished_jobs.begin(), finished_jobs.end(), job) == finished_jobs.end())
+            SDL_CondWait(writer_changed, writer_lock);
+        finished_jobs.erase(std::find(finished_jobs.begin(), finished_jobs.end(), job));
+        SDL_UnlockMutex(writer_lock);
+    } else {
+        write_quick_save(job);
+    }
+    results.writer_microseconds = job->writer_microseconds;
+
+    bool success = job->success && read_whole_file(save.save_file, background_data);
+    delete job;
+    save.save_file.Delete();
+    clear_game_error();
+
+    results.bytes = static_cast<uint32>(background_data.size());
+    results.matches = success && synchronous_data == background_data;
     return success;
 }
 
@@ -63,7 +63,24 @@ private:
     std::vector<QuickSave> m_saves;
 };
 
-bool create_quick_save(void);
+// Quick saves are written in the background: the game is packed into memory and the
+// preview drawn on the game thread, then the writer thread encodes the preview, builds
+// the wads and writes and renames the file.  The callback comes on the main thread,
+// from idle_quick_saves(), once the file is there (or isn't).
+typedef void (*quick_save_callback)(const QuickSave& save, bool success);
+
+struct quick_save_benchmark {
+    uint64 synchronous_microseconds;  // everything on the game thread, as saves used to be
+    uint64 snapshot_microseconds;     // what the game thread still does
+    uint64 writer_microseconds;       // the rest, on the writer thread
+    uint32 bytes;
+    bool matches;                     // both ways wrote the same file
+};
+
+bool create_quick_save(quick_save_callback callback = NULL);
+void idle_quick_saves(void);
+void flush_quick_saves(void);         // waits for the writer, then calls back
+bool benchmark_quick_save(quick_save_benchmark& results);
 bool delete_quick_save(QuickSave& save);
 bool load_quick_save_dialog(FileSpecifier& saved_game);
 size_t saved_game_was_networked(FileSpecifier& saved_game);
@@ -117,6 +117,8 @@
 #include "Movie.h"
 #include "HTTP.h"
 #include "WadImageCache.h"
+#include "QuickSave.h"
+#include "InfoTreeCache.h"
 
 #ifdef __WIN32__
 #define WIN32_LEAN_AND_MEAN
@@ -137,6 +139,7 @@ DirectorySpecifier preferences_dir;   // Directory for preferences
 DirectorySpecifier saved_games_dir;   // Directory for saved games
 DirectorySpecifier quick_saves_dir;   // Directory for auto-named saved games
 DirectorySpecifier image_cache_dir;   // Directory for image cache
+DirectorySpecifier map_cache_dir;     // Directory for precalculated map data
 DirectorySpecifier recordings_dir;    // Directory for recordings (except film buffer, which is stored in local_data_dir)
 DirectorySpecifier screenshots_dir;   // Directory for screenshots
 DirectorySpecifier log_dir;           // Directory for Aleph One Log.txt
@@ -150,6 +153,12 @@ bool option_nogamma = false;	      // Disable gamma table effects (menu fades)
 bool option_debug = false;
 bool option_nojoystick = false;
 bool insecure_lua = false;
+bool option_headless = false;         // No window, no sound; replay films as fast as possible
+static std::vector<std::string> replay_films; // From --replay-film
+static short timedemo_width = 0, timedemo_height = 0, timedemo_depth = 32; // From --timedemo
+static std::string camera_path_file;  // From --camera-path
+static std::string save_frames_directory; // From --save-frames
+static int save_frames_interval = TICKS_PER_SECOND;
 static bool force_fullscreen = false; // Force fullscreen mode
 static bool force_windowed = false;   // Force windowed mode
 
@@ -169,6 +178,8 @@ void execute_timer_tasks(uint32 time);
 
 // Prototypes
 static void initialize_application(void);
+static int run_headless_replays(void);
+static bool read_camera_path(const char *path, std::vector<world_location3d>& camera_path);
 void shutdown_application(void);
 static void initialize_marathon_music_handler(void);
 static void process_event(const SDL_Event &event);
@@ -196,6 +207,19 @@ static void usage(const char *prg_name)
 	  "\t[-s | --nosound]       Do not access the sound card\n"
 	  "\t[-m | --nogamma]       Disable gamma table effects (menu fades)\n"
           "\t[-j | --nojoystick]    Do not initialize joysticks\n"
+	  "\t[--replay-film file]   Play a film (may be given more than once)\n"
+	  "\t[--headless]           Replay films as fast as possible without\n"
+	  "\t                       video or sound, then print timings and\n"
+	  "\t                       world hashes and quit\n"
+	  "\t[--timedemo WxH[xD]]    While replaying headless, draw every tick\n"
+	  "\t                       with the software renderer into a WxH view\n"
+	  "\t                       of depth D (8, 16 or 32) and print frame times\n"
+	  "\t[--camera-path file]    For a timedemo, load the film's level and\n"
+	  "\t                       draw the views listed in file instead, one\n"
+	  "\t                       \"x y z yaw pitch\" (world units, degrees)\n"
+	  "\t                       per line\n"
+	  "\t[--save-frames dir [n]] For a timedemo, save every nth frame\n"
+	  "\t                       (default 30) into dir\n"
 	  // Documenting this might be a bad idea?
 	  // "\t[-i | --insecure_lua]  Allow Lua netscripts to take over your computer\n"
 	  "\tdirectory              Directory containing scenario data files\n"
@@ -310,6 +334,52 @@ int main(int argc, char **argv)
 			insecure_lua = true;
 		} else if (strcmp(*argv, "-d") == 0 || strcmp(*argv, "--debug") == 0) {
 		  option_debug = true;
+		} else if (strcmp(*argv, "--headless") == 0) {
+			option_headless = true;
+			option_nosound = true;
+			option_nojoystick = true;
+		} else if (strcmp(*argv, "--replay-film") == 0) {
+			if (argc < 2) {
+				printf("--replay-film needs a film file.\n");
+				usage(prg_name);
+			}
+			argc--;
+			argv++;
+			replay_films.push_back(*argv);
+		} else if (strcmp(*argv, "--timedemo") == 0) {
+			int width = 0, height = 0, depth = 32;
+			if (argc < 2 || sscanf(argv[1], "%dx%dx%d", &width, &height, &depth) < 2 ||
+			    width <= 0 || height <= 0 || width > 8192 || height > 8192 ||
+			    (depth != 8 && depth != 16 && depth != 32)) {
+				printf("--timedemo needs a size such as 640x480 or 1280x720x16.\n");
+				usage(prg_name);
+			}
+			argc--;
+			argv++;
+			timedemo_width = width;
+			timedemo_height = height;
+			timedemo_depth = depth;
+		} else if (strcmp(*argv, "--camera-path") == 0) {
+			if (argc < 2) {
+				printf("--camera-path needs a file.\n");
+				usage(prg_name);
+			}
+			argc--;
+			argv++;
+			camera_path_file = *argv;
+		} else if (strcmp(*argv, "--save-frames") == 0) {
+			if (argc < 2) {
+				printf("--save-frames needs a directory.\n");
+				usage(prg_name);
+			}
+			argc--;
+			argv++;
+			save_frames_directory = *argv;
+			if (argc >= 2 && isdigit(argv[1][0])) {
+				argc--;
+				argv++;
+				save_frames_interval = MAX(atoi(*argv), 1);
+			}
 		} else if (*argv[0] != '-') {
 			// if it's a directory, make it the default data dir
 			// otherwise push it and handle it later
@@ -330,11 +400,30 @@ int main(int argc, char **argv)
 		argv++;
 	}
 
+	if (option_headless && replay_films.empty()) {
+		printf("--headless needs at least one --replay-film.\n");
+		usage(prg_name);
+	}
+	if ((!camera_path_file.empty() || !save_frames_directory.empty()) && !timedemo_width) {
+		printf("--camera-path and --save-frames go with --timedemo.\n");
+		usage(prg_name);
+	}
+	if (timedemo_width && !option_headless) {
+		printf("--timedemo needs --headless.\n");
+		usage(prg_name);
+	}
+
 	try {
 		
 		// Initialize everything
 		initialize_application();
 
+		if (option_headless)
+		{
+			exit(run_headless_replays());
+		}
+		arg_files.insert(arg_files.begin(), replay_films.begin(), replay_films.end());
+
 		for (std::vector<std::string>::iterator it = arg_files.begin(); it != arg_files.end(); ++it)
 		{
 			if (handle_open_document(*it))
@@ -383,6 +472,9 @@ static void initialize_application(void)
 #if defined(__WIN32__)
 	SDL_setenv("SDL_AUDIODRIVER", "directsound", 0);
 #endif
+	// Headless runs still go through the normal screen setup; they just never show it
+	if (option_headless)
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
 
 	// Initialize SDL
 	int retval = SDL_Init(SDL_INIT_VIDEO |
@@ -440,6 +532,7 @@ static void initialize_application(void)
 	saved_games_dir = get_data_path(kPathSavedGames);
 	quick_saves_dir = get_data_path(kPathQuickSaves);
 	image_cache_dir = get_data_path(kPathImageCache);
+	map_cache_dir = get_data_path(kPathMapCache);
 	recordings_dir = get_data_path(kPathRecordings);
 	screenshots_dir = get_data_path(kPathScreenshots);
 	
@@ -508,6 +601,10 @@ static void initialize_application(void)
 	// Check for presence of files (one last chance to change data_search_path)
 	if (!have_default_files()) {
 		char chosen_dir[256];
+		if (option_headless) {
+			fprintf(stderr, "Can't find the scenario data files.\n");
+			exit(1);
+		}
 		if (alert_choose_scenario(chosen_dir)) {
 			// remove original argument (or fallback) from search path
 			if (dsp_delete_pos < data_search_path.size())
@@ -546,11 +643,19 @@ static void initialize_application(void)
 		quick_saves_dir.CreateDirectory();
 	}
 	image_cache_dir.CreateDirectory();
+	map_cache_dir.CreateDirectory();
 	recordings_dir.CreateDirectory();
 	screenshots_dir.CreateDirectory();
 	
 	WadImageCache::instance()->initialize_cache();
 
+	// Everything parsed at startup has been, so keep it for next time
+	const info_tree_cache_statistics& xml_statistics = InfoTreeCache::instance()->statistics();
+	logNote("XML at startup: %d files from the cache in %llu us, %d parsed in %llu us",
+		xml_statistics.hits, (unsigned long long) xml_statistics.hit_microseconds,
+		xml_statistics.misses, (unsigned long long) xml_statistics.miss_microseconds);
+	InfoTreeCache::instance()->save_cache();
+
 #ifndef HAVE_OPENGL
 	graphics_preferences->screen_mode.acceleration = _no_acceleration;
 #endif
@@ -560,6 +665,13 @@ static void initialize_application(void)
 		graphics_preferences->screen_mode.fullscreen = false;
 	write_preferences();
 
+	// Not saved; headless has no window to put OpenGL in
+	if (option_headless)
+		override_acceleration_for_session(_no_acceleration);
+	// Nor this; the shading tables are built for the screen's depth, so timedemos set it
+	if (timedemo_width)
+		override_bit_depth_for_session(timedemo_depth);
+
 	Plugins::instance()->load_mml();
 
 //	SDL_WM_SetCaption(application_name, application_name);
@@ -603,6 +715,158 @@ static void initialize_application(void)
 	initialize_game_state();
 }
 
+// Plays every --replay-film as fast as it will go and reports on each; returns the exit status,
+// which is nonzero if any film couldn't be played or stopped matching its recorded world hashes
+static int run_headless_replays(void)
+{
+	int status = 0;
+
+	std::vector<world_location3d> camera_path;
+	if (!camera_path_file.empty() && !read_camera_path(camera_path_file.c_str(), camera_path))
+		return 1;
+
+	headless_timedemo timedemo;
+	timedemo.width = timedemo_width;
+	timedemo.height = timedemo_height;
+	timedemo.camera_path = camera_path.empty() ? NULL : &camera_path[0];
+	timedemo.camera_path_count = camera_path.size();
+	timedemo.frame_directory = save_frames_directory.empty() ? NULL : save_frames_directory.c_str();
+	timedemo.frame_interval = save_frames_interval;
+	if (timedemo.frame_directory)
+		FileSpecifier(save_frames_directory).CreateDirectory();
+
+	for (std::vector<std::string>::iterator it = replay_films.begin(); it != replay_films.end(); ++it)
+	{
+		FileSpecifier file(*it);
+		headless_replay_results results;
+
+		if (!replay_film_headless(file, &results, timedemo_width ? &timedemo : NULL))
+		{
+			printf("%s: FAILED\n", it->c_str());
+			status = 1;
+			if (results.tick_count == 0)
+				continue;
+		}
+
+		double seconds = results.microseconds / 1000000.0;
+		printf("%s: %d ticks in %.3f seconds (%.0f ticks/second, %.1fx real time)\n",
+			   it->c_str(), results.tick_count, seconds,
+			   seconds > 0 ? results.tick_count / seconds : 0.0,
+			   seconds > 0 ? results.tick_count / seconds / TICKS_PER_SECOND : 0.0);
+
+		const world_update_timing* timing = get_world_update_timing();
+		for (short timer = 0; timer < NUMBER_OF_WORLD_UPDATE_TIMERS; ++timer)
+		{
+			uint64 microseconds = timing->microseconds[timer];
+			printf("\t%-16s %10.3f ms %6.1f%% %8.2f us/tick\n", get_world_update_timer_name(timer),
+				   microseconds / 1000.0,
+				   results.microseconds ? 100.0 * microseconds / results.microseconds : 0.0,
+				   results.tick_count ? double(microseconds) / results.tick_count : 0.0);
+		}
+
+		printf("\tfinal world hash %08x at tick %d\n", results.final_world_hash, results.final_tick);
+		if (results.world_hashes_recorded == 0)
+		{
+			printf("\tfilm has no recorded world hashes\n");
+		}
+		else if (results.world_hashes_match)
+		{
+			printf("\tmatched %d of %d recorded world hashes\n", results.world_hashes_checked, results.world_hashes_recorded);
+		}
+		else
+		{
+			printf("\tOUT OF SYNC after %d of %d recorded world hashes\n", results.world_hashes_checked, results.world_hashes_recorded);
+			status = 1;
+		}
+
+		if (!results.frame_microseconds.empty())
+		{
+			std::vector<uint32> sorted(results.frame_microseconds);
+			std::sort(sorted.begin(), sorted.end());
+
+			uint64 total = 0;
+			for (size_t i = 0; i < sorted.size(); ++i)
+				total += sorted[i];
+			size_t p99 = (sorted.size() * 99 + 99) / 100 - 1;
+
+			printf("\ttimedemo %dx%d %d-bit%s: %d frames, %.3f ms min, %.3f ms mean, %.3f ms p99, %.3f ms max (%.1f fps)\n",
+				   timedemo_width, timedemo_height, timedemo_depth,
+				   camera_path.empty() ? "" : " along camera path",
+				   (int) sorted.size(),
+				   sorted.front() / 1000.0,
+				   total / 1000.0 / sorted.size(),
+				   sorted[p99] / 1000.0,
+				   sorted.back() / 1000.0,
+				   total ? 1000000.0 * sorted.size() / total : 0.0);
+			if (timedemo.frame_directory)
+				printf("\tsaved %d frames to %s\n", results.frames_saved, timedemo.frame_directory);
+		}
+		fflush(stdout);
+	}
+
+	return status;
+}
+
+// One view per line: "x y z yaw pitch", in world units and degrees; blank lines and lines
+// starting with # are skipped.  Pitch has to be within the player's elevation limits, as the
+// renderer can't look straight up or down.  Polygons are looked up once the level is loaded
+static bool read_camera_path(const char *path, std::vector<world_location3d>& camera_path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Can't open camera path %s.\n", path);
+		return false;
+	}
+
+	_fixed minimum_pitch, maximum_pitch;
+	get_absolute_pitch_range(&minimum_pitch, &maximum_pitch);
+
+	char line[256];
+	int line_number = 0;
+	bool success = true;
+	while (fgets(line, sizeof(line), file))
+	{
+		float x, y, z, yaw, pitch;
+		++line_number;
+
+		char *start = line;
+		while (isspace(*start)) ++start;
+		if (*start == '\0' || *start == '#')
+			continue;
+
+		if (sscanf(start, "%f %f %f %f %f", &x, &y, &z, &yaw, &pitch) != 5) {
+			fprintf(stderr, "%s:%d: expected x y z yaw pitch.\n", path, line_number);
+			success = false;
+			break;
+		}
+
+		double pitch_angle = floor(pitch * FULL_CIRCLE / 360.0 + 0.5);
+		if (!(pitch_angle >= FIXED_INTEGERAL_PART(minimum_pitch) && pitch_angle <= FIXED_INTEGERAL_PART(maximum_pitch))) {
+			fprintf(stderr, "%s:%d: pitch must be between %.1f and %.1f degrees.\n", path, line_number,
+				FIXED_INTEGERAL_PART(minimum_pitch) * 360.0 / FULL_CIRCLE, FIXED_INTEGERAL_PART(maximum_pitch) * 360.0 / FULL_CIRCLE);
+			success = false;
+			break;
+		}
+
+		world_location3d location;
+		obj_clear(location);
+		location.point.x = static_cast<world_distance>(x * WORLD_ONE);
+		location.point.y = static_cast<world_distance>(y * WORLD_ONE);
+		location.point.z = static_cast<world_distance>(z * WORLD_ONE);
+		location.polygon_index = NONE;
+		location.yaw = NORMALIZE_ANGLE(static_cast<angle>(floor(yaw * FULL_CIRCLE / 360.0 + 0.5)));
+		location.pitch = NORMALIZE_ANGLE(static_cast<angle>(pitch_angle));
+		camera_path.push_back(location);
+	}
+	fclose(file);
+
+	if (success && camera_path.empty()) {
+		fprintf(stderr, "Camera path %s has no views.\n", path);
+		success = false;
+	}
+	return success;
+}
+
 void shutdown_application(void)
 {
         // ZZZ: seem to be having weird recursive shutdown problems esp. with fullscreen modes...
@@ -612,7 +876,9 @@ void shutdown_application(void)
 
         already_shutting_down = true;
         
+	flush_quick_saves();
 	WadImageCache::instance()->save_cache();
+	InfoTreeCache::instance()->save_cache(true);
 	close_external_resources();
         
 #if defined(HAVE_SDL_IMAGE) && (SDL_IMAGE_PATCHLEVEL >= 8)